@@ -0,0 +1,85 @@
+#ifndef _ASSET_CACHE_H_
+#define _ASSET_CACHE_H_
+
+#include <string>
+#include <map>
+#include "texture.h"
+#include "image.h"
+#include "material.h"
+
+using namespace std;
+
+class GLRenderingContext;
+
+struct AssetCacheStats
+{
+	int numTextures;
+	int numRequests;    // textures asked for
+	int numPathHits;    // the same file again, however it was spelled
+	int numContentHits; // another file with the same pixels
+	int numLibHits;     // material libraries loaded before
+	int cachedBytes;    // image bytes of the textures held
+	int savedBytes;     // image bytes not uploaded again thanks to hits
+};
+
+// Textures and material libraries shared by everything loaded into a
+// context. A texture is found by the canonical path of its file first
+// and by a hash of its pixels second, so an image is uploaded once no
+// matter which library refers to it or how the path is written. A hash
+// match is only shared once the file it was first read from is read
+// again and found to hold the same bytes. The
+// cache holds a reference to each texture; Trim() releases those that
+// nothing else uses any more.
+class AssetCache
+{
+public:
+	AssetCache(GLRenderingContext *rc);
+
+	// absolute path with '/' separators, in lower case as file names on
+	// Windows are not case sensitive; relative paths start at the current
+	// directory, so workers should pass absolute ones
+	static string CanonicalPath(const string &path);
+	// hash of the pixels and the format of an image, never 0
+	static unsigned long long HashImage(const Image &img);
+
+	// reads the file (or the .dds next to it) unless it is cached
+	Texture2D LoadTexture(const string &path);
+	// the texture for an image read from path; hash may be 0 if not computed yet
+	Texture2D AddTexture(const string &path, const Image &img, unsigned long long hash = 0);
+	bool HasTexture(const string &path) const;
+
+	// library of rc->materials read from path, NULL if there is none
+	Dictionary<Material> *FindMaterialLib(const string &path);
+	// Adds lib to rc->materials as name, or as the canonical path when
+	// name is taken by a library from another file.
+	Dictionary<Material> &AddMaterialLib(const string &path, const string &name, const Dictionary<Material> &lib);
+
+	// drops textures nobody else holds, returns how many
+	int Trim();
+	void Clear();
+
+	const AssetCacheStats &GetStats() const { return stats; }
+private:
+	struct TextureEntry
+	{
+		Texture2D texture;
+		int bytes;
+		string file; // what the image was read from, to compare on a hash match
+	};
+	typedef multimap<unsigned long long, TextureEntry> TextureMap; // different images may share a hash
+
+	GLRenderingContext *rc;
+	map<string, TextureMap::iterator> paths;
+	TextureMap textures;
+	map<string, string> materialLibs; // canonical path - name in rc->materials
+	AssetCacheStats stats;
+
+	Texture2D addTexture(const string &key, const string &path, const Image &img, unsigned long long hash);
+	static bool sameImage(const Image &a, const Image &b);
+	bool isUsed(TextureEntry &e);
+
+	AssetCache(const AssetCache &);
+	AssetCache &operator=(const AssetCache &);
+};
+
+#endif // _ASSET_CACHE_H_
\ No newline at end of file
@@ -0,0 +1,132 @@
+#ifndef _ASSET_LOADER_H_
+#define _ASSET_LOADER_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "sharedptr.h"
+#include "mesh.h"
+
+using namespace std;
+
+class GLRenderingContext;
+class Model;
+class AssetHandle;
+struct ModelData;
+
+enum AssetState
+{
+	AS_LOADING,
+	AS_READY,
+	AS_FAILED
+};
+
+template<>
+class shared_traits<AssetHandle>
+{
+public:
+	string name;
+	AssetState state;
+	atomic<int> numSteps;  // known once the file is parsed
+	atomic<int> stepsDone;
+	vector<Mesh> meshes;
+	const ModelData *data; // only while the callback reporting AS_READY runs
+
+	shared_traits() : state(AS_LOADING), data(NULL) {
+		numSteps = 0;
+		stepsDone = 0;
+	}
+};
+
+// Result of AssetLoader::LoadModel(). The state and the meshes change
+// only inside AssetLoader::ProcessUploads(), on the thread that owns the
+// context; handles should not be copied to other threads.
+class AssetHandle : public Shared<AssetHandle>
+{
+public:
+	const string &GetName() const { return ptr->name; }
+	AssetState GetState() const { return ptr->state; }
+	bool IsDone() const { return ptr->state != AS_LOADING; }
+	bool IsReady() const { return ptr->state == AS_READY; }
+	float GetProgress() const {
+		int n = ptr->numSteps;
+		return n ? (float)ptr->stepsDone / n : 0.0f;
+	}
+	const vector<Mesh> &GetMeshes() const { return ptr->meshes; }
+	// what the meshes were made from, for CPU-side uses such as occluders;
+	// NULL except inside the progress callback that reports the asset ready
+	const ModelData *GetData() const { return ptr->data; }
+private:
+	friend class AssetLoader;
+};
+
+typedef void (*AssetProgressCallback)(void *context, const AssetHandle &asset);
+
+// Loads models in the background. Worker threads read and parse the
+// model file and its material library, decode the textures and generate
+// tangents and LODs; what needs GL is queued and done by ProcessUploads(),
+// which the render thread calls once per frame with a time budget.
+class AssetLoader
+{
+public:
+	AssetLoader(GLRenderingContext *rc, int numThreads = 0); // 0 - one less than the number of cores
+	~AssetLoader();
+
+	// Starts loading a RAW or OBJ file (chosen by extension). Relative paths,
+	// including those of the material library and its textures, are taken
+	// from the current directory at the time of the call. The meshes of
+	// model, if given, are replaced when the load is done, so the model
+	// has to outlive it.
+	AssetHandle LoadModel(const char *filename, Model *model = NULL, int numLods = 0);
+
+	// called from ProcessUploads() whenever an asset makes progress
+	void SetProgressCallback(AssetProgressCallback callback, void *context) {
+		this->callback = callback;
+		callbackContext = context;
+	}
+
+	// Creates queued textures and buffers until about budget ms are spent
+	// (no limit if budget <= 0). At least one upload is done per call so
+	// loading always advances. Returns the number of uploads done.
+	int ProcessUploads(float budget);
+	// blocks until every asset is loaded
+	void Finish();
+
+	bool IsIdle() const { return jobs.empty(); }
+	int GetPendingCount() const { return jobs.size(); }
+	float GetLastUploadTime() const { return uploadTime; } // ms spent in the last ProcessUploads()
+private:
+	struct Job;
+	struct WorkItem
+	{
+		Job *job;
+		int image; // -1 - the model itself
+	};
+
+	GLRenderingContext *rc;
+	vector<thread> workers;
+	mutex lock;
+	condition_variable wake, uploadReady;
+	bool quit;
+	deque<WorkItem> tasks;
+	deque<WorkItem> uploads;
+	vector<Job *> jobs; // touched by the render thread only
+
+	AssetProgressCallback callback;
+	void *callbackContext;
+	float uploadTime;
+
+	void workerMain();
+	void readModel(Job *job);
+	void decodeImage(Job *job, int image);
+	void upload(const WorkItem &item);
+
+	AssetLoader(const AssetLoader &);
+	AssetLoader &operator=(const AssetLoader &);
+};
+
+#endif // _ASSET_LOADER_H_
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef _CASCADED_SHADOW_MAP_H_
+#define _CASCADED_SHADOW_MAP_H_
+
+#include "common.h"
+#include "datatypes.h"
+#include "texture.h"
+#include "framebuffer.h"
+
+#define CSM_MAX_CASCADES 4
+
+class GLRenderingContext;
+class ProgramObject;
+class Model;
+
+struct ShadowCascade
+{
+	Matrix44f view;       // rotation of the light, world space
+	Matrix44f projection; // orthographic, snapped to whole texels
+	float splitNear, splitFar; // view-space distances the cascade covers
+	float radius;         // of the bounding sphere of its slice
+};
+
+struct ShadowStats
+{
+	int numCascades;
+	int numCasters[CSM_MAX_CASCADES]; // meshes drawn into each cascade
+	float fitTime;    // ms spent in Update()
+	float renderTime; // ms spent submitting casters in Render()
+};
+
+// Cascaded shadow maps for one directional light of the context. Update()
+// splits the view frustum of the current projection into depth slices and
+// fits an orthographic light frustum around the bounding sphere of each;
+// the sphere does not change as the camera turns and its position is
+// snapped to whole texels in light space, so shadow edges stay put while
+// the camera moves. Render() draws the casters each cascade sees into a
+// layer of a depth array texture, with depth-only meshes and the frustum
+// culler working on the light frustum. Bind() hands the cascades to a
+// program including shadows.glsl.
+class CascadedShadowMap
+{
+public:
+	CascadedShadowMap(GLRenderingContext *rc, int resolution = 2048, int numCascades = 4);
+
+	// index of the light in the context's lights; it has to be directional
+	void SetLight(int index) { light = index; }
+	int GetLight() const { return light; }
+	// shadows end at that view-space distance, or at the far plane before it
+	void SetMaxDistance(float distance) { maxDistance = distance; }
+	// 0 splits the distance evenly, 1 logarithmically
+	void SetSplitLambda(float lambda) { splitLambda = lambda; }
+	// depth offset while rendering, see glPolygonOffset
+	void SetDepthBias(float factor, float units) { biasFactor = factor; biasUnits = units; }
+
+	int GetResolution() const { return resolution; }
+	int GetCascadeCount() const { return numCascades; }
+	const ShadowCascade &GetCascade(int i) const { return cascades[i]; }
+
+	// fits the cascades for the current projection, which has to be a
+	// perspective one, seen through view
+	void Update(const Matrix44f &view);
+	// draws the models with prog into every cascade; leaves the frustum
+	// culler in its view-space mode
+	void Render(ProgramObject &prog, Model *const *models, int numModels);
+	// binds the depth array to unit 12 and sets the uniforms of prog
+	void Bind(ProgramObject &prog);
+
+	const ShadowStats &GetStats() const { return stats; }
+private:
+	GLRenderingContext *rc;
+	int resolution, numCascades;
+	int light;
+	float maxDistance, splitLambda;
+	float biasFactor, biasUnits;
+
+	ShadowCascade cascades[CSM_MAX_CASCADES];
+	Matrix44f shadowMatrices[CSM_MAX_CASCADES]; // view space to shadow map
+	BaseTexture depth;
+	Framebuffer fb;
+	ShadowStats stats;
+
+	void fitCascade(ShadowCascade &c, const Matrix44f &invView, const Matrix44f &lightView);
+
+	CascadedShadowMap(const CascadedShadowMap &);
+	CascadedShadowMap &operator=(const CascadedShadowMap &);
+};
+
+#endif // _CASCADED_SHADOW_MAP_H_
\ No newline at end of file
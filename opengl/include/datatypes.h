@@ -4,7 +4,9 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#ifndef M_PIf // glibc has its own
 #define M_PIf 3.141592653589f
+#endif
 #define DEG_TO_RAD(a) ((a) * M_PIf / 180.0f)
 #define RAD_TO_DEG(a) ((a) / M_PIf * 180.0f)
 
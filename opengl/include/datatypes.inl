@@ -628,7 +628,7 @@ Color4<T> operator*(T scale, Color4<T> c) {
 
 template<class T>
 Color4<T> Color4<T>::operator*(T scale) const {
-	return Color4<T>(r*scale, g*scale, b*scale, c.a*scale);
+	return Color4<T>(r*scale, g*scale, b*scale, a*scale);
 }
 
 template<class T>
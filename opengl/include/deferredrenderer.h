@@ -0,0 +1,75 @@
+#ifndef _DEFERRED_RENDERER_H_
+#define _DEFERRED_RENDERER_H_
+
+#include "common.h"
+#include "texture.h"
+#include "framebuffer.h"
+#include "vertexbuffer.h"
+#include "rendertargets.h"
+#include "framegraph.h"
+
+class GLRenderingContext;
+class ProgramObject;
+
+// Deferred shading in two passes. Between BeginGeometryPass() and
+// EndGeometryPass() meshes are drawn into the G-buffer instead of the
+// screen: their programs write albedo, the view-space normal and the
+// specular color to gl_FragData[0], [1] and [2]. LightingPass() then
+// draws one triangle over the screen with a program reading them back,
+// so lights are evaluated once per pixel whatever the overdraw was.
+class DeferredRenderer
+{
+public:
+	DeferredRenderer(GLRenderingContext *rc);
+
+	// call it with the size of the viewport; the G-buffer follows it
+	void Resize(int width, int height);
+	int GetWidth() const { return targets.GetWidth(); }
+	int GetHeight() const { return targets.GetHeight(); }
+	size_t GetBytes() const { return targets.GetBytes(); }
+
+	void BeginGeometryPass();
+	void EndGeometryPass();
+
+	// Draws to the framebuffer bound. The G-buffer is bound to units 8 to 11
+	// as GAlbedo, GNormal, GSpecular and GDepth; ProjectionParams (x and y
+	// scale and offset) and DepthParams of the current projection are there
+	// to rebuild view-space positions. The program writes gl_FragDepth and
+	// discards pixels nothing was drawn to.
+	void LightingPass(ProgramObject &prog);
+
+	// Declares the same two passes in graph with the G-buffer as transient
+	// textures of width x height, leaving the targets above alone. The
+	// geometry pass clears depth and calls drawScene; the lighting pass
+	// draws with prog over the target resource, or to the framebuffer the
+	// graph draws to if target is -1.
+	void AddPasses(FrameGraph &graph, int width, int height, ProgramObject &prog,
+		FrameGraphExecute drawScene, void *context, int target = -1);
+
+	const Texture2D &GetAlbedo() const { return *albedo; }
+	const Texture2D &GetNormal() const { return *normal; }
+	const Texture2D &GetSpecular() const { return *specular; }
+	const Texture2D &GetDepth() const { return *depth; }
+private:
+	GLRenderingContext *rc;
+	RenderTargets targets;
+	Texture2D *albedo, *normal, *specular, *depth;
+	Framebuffer gbuffer;
+	VertexArrayObject vao; // no attributes, the vertex shader uses gl_VertexID
+
+	// what AddPasses() declared
+	ProgramObject *graphProg;
+	FrameGraphExecute drawScene;
+	void *sceneContext;
+	int graphTextures[4];
+
+	static void geometryTask(void *context, FrameGraph &graph, int pass);
+	static void lightingTask(void *context, FrameGraph &graph, int pass);
+	void drawLighting(ProgramObject &prog, Texture2D albedo, Texture2D normal,
+		Texture2D specular, Texture2D depth);
+
+	DeferredRenderer(const DeferredRenderer &);
+	DeferredRenderer &operator=(const DeferredRenderer &);
+};
+
+#endif // _DEFERRED_RENDERER_H_
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef _FIXED_STACK_H_
+#define _FIXED_STACK_H_
+
+// Stack with inline storage for at most N elements; never allocates.
+// Callers are expected to check IsFull()/IsEmpty() before Push()/Pop().
+template<class T, int N>
+class FixedStack
+{
+public:
+	FixedStack() : count(0) { }
+
+	bool IsEmpty() const { return count == 0; }
+	bool IsFull() const { return count == N; }
+	int GetSize() const { return count; }
+	int GetCapacity() const { return N; }
+
+	T &Push() { return items[count++]; }
+	void Push(const T &item) { items[count++] = item; }
+	void Pop() { count--; }
+
+	T &Top() { return items[count - 1]; }
+	const T &Top() const { return items[count - 1]; }
+private:
+	T items[N];
+	int count;
+};
+
+#endif // _FIXED_STACK_H_
\ No newline at end of file
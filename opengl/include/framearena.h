@@ -0,0 +1,111 @@
+#ifndef _FRAME_ARENA_H_
+#define _FRAME_ARENA_H_
+
+#include <new>
+#include <vector>
+#include <Windows.h>
+
+using namespace std;
+
+struct FrameArenaStats
+{
+	int bytesUsed;    // bytes handed out during the frame
+	int peakBytes;    // largest bytesUsed seen since the arena was created
+	int capacity;     // bytes reserved by the primary block
+	int numAllocs;    // number of allocations during the frame
+	int numOverflows; // allocations that did not fit into the primary block
+};
+
+// Linear (bump) allocator for data that lives no longer than one frame.
+// Memory is released all at once by Reset(). Allocations that do not fit
+// into the primary block go to the heap and the primary block is grown
+// on the next Reset() so that the steady state does no heap allocations.
+class FrameArena
+{
+public:
+	FrameArena(int initialSize = 64*1024);
+	~FrameArena();
+
+	void *Alloc(int size, int alignment = 16);
+
+	template<class T>
+	T *AllocArray(int count)
+	{
+		T *p = (T *)Alloc(count*sizeof(T));
+		for (int i = 0; i < count; i++)
+			new(p + i) T;
+		return p;
+	}
+
+	int GetMarker() const { return offset; }
+	void Rewind(int marker);
+	void Reset();
+
+	int GetBytesUsed() const { return bytesUsed; }
+	int GetCapacity() const { return blockSize; }
+	const FrameArenaStats &GetLastFrameStats() const { return lastFrame; }
+private:
+	BYTE *block;
+	int blockSize;
+	int offset;
+
+	int bytesUsed;
+	int numAllocs;
+	int peakBytes;
+	int neededBytes;   // highest offset reached in the block this frame
+	int overflowBytes; // taken from the heap this frame, with padding
+	vector<BYTE *> overflow;
+	FrameArenaStats lastFrame;
+
+	FrameArena(const FrameArena &);
+	FrameArena &operator=(const FrameArena &);
+};
+
+// Releases everything allocated from the arena inside the scope when the
+// scope ends, so temporaries do not accumulate until the end of the frame.
+class ScratchScope
+{
+public:
+	ScratchScope(FrameArena &arena) : arena(arena), marker(arena.GetMarker()) { }
+	~ScratchScope() { arena.Rewind(marker); }
+
+	void *Alloc(int size, int alignment = 16) {
+		return arena.Alloc(size, alignment);
+	}
+
+	template<class T>
+	T *AllocArray(int count) {
+		return arena.AllocArray<T>(count);
+	}
+private:
+	FrameArena &arena;
+	int marker;
+
+	ScratchScope(const ScratchScope &);
+	ScratchScope &operator=(const ScratchScope &);
+};
+
+// Temporary array kept on the stack when it holds at most N elements,
+// for code that has no rendering context (and therefore no arena) at hand.
+template<class T, int N>
+class ScratchBuffer
+{
+public:
+	explicit ScratchBuffer(int count) {
+		data = count <= N ? local : new T[count];
+	}
+	~ScratchBuffer() {
+		if (data != local) delete [] data;
+	}
+
+	T *Get() { return data; }
+	operator T*() { return data; }
+private:
+	T local[N];
+	T *data;
+
+	ScratchBuffer(const ScratchBuffer &);
+	ScratchBuffer &operator=(const ScratchBuffer &);
+};
+
+#endif // _FRAME_ARENA_H_
\ No newline at end of file
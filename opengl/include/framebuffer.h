@@ -44,6 +44,8 @@ public:
 	Framebuffer(GLenum target = GL_FRAMEBUFFER);
 
 	void AttachTexture(GLenum attachment, const BaseTexture &texture, GLint level = 0);
+	// one layer of an array texture
+	void AttachTextureLayer(GLenum attachment, const BaseTexture &texture, GLint layer, GLint level = 0);
 	void AttachRenderbuffer(GLenum attachment, const Renderbuffer &rb);
 
 	GLuint GetId() const { return ptr->id; }
@@ -0,0 +1,167 @@
+#ifndef _FRAME_GRAPH_H_
+#define _FRAME_GRAPH_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#ifdef _WIN32
+#include "common.h"
+#else
+#include <gl/glew.h>
+#endif
+
+using namespace std;
+
+class FrameGraph;
+class Texture2D;
+
+typedef void (*FrameGraphExecute)(void *context, FrameGraph &graph, int pass);
+
+struct FrameGraphTextureDesc
+{
+	int width, height;
+	GLint internalFormat;
+	GLenum format, type; // any the internal format takes, nothing is uploaded
+
+	bool operator==(const FrameGraphTextureDesc &d) const {
+		return width == d.width && height == d.height && internalFormat == d.internalFormat &&
+			format == d.format && type == d.type;
+	}
+};
+
+// the GL calls the graph makes, so that a test can stand in for the driver
+struct FrameGraphGL
+{
+	// a texture of the description with nearest filtering, nothing uploaded
+	GLuint (*createTexture)(const FrameGraphTextureDesc &desc);
+	void (*deleteTexture)(GLuint texture);
+	// draws to the color attachments in the order they come
+	GLuint (*createFramebuffer)(const GLuint *textures, const GLenum *attachments, int count);
+	void (*deleteFramebuffer)(GLuint framebuffer);
+	void (*bindFramebuffer)(GLuint framebuffer);
+	void (GLAPIENTRY *viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+	void (GLAPIENTRY *getIntegerv)(GLenum pname, GLint *params);
+
+	// those of the current context; defined in framegraphgl.cpp, so the
+	// graph itself can be linked without GL
+	static FrameGraphGL Defaults();
+};
+
+struct FrameGraphStats
+{
+	int numPasses;
+	int numCulledPasses;   // nothing live read what they wrote
+	int numTextures;       // transient textures the live passes use
+	int numAllocated;      // textures they share after aliasing
+	size_t transientBytes; // memory of those
+	size_t naiveBytes;     // memory with a texture for each
+};
+
+// Passes of a frame declared with the textures they read and write.
+// Compile() culls the passes whose results nothing needs, orders the rest
+// so that writers of a texture run before its readers (and writers in
+// the order they were added), and gives transient textures whose
+// lifetimes do not overlap the same texture when their descriptions
+// match. Compile() makes no GL calls; Execute() allocates what the plan
+// needs from textures kept between frames, binds a framebuffer with the
+// textures each pass writes and calls it, all through the functions the
+// graph was made with. Passes that write nothing draw
+// to the framebuffer that was bound; such passes and passes writing
+// imported textures are never culled. Transient textures hold nothing
+// when the first pass writing them starts.
+class FrameGraph
+{
+public:
+	FrameGraph(const FrameGraphGL &gl = FrameGraphGL::Defaults());
+	~FrameGraph();
+
+	int AddPass(const char *name, FrameGraphExecute execute, void *context);
+	// keeps the pass even if nothing reads what it writes
+	void SetSideEffect(int pass);
+
+	int CreateTexture(const char *name, const FrameGraphTextureDesc &desc);
+	// a texture that lives outside the graph; it stays where it is
+	int ImportTexture(const char *name, const Texture2D &texture, const FrameGraphTextureDesc &desc);
+
+	void Read(int pass, int resource);
+	void Write(int pass, int resource);
+
+	// returns false if the passes depend on each other in a cycle
+	bool Compile();
+	void Execute();
+	// drops the passes and resources for the next frame
+	void Reset();
+	// frees the textures kept between frames, e.g. when the graph goes unused
+	void ReleaseTextures();
+
+	// for passes while they execute
+	GLuint GetTextureId(int resource) const;
+	Texture2D GetTexture(int resource) const;
+	const FrameGraphTextureDesc &GetDesc(int resource) const { return resources[resource].desc; }
+	const char *GetPassName(int pass) const { return passes[pass].name.c_str(); }
+	bool IsCulled(int pass) const { return !passes[pass].live; }
+	// live passes in the order Execute() runs them
+	const vector<int> &GetOrder() const { return order; }
+
+	const FrameGraphStats &GetStats() const { return stats; }
+private:
+	struct Pass
+	{
+		string name;
+		FrameGraphExecute execute;
+		void *context;
+		vector<int> reads, writes;
+		bool sideEffect;
+		bool live;
+	};
+
+	struct Resource
+	{
+		string name;
+		FrameGraphTextureDesc desc;
+		GLuint imported; // 0 if transient
+		int first, last; // positions in order of the passes using it
+		int slot;        // of transient ones
+	};
+
+	struct Slot
+	{
+		FrameGraphTextureDesc desc;
+		int last;
+		GLuint texture;
+	};
+
+	struct PooledTexture
+	{
+		FrameGraphTextureDesc desc;
+		GLuint texture;
+		bool used;
+	};
+
+	vector<Pass> passes;
+	vector<Resource> resources;
+	vector<int> order;
+	vector<Slot> slots;
+	bool compiled;
+	FrameGraphStats stats;
+	FrameGraphGL gl;
+
+	// textures and framebuffers kept between frames; the ones a frame
+	// does not use are released after it
+	vector<PooledTexture> pool;
+	map<vector<GLuint>, GLuint> framebuffers;
+
+	bool sortPasses();
+	void assignSlots();
+	void allocate();
+	void releaseUnused();
+	void clearFramebuffers();
+	GLuint getFramebuffer(const Pass &p);
+
+	static bool isDepthFormat(GLint internalFormat);
+
+	FrameGraph(const FrameGraph &);
+	FrameGraph &operator=(const FrameGraph &);
+};
+
+#endif // _FRAME_GRAPH_H_
\ No newline at end of file
@@ -8,15 +8,78 @@ class GLRenderingContext;
 class FrustumCuller
 {
 public:
-	FrustumCuller(GLRenderingContext *rc) : rc(rc), fComputePlanes(true)
+	FrustumCuller(GLRenderingContext *rc)
+		: rc(rc), fComputePlanes(true), fComputeProjPlanes(true),
+		fWorldSpace(false), fModelKnown(false), fLightFrustum(false)
 	{ }
 
 	bool Cull(const AABox &boundingBox)
 	{
 		if (fComputePlanes) ComputePlanes();
+		if (fWorldSpace) {
+			if (!fModelKnown) return cullEyeSpace(boundingBox);
+			return cullBox(planes, boundingBox.Transform(model));
+		}
+		return cullBox(planes, boundingBox);
+	}
+
+	// Switches to world-space culling: the planes are extracted once from
+	// projection * view and survive modelview changes, while bounding boxes
+	// are moved to world space with the model matrix. The modelview is
+	// taken to be the view at this call; every MultModelView() after it is
+	// composed into the model matrix, and push/pop save and restore it.
+	// Once SetModelView() replaces the modelview (a view-space draw such as
+	// a first-person weapon), boxes of that level are moved to eye space
+	// and tested against the projection alone.
+	void SetViewMatrix(const Matrix44f &view);
+	void ResetViewMatrix();
+	bool IsWorldSpace() const { return fWorldSpace; }
+
+	// World-space culling of shadow casters, with the projection set to
+	// the orthographic frustum of a light and view to its rotation. The
+	// near plane is left out: whatever lies between the light and the
+	// frustum still casts into it. ResetViewMatrix() ends it as well.
+	void SetLightView(const Matrix44f &view);
+	bool IsLightFrustum() const { return fLightFrustum; }
+
+	// the model matrix composed since SetViewMatrix()
+	const Matrix44f &GetModelMatrix() const { return model; }
+
+	void UpdateMVP() {
+		if (!fWorldSpace) fComputePlanes = true;
+	}
+	void UpdateProjection() {
+		fComputePlanes = fComputeProjPlanes = true;
+	}
+private:
+	friend class GLRenderingContext;
+
+	GLRenderingContext *rc;
+	Plane planes[6];
+	Plane projPlanes[6]; // eye space, for draws that replaced the view
+	bool fComputePlanes, fComputeProjPlanes;
+	bool fWorldSpace;
+	bool fModelKnown; // the modelview is view * model
+	bool fLightFrustum;
+	Matrix44f view, model;
 
+	void ComputePlanes();
+	void extractPlanes(const Matrix44f &mvp, Plane *planes);
+	bool cullEyeSpace(const AABox &boundingBox);
+
+	// called by the context as the modelview changes
+	void multModel(const Matrix44f &mat) {
+		if (fWorldSpace && fModelKnown) model *= mat;
+	}
+	void replaceModel() {
+		fModelKnown = false;
+	}
+
+	bool cullBox(const Plane *planes, const AABox &boundingBox) const
+	{
 		for (int i = 0; i < 6; i++)
 		{
+			if (i == 4 && fLightFrustum) continue;
 			Vector3f normal = planes[i].Normal();
 			Point3f p = boundingBox.vmin;
 
@@ -30,15 +93,6 @@ public:
 
 		return true;
 	}
-
-	void UpdateMVP() {
-		fComputePlanes = true;
-	}
-private:
-	GLRenderingContext *rc;
-	Plane planes[6];
-	bool fComputePlanes;
-	void ComputePlanes();
 };
 
-#endif // _FRUSTUM_CULLER_H_
\ No newline at end of file
+#endif // _FRUSTUM_CULLER_H_
@@ -173,6 +173,25 @@ class AABox
 public:
 	Vector3f vmin, vmax;
 
+	// Bounding box of the transformed box (Arvo's method in center/extent
+	// form): the center is transformed, the extent by the absolute 3x3 part
+	AABox Transform(const Matrix44f &mat) const
+	{
+		const float(&m)[4][4] = mat.m;
+		Vector3f c = (vmin + vmax) * 0.5f;
+		Vector3f e = (vmax - vmin) * 0.5f;
+		AABox box;
+
+		for (int i = 0; i < 3; i++)
+		{
+			float ci = m[0][i]*c.x + m[1][i]*c.y + m[2][i]*c.z + m[3][i];
+			float ei = fabs(m[0][i])*e.x + fabs(m[1][i])*e.y + fabs(m[2][i])*e.z;
+			box.vmin[i] = ci - ei;
+			box.vmax[i] = ci + ei;
+		}
+		return box;
+	}
+
 	bool Intersect(const Ray &ray) const
 	{
 		float tmin, tmax;
@@ -2,7 +2,6 @@
 #define _GL_CONTEXT_H_
 
 #include <vector>
-#include <stack>
 #include <list>
 #include <map>
 #include "common.h"
@@ -12,9 +11,21 @@
 #include "shader.h"
 #include "material.h"
 #include "frustumculler.h"
+#include "occlusionculler.h"
+#include "lightculler.h"
+#include "threadpool.h"
+#include "framearena.h"
+#include "texturestreamer.h"
+#include "assetcache.h"
+#include "meshcache.h"
+#include "shadercache.h"
+#include "programbinarycache.h"
+#include "fixedstack.h"
 
 using namespace std;
 
+#define GLRC_MATRIX_STACK_DEPTH 32
+
 class GLRenderingContext;
 class ProgramObject;
 
@@ -67,18 +78,69 @@ public:
 	Matrix44f GetProjection() const { return projection; }
 	const Matrix44f &GetModelViewRef() const { return modelview; }
 	const Matrix44f &GetProjectionRef() const { return projection; }
+	const Matrix44f &GetModelViewProjection();
+	const Matrix44f &GetNormalMatrix();
 
-	void PushModelView()  { mvStack.push(modelview); }
-	void PopModelView()   { SetModelView(mvStack.top()); mvStack.pop(); }
-	void PushProjection() { projStack.push(projection); }
-	void PopProjection()  { SetProjection(projStack.top()); projStack.pop(); }
+	void PushModelView();
+	void PopModelView();
+	void PushProjection();
+	void PopProjection();
 
 	void EnableFrustumCulling(bool enabled) { fFrustumCulling = enabled; }
 	bool IsFrustumCullingEnabled() const { return fFrustumCulling; }
 	FrustumCuller frustumCuller;
 
+	void EnableOcclusionCulling(bool enabled) { fOcclusionCulling = enabled; }
+	bool IsOcclusionCullingEnabled() const { return fOcclusionCulling; }
+	OcclusionCuller occlusionCuller;
+
+	// light sources of the scene; lightCuller.Update() bins them into
+	// clusters once a frame for programs that include lights.glsl
+	vector<Light> lights;
+	LightCuller lightCuller;
+
+	// meshes draw with no material but their opacity mask and keep the LOD
+	// they last had, for shadow maps and other depth-only passes
+	void EnableDepthOnly(bool enabled) { fDepthOnly = enabled; }
+	bool IsDepthOnlyEnabled() const { return fDepthOnly; }
+
+	// meshes with LODs switch to level 1 when their bounding sphere covers
+	// less than threshold of the viewport height, each next level at half that
+	void EnableLodSelection(bool enabled) { fLodSelection = enabled; }
+	bool IsLodSelectionEnabled() const { return fLodSelection; }
+	void SetLodThreshold(float threshold) { lodThreshold = threshold; }
+	float GetLodThreshold() const { return lodThreshold; }
+
+	// streamed textures keep only the mip levels meshes draw them at;
+	// see MaterialLoader::SetTextureStreamer()
+	void EnableTextureStreaming(bool enabled) { fTextureStreaming = enabled; }
+	bool IsTextureStreamingEnabled() const { return fTextureStreaming; }
+	TextureStreamer textureStreamer;
+
+	// worker threads shared by the context's CPU-side passes, created on first use
+	ThreadPool *GetThreadPool();
+
+	// transient per-frame memory, released by EndFrame(); streamed
+	// textures are updated there as well
+	FrameArena frameArena;
+	void EndFrame();
+	unsigned int GetFrameNumber() const { return frameNumber; } // frames ended so far
+
 	LibCollection<Texture2D> textures;
 	LibCollection<Material> materials;
+	// what model loading goes through to share textures and libraries
+	AssetCache assetCache;
+	// processed OBJ files kept on disk between runs, off by default
+	void EnableMeshCache(bool enabled) { fMeshCache = enabled; }
+	bool IsMeshCacheEnabled() const { return fMeshCache; }
+	MeshCache meshCache;
+	// programs by their sources and definitions, to share variants
+	ShaderCache shaderCache;
+	// linked programs kept on disk in the driver's format, off by default;
+	// see ProgramObject::Build()
+	void EnableProgramBinaryCache(bool enabled) { fProgramBinaryCache = enabled; }
+	bool IsProgramBinaryCacheEnabled() const { return fProgramBinaryCache; }
+	ProgramBinaryCache programBinaryCache;
 
 	void AddModule(const char *name, GLRC_Module *module);
 	GLRC_Module *GetModule(const char *name);
@@ -90,8 +152,15 @@ private:
 	map<string, GLRC_Module *> modules;
 	list<shared_traits<ProgramObject> *> shaders;
 	Matrix44f modelview, projection;
-	stack<Matrix44f> mvStack, projStack;
 	bool fFrustumCulling;
+	bool fOcclusionCulling;
+	bool fDepthOnly;
+	bool fLodSelection;
+	bool fTextureStreaming;
+	bool fMeshCache;
+	bool fProgramBinaryCache;
+	float lodThreshold;
+	ThreadPool *threadPool;
 
 	ProgramObject *curProgram;
 
@@ -99,6 +168,32 @@ private:
 	bool mvpComputed;
 	bool normComputed;
 
+	// every distinct matrix value gets a new version; popping restores
+	// the version it had, so programs that already hold it skip the upload
+	unsigned int mvVersion, projVersion;
+	unsigned int lastVersion;
+
+	// one stack level: the saved matrix together with everything derived
+	// from it, so popping does not recompute anything
+	struct MatrixState
+	{
+		Matrix44f matrix;
+		Matrix44f mvpMatrix, normalMatrix;
+		bool mvpComputed, normComputed;
+		unsigned int mvVersion, projVersion;
+		Plane planes[6];
+		bool planesComputed;
+		Matrix44f cullModel; // the culler's model matrix, modelview levels only
+		bool cullModelKnown;
+	};
+
+	FixedStack<MatrixState, GLRC_MATRIX_STACK_DEPTH> mvStack, projStack;
+	int mvOverflow, projOverflow; // pushes refused because a stack was full
+	unsigned int frameNumber;
+
+	void saveState(MatrixState &s, const Matrix44f &matrix);
+	void restoreDerived(const MatrixState &s);
+
 	void AttachProgram(shared_traits<ProgramObject> *prog) {
 		shaders.push_back(prog);
 	}
@@ -106,8 +201,8 @@ private:
 		shaders.remove(prog);
 	}
 	
-	void set_mv(const Matrix44f &mat);
-	void set_proj(const Matrix44f &mat);
+	void set_mv();
+	void set_proj();
 
 	HGLRC createContextAttrib(HDC hdc, const GLRenderingContextParams *params);
 };
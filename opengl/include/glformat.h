@@ -0,0 +1,26 @@
+#ifndef _GL_FORMAT_H_
+#define _GL_FORMAT_H_
+
+#ifdef _WIN32
+#include "common.h"
+#else
+#include <gl/glew.h>
+#endif
+
+// bytes a texel of the internal format takes; 4 for those not listed
+inline int GetPixelSize(GLint internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_R8: return 1;
+	case GL_RG8: case GL_R16F: return 2;
+	case GL_RGBA8: case GL_RG16F: case GL_R32F: case GL_R32UI: case GL_R11F_G11F_B10F:
+	case GL_RGB10_A2: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH24_STENCIL8: return 4;
+	case GL_RGBA16F: case GL_RG32F: case GL_RG32UI: return 8;
+	case GL_RGBA32F: return 16;
+	}
+	return 4;
+}
+
+#endif // _GL_FORMAT_H_
\ No newline at end of file
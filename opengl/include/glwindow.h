@@ -50,6 +50,7 @@ public:
 	void Redraw() {
 		OnDisplay();
 		SwapBuffers(m_hdc);
+		m_rc->EndFrame();
 	}
 
 	virtual void Update(int timeDelta) { }
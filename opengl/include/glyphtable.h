@@ -0,0 +1,79 @@
+#ifndef _GLYPH_TABLE_H_
+#define _GLYPH_TABLE_H_
+
+#include <stddef.h>
+#include <vector>
+
+using namespace std;
+
+#define GT_LATIN_SIZE 256 // Basic Latin and Latin-1
+
+struct Glyph
+{
+	float x0, y0, x1, y1; // quad from the pen position, y down from the top of the line
+	float u0, v0, u1, v1; // atlas rectangle
+	float advance;
+};
+
+// Glyphs of a font by code point. Code points of the Latin page are
+// looked up directly in an array, others and kerning pairs in hash tables.
+class GlyphTable
+{
+public:
+	GlyphTable();
+
+	const Glyph *Find(unsigned int code) const {
+		if (code < GT_LATIN_SIZE)
+			return latin[code] >= 0 ? &glyphs[latin[code]] : NULL;
+		return findOther(code);
+	}
+
+	// replaces the glyph code had
+	void Add(unsigned int code, const Glyph &glyph);
+	int GetCount() const { return glyphs.size(); }
+
+	void AddKerning(unsigned int first, unsigned int second, float amount);
+	float GetKerning(unsigned int first, unsigned int second) const {
+		return numKernings ? findKerning(first, second) : 0.0f;
+	}
+	int GetKerningCount() const { return numKernings; }
+
+	void Clear();
+private:
+	struct CodeSlot
+	{
+		unsigned int code;
+		int glyph; // -1 in empty slots
+	};
+
+	struct KerningSlot
+	{
+		unsigned long long pair; // 0 in empty slots
+		float amount;
+	};
+
+	vector<Glyph> glyphs;
+	int latin[GT_LATIN_SIZE];
+	vector<CodeSlot> codes; // sizes are powers of two
+	vector<KerningSlot> kernings;
+	int numCodes;
+	int numKernings;
+
+	const Glyph *findOther(unsigned int code) const;
+	float findKerning(unsigned int first, unsigned int second) const;
+	void growCodes();
+	void growKernings();
+};
+
+struct GlyphRect
+{
+	int width, height; // in
+	int x, y;          // out
+};
+
+// Shelf packing of glyph bitmaps, tallest first, with padding pixels
+// between them and the border. Picks the smallest power of two atlas
+// up to maxSize on each side; returns false if they do not fit.
+bool PackGlyphs(vector<GlyphRect> &rects, int padding, int maxSize, int &width, int &height);
+
+#endif // _GLYPH_TABLE_H_
\ No newline at end of file
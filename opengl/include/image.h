@@ -2,9 +2,23 @@
 #define _IAMGE_H_
 
 #include <new>
-#include <Windows.h>
 #include "sharedptr.h"
 #include "datatypes.h"
+#include "mappedfile.h"
+
+#define IMAGE_MAX_MIPS 16
+
+enum ImageCompression
+{
+	IC_NONE,
+	IC_BC1,
+	IC_BC2,
+	IC_BC3,
+	IC_BC4,
+	IC_BC5,
+	IC_BC6H,
+	IC_BC7
+};
 
 class Image;
 
@@ -13,8 +27,9 @@ class shared_traits<Image>
 {
 public:
 	BYTE *data;
+	MappedFile file; // set when data points into a mapped file
 	shared_traits() : data(0) { }
-	~shared_traits() { delete [] data; }
+	~shared_traits() { if (!file) delete [] data; }
 };
 
 class Image : public Shared<Image>
@@ -22,9 +37,20 @@ class Image : public Shared<Image>
 public:
 	Image() : isGood(false), dataSize(0) {
 		width = height = depth = 0;
+		compression = IC_NONE;
+		numMips = 0;
 	}
 
+	// picks the loader by extension (.dds, .ktx, otherwise TGA)
+	bool Load(const char *filename);
 	bool LoadTga(const char *filename);
+	bool LoadDds(const char *filename);
+	bool LoadKtx(const char *filename);
+
+	// allocates an image with numMips levels; depth is 0 for compressed images
+	void Create(int width, int height, int depth, ImageCompression compression = IC_NONE, int numMips = 1);
+	// writes all levels to a DDS file (BCn as FourCC, otherwise BGR(A) or luminance)
+	bool SaveDds(const char *filename) const;
 
 	operator bool() const { return isGood; }
 	bool IsGood() const { return isGood; }
@@ -32,7 +58,23 @@ public:
 	int GetHeight() const { return height; }
 	int GetDepth() const { return depth; }
 	int GetDataSize() const { return dataSize; }
-	BYTE *GetData() const { return ptr->data; };
+	const BYTE *GetData() const { return ptr->data; };
+
+	// DDS and KTX files may hold block-compressed data and a mip chain;
+	// for those GetDepth() is 0 and the levels are read separately
+	ImageCompression GetCompression() const { return compression; }
+	bool IsCompressed() const { return compression != IC_NONE; }
+	int GetMipCount() const { return numMips; }
+	int GetMipWidth(int level) const { return width >> level ? width >> level : 1; }
+	int GetMipHeight(int level) const { return height >> level ? height >> level : 1; }
+	const BYTE *GetMipData(int level) const { return ptr->data + mipOffset[level]; }
+	int GetMipSize(int level) const { return mipSize[level]; }
+
+	// Copies of an image (including clones) share pixels until one of
+	// them asks for writable data; the pixels are copied at that point,
+	// as they are when they still live in a read-only file mapping.
+	BYTE *GetWritableData();
+	BYTE *GetWritableMipData(int level) { return GetWritableData() + mipOffset[level]; }
 
 	Color4b GetPixel(int x, int y) const
 	{
@@ -50,12 +92,22 @@ public:
 	}
 
 	Image Clone() const;
+	// builds the full chain of an uncompressed single-level image with a
+	// box filter; images that already have mips are left as they are
+	bool GenerateMips();
 private:
 	bool isGood;
 	int dataSize;
 	int width, height;
 	int depth;
-	void read(HANDLE hFile, LPVOID lpBuffer, DWORD nNumBytes);
+	ImageCompression compression;
+	int numMips;
+	int mipOffset[IMAGE_MAX_MIPS];
+	int mipSize[IMAGE_MAX_MIPS];
+
+	void reset();
+	int levelSize(int level) const;
+	bool wrapLevels(const MappedFile &file, const BYTE *data, const BYTE *end, int count);
 };
 
 #endif // _IAMGE_H_
\ No newline at end of file
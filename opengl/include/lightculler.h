@@ -0,0 +1,107 @@
+#ifndef _LIGHT_CULLER_H_
+#define _LIGHT_CULLER_H_
+
+#include <vector>
+#include "datatypes.h"
+#include "geometry.h"
+#include "texture.h"
+
+using namespace std;
+
+class GLRenderingContext;
+class ProgramObject;
+
+// A light source as lights.glsl takes it. Point lights (position.w = 1)
+// reach radius units; directional lights (position.w = 0) and lights
+// with radius 0 light everything.
+struct Light
+{
+	Vector4f position; // world space
+	Color4f diffuse;
+	Color4f ambient;
+	Color4f specular;
+	float radius;
+};
+
+struct LightCullerStats
+{
+	int numLights;
+	int numGlobalLights;  // directional or of unlimited radius, not culled
+	int numIndices;       // light references in all clusters
+	int maxClusterLights; // most lights in one cluster
+	float cullTime;       // ms spent in Update()
+};
+
+// Clustered light culling. The view frustum is divided into a grid of
+// screen tiles and exponentially growing depth slices. Update() bins the
+// spheres of the context's point lights into those clusters (slices are
+// spread over the thread pool and test four lights at a time with SSE)
+// and uploads the lights, an offset and count per cluster and the light
+// indices they point to as textures. Bind() hands them to a program
+// including lights.glsl, which then shades a fragment with the lights of
+// its cluster only.
+class LightCuller
+{
+public:
+	LightCuller(GLRenderingContext *rc);
+	~LightCuller();
+
+	void SetGrid(int tilesX, int tilesY, int numSlices);
+	int GetTilesX() const { return tilesX; }
+	int GetTilesY() const { return tilesY; }
+	int GetSliceCount() const { return numSlices; }
+
+	// bins the lights for the current projection, which has to be a
+	// perspective one, seen through view
+	void Update(const Matrix44f &view, int viewportWidth, int viewportHeight);
+	// binds the textures to units 5 to 7 and sets the uniforms of prog
+	void Bind(ProgramObject &prog);
+	// the context calls this while it is still current
+	void Release();
+
+	const LightCullerStats &GetStats() const { return stats; }
+private:
+	// lights that may touch one depth slice and the indices it ends up with
+	struct Slice
+	{
+		vector<float> x, y, z, r2;
+		vector<unsigned int> ids;
+		vector<unsigned int> indices;
+		int maxLights;
+	};
+
+	GLRenderingContext *rc;
+	int tilesX, tilesY, numSlices;
+	int viewportWidth, viewportHeight;
+	float zNear, zFar;
+
+	Matrix44f projection;
+	bool boundsValid;
+	vector<AABox> bounds; // of every cluster in view space, slice by slice
+
+	// point lights in view space
+	vector<Vector4f> pointLights; // xyz, radius
+	vector<unsigned int> pointIds;
+	vector<Slice> slices;
+
+	vector<Vector4f> lightData; // five texels per light
+	vector<unsigned int> grid;  // offset and count per cluster
+	vector<unsigned int> indices;
+	int numGlobalLights;
+
+	Texture2D *lightTex, *gridTex, *indexTex;
+	int lightTexHeight, gridTexWidth, gridTexHeight, indexTexHeight;
+
+	LightCullerStats stats;
+
+	void computeBounds();
+	void cullSlice(int slice);
+	void upload();
+
+	static void cullTask(void *context, int index);
+
+	LightCuller(const LightCuller &);
+	LightCuller &operator=(const LightCuller &);
+};
+
+#endif // _LIGHT_CULLER_H_
\ No newline at end of file
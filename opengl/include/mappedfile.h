@@ -0,0 +1,52 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <stddef.h>
+#include "sharedptr.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+typedef unsigned char BYTE;
+typedef unsigned short USHORT;
+typedef unsigned int UINT;
+#endif
+
+class MappedFile;
+
+template<>
+class shared_traits<MappedFile>
+{
+public:
+	const BYTE *data;
+	size_t size;
+	bool mapped;
+
+	shared_traits() : data(0), size(0), mapped(false) { }
+	~shared_traits();
+};
+
+// Read-only view of a whole file. The file is memory-mapped when the
+// platform allows it and read into memory otherwise; either way the
+// contents stay valid while any copy of the MappedFile is alive.
+class MappedFile : public Shared<MappedFile>
+{
+public:
+	MappedFile() : isOpen(false) { }
+	explicit MappedFile(const char *filename) : isOpen(false) {
+		Open(filename);
+	}
+
+	bool Open(const char *filename);
+	void Close();
+
+	operator bool() const { return isOpen; }
+	bool IsOpen() const { return isOpen; }
+	bool IsMapped() const { return ptr->mapped; }
+	const BYTE *GetData() const { return ptr->data; }
+	size_t GetSize() const { return ptr->size; }
+private:
+	bool isOpen;
+};
+
+#endif // _MAPPED_FILE_H_
\ No newline at end of file
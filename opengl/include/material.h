@@ -2,14 +2,17 @@
 #define _MATERIAL_H_
 
 #include <string>
-#include <map>
+#include <vector>
 #include "nullable.h"
 #include "datatypes.h"
 #include "texture.h"
+#include "stringmap.h"
 
 using namespace std;
 
 class GLRenderingContext;
+class TextureStreamer;
+class AssetCache;
 template<class T> class Dictionary;
 
 enum MaterialMode
@@ -39,49 +42,87 @@ public:
 	}
 };
 
+// Material as read from an .mtl file, with texture file names in place
+// of textures; reading it does not touch GL, so it can be done on any thread
+struct MaterialDesc
+{
+	string name;
+	Material material; // colors and mode only
+	string diffuseMap;
+	string normalMap;
+	string specularMap;
+	string specularIntensityMap;
+	string opacityMask;
+};
+
 class MaterialLoader
 {
 public:
+	MaterialLoader() : streamer(NULL), cache(NULL) { }
+
+	// textures made by this loader are streamed by streamer if it is set
+	void SetTextureStreamer(TextureStreamer *streamer) { this->streamer = streamer; }
+	// Maps are taken from cache instead of the textures dictionary when it
+	// is set, with their names relative to basePath (the current directory
+	// if empty); the cache does its own streaming.
+	void SetAssetCache(AssetCache *cache) { this->cache = cache; }
+	void SetBasePath(const string &path) { basePath = path; }
+
 	bool LoadMtl(const char *filename, Dictionary<Material> &materials);
 	bool LoadMtl(const char *filename, Dictionary<Material> &materials, Dictionary<Texture2D> &textures);
+
+	bool ReadMtl(const char *filename, vector<MaterialDesc> &descs);
+	// maps not found in textures (or the asset cache) are read from disk
+	void CreateMaterials(const vector<MaterialDesc> &descs, Dictionary<Material> &materials,
+		Dictionary<Texture2D> &textures);
+
+	// reads the file a map refers to; a precompressed .dds next to it
+	// is preferred as it comes with its mip chain
+	static bool ReadTextureImage(const string &name, Image &img);
+	// makes a texture for a map from its image and adds it to textures
+	static Texture2D CreateTexture(const string &name, const Image &img, Dictionary<Texture2D> &textures,
+		TextureStreamer *streamer = NULL);
+	// the same without the dictionary
+	static Texture2D MakeTexture(const Image &img, TextureStreamer *streamer = NULL);
 private:
+	TextureStreamer *streamer;
+	AssetCache *cache;
+	string basePath;
+
 	Texture2D getTexture(const string &name, Dictionary<Texture2D> &textures);
 };
 
+// Named items, looked up by const char * or string without temporaries.
+// Pointers returned stay valid until the item is removed.
 template<class T>
 class Dictionary
 {
 public:
 	typedef T mapped_type;
 
-	T *GetItem(const char *name) {
-		map_t::iterator i = map.find(name);
-		return i != map.end() ? &i->second : NULL;
-	}
+	T *GetItem(const char *name) { return items.Find(name); }
+	T *GetItem(const string &name) { return items.Find(name); }
+	const T *GetItem(const char *name) const { return items.Find(name); }
+	const T *GetItem(const string &name) const { return items.Find(name); }
 
-	const T *GetItem(const char *name) const {
-		map_t::const_iterator i = map.find(name);
-		return i != map.end() ? &i->second : NULL;
-	}
+	// an item that already exists is kept
+	T &AddItem(const char *name, const T &item) { return items.Insert(name, item); }
+	T &AddItem(const string &name, const T &item) { return items.Insert(name, item); }
 
-	T &AddItem(const char *name, const T &mat) {
-		return map.insert(make_pair(name, mat)).first->second;
-	}
+	bool HasItem(const char *name) const { return items.Find(name) != NULL; }
+	bool HasItem(const string &name) const { return items.Find(name) != NULL; }
 
-	bool HasItem(const char *name) const {
-		return map.find(name) != map.end();
-	}
+	void RemoveItem(const char *name) { items.Remove(name); }
+	void RemoveItem(const string &name) { items.Remove(name); }
 
-	void RemoveItem(const char *name) {
-		map.erase(name);
-	}
+	int GetItemCount() const { return items.GetSize(); }
+	void Clear() { items.Clear(); }
 
-	Material *operator[](const char *name) {
+	T *operator[](const char *name) {
 		return GetItem(name);
 	}
 protected:
-	typedef map<string, T> map_t;
-	map_t map;
+	StringMap<T> items;
 };
 
 template<class T>
@@ -89,27 +130,30 @@ class LibCollection
 {
 public:
 	LibCollection() {
-		defaultLib = "default";
-		AddLib("default", Dictionary<T>());
+		defaultLib = &AddLib("default", Dictionary<T>());
+		defaultLibName = StringPool::Intern("default");
 	}
 
-	bool SetDefaultLib(const char *libName) {
-		if (GetLib(libName)) {
-			defaultLib = libName;
+	bool SetDefaultLib(const char *libName)
+	{
+		Dictionary<T> *lib = GetLib(libName);
+		if (lib) {
+			defaultLib = lib;
+			defaultLibName = StringPool::Intern(libName);
 			return true;
 		}
 		return false;
 	}
 
 	Dictionary<T> &GetDefaultLib() {
-		return *GetLib(defaultLib.c_str());
+		return *defaultLib;
 	}
 
-	typename T *GetItem(const char *itemName) {
-		return GetItem(defaultLib.c_str(), itemName);
+	T *GetItem(const char *itemName) {
+		return defaultLib->GetItem(itemName);
 	}
 
-	typename T *GetItem(const char *libName, const char *itemName)
+	T *GetItem(const char *libName, const char *itemName)
 	{
 		Dictionary<T> *lib = dicts.GetItem(libName);
 		if (!lib) return NULL;
@@ -124,17 +168,29 @@ public:
 		return dicts.GetItem(name);
 	}
 
-	void RemoveLib(const char *name) {
+	// "default" is always there and is only emptied; the default library
+	// goes back to it when the one set is removed
+	void RemoveLib(const char *name)
+	{
+		if (!strcmp(name, "default")) {
+			GetLib("default")->Clear();
+			return;
+		}
+		if (!strcmp(name, defaultLibName)) SetDefaultLib("default");
 		dicts.RemoveItem(name);
 	}
 
-	typename T *operator()(const char *libName, const char *itemName)
+	T *operator()(const char *libName, const char *itemName)
 	{
 		return GetItem(libName, itemName);
 	}
 private:
 	Dictionary<Dictionary<T>> dicts;
-	string defaultLib;
+	Dictionary<T> *defaultLib; // kept so the default lookups are a single one
+	const char *defaultLibName;
+
+	LibCollection(const LibCollection &);
+	LibCollection &operator=(const LibCollection &);
 };
 
 #endif // _MATERIAL_H_
\ No newline at end of file
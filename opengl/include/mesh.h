@@ -24,6 +24,12 @@ enum VertexFormat
 	VF_TANGENTS_BINORMALS = 8
 };
 
+struct MeshLod
+{
+	int firstIndex;
+	int numIndices;
+};
+
 class Mesh
 {
 public:
@@ -35,9 +41,18 @@ public:
 	int GetIndexCount() const { return numIndices >= 0 ? numIndices : indices->GetSize() / sizeof(int); }
 	int GetFaceCount() const { return GetIndexCount() / 3; }
 
+	int GetFirstIndex() const { return firstIndex; }
 	void SetFirstIndex(int firstIndex) { this->firstIndex = firstIndex; }
 	void SetIndexCount(int numIndices) { this->numIndices = numIndices; } // -1 to draw all
 
+	// level 0 is the full mesh, coarser levels are extra index ranges
+	// in the same index buffer; Draw() picks one by projected size
+	int GetLodCount() const { return lods.size() + 1; }
+	int GetCurrentLod() const { return curLod; }
+	const MeshLod &GetLod(int lod) const { return lods[lod - 1]; }
+	void AddLod(int firstIndex, int numIndices);
+	void ClearLods() { lods.clear(); curLod = 0; }
+
 	void ComputeTangents();
 	void ComputeBoundingBox();
 
@@ -49,6 +64,7 @@ public:
 
 	AABox boundingBox;
 	Sphere boundingSphere;
+	float uvDensity; // texture coordinate units per mesh unit, 0 if unknown
 
 	VertexArrayObject vao;
 	Material material;
@@ -62,6 +78,13 @@ private:
 
 	int firstIndex;
 	int numIndices;
+
+	vector<MeshLod> lods;
+	int curLod;
+	unsigned int lodFrame; // frame curLod was chosen in by a full draw
+
+	int selectLod();
+	void requestTextures();
 };
 
 #endif // _MESH_H_
\ No newline at end of file
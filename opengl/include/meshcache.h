@@ -0,0 +1,66 @@
+#ifndef _MESH_CACHE_H_
+#define _MESH_CACHE_H_
+
+#include <string>
+#include <mutex>
+
+using namespace std;
+
+struct ModelData;
+
+struct MeshCacheStats
+{
+	int numHits;
+	int numMisses;
+	int numStale;     // entries that no longer match their source
+	int numWrites;
+	double bytesRead;
+	double bytesWritten;
+	float readTime;   // ms spent loading hits
+	float writeTime;
+};
+
+// the settings of ModelLoader an entry was made with
+struct MeshCacheKey
+{
+	bool separateMeshes;
+	int numLods;
+	float lodReduction;
+	string basePath; // where the material library is looked up
+};
+
+// On-disk cache of processed OBJ files. An entry holds everything
+// ReadObj() computes except the materials: welded vertices, tangents,
+// indices with the LOD ranges, mesh ranges and bounds. The arrays are
+// aligned, but Read() copies them out of the mapping into ModelData,
+// which the loader keeps until the buffers are made. Entries are
+// named after the canonical source path and the read options; they
+// are valid while the size and write time of the source (or, failing
+// that, its contents) and of its material library are unchanged.
+// Read() and Write() may be called from several threads at once.
+class MeshCache
+{
+public:
+	// relative directories are resolved against the current one right away
+	MeshCache(const char *dir = "meshcache");
+
+	void SetDirectory(const string &dir);
+	const string &GetDirectory() const { return dir; }
+
+	// fills data except for its materials, which are read from data.materialLib
+	bool Read(const char *filename, const MeshCacheKey &key, ModelData &data);
+	bool Write(const char *filename, const MeshCacheKey &key, const ModelData &data);
+	// deletes the entry of filename, so the next read parses it again
+	void Remove(const char *filename, const MeshCacheKey &key);
+
+	MeshCacheStats GetStats();
+	void ResetStats();
+private:
+	string dir;
+	mutex lock;
+	MeshCacheStats stats;
+
+	string entryPath(const char *filename, const MeshCacheKey &key) const;
+};
+
+#endif // _MESH_CACHE_H_
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef _MESH_SIMPLIFIER_H_
+#define _MESH_SIMPLIFIER_H_
+
+#include <vector>
+#include "datatypes.h"
+
+using namespace std;
+
+// Quadric error metric simplifier working on indexed triangle lists.
+// Edges are collapsed onto one of their end points, so the simplified
+// index lists keep referencing the original vertices and can share the
+// vertex buffers of the source mesh. Vertices on open borders and on
+// attribute seams (several vertices with the same position) are never
+// moved, which keeps meshes watertight and texture seams intact.
+class MeshSimplifier
+{
+public:
+	MeshSimplifier(const Vector3f *vertices, int numVertices);
+
+	// simplifies the triangle list down to about targetCount indices and
+	// returns the largest collapse error (squared distance)
+	float Simplify(const int *indices, int numIndices, int targetCount, vector<int> &result);
+private:
+	struct Quadric
+	{
+		double a00, a01, a02, a11, a12, a22;
+		double b0, b1, b2, c;
+
+		void Add(const Quadric &q);
+		double Error(const Vector3f &p) const;
+	};
+	struct Collapse
+	{
+		int from, to;
+		float error;
+		bool operator<(const Collapse &c) const { return error < c.error; }
+	};
+
+	const Vector3f *srcVertices;
+	int srcNumVertices;
+	vector<int> srcPosRemap; // first vertex with the same position
+	vector<unsigned char> srcSeam;
+	vector<int> localIndex, localGroup; // -1 outside of Simplify()
+
+	// the vertices of the mesh being simplified, numbered from 0
+	vector<Vector3f> localVertices;
+	vector<int> globalIndex;
+	const Vector3f *vertices;
+	int numVertices;
+	vector<int> posRemap;
+	vector<unsigned char> seam;
+
+	vector<Quadric> quadrics;
+	vector<unsigned char> locked;
+	vector<int> adjOffset, adjTris;
+	vector<int> collapseTo;
+	vector<unsigned char> touched;
+
+	void computeQuadrics(const vector<int> &inds);
+	void lockBorders(const vector<int> &inds);
+	void buildAdjacency(const vector<int> &inds);
+	bool flips(const vector<int> &inds, int from, int to) const;
+	void compact(vector<int> &inds);
+};
+
+#endif // _MESH_SIMPLIFIER_H_
\ No newline at end of file
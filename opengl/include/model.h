@@ -23,8 +23,8 @@ public:
 	const Matrix44f &GetTransformRef() const { return transform; }
 
 	void AddMesh(const Mesh &mesh) { meshes.push_back(mesh); }
-	bool LoadObj(const char *filename);
-	bool LoadRaw(const char *filename);
+	bool LoadObj(const char *filename, int numLods = 0);
+	bool LoadRaw(const char *filename, int numLods = 0);
 	void UpdateTransform();
 	void ApplyTransform();
 	int Draw();
@@ -4,24 +4,96 @@
 #include <vector>
 #include "nullable.h"
 #include "mesh.h"
+#include "material.h"
 #include "glcontext.h"
 
 using namespace std;
 
+struct MeshLodDesc
+{
+	int mesh;
+	int firstIndex;
+	int numIndices;
+};
+
+struct ModelMeshDesc
+{
+	string material;
+	int firstIndex;
+	int numIndices; // -1 - up to the end of the index buffer
+	AABox boundingBox;
+	float uvDensity; // texture coordinate units per model unit, 0 if unknown
+};
+
+// Contents of a model file after all the CPU work (parsing, vertex
+// splitting, LOD and tangent generation) is done. Reading it touches no
+// GL state, so it can be done on a worker thread; CreateMeshes() then
+// makes the buffers on the thread that owns the context.
+struct ModelData
+{
+	string materialLib;
+	vector<MaterialDesc> materials;
+	vector<ModelMeshDesc> meshes;
+	vector<MeshLodDesc> lods;
+	vector<Vector3f> vertices;
+	vector<Vector3f> normals;
+	vector<Vector2f> texCoords;
+	vector<Vector3f> tangents, binormals; // only if a material has a normal map
+	vector<int> indices; // LOD ranges follow the meshes
+
+	const MaterialDesc *FindMaterial(const string &name) const;
+};
+
 class ModelLoader
 {
 public:
-	ModelLoader(GLRenderingContext *rc) : rc(rc) {  }
+	ModelLoader(GLRenderingContext *rc) : rc(rc), numLods(0), lodReduction(0.5f) {
+		meshCache = rc && rc->IsMeshCacheEnabled() ? &rc->meshCache : NULL;
+	}
+
+	// generate numLods coarser levels per mesh while loading, each with
+	// about reduction times the triangles of the previous one; RAW files
+	// that already contain LODs use the stored ones
+	void SetLodCount(int numLods, float reduction = 0.5f) {
+		this->numLods = numLods;
+		lodReduction = reduction;
+	}
+
+	// directory the material library of a model is looked up in instead
+	// of the current one (library and texture names are kept as written)
+	void SetBasePath(const string &path) { basePath = path; }
+
+	// ReadObj() reuses what an earlier call wrote to cache instead of
+	// parsing the file; the context's cache is used if it is enabled
+	void SetMeshCache(MeshCache *cache) { meshCache = cache; }
+
+	// simplifies the meshes of a RAW file and stores the LODs in it
+	bool BakeRawLods(const char *filename);
+
 	bool LoadObj(const char *filename, Mesh &mesh);
 	bool LoadObj(const char *filename, vector<Mesh> &meshes);
 	bool LoadRaw(const char *filename, Mesh &mesh);
 	bool LoadRaw(const char *filename, vector<Mesh> &meshes);
+
+	// the two halves of LoadObj/LoadRaw; textures of the material library
+	// already in the context's asset cache are not read again
+	bool ReadObj(const char *filename, ModelData &data, bool separateMeshes = true);
+	bool ReadRaw(const char *filename, ModelData &data, bool separateMeshes = true);
+	void CreateMeshes(const ModelData &data, vector<Mesh> &meshes);
 private:
 	GLRenderingContext *rc;
+	int numLods;
+	float lodReduction;
+	string basePath;
+	MeshCache *meshCache;
+
+	bool parseObj(const char *filename, ModelData &data, bool separateMeshes);
 	void read_num(const string &line, char &c, int &i, int &n);
-	void setupVao(vector<Mesh> &meshes, bool computeTangents);
-	bool loadObj(const char *filename, vector<Mesh> &meshes, bool separateMeshes);
-	bool loadRaw(const char *filename, vector<Mesh> &meshes, bool separateMeshes);
+	void setupVao(vector<Mesh> &meshes, int firstMesh, const ModelData &data);
+	void computeTangents(ModelData &data);
+	void computeUVDensity(ModelData &data);
+	void generateLods(const Vector3f *verts, int numVertices, vector<int> &inds,
+		const vector<int> &meshFirst, vector<MeshLodDesc> &lods);
 
 	Nullable<VertexBuffer> vertices, indices, normals, texCoords;
 };
@@ -0,0 +1,89 @@
+#ifndef _OCCLUSION_CULLER_H_
+#define _OCCLUSION_CULLER_H_
+
+#include <vector>
+#include "datatypes.h"
+#include "geometry.h"
+
+using namespace std;
+
+class GLRenderingContext;
+struct ModelData;
+
+struct OcclusionCullerStats
+{
+	int numOccluderTris;   // occluder triangles submitted to the rasterizer
+	int numRasterizedTris; // triangles that survived clipping and backface culling
+	int numTested;         // bounding boxes tested against the depth pyramid
+	int numCulled;         // bounding boxes found to be hidden
+	float rasterTime;      // ms spent in RenderOccluders()
+	float testTime;        // ms spent in Cull()
+};
+
+// Software occlusion culler. Designated occluder meshes are rasterized
+// on the CPU into a small depth buffer once per frame (vertex transform
+// and tile rasterization are spread over the context's thread pool and
+// use SSE). A min/max depth pyramid built from it is then used to test
+// bounding boxes before they are drawn.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller(GLRenderingContext *rc);
+	~OcclusionCuller();
+
+	void SetResolution(int width, int height);
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+
+	// Occluders are copied from the loader's CPU-side data (one mesh, or
+	// every mesh of the model), so no GL buffer is read back.
+	void AddOccluder(const ModelData &data, int mesh, const Matrix44f &model = Matrix44f::Identity());
+	void AddOccluders(const ModelData &data, const Matrix44f &model = Matrix44f::Identity());
+	void ClearOccluders();
+
+	// rasterizes occluders; viewProj must match the projection and view
+	// used for drawing during the rest of the frame
+	void RenderOccluders(const Matrix44f &viewProj);
+
+	// returns false if the box (in object space of the current modelview)
+	// is hidden behind the occluders
+	bool Cull(const AABox &boundingBox);
+
+	// statistics of the previous frame
+	const OcclusionCullerStats &GetStats() const { return frameStats; }
+private:
+	struct Triangle { int i0, i1, i2; };
+	struct Level { int width, height; float *minDepth, *maxDepth; };
+
+	GLRenderingContext *rc;
+	int width, height;
+	int numTiles, tileHeight;
+	float *depth;
+	vector<Level> levels;
+
+	vector<Vector3f> worldVerts;
+	vector<int> indices;
+	vector<Vector4f> clipVerts;
+	vector<Vector3f> screenVerts;
+	vector<unsigned char> vertVisible;
+	vector<vector<Triangle> > tileTris;
+	Matrix44f viewProj;
+	bool rendered;
+
+	OcclusionCullerStats stats, frameStats;
+	long long testTicks;
+
+	void allocate();
+	void release();
+	void buildPyramid();
+	void rasterizeTile(int tile);
+	void rasterizeTriangle(const Triangle &t, int y0, int y1);
+
+	static void transformTask(void *context, int index);
+	static void rasterizeTask(void *context, int index);
+
+	OcclusionCuller(const OcclusionCuller &);
+	OcclusionCuller &operator=(const OcclusionCuller &);
+};
+
+#endif // _OCCLUSION_CULLER_H_
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef _PROGRAM_BINARY_CACHE_H_
+#define _PROGRAM_BINARY_CACHE_H_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#ifdef _WIN32
+#include "common.h"
+#else
+#include <gl/glew.h>
+#endif
+#include "mappedfile.h"
+
+using namespace std;
+
+struct ProgramBinaryCacheStats
+{
+	int numHits;
+	int numMisses;
+	int numRejected;  // entries the driver would not take back
+	int numWrites;
+	float loadTime;   // ms spent loading hits
+	float savedTime;  // what the hits took to build from source, less loadTime
+};
+
+struct ProgramBinary
+{
+	unsigned int format; // as glGetProgramBinary gave it
+	vector<BYTE> data;
+	float compileTime;   // ms the program took to compile and link
+};
+
+// the GL functions the cache calls, so that a test can stand in for the driver
+struct ProgramBinaryGL
+{
+	void (GLAPIENTRY *getIntegerv)(GLenum pname, GLint *params);
+	const GLubyte *(GLAPIENTRY *getString)(GLenum name);
+	PFNGLPROGRAMBINARYPROC programBinary;
+	PFNGLGETPROGRAMIVPROC getProgramiv;
+	PFNGLGETPROGRAMBINARYPROC getProgramBinary;
+
+	// those of the current context; GLEW has to be initialized. Defined in
+	// programbinarygl.cpp, so the cache itself can be linked without GLEW.
+	static ProgramBinaryGL Defaults();
+};
+
+// On-disk cache of linked programs in the driver's own binary format.
+// Entries are named after a hash of the preprocessed sources of the
+// program and of the driver (its vendor, renderer and version strings),
+// so other sources or a driver update miss; an entry in a format the
+// driver no longer lists is dropped before it is handed over. Load() and
+// Save() move binaries between the driver and the files through the GL
+// functions of SetGL(); until it is called nothing is supported.
+class ProgramBinaryCache
+{
+public:
+	// relative directories are kept as they are, unlike MeshCache
+	ProgramBinaryCache(const char *dir = "programcache");
+
+	void SetDirectory(const string &dir) { this->dir = dir; }
+	const string &GetDirectory() const { return dir; }
+	void SetGL(const ProgramBinaryGL &gl) { this->gl = gl; }
+	bool HasGL() const { return gl.getIntegerv != NULL; }
+
+	// whether the driver has any binary format
+	bool IsSupported();
+	// links program from the entry of its sources; false on a miss or if
+	// the driver rejects the binary, whose entry is then deleted
+	bool Load(GLuint program, unsigned long long sourceHash);
+	// keeps the binary of a program that linked, built in compileTime ms
+	bool Save(GLuint program, unsigned long long sourceHash, float compileTime);
+	// deletes the entry of the sources for the current driver
+	bool Remove(unsigned long long sourceHash);
+
+	bool Read(unsigned long long sourceHash, const string &driver, ProgramBinary &binary);
+	bool Write(unsigned long long sourceHash, const string &driver, const ProgramBinary &binary);
+
+	ProgramBinaryCacheStats GetStats();
+	void ResetStats();
+private:
+	string dir;
+	mutex lock;
+	ProgramBinaryCacheStats stats;
+	ProgramBinaryGL gl;
+
+	string entryPath(unsigned long long sourceHash, const string &driver) const;
+	string driverString();
+	bool isFormatSupported(GLenum format);
+	void loaded(const ProgramBinary &binary, float loadTime);
+	void reject(unsigned long long sourceHash, const string &driver);
+};
+
+#endif // _PROGRAM_BINARY_CACHE_H_
\ No newline at end of file
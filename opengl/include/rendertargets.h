@@ -0,0 +1,52 @@
+#ifndef _RENDER_TARGETS_H_
+#define _RENDER_TARGETS_H_
+
+#include <vector>
+#include "common.h"
+#include "texture.h"
+
+using namespace std;
+
+struct RenderTargetDesc
+{
+	GLint internalFormat;
+	GLenum format, type; // any the internal format takes, nothing is uploaded
+	float scale;         // of the screen size
+};
+
+// Textures sized after the screen. Resize() reallocates all of them when
+// the size changes; texture names stay the same, so framebuffers they are
+// attached to need not be touched.
+class RenderTargets
+{
+public:
+	RenderTargets();
+	~RenderTargets();
+
+	// allocated at the current size, if there is one yet
+	Texture2D *Add(const RenderTargetDesc &desc, GLenum textureUnit = GL_TEXTURE0);
+	// returns false if the size did not change
+	bool Resize(int width, int height);
+	void Clear();
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	// video memory of all targets at the current size
+	size_t GetBytes() const;
+private:
+	struct Target
+	{
+		RenderTargetDesc desc;
+		Texture2D *texture;
+	};
+
+	vector<Target> targets;
+	int width, height;
+
+	void allocate(Target &t);
+
+	RenderTargets(const RenderTargets &);
+	RenderTargets &operator=(const RenderTargets &);
+};
+
+#endif // _RENDER_TARGETS_H_
\ No newline at end of file
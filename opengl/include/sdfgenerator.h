@@ -0,0 +1,51 @@
+#ifndef _SDF_GENERATOR_H_
+#define _SDF_GENERATOR_H_
+
+#include <vector>
+#include "image.h"
+
+using namespace std;
+
+class ThreadPool;
+
+// glyph bitmap to turn into a field
+struct SdfGlyph
+{
+	const BYTE *coverage; // 0-255, rows of pitch bytes
+	int width, height, pitch;
+	BYTE *field;          // GetFieldSize() of width by height, rows of fieldPitch bytes
+	int fieldPitch;
+};
+
+// Signed distance fields for text. The output is 8-bit: 128 on the
+// outline, rising to 255 spread pixels inside and falling to 0 spread
+// pixels outside. Fields are built with an exact Euclidean distance
+// transform and spread over a thread pool when one is given.
+class SdfGenerator
+{
+public:
+	SdfGenerator(ThreadPool *pool = NULL, int spread = 4)
+		: pool(pool), spread(spread) { }
+
+	void SetSpread(int spread) { this->spread = spread; }
+	int GetSpread() const { return spread; }
+
+	// field of the alpha of a 32-bit image (or an 8-bit one) at the same size
+	bool Generate(const Image &src, Image &dst) const;
+
+	// Glyphs rasterized at scale times the size of the field; each field
+	// gets a border of spread pixels so the outside of the glyph fits.
+	void Generate(vector<SdfGlyph> &glyphs, int scale) const;
+	int GetFieldSize(int size, int scale) const { return (size + scale - 1) / scale + 2*spread; }
+private:
+	ThreadPool *pool;
+	int spread;
+
+	struct AtlasJob;
+	struct GlyphJob;
+	static void transformColumns(void *context, int index);
+	static void transformRows(void *context, int index);
+	static void makeGlyph(void *context, int index);
+};
+
+#endif // _SDF_GENERATOR_H_
\ No newline at end of file
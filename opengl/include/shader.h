@@ -14,6 +14,7 @@ using namespace std;
 class GLRenderingContext;
 class Shader;
 class ProgramObject;
+class ShaderPreprocessor;
 
 enum AttribLocation
 {
@@ -30,6 +31,7 @@ class shared_traits<Shader>
 public:
 	GLuint handle;
 	bool compiled;
+	vector<string> files; // of the source last compiled, for the log
 	shared_traits() : handle(0), compiled(false) { }
 	~shared_traits() { glDeleteShader(handle); }
 };
@@ -40,13 +42,20 @@ public:
 	Shader(GLenum type);
 	Shader(GLenum type, const char *path, const vector<string> &definitions = vector<string>());
 
+	// Sources go through ShaderPreprocessor first: definitions are NAME or
+	// NAME=VALUE, and files can #include others next to them.
 	GLuint Handle() const { return ptr->handle; }
 	bool IsCompiled() const { return ptr->compiled; }
 	bool CompileFile(const char *filename, const vector<string> &definitions = vector<string>());
 	bool CompileSource(const char *source, int length = 0, const vector<string> &definitions = vector<string>());
+	// source that went through sp already
+	bool Compile(const ShaderPreprocessor &sp);
+	// Compile() in two steps: CompileAsync() hands the source to the driver
+	// and returns, CheckCompiled() waits for the result and logs it
+	void CompileAsync(const ShaderPreprocessor &sp);
+	bool CheckCompiled();
 private:
-	bool log();
-	void compileLines(const vector<string> &lines);
+	bool log(const vector<string> &files);
 };
 
 struct KnownUniforms
@@ -73,9 +82,13 @@ public:
 	GLRenderingContext *rc;
 	GLuint handle;
 	bool linked;
-	bool fUpdateMV, fUpdateProj;
+	unsigned int mvVersion, projVersion; // last matrices uploaded
 	KnownUniforms knownUniforms;
 
+	// what a build started by BuildAsync() needs until it is finished
+	struct PendingBuild;
+	PendingBuild *pending;
+
 	shared_traits();
 	~shared_traits();
 
@@ -101,6 +114,19 @@ public:
 	void AttachShader(const Shader &shader);
 	void DetachShader(const Shader &shader);
 	bool Link();
+	// Compiles and links the two sources, or loads the program from the
+	// context's program binary cache when it is enabled and holds them.
+	// Binaries the driver does not take are dropped and built again.
+	bool Build(const ShaderPreprocessor &vert, const ShaderPreprocessor &frag);
+	// Build() in steps, so that several programs compile at once. BuildAsync()
+	// starts compiling and linking without asking the driver for any status;
+	// attributes have to be bound before it. IsBuildComplete() tells without
+	// waiting if the driver is done (always true without
+	// ARB_parallel_shader_compile). FinishBuild() checks the results and
+	// reads the uniforms; Use() calls it if it has not been called.
+	void BuildAsync(const ShaderPreprocessor &vert, const ShaderPreprocessor &frag);
+	bool IsBuildComplete();
+	bool FinishBuild();
 	void Use();
 
 	GLint GetAttribLocation(const char *name);
@@ -126,6 +152,9 @@ private:
 	
 	GLRenderingContext *rc;
 	
+	void submitLink();
+	bool checkLinked();
+	void readUniforms();
 	void updateMatrices();
 	void updateMVP();
 	void updateNorm();
@@ -0,0 +1,99 @@
+#ifndef _SHADER_CACHE_H_
+#define _SHADER_CACHE_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "shader.h"
+#include "shaderpreprocessor.h"
+#include "stringmap.h"
+
+using namespace std;
+
+class GLRenderingContext;
+
+struct ShaderCacheStats
+{
+	int numPrograms;
+	int numRequests;
+	int numHits;       // variants asked for before
+	int numSourceHits; // new variants that came out the same as a cached one
+	int numPrewarmed;  // started by Prewarm() before anyone asked
+	float compileMs;   // the thread of the context spent building programs
+};
+
+// Programs of a context by the preprocessed text of their two shaders,
+// which covers the files, everything they include and the definitions.
+// Definitions are sorted and duplicates dropped first, so the order
+// they come in does not make another variant. A variant asked for again
+// is found by its paths and definitions without touching the files.
+class ShaderCache
+{
+public:
+	ShaderCache(GLRenderingContext *rc);
+	~ShaderCache();
+
+	// the program built from the two files, compiled on first request;
+	// it is not linked if they fail to compile, and is compiled again
+	// when asked for next time
+	ProgramObject GetProgram(const char *vertPath, const char *fragPath,
+		const vector<string> &definitions = vector<string>());
+
+	// Declares a variant to build before it is needed. A worker thread
+	// reads and preprocesses the files; Prewarm() compiles what is ready
+	// on the thread of the context. With ARB_parallel_shader_compile it
+	// submits all of it and finishes the programs the driver is done with,
+	// so none of them stalls the frame; otherwise it builds them one by one
+	// for up to budgetMs (at least one program). Call it once a frame while
+	// GetPendingCount() is not 0.
+	void AddVariant(const char *vertPath, const char *fragPath,
+		const vector<string> &definitions = vector<string>());
+	int Prewarm(float budgetMs);
+	int GetPendingCount();
+
+	// the context calls this while it is still current
+	void Clear();
+	const ShaderCacheStats &GetStats() const { return stats; }
+
+	static unsigned long long HashSource(const string &source, unsigned long long h = 0xCBF29CE484222325ULL);
+private:
+	struct Variant
+	{
+		string key; // paths and sorted definitions
+		string vertPath, fragPath;
+		vector<string> definitions;
+		ShaderPreprocessor vert, frag;
+		bool preprocessed;
+	};
+
+	GLRenderingContext *rc;
+	StringMap<unsigned long long> requests; // key - hash of the sources
+	map<unsigned long long, ProgramObject> programs;
+	ShaderCacheStats stats;
+
+	// variants declared for Prewarm(), from queued to ready
+	thread worker;
+	mutex lock;
+	condition_variable wake;
+	deque<Variant *> queued, ready;
+	list<pair<unsigned long long, ProgramObject> > building; // submitted by Prewarm(), not finished
+	int numPending;
+	bool quit;
+
+	static void describe(Variant &v, const char *vertPath, const char *fragPath, const vector<string> &definitions);
+	static void preprocess(Variant &v);
+	ProgramObject addProgram(Variant &v, bool async = false);
+	// drops a program that did not link and the requests for it
+	void forget(unsigned long long hash);
+	void workerMain();
+
+	ShaderCache(const ShaderCache &);
+	ShaderCache &operator=(const ShaderCache &);
+};
+
+#endif // _SHADER_CACHE_H_
\ No newline at end of file
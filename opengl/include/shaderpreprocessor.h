@@ -0,0 +1,77 @@
+#ifndef _SHADER_PREPROCESSOR_H_
+#define _SHADER_PREPROCESSOR_H_
+
+#include <vector>
+#include <string>
+#include "stringmap.h"
+
+using namespace std;
+
+// Expands #include and resolves #if/#ifdef/#ifndef/#elif/#else/#endif of
+// GLSL source into one buffer, ahead of the driver. Definitions are NAME
+// or NAME=VALUE (NAME alone is 1); they are tested by the conditionals
+// and written out as #define lines after #version. #define and #undef in
+// the source are tracked for the conditionals and passed on as well.
+//
+// /* */ comments are removed first, so directives inside them are not
+// seen. Included files are found next to the file including them, with
+// their paths normalized (see strhlp::normalizePath). A file with
+// #pragma once or an include guard around all of it is skipped when it
+// would be included again, without being read. Each file gets a source
+// string number in #line directives, so compiler errors point into it;
+// GetFiles() tells which number is which file.
+class ShaderPreprocessor
+{
+public:
+	ShaderPreprocessor(const vector<string> &definitions = vector<string>());
+
+	// both can be called more than once; the output is appended to
+	bool ProcessFile(const char *filename);
+	bool ProcessSource(const char *source, int length = 0);
+
+	const string &GetSource() const { return output; }
+	const vector<string> &GetFiles() const { return files; }
+	const string &GetError() const { return error; }
+
+	// Files are read once per process and kept with where their guards
+	// are; this drops them, for shaders edited while running.
+	static void ClearFileCache();
+private:
+	struct Condition
+	{
+		bool active;
+		bool taken;        // some branch of it was active
+		bool parentActive;
+		bool sawElse;
+		int line;
+	};
+
+	vector<string> definitions;
+	StringMap<string> macros;
+	StringMap<bool> onceFiles;
+	vector<Condition> conditions;
+	vector<string> files;
+	string output;
+	string error;
+	bool injected;
+	bool exactLines;   // GLSL 3.00 and later number from the line #line names
+	int depth;
+	int conditionBase; // conditions of the files including the current one
+
+	// these return false once error is set
+	bool process(const char *text, int length, int file);
+	bool directive(const char *begin, const char *end, int file, int line);
+	bool include(const string &name, int file, int line);
+	void inject(const char *version, int file, int nextLine);
+	void lineDirective(int line, int file);
+	int fileIndex(const string &path);
+	bool isActive() const { return conditions.empty() || conditions.back().active; }
+
+	bool test(const string &expr, int file, int line, bool &result);
+	bool fail(int file, int line, const string &message);
+	static string onceKey(const string &path);
+
+	friend class ExpressionParser;
+};
+
+#endif // _SHADER_PREPROCESSOR_H_
\ No newline at end of file
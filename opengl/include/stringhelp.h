@@ -42,7 +42,50 @@ namespace strhlp
 		return trimRight(trimLeft(s));
 	}
 
-	inline vector<string> split(const string &s, char delim = ' ')
+	// prefixes a relative path with dir; absolute paths are kept as they are
+	inline string joinPath(const string &dir, const string &path)
+	{
+		if (dir.empty() || path.empty()) return path;
+		if (path[0] == '/' || path[0] == '\\' || path.find(':') != string::npos)
+			return path;
+		char last = dir[dir.size() - 1];
+		return last == '/' || last == '\\' ? dir + path : dir + '/' + path;
+	}
+
+	// '/' separators with "." and "dir/.." taken out, so that two
+	// spellings of a relative or absolute path compare equal; the file
+	// system is not asked, so links and case are left as they are
+	inline string normalizePath(const string &path)
+	{
+		string s = path;
+		replace(s.begin(), s.end(), '\\', '/');
+		bool absolute = !s.empty() && s[0] == '/';
+
+		vector<string> parts;
+		size_t i = 0;
+		while (i <= s.size())
+		{
+			size_t j = s.find('/', i);
+			if (j == string::npos) j = s.size();
+			string part = s.substr(i, j - i);
+			if (part == "..") {
+				if (!parts.empty() && parts.back() != "..") parts.pop_back();
+				else if (!absolute) parts.push_back(part);
+			}
+			else if (!part.empty() && part != ".")
+				parts.push_back(part);
+			i = j + 1;
+		}
+
+		string res = absolute ? "/" : "";
+		for (int k = 0, n = parts.size(); k < n; k++) {
+			if (k) res += '/';
+			res += parts[k];
+		}
+		return res;
+	}
+
+		inline vector<string> split(const string &s, char delim = ' ')
 	{
 		vector<string> arr;
 		int prev = 0;
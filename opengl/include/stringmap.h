@@ -0,0 +1,214 @@
+#ifndef _STRING_MAP_H_
+#define _STRING_MAP_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <new>
+#include <type_traits>
+#include <string.h>
+
+using namespace std;
+
+// Process-wide table of interned strings. Equal strings share one copy,
+// which lives until the program exits, so keys can be held as plain
+// pointers. Nothing is ever freed: the pool grows by every distinct
+// string interned (GetBytes() tells how much), so it suits names from
+// a bounded set, such as materials and libraries, and not arbitrary
+// data. Interning may be done from any thread.
+class StringPool
+{
+public:
+	// never 0
+	static unsigned int Hash(const char *s, int len);
+
+	static const char *Intern(const char *s) { return Intern(s, strlen(s)); }
+	static const char *Intern(const string &s) { return Intern(s.c_str(), s.size()); }
+	static const char *Intern(const char *s, int len) { return Intern(s, len, Hash(s, len)); }
+	static const char *Intern(const char *s, int len, unsigned int hash);
+
+	static int GetCount();
+	static int GetBytes(); // bytes of string data held
+};
+
+// Hash map from strings to T with open addressing (linear probing). Keys
+// are interned and looked up by const char * or string directly, without
+// constructing temporaries. Values are kept in a deque, so pointers to
+// them stay valid until their item is removed. A value is constructed
+// when its item is inserted and destroyed when it is removed; free
+// entries hold no T.
+template<class T>
+class StringMap
+{
+public:
+	StringMap() : count(0), numRemoved(0) { }
+	StringMap(const StringMap &m) : count(0), numRemoved(0) { copy(m); }
+	~StringMap() { destroyValues(); }
+
+	StringMap &operator=(const StringMap &m)
+	{
+		if (this != &m) {
+			Clear();
+			copy(m);
+		}
+		return *this;
+	}
+
+	int GetSize() const { return count; }
+
+	T *Find(const char *key) { return find(key, strlen(key)); }
+	T *Find(const string &key) { return find(key.c_str(), key.size()); }
+	const T *Find(const char *key) const { return const_cast<StringMap *>(this)->find(key, strlen(key)); }
+	const T *Find(const string &key) const { return const_cast<StringMap *>(this)->find(key.c_str(), key.size()); }
+
+	// an existing item is kept and returned, as with std::map::insert
+	T &Insert(const char *key, const T &value) { return insert(key, strlen(key), value); }
+	T &Insert(const string &key, const T &value) { return insert(key.c_str(), key.size(), value); }
+
+	bool Remove(const char *key) { return remove(key, strlen(key)); }
+	bool Remove(const string &key) { return remove(key.c_str(), key.size()); }
+
+	void Clear()
+	{
+		destroyValues();
+		slots.clear();
+		entries.clear();
+		freeEntries.clear();
+		count = numRemoved = 0;
+	}
+
+	// calls f(key, value) for every item in no particular order
+	template<class F>
+	void ForEach(F f)
+	{
+		for (int i = 0, n = entries.size(); i < n; i++)
+			if (entries[i].key) f(entries[i].key, entries[i].value());
+	}
+private:
+	struct Entry
+	{
+		const char *key; // interned, NULL in free entries
+		int len;
+		typename aligned_storage<sizeof(T), alignment_of<T>::value>::type storage;
+
+		T &value() { return *(T *)&storage; }
+	};
+
+	struct Slot
+	{
+		unsigned int hash; // 0 in empty slots
+		Entry *entry;      // NULL in empty and removed slots
+	};
+
+	vector<Slot> slots; // the size is a power of two
+	deque<Entry> entries;
+	vector<Entry *> freeEntries;
+	int count;
+	int numRemoved;
+
+	int findSlot(const char *key, int len, unsigned int hash) const
+	{
+		if (slots.empty()) return -1;
+		int mask = slots.size() - 1;
+		for (int i = hash & mask; ; i = (i + 1) & mask)
+		{
+			const Slot &s = slots[i];
+			if (!s.hash) return -1;
+			if (s.hash == hash && s.entry) {
+				const Entry &e = *s.entry;
+				if (e.key == key || (e.len == len && memcmp(e.key, key, len) == 0))
+					return i;
+			}
+		}
+	}
+
+	T *find(const char *key, int len)
+	{
+		int i = findSlot(key, len, StringPool::Hash(key, len));
+		return i >= 0 ? &slots[i].entry->value() : NULL;
+	}
+
+	T &insert(const char *key, int len, const T &value)
+	{
+		unsigned int hash = StringPool::Hash(key, len);
+		int i = findSlot(key, len, hash);
+		if (i >= 0) return slots[i].entry->value();
+
+		// at most three quarters of the slots in use, removed ones included
+		if ((count + numRemoved + 1) * 4 > (int)slots.size() * 3)
+			rehash(count + 1);
+
+		Entry *e;
+		if (!freeEntries.empty()) {
+			e = freeEntries.back();
+			freeEntries.pop_back();
+		}
+		else {
+			entries.push_back(Entry());
+			e = &entries.back();
+		}
+		new (&e->storage) T(value);
+		e->key = StringPool::Intern(key, len, hash);
+		e->len = len;
+
+		int mask = slots.size() - 1;
+		i = hash & mask;
+		while (slots[i].entry) i = (i + 1) & mask;
+		if (slots[i].hash) numRemoved--;
+		slots[i].hash = hash;
+		slots[i].entry = e;
+		count++;
+		return e->value();
+	}
+
+	bool remove(const char *key, int len)
+	{
+		int i = findSlot(key, len, StringPool::Hash(key, len));
+		if (i < 0) return false;
+
+		Entry *e = slots[i].entry;
+		e->key = NULL;
+		e->value().~T();
+		freeEntries.push_back(e);
+		slots[i].entry = NULL; // the hash is kept, so probing goes on past it
+		count--;
+		numRemoved++;
+		return true;
+	}
+
+	void copy(const StringMap &m)
+	{
+		for (int i = 0, n = m.entries.size(); i < n; i++) {
+			const Entry &e = m.entries[i];
+			if (e.key) insert(e.key, e.len, const_cast<Entry &>(e).value());
+		}
+	}
+
+	void destroyValues()
+	{
+		for (int i = 0, n = entries.size(); i < n; i++)
+			if (entries[i].key) entries[i].value().~T();
+	}
+
+	void rehash(int minCount)
+	{
+		int size = 16;
+		while (size * 3 < minCount * 4 * 2) size *= 2; // half full at most after growing
+
+		vector<Slot> old;
+		old.swap(slots);
+		Slot empty = { 0, NULL };
+		slots.assign(size, empty);
+		numRemoved = 0;
+
+		int mask = size - 1;
+		for (int j = 0, n = old.size(); j < n; j++) {
+			if (!old[j].entry) continue;
+			int i = old[j].hash & mask;
+			while (slots[i].hash) i = (i + 1) & mask;
+			slots[i] = old[j];
+		}
+	}
+};
+
+#endif // _STRING_MAP_H_
\ No newline at end of file
@@ -1,11 +1,14 @@
 #ifndef _TEXT_2D_
 #define _TEXT_2D_
 
+#include <fstream>
 #include "sharedptr.h"
 #include "vertexbuffer.h"
 #include "texture.h"
 #include "shader.h"
 #include "glcontext.h"
+#include "glyphtable.h"
+#include "sdfgenerator.h"
 
 class Text2D;
 class Font2D;
@@ -14,49 +17,71 @@ template<>
 class shared_traits<Font2D>
 {
 public:
-	struct Charset {
-		int base;
-		int startChar;
-		int endChar;
-	};
-
-	int numChars, numCharsets;
-	Charset *charsets;
-	int *charWidth;
-
+	GlyphTable glyphs;
 	Texture2D fontTexture;
-	int numCellsX, numCellsY;
-	float fontHeight;
+	float fontHeight; // from one line to the next
+	float base;       // from the top of a line to the baseline
+	bool sdf;         // fontTexture holds a distance field
 
-	float dty;
-	float numCellsX_inv, numCellsY_inv;
-	float texWidth_inv;
+	shared_traits() : fontHeight(0.0f), base(0.0f), sdf(false) { }
+	bool load(const char *filename, const SdfGenerator *generator);
+	bool loadTtf(const char *filename, int pixelHeight, const wchar_t *chars, const SdfGenerator *generator);
+private:
+	bool loadGrid(ifstream &file, const SdfGenerator *generator);
+	bool loadBMFont(ifstream &file, const char *filename, const SdfGenerator *generator);
+	bool loadAtlas(const char *filename, const SdfGenerator *generator);
+};
 
-	shared_traits();
-	~shared_traits();
-	bool load(const char *name);
+// glyph rectangle in pixels from the origin of the text and in the atlas
+struct GlyphQuad
+{
+	float x0, y0, x1, y1;
+	float u0, v0, u1, v1;
 };
 
 class Font2D : public Shared<Font2D>
 {
 public:
-	Font2D() : lineSpacing(0) { }
+	Font2D() : lineSpacing(0), scale(1.0f), loaded(false) { }
 	Font2D(const char *filename);
 
-	void LoadFnt(const char *filename);
-	bool IsLoaded() { return loaded; }
+	// Fonts loaded with a generator get a distance field atlas instead of
+	// coverage; they are drawn with crisp edges at any scale.
+
+	// reads either the grid format of fonts/font.fnt or a BMFont text
+	// file; BMFont pages are found next to the .fnt, only the first is used
+	bool LoadFnt(const char *filename, const SdfGenerator *generator = NULL);
+	// Rasterizes chars of a TrueType font file at pixelHeight into a packed
+	// atlas with the kerning pairs of the font. Without chars Latin-1 and
+	// Cyrillic are taken.
+	bool LoadTtf(const char *filename, int pixelHeight, const wchar_t *chars = NULL,
+		const SdfGenerator *generator = NULL);
+	bool IsLoaded() const { return loaded; }
+	bool IsSdf() const { return ptr->sdf; }
 
 	void SetColor(Color4f color) { this->color = color; }
 	Color4f GetColor() const { return color; }
-	int GetHeight() const { return (int)ptr->fontHeight; }
+	// size relative to the atlas, meant for distance field fonts
+	void SetScale(float scale) { this->scale = scale; }
+	float GetScale() const { return scale; }
+	int GetHeight() const { return (int)(ptr->fontHeight * scale); }
+	int GetGlyphCount() const { return ptr->glyphs.GetCount(); }
 	void SetLineSpacing(int spacing) { lineSpacing = spacing; }
+	// width of the widest line
 	int CalcTextWidth(const wchar_t *text);
+
+	// Lays text out from (0, 0) with lines going down and writes a quad for
+	// each visible glyph, at most one per character; returns how many.
+	// Characters the font has no glyph for are skipped.
+	int LayoutText(const wchar_t *text, GlyphQuad *quads) const;
 private:
 	friend class Text2D;
+	friend class TextBatch;
 	friend class SharedTraits;
 
 	Color4f color;
 	int lineSpacing;
+	float scale;
 	bool loaded;
 	
 	SharedTraits *operator->() { return ptr.Get(); }
@@ -80,10 +105,56 @@ private:
 	int numVerts;
 	VertexArrayObject vao;
 	VertexBuffer vertices, texCoords;
-	ProgramObject *prog;
+	ProgramObject *prog, *sdfProg;
 	
 	void drawFixed(int x, int y);
 	void clone(const Text2D &t);
 };
 
+// Lays out any number of strings into one interleaved, indexed quad
+// buffer and draws them with a single call per font atlas, without
+// touching the matrix stacks. Strings are added anew every frame.
+class TextBatch
+{
+public:
+	TextBatch(GLRenderingContext *rc);
+
+	// queues text at (x, y) in pixels from the top left corner of the
+	// viewport, in the current color of font
+	void Add(const Font2D &font, const wchar_t *text, int x, int y);
+	// draws what was added since the last call and empties the batch
+	void Draw();
+	void Clear();
+
+	int GetGlyphCount() const { return numGlyphs; }
+	int GetLastDrawCount() const { return lastDrawCount; }
+private:
+	struct TextVertex
+	{
+		Vector2f pos;
+		Vector2f texCoord;
+		Color4b color;
+	};
+
+	struct Atlas
+	{
+		Texture2D texture;
+		bool sdf;
+		vector<TextVertex> verts; // four per glyph
+		Atlas(const Texture2D &texture, bool sdf) : texture(texture), sdf(sdf) { }
+	};
+
+	GLRenderingContext *rc;
+	ProgramObject *prog, *sdfProg;
+	VertexArrayObject vao;
+	VertexBuffer vertices, indices;
+	vector<Atlas> atlases;
+	int numGlyphs;
+	int indexCapacity; // glyphs the index buffer has quads for
+	int lastDrawCount;
+
+	TextBatch(const TextBatch &);
+	TextBatch &operator=(const TextBatch &);
+};
+
 #endif // _TEXT_2D_
\ No newline at end of file
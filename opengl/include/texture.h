@@ -17,10 +17,18 @@ public:
 	bool needDelete;
 	GLuint id;
 	int width, height;
+	int numLevels;
+	bool compressed;
 	bool loaded;
+	int baseLevel;   // image level uploaded as level 0
+	int streamIndex; // entry in the texture streamer, -1 if not streamed
 
 	shared_traits() : needDelete(false), id(0), loaded(false) {
 		width = height = 0;
+		numLevels = 0;
+		compressed = false;
+		baseLevel = 0;
+		streamIndex = -1;
 	}
 	~shared_traits() {
 		if (needDelete) glDeleteTextures(1, &id);
@@ -43,12 +51,22 @@ public:
 	void SetBorderColor(Color4f color);
 
 	void BuildMipmaps();
+
+	// mip levels that came with the image, 1 if it had no mip chain
+	int GetLevelCount() const { return ptr->numLevels; }
+	bool IsCompressed() const { return ptr->compressed; }
+	// first level of the image that is resident; above 0 while the
+	// texture streamer holds back the finer levels
+	int GetBaseLevel() const { return ptr->baseLevel; }
 protected:
+	friend class TextureStreamer;
+
 	GLenum target, textureUnit;
 
 	bool loadFromTGA(const char *filename, Image &img);
-	void texImage2D(GLenum target, const Image &img);
-	void read(HANDLE hFile, LPVOID lpBuffer, DWORD nNumBytes);
+	bool loadImage(const char *filename, Image &img);
+	void texImage2D(GLenum target, const Image &img, int firstLevel = 0);
+	void texLevels(GLenum target, const Image &img, int firstLevel);
 };
 
 class Texture2D : public BaseTexture
@@ -62,6 +80,8 @@ public:
 
 	bool IsLoaded() const { return ptr->loaded; }
 	bool LoadFromTGA(const char *filename);
+	bool LoadFromFile(const char *filename); // TGA, DDS or KTX
+	bool LoadFromImage(const Image &img);
 	void SetTexImage(GLenum level, GLint internalFormat, GLsizei width, GLsizei height,
 		GLint border, GLenum format, GLenum type, const GLvoid *data);
 };
@@ -0,0 +1,77 @@
+#ifndef _TEXTURE_COMPRESSOR_H_
+#define _TEXTURE_COMPRESSOR_H_
+
+#include <vector>
+#include "image.h"
+
+using namespace std;
+
+class ThreadPool;
+
+enum CompressionQuality
+{
+	CQ_FAST,   // bounding box endpoints
+	CQ_NORMAL, // principal axis endpoints
+	CQ_HIGH    // principal axis plus least squares refinement
+};
+
+enum MipFilter
+{
+	MF_BOX,
+	MF_KAISER
+};
+
+// what the texture holds decides how its mips are filtered
+enum TextureContent
+{
+	TC_COLOR,  // sRGB encoded color, filtered in linear space
+	TC_LINEAR, // masks and other linear data
+	TC_NORMAL  // tangent space normals, renormalized after filtering
+};
+
+// Block compressor for BC1, BC3, BC4 and BC5. Works on Image data (BGR,
+// BGRA or 8-bit rows, top row first); blocks are encoded with SSE and
+// spread over a thread pool when one is given.
+class TextureCompressor
+{
+public:
+	TextureCompressor(ThreadPool *pool = NULL)
+		: pool(pool), quality(CQ_NORMAL), filter(MF_BOX) { }
+
+	void SetQuality(CompressionQuality quality) { this->quality = quality; }
+	void SetMipFilter(MipFilter filter) { this->filter = filter; }
+
+	// compresses one level; blocks must hold GetCompressedSize() bytes
+	void CompressLevel(const BYTE *pixels, int width, int height, int bpp,
+		ImageCompression format, BYTE *blocks);
+
+	// builds the full mip chain of src and compresses every level
+	bool Compress(const Image &src, ImageCompression format, TextureContent content, Image &dst);
+
+	// decodes level 0 of a compressed image and compares it with the
+	// channels of the original that the format keeps; result in dB
+	static double ComputePSNR(const Image &original, const Image &compressed);
+
+	static int GetCompressedSize(int width, int height, ImageCompression format);
+private:
+	ThreadPool *pool;
+	CompressionQuality quality;
+	MipFilter filter;
+
+	struct Job
+	{
+		TextureCompressor *compressor;
+		const BYTE *pixels;
+		int width, height, bpp;
+		int blocksX;
+		ImageCompression format;
+		BYTE *blocks;
+	};
+	static void compressRow(void *context, int row);
+
+	void buildMips(const Image &src, TextureContent content, vector<vector<BYTE> > &levels);
+	void downsample(const vector<float> &src, int width, int height,
+		vector<float> &dst, int dstWidth, int dstHeight) const;
+};
+
+#endif // _TEXTURE_COMPRESSOR_H_
\ No newline at end of file
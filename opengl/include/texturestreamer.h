@@ -0,0 +1,93 @@
+#ifndef _TEXTURE_STREAMER_H_
+#define _TEXTURE_STREAMER_H_
+
+#include <vector>
+#include "texture.h"
+#include "image.h"
+
+using namespace std;
+
+// levels up to this size are always resident
+#define TS_TAIL_SIZE 64
+
+struct TextureStreamerStats
+{
+	int numTextures;
+	int numRequested;   // textures drawn in the last frame
+	int numWaiting;     // requested ones still coarser than needed
+	int numUploads;     // in the last Update()
+	int numEvictions;
+	int residentBytes;
+	int requestedBytes; // if every texture had exactly the levels it needs
+	int fullBytes;      // if every level of every texture was resident
+	int budget;
+	float updateTime;   // ms
+};
+
+// Keeps resident only the mip levels that are needed on screen. A
+// streamed texture starts with its tail (levels up to TS_TAIL_SIZE);
+// Mesh::Draw() requests levels from the projected size of the mesh and
+// its UV density, and Update() uploads finer levels from the CPU copy of
+// the image, taking levels away from the least recently drawn textures
+// when the byte budget would be exceeded.
+class TextureStreamer
+{
+public:
+	TextureStreamer();
+
+	void SetBudget(int bytes) { budget = bytes; }
+	int GetBudget() const { return budget; }
+	// bytes uploaded per Update(), so that streaming does not stall a frame;
+	// one texture is always uploaded even if it is larger
+	void SetUploadLimit(int bytes) { uploadLimit = bytes; }
+	int GetUploadLimit() const { return uploadLimit; }
+
+	// Takes over the levels of tex. The image is kept, with mips built for
+	// it if it has none; compressed images without mips are rejected.
+	bool AddTexture(Texture2D &tex, const Image &img);
+	// makes every level resident and stops streaming tex
+	void RemoveTexture(Texture2D &tex);
+	bool IsStreamed(const BaseTexture &tex) const { return tex.ptr->streamIndex >= 0; }
+
+	// uvPerPixel is how much the texture coordinates change across one
+	// pixel of the screen; the finest level needed this frame is kept
+	void Request(const BaseTexture &tex, float uvPerPixel);
+
+	// called once per frame by GLRenderingContext::EndFrame()
+	void Update();
+
+	// height of the viewport in the last Update(), in pixels
+	int GetViewportHeight() const { return viewportHeight; }
+	const TextureStreamerStats &GetStats() const { return stats; }
+private:
+	struct Entry
+	{
+		Texture2D texture;
+		Image image;
+		int tailLevel;
+		int residentLevel;
+		int wantedLevel;
+		unsigned int lastUsed;
+		int levelBytes[IMAGE_MAX_MIPS + 1]; // size of the chain from each level on
+	};
+
+	struct LessRecent;
+	struct LargerGap;
+
+	vector<Entry> entries;
+	int budget;
+	int uploadLimit;
+	int residentBytes;
+	unsigned int frame;
+	int viewportHeight;
+	TextureStreamerStats stats;
+
+	void setResident(Entry &e, int level);
+	void removeEntry(int index);
+	int evict(int bytes);
+
+	TextureStreamer(const TextureStreamer &);
+	TextureStreamer &operator=(const TextureStreamer &);
+};
+
+#endif // _TEXTURE_STREAMER_H_
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+using namespace std;
+
+typedef void (*ParallelTask)(void *context, int index);
+
+// Fixed set of worker threads for data-parallel work. ParallelFor()
+// runs func(context, i) for every i in [0, count) and returns when all
+// of them are done; the calling thread takes part in the work.
+class ThreadPool
+{
+public:
+	ThreadPool(int numThreads = 0); // 0 - one less than the number of cores
+	~ThreadPool();
+
+	int GetThreadCount() const { return workers.size() + 1; }
+	void ParallelFor(int count, ParallelTask func, void *context);
+private:
+	vector<thread> workers;
+	mutex lock;
+	condition_variable wake, done;
+	bool quit;
+
+	ParallelTask func;
+	void *context;
+	int count;
+	atomic<int> next;
+	int pending;
+	int busy;
+	unsigned int generation;
+
+	void workerMain();
+	int runTasks();
+
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+};
+
+#endif // _THREAD_POOL_H_
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "assetcache.h"
+#include "glcontext.h"
+#include "stringhelp.h"
+#include <string.h>
+#include <algorithm>
+
+AssetCache::AssetCache(GLRenderingContext *rc) : rc(rc)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+string AssetCache::CanonicalPath(const string &path)
+{
+	char full[MAX_PATH] = "";
+	string s = GetFullPathNameA(path.c_str(), MAX_PATH, full, NULL) ? full : path;
+	replace(s.begin(), s.end(), '\\', '/');
+	return strhlp::toLowerCase(s);
+}
+
+unsigned long long AssetCache::HashImage(const Image &img)
+{
+	const unsigned long long k = 0x9E3779B97F4A7C15ULL;
+	unsigned long long h = 0xCBF29CE484222325ULL;
+	unsigned long long format[5] = { (unsigned long long)img.GetWidth(), (unsigned long long)img.GetHeight(),
+		(unsigned long long)img.GetDepth(), (unsigned long long)img.GetCompression(), (unsigned long long)img.GetMipCount() };
+	for (int i = 0; i < 5; i++) {
+		h = (h ^ format[i]) * k;
+		h ^= h >> 32;
+	}
+
+	// eight bytes at a time, the tail padded with zeros
+	const BYTE *data = img.GetData();
+	int size = img.GetDataSize();
+	int i = 0;
+	for (; i + 8 <= size; i += 8) {
+		unsigned long long w;
+		memcpy(&w, data + i, 8);
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+	if (i < size) {
+		unsigned long long w = 0;
+		memcpy(&w, data + i, size - i);
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+	return h ? h : 1;
+}
+
+Texture2D AssetCache::LoadTexture(const string &path)
+{
+	stats.numRequests++;
+	string key = CanonicalPath(path);
+	map<string, TextureMap::iterator>::iterator p = paths.find(key);
+	if (p != paths.end()) {
+		TextureEntry &e = p->second->second;
+		stats.numPathHits++;
+		stats.savedBytes += e.bytes;
+		return e.texture;
+	}
+
+	Image img;
+	MaterialLoader::ReadTextureImage(path, img);
+	return addTexture(key, path, img, 0);
+}
+
+Texture2D AssetCache::AddTexture(const string &path, const Image &img, unsigned long long hash)
+{
+	stats.numRequests++;
+	string key = CanonicalPath(path);
+	map<string, TextureMap::iterator>::iterator p = paths.find(key);
+	if (p != paths.end()) {
+		TextureEntry &e = p->second->second;
+		stats.numPathHits++;
+		stats.savedBytes += e.bytes;
+		return e.texture;
+	}
+	return addTexture(key, path, img, hash);
+}
+
+bool AssetCache::HasTexture(const string &path) const {
+	return paths.find(CanonicalPath(path)) != paths.end();
+}
+
+bool AssetCache::sameImage(const Image &a, const Image &b)
+{
+	if (a.GetWidth() != b.GetWidth() || a.GetHeight() != b.GetHeight() ||
+		a.GetDepth() != b.GetDepth() || a.GetCompression() != b.GetCompression() ||
+		a.GetMipCount() != b.GetMipCount() || a.GetDataSize() != b.GetDataSize())
+		return false;
+	return memcmp(a.GetData(), b.GetData(), a.GetDataSize()) == 0;
+}
+
+Texture2D AssetCache::addTexture(const string &key, const string &path, const Image &img, unsigned long long hash)
+{
+	// missing files get a texture that is not loaded, as without the cache
+	if (!img) return Texture2D();
+
+	if (!hash) hash = HashImage(img);
+	pair<TextureMap::iterator, TextureMap::iterator> range = textures.equal_range(hash);
+	for (TextureMap::iterator t = range.first; t != range.second; ++t)
+	{
+		// the hash only says where to look; the bytes decide
+		Image other;
+		if (!MaterialLoader::ReadTextureImage(t->second.file, other) || !sameImage(img, other))
+			continue;
+
+		stats.numContentHits++;
+		stats.savedBytes += t->second.bytes;
+		paths[key] = t;
+		return t->second.texture;
+	}
+
+	TextureStreamer *streamer = rc->IsTextureStreamingEnabled() ? &rc->textureStreamer : NULL;
+	TextureEntry e = { MaterialLoader::MakeTexture(img, streamer), img.GetDataSize(), path };
+	TextureMap::iterator t = textures.insert(make_pair(hash, e));
+	paths[key] = t;
+
+	stats.numTextures++;
+	stats.cachedBytes += e.bytes;
+	return e.texture;
+}
+
+Dictionary<Material> *AssetCache::FindMaterialLib(const string &path)
+{
+	map<string, string>::iterator i = materialLibs.find(CanonicalPath(path));
+	if (i == materialLibs.end()) return NULL;
+
+	Dictionary<Material> *lib = rc->materials.GetLib(i->second.c_str());
+	if (lib) stats.numLibHits++;
+	else materialLibs.erase(i); // removed from the context since
+	return lib;
+}
+
+Dictionary<Material> &AssetCache::AddMaterialLib(const string &path, const string &name, const Dictionary<Material> &lib)
+{
+	string key = CanonicalPath(path);
+	string libName = rc->materials.GetLib(name.c_str()) ? key : name;
+	materialLibs[key] = libName;
+	return rc->materials.AddLib(libName.c_str(), lib);
+}
+
+int AssetCache::Trim()
+{
+	// paths go first, while the entries they point to still exist
+	map<string, TextureMap::iterator>::iterator p = paths.begin();
+	while (p != paths.end()) {
+		if (!isUsed(p->second->second))
+			paths.erase(p++);
+		else ++p;
+	}
+
+	int numRemoved = 0;
+	TextureMap::iterator t = textures.begin();
+	while (t != textures.end())
+	{
+		if (isUsed(t->second)) {
+			++t;
+			continue;
+		}
+
+		stats.numTextures--;
+		stats.cachedBytes -= t->second.bytes;
+		textures.erase(t++);
+		numRemoved++;
+	}
+	return numRemoved;
+}
+
+bool AssetCache::isUsed(TextureEntry &e)
+{
+	// the texture streamer keeps a reference of its own
+	int owners = rc->textureStreamer.IsStreamed(e.texture) ? 2 : 1;
+	return e.texture.GetRefCount() > owners;
+}
+
+void AssetCache::Clear()
+{
+	paths.clear();
+	textures.clear();
+	materialLibs.clear();
+	stats.numTextures = 0;
+	stats.cachedBytes = 0;
+}
\ No newline at end of file
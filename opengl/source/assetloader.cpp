@@ -0,0 +1,254 @@
+#include <algorithm>
+#include "assetloader.h"
+#include "modelloader.h"
+#include "model.h"
+#include "stringhelp.h"
+
+struct AssetLoader::Job
+{
+	AssetHandle handle;
+	shared_traits<AssetHandle> *state; // what the workers update
+	string filename;
+	string dir;
+	Model *model;
+	int numLods;
+	bool failed;
+
+	ModelData data;
+	vector<string> imageNames;
+	vector<Image> images;
+	vector<unsigned long long> hashes; // for the asset cache
+	int imagesLeft; // guarded by the loader's lock
+};
+
+static long long getTicks()
+{
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+static float ticksToMs(long long ticks)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (float)(ticks * 1000.0 / freq.QuadPart);
+}
+
+static void addImageName(vector<string> &names, const string &name)
+{
+	if (name.empty()) return;
+	for (int i = 0, n = names.size(); i < n; i++)
+		if (names[i] == name) return;
+	names.push_back(name);
+}
+
+AssetLoader::AssetLoader(GLRenderingContext *rc, int numThreads)
+	: rc(rc), quit(false), callback(NULL), callbackContext(NULL), uploadTime(0.0f)
+{
+	if (numThreads <= 0)
+		numThreads = max((int)thread::hardware_concurrency() - 1, 1);
+	for (int i = 0; i < numThreads; i++)
+		workers.push_back(thread(&AssetLoader::workerMain, this));
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		unique_lock<mutex> l(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (int i = 0, n = workers.size(); i < n; i++)
+		workers[i].join();
+
+	for (int i = 0, n = jobs.size(); i < n; i++)
+		delete jobs[i];
+}
+
+AssetHandle AssetLoader::LoadModel(const char *filename, Model *model, int numLods)
+{
+	Job *job = new Job;
+	job->state = job->handle.ptr.Get();
+	job->state->name = filename;
+	job->filename = filename;
+	job->model = model;
+	job->numLods = numLods;
+	job->failed = false;
+	job->imagesLeft = 0;
+
+	char dir[MAX_PATH] = "";
+	GetCurrentDirectory(MAX_PATH, dir);
+	job->dir = dir;
+
+	jobs.push_back(job);
+	{
+		unique_lock<mutex> l(lock);
+		WorkItem task = { job, -1 };
+		tasks.push_back(task);
+	}
+	wake.notify_one();
+	return job->handle;
+}
+
+void AssetLoader::workerMain()
+{
+	for (;;)
+	{
+		WorkItem task;
+		{
+			unique_lock<mutex> l(lock);
+			while (!quit && tasks.empty())
+				wake.wait(l);
+			if (quit) return;
+			task = tasks.front();
+			tasks.pop_front();
+		}
+
+		if (task.image < 0)
+			readModel(task.job);
+		else decodeImage(task.job, task.image);
+	}
+}
+
+void AssetLoader::readModel(Job *job)
+{
+	ModelLoader loader(rc);
+	loader.SetLodCount(job->numLods);
+	loader.SetBasePath(job->dir);
+
+	string path = strhlp::joinPath(job->dir, job->filename);
+	string ext = strhlp::toLowerCase(path.substr(path.size() > 4 ? path.size() - 4 : 0));
+	bool ok = ext == ".obj" ?
+		loader.ReadObj(path.c_str(), job->data) :
+		loader.ReadRaw(path.c_str(), job->data);
+
+	if (ok)
+	{
+		for (int i = 0, n = job->data.materials.size(); i < n; i++) {
+			const MaterialDesc &m = job->data.materials[i];
+			addImageName(job->imageNames, m.diffuseMap);
+			addImageName(job->imageNames, m.normalMap);
+			addImageName(job->imageNames, m.specularMap);
+			addImageName(job->imageNames, m.specularIntensityMap);
+			addImageName(job->imageNames, m.opacityMask);
+		}
+	}
+	else job->failed = true;
+
+	// reading, decoding and uploading every texture, creating the meshes
+	int numImages = job->imageNames.size();
+	job->images.resize(numImages);
+	job->hashes.resize(numImages);
+	job->state->numSteps = 2 + numImages*2;
+	job->state->stepsDone++;
+
+	{
+		unique_lock<mutex> l(lock);
+		job->imagesLeft = numImages;
+		for (int i = 0; i < numImages; i++) {
+			WorkItem task = { job, i };
+			tasks.push_back(task);
+		}
+		if (numImages == 0) {
+			WorkItem item = { job, -1 };
+			uploads.push_back(item);
+		}
+	}
+	if (numImages == 0)
+		uploadReady.notify_all();
+	else wake.notify_all();
+}
+
+void AssetLoader::decodeImage(Job *job, int image)
+{
+	string path = strhlp::joinPath(job->dir, job->imageNames[image]);
+	if (MaterialLoader::ReadTextureImage(path, job->images[image]))
+		job->hashes[image] = AssetCache::HashImage(job->images[image]);
+	job->state->stepsDone++;
+
+	{
+		// the model is queued after the last of its textures
+		unique_lock<mutex> l(lock);
+		WorkItem item = { job, image };
+		uploads.push_back(item);
+		if (--job->imagesLeft == 0) {
+			item.image = -1;
+			uploads.push_back(item);
+		}
+	}
+	uploadReady.notify_all();
+}
+
+void AssetLoader::upload(const WorkItem &item)
+{
+	Job *job = item.job;
+	shared_traits<AssetHandle> *state = job->state;
+
+	if (item.image >= 0)
+	{
+		string path = strhlp::joinPath(job->dir, job->imageNames[item.image]);
+		rc->assetCache.AddTexture(path, job->images[item.image], job->hashes[item.image]);
+		job->images[item.image] = Image();
+		state->stepsDone++;
+		if (callback) callback(callbackContext, job->handle);
+		return;
+	}
+
+	if (!job->failed)
+	{
+		ModelLoader loader(rc);
+		loader.SetBasePath(job->dir);
+		loader.CreateMeshes(job->data, state->meshes);
+		if (job->model) job->model->meshes = state->meshes;
+		state->state = AS_READY;
+	}
+	else state->state = AS_FAILED;
+	state->stepsDone = (int)state->numSteps;
+
+	jobs.erase(find(jobs.begin(), jobs.end(), job));
+	if (callback) {
+		if (state->state == AS_READY) state->data = &job->data;
+		callback(callbackContext, job->handle);
+		state->data = NULL;
+	}
+	delete job;
+}
+
+int AssetLoader::ProcessUploads(float budget)
+{
+	long long start = getTicks();
+	int numUploads = 0;
+
+	for (;;)
+	{
+		WorkItem item;
+		{
+			unique_lock<mutex> l(lock);
+			if (uploads.empty()) break;
+			item = uploads.front();
+			uploads.pop_front();
+		}
+
+		upload(item);
+		numUploads++;
+		if (budget > 0.0f && ticksToMs(getTicks() - start) >= budget)
+			break;
+	}
+
+	uploadTime = ticksToMs(getTicks() - start);
+	return numUploads;
+}
+
+void AssetLoader::Finish()
+{
+	while (!jobs.empty())
+	{
+		{
+			unique_lock<mutex> l(lock);
+			while (uploads.empty())
+				uploadReady.wait(l);
+		}
+		ProcessUploads(0.0f);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include "cascadedshadowmap.h"
+#include "glcontext.h"
+#include "transform.h"
+#include "model.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+static long long getTicks()
+{
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+static float ticksToMs(long long ticks)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (float)(ticks * 1000.0 / freq.QuadPart);
+}
+
+CascadedShadowMap::CascadedShadowMap(GLRenderingContext *rc, int resolution, int numCascades)
+	: rc(rc), resolution(resolution), light(0), depth(GL_TEXTURE_2D_ARRAY, GL_TEXTURE12)
+{
+	this->numCascades = max(1, min(numCascades, CSM_MAX_CASCADES));
+	maxDistance = 400.0f;
+	splitLambda = 0.75f;
+	biasFactor = 2.0f;
+	biasUnits = 4.0f;
+	memset(&stats, 0, sizeof(stats));
+
+	depth.Bind();
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution,
+		this->numCascades, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	depth.SetFilters(GL_LINEAR, GL_LINEAR);
+	depth.SetWrapMode(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	fb.AttachTextureLayer(GL_DEPTH_ATTACHMENT, depth, 0);
+	fb.Bind();
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	fb.Unbind();
+}
+
+void CascadedShadowMap::Update(const Matrix44f &view)
+{
+	long long start = getTicks();
+	stats.numCascades = 0;
+	if (light < 0 || light >= (int)rc->lights.size()) return;
+
+	const float *p = rc->GetProjectionRef().data;
+	float zNear = p[14] / (p[10] - 1.0f);
+	float zFar = p[14] / (p[10] + 1.0f);
+	float dist = min(zFar, maxDistance);
+
+	// the light looks along its direction from the origin; only its
+	// rotation matters, so texel snapping happens in a fixed space
+	const Vector4f &pos = rc->lights[light].position;
+	Vector3f toLight(pos.x, pos.y, pos.z);
+	toLight.Normalize();
+	Vector3f up = fabs(toLight.y) > 0.99f ? Vector3f(1.0f, 0.0f, 0.0f) : Vector3f(0.0f, 1.0f, 0.0f);
+	Matrix44f lightView = LookAt(Vector3f(0.0f), -toLight, up);
+	Matrix44f invView = view.GetInverse();
+
+	// view space to [0, 1] of the shadow map
+	Matrix44f bias(0.5f);
+	bias.data[15] = 1.0f;
+	bias.translate = Vector3f(0.5f);
+
+	float splitNear = zNear;
+	for (int i = 0; i < numCascades; i++)
+	{
+		// between even and logarithmic splits, the latter keeping texels
+		// per screen pixel about the same at every distance
+		float t = (i + 1) / (float)numCascades;
+		float logSplit = zNear * pow(dist / zNear, t);
+		float evenSplit = zNear + (dist - zNear) * t;
+
+		ShadowCascade &c = cascades[i];
+		c.splitNear = splitNear;
+		c.splitFar = splitLambda * logSplit + (1.0f - splitLambda) * evenSplit;
+		splitNear = c.splitFar;
+
+		fitCascade(c, invView, lightView);
+		shadowMatrices[i] = bias * c.projection * c.view * invView;
+	}
+
+	stats.numCascades = numCascades;
+	stats.fitTime = ticksToMs(getTicks() - start);
+}
+
+void CascadedShadowMap::fitCascade(ShadowCascade &c, const Matrix44f &invView, const Matrix44f &lightView)
+{
+	const float *p = rc->GetProjectionRef().data;
+
+	// corners of the slice in view space; their bounding sphere is the
+	// same however the camera is turned
+	Vector3f corners[8];
+	Vector3f center(0.0f);
+	for (int k = 0; k < 8; k++) {
+		float d = k & 4 ? c.splitFar : c.splitNear;
+		float nx = k & 1 ? 1.0f : -1.0f;
+		float ny = k & 2 ? 1.0f : -1.0f;
+		corners[k] = Vector3f(d * (nx + p[8]) / p[0], d * (ny + p[9]) / p[5], -d);
+		center += corners[k];
+	}
+	center *= 1.0f / 8.0f;
+
+	float radius = 0.0f;
+	for (int k = 0; k < 8; k++)
+		radius = max(radius, (corners[k] - center).Length());
+	radius = ceil(radius * 16.0f) / 16.0f;
+
+	// moving the frustum by whole texels only keeps shadow edges from crawling
+	Vector4f l = Vector4f(center.x, center.y, center.z) * invView * lightView;
+	float texel = 2.0f * radius / resolution;
+	float x = floor(l.x / texel) * texel;
+	float y = floor(l.y / texel) * texel;
+
+	c.view = lightView;
+	c.projection = Ortho(x - radius, x + radius, y - radius, y + radius, -l.z - radius, -l.z + radius);
+	c.radius = radius;
+}
+
+void CascadedShadowMap::Render(ProgramObject &prog, Model *const *models, int numModels)
+{
+	long long start = getTicks();
+	if (stats.numCascades == 0) return;
+
+	GLint bound = 0, viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	bool frustumCulling = rc->IsFrustumCullingEnabled();
+	bool occlusionCulling = rc->IsOcclusionCullingEnabled();
+	rc->EnableFrustumCulling(true);
+	rc->EnableOcclusionCulling(false);
+	rc->EnableDepthOnly(true);
+
+	// casters in front of the near plane are flattened onto it
+	glEnable(GL_DEPTH_CLAMP);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(biasFactor, biasUnits);
+	glViewport(0, 0, resolution, resolution);
+
+	rc->PushProjection();
+	rc->PushModelView();
+	for (int i = 0; i < numCascades; i++)
+	{
+		const ShadowCascade &c = cascades[i];
+		fb.AttachTextureLayer(GL_DEPTH_ATTACHMENT, depth, i);
+		fb.Bind();
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		rc->SetProjection(c.projection);
+		rc->SetModelView(c.view);
+		rc->frustumCuller.SetLightView(c.view);
+
+		stats.numCasters[i] = 0;
+		for (int m = 0; m < numModels; m++) {
+			Nullable<ProgramObject> shader = models[m]->shader;
+			models[m]->shader = prog;
+			stats.numCasters[i] += models[m]->Draw();
+			models[m]->shader = shader;
+		}
+	}
+	rc->frustumCuller.ResetViewMatrix();
+	rc->PopModelView();
+	rc->PopProjection();
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glDisable(GL_DEPTH_CLAMP);
+	glBindFramebuffer(GL_FRAMEBUFFER, bound);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	rc->EnableDepthOnly(false);
+	rc->EnableOcclusionCulling(occlusionCulling);
+	rc->EnableFrustumCulling(frustumCulling);
+	stats.renderTime = ticksToMs(getTicks() - start);
+}
+
+void CascadedShadowMap::Bind(ProgramObject &prog)
+{
+	float splits[CSM_MAX_CASCADES] = { };
+	for (int i = 0; i < numCascades; i++)
+		splits[i] = cascades[i].splitFar;
+
+	// LightCuller puts global lights first in the order of the context's
+	// lights, which is where lights.glsl finds them
+	int index = -1;
+	if (light >= 0 && light < (int)rc->lights.size()) {
+		index = 0;
+		for (int i = 0; i < light; i++) {
+			const Light &l = rc->lights[i];
+			if (l.position.w == 0.0f || l.radius <= 0.0f) index++;
+		}
+	}
+
+	depth.Bind();
+	prog.Uniform("ShadowMap", 12);
+	prog.UniformMatrix("ShadowMatrix", numCascades, false, shadowMatrices[0].data);
+	prog.Uniform("ShadowSplits", splits[0], splits[1], splits[2], splits[3]);
+	prog.Uniform("ShadowTexelSize", 1.0f / resolution);
+	prog.Uniform("NumCascades", stats.numCascades);
+	prog.Uniform("ShadowLight", index);
+}
\ No newline at end of file
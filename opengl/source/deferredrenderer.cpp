@@ -0,0 +1,116 @@
+#include "deferredrenderer.h"
+#include "glcontext.h"
+
+DeferredRenderer::DeferredRenderer(GLRenderingContext *rc) :
+	rc(rc), graphProg(NULL), drawScene(NULL), sceneContext(NULL)
+{
+	const RenderTargetDesc albedoDesc = { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 1.0f };
+	const RenderTargetDesc normalDesc = { GL_RGBA16F, GL_RGBA, GL_FLOAT, 1.0f };
+	const RenderTargetDesc specularDesc = { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 1.0f };
+	const RenderTargetDesc depthDesc = { GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 1.0f };
+
+	albedo = targets.Add(albedoDesc, GL_TEXTURE8);
+	normal = targets.Add(normalDesc, GL_TEXTURE9);
+	specular = targets.Add(specularDesc, GL_TEXTURE10);
+	depth = targets.Add(depthDesc, GL_TEXTURE11);
+
+	gbuffer.AttachTexture(GL_COLOR_ATTACHMENT0, *albedo);
+	gbuffer.AttachTexture(GL_COLOR_ATTACHMENT1, *normal);
+	gbuffer.AttachTexture(GL_COLOR_ATTACHMENT2, *specular);
+	gbuffer.AttachTexture(GL_DEPTH_ATTACHMENT, *depth);
+
+	const GLenum buffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	gbuffer.Bind();
+	glDrawBuffers(3, buffers);
+	gbuffer.Unbind();
+}
+
+void DeferredRenderer::Resize(int width, int height) {
+	targets.Resize(width, height);
+}
+
+void DeferredRenderer::BeginGeometryPass()
+{
+	gbuffer.Bind();
+	glViewport(0, 0, targets.GetWidth(), targets.GetHeight());
+	// pixels are only read back where something was drawn, which depth tells
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::EndGeometryPass() {
+	gbuffer.Unbind();
+}
+
+void DeferredRenderer::LightingPass(ProgramObject &prog) {
+	drawLighting(prog, *albedo, *normal, *specular, *depth);
+}
+
+void DeferredRenderer::drawLighting(ProgramObject &prog, Texture2D albedo, Texture2D normal,
+	Texture2D specular, Texture2D depth)
+{
+	albedo.SetTextureUnit(GL_TEXTURE8);
+	normal.SetTextureUnit(GL_TEXTURE9);
+	specular.SetTextureUnit(GL_TEXTURE10);
+	depth.SetTextureUnit(GL_TEXTURE11);
+	albedo.Bind();
+	normal.Bind();
+	specular.Bind();
+	depth.Bind();
+
+	const float *p = rc->GetProjectionRef().data;
+	prog.Uniform("GAlbedo", 8);
+	prog.Uniform("GNormal", 9);
+	prog.Uniform("GSpecular", 10);
+	prog.Uniform("GDepth", 11);
+	prog.Uniform("ProjectionParams", p[0], p[5], p[8], p[9]);
+	prog.Uniform("DepthParams", p[10], p[14]);
+
+	// the triangle passes everywhere and puts the depth of the scene back
+	glDepthFunc(GL_ALWAYS);
+	vao.Bind();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	vao.Unbind();
+	glDepthFunc(GL_LESS);
+}
+
+void DeferredRenderer::AddPasses(FrameGraph &graph, int width, int height, ProgramObject &prog,
+	FrameGraphExecute drawScene, void *context, int target)
+{
+	const FrameGraphTextureDesc descs[4] = {
+		{ width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE },
+		{ width, height, GL_RGBA16F, GL_RGBA, GL_FLOAT },
+		{ width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE },
+		{ width, height, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT }
+	};
+	const char *names[4] = { "GAlbedo", "GNormal", "GSpecular", "GDepth" };
+
+	graphProg = &prog;
+	this->drawScene = drawScene;
+	sceneContext = context;
+
+	int geometry = graph.AddPass("geometry", geometryTask, this);
+	int lighting = graph.AddPass("lighting", lightingTask, this);
+	for (int i = 0; i < 4; i++) {
+		graphTextures[i] = graph.CreateTexture(names[i], descs[i]);
+		graph.Write(geometry, graphTextures[i]);
+		graph.Read(lighting, graphTextures[i]);
+	}
+	if (target != -1) graph.Write(lighting, target);
+	else graph.SetSideEffect(lighting);
+}
+
+void DeferredRenderer::geometryTask(void *context, FrameGraph &graph, int pass)
+{
+	DeferredRenderer *self = (DeferredRenderer *)context;
+	// the textures may have held other targets earlier in the frame
+	glClear(GL_DEPTH_BUFFER_BIT);
+	if (self->drawScene) self->drawScene(self->sceneContext, graph, pass);
+}
+
+void DeferredRenderer::lightingTask(void *context, FrameGraph &graph, int pass)
+{
+	DeferredRenderer *self = (DeferredRenderer *)context;
+	const int *t = self->graphTextures;
+	self->drawLighting(*self->graphProg, graph.GetTexture(t[0]), graph.GetTexture(t[1]),
+		graph.GetTexture(t[2]), graph.GetTexture(t[3]));
+}
\ No newline at end of file
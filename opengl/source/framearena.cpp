@@ -0,0 +1,77 @@
+#include "framearena.h"
+
+FrameArena::FrameArena(int initialSize)
+{
+	blockSize = initialSize;
+	block = new BYTE[blockSize];
+	offset = 0;
+	bytesUsed = 0;
+	numAllocs = 0;
+	peakBytes = 0;
+	neededBytes = 0;
+	overflowBytes = 0;
+	ZeroMemory(&lastFrame, sizeof(lastFrame));
+	lastFrame.capacity = blockSize;
+}
+
+FrameArena::~FrameArena()
+{
+	for (int i = 0, n = overflow.size(); i < n; i++)
+		delete [] overflow[i];
+	delete [] block;
+}
+
+void *FrameArena::Alloc(int size, int alignment)
+{
+	int aligned = (offset + alignment - 1) & ~(alignment - 1);
+	bytesUsed += size;
+	numAllocs++;
+
+	if (aligned + size <= blockSize) {
+		offset = aligned + size;
+		if (offset > neededBytes) neededBytes = offset;
+		return block + aligned;
+	}
+
+	// over-allocated by the alignment, which the block would have padded as well
+	BYTE *p = new BYTE[size + alignment - 1];
+	overflow.push_back(p);
+	overflowBytes += size + alignment - 1;
+	return (BYTE *)(((size_t)p + alignment - 1) & ~(size_t)(alignment - 1));
+}
+
+void FrameArena::Rewind(int marker)
+{
+	if (marker < offset) offset = marker;
+}
+
+void FrameArena::Reset()
+{
+	if (bytesUsed > peakBytes) peakBytes = bytesUsed;
+
+	lastFrame.bytesUsed = bytesUsed;
+	lastFrame.peakBytes = peakBytes;
+	lastFrame.numAllocs = numAllocs;
+	lastFrame.numOverflows = overflow.size();
+
+	if (!overflow.empty())
+	{
+		for (int i = 0, n = overflow.size(); i < n; i++)
+			delete [] overflow[i];
+		overflow.clear();
+
+		// what the frame took in the block with padding, rewound scopes
+		// included, and what did not fit
+		int needed = neededBytes + overflowBytes;
+		while (blockSize < needed) blockSize *= 2;
+		delete [] block;
+		block = new BYTE[blockSize];
+	}
+
+	lastFrame.capacity = blockSize;
+	offset = 0;
+	bytesUsed = 0;
+	numAllocs = 0;
+	neededBytes = 0;
+	overflowBytes = 0;
+}
\ No newline at end of file
@@ -27,6 +27,17 @@ void Framebuffer::AttachTexture(GLenum attachment, const BaseTexture &texture, G
 	glBindFramebuffer(GL_READ_FRAMEBUFFER, bind_read);
 }
 
+void Framebuffer::AttachTextureLayer(GLenum attachment, const BaseTexture &texture, GLint layer, GLint level)
+{
+	GLint bind_draw = 0, bind_read = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bind_draw);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &bind_read);
+	Bind();
+	glFramebufferTextureLayer(target, attachment, texture.GetId(), level, layer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bind_draw);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, bind_read);
+}
+
 void Framebuffer::AttachRenderbuffer(GLenum attachment, const Renderbuffer &rb)
 {
 	GLint bind_draw = 0, bind_read = 0;
@@ -0,0 +1,363 @@
+#include "framegraph.h"
+#include "glformat.h"
+#include <algorithm>
+#include <string.h>
+
+static size_t textureBytes(const FrameGraphTextureDesc &d) {
+	return (size_t)d.width * d.height * GetPixelSize(d.internalFormat);
+}
+
+FrameGraph::FrameGraph(const FrameGraphGL &gl) : compiled(false), gl(gl) {
+	memset(&stats, 0, sizeof(stats));
+}
+
+FrameGraph::~FrameGraph() {
+	ReleaseTextures();
+}
+
+int FrameGraph::AddPass(const char *name, FrameGraphExecute execute, void *context)
+{
+	Pass p;
+	p.name = name;
+	p.execute = execute;
+	p.context = context;
+	p.sideEffect = false;
+	p.live = false;
+	passes.push_back(p);
+	compiled = false;
+	return passes.size() - 1;
+}
+
+void FrameGraph::SetSideEffect(int pass) {
+	passes[pass].sideEffect = true;
+}
+
+int FrameGraph::CreateTexture(const char *name, const FrameGraphTextureDesc &desc)
+{
+	Resource r;
+	r.name = name;
+	r.desc = desc;
+	r.imported = 0;
+	r.first = r.last = -1;
+	r.slot = -1;
+	resources.push_back(r);
+	return resources.size() - 1;
+}
+
+void FrameGraph::Read(int pass, int resource) {
+	passes[pass].reads.push_back(resource);
+	compiled = false;
+}
+
+void FrameGraph::Write(int pass, int resource) {
+	passes[pass].writes.push_back(resource);
+	compiled = false;
+}
+
+void FrameGraph::Reset()
+{
+	passes.clear();
+	resources.clear();
+	order.clear();
+	slots.clear();
+	compiled = false;
+	memset(&stats, 0, sizeof(stats));
+}
+
+bool FrameGraph::Compile()
+{
+	int numPasses = passes.size();
+	int numResources = resources.size();
+	vector<vector<int> > writers(numResources);
+
+	for (int i = 0; i < numPasses; i++) {
+		Pass &p = passes[i];
+		p.live = p.sideEffect;
+		for (int j = 0, n = p.writes.size(); j < n; j++) {
+			writers[p.writes[j]].push_back(i);
+			if (resources[p.writes[j]].imported) p.live = true;
+		}
+	}
+
+	// everything that writes what a live pass reads is live as well
+	vector<int> stack;
+	for (int i = 0; i < numPasses; i++)
+		if (passes[i].live) stack.push_back(i);
+	while (!stack.empty()) {
+		const Pass &p = passes[stack.back()];
+		stack.pop_back();
+		for (int j = 0, n = p.reads.size(); j < n; j++) {
+			const vector<int> &w = writers[p.reads[j]];
+			for (int k = 0, m = w.size(); k < m; k++) {
+				if (!passes[w[k]].live) {
+					passes[w[k]].live = true;
+					stack.push_back(w[k]);
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < numResources; i++) {
+		resources[i].first = resources[i].last = -1;
+		resources[i].slot = -1;
+	}
+
+	if (!sortPasses()) {
+		order.clear();
+		compiled = false;
+		return false;
+	}
+
+	for (int pos = 0, n = order.size(); pos < n; pos++) {
+		const Pass &p = passes[order[pos]];
+		for (int k = 0; k < 2; k++) {
+			const vector<int> &used = k == 0 ? p.reads : p.writes;
+			for (int j = 0, m = used.size(); j < m; j++) {
+				Resource &r = resources[used[j]];
+				if (r.first == -1) r.first = pos;
+				r.last = pos;
+			}
+		}
+	}
+
+	assignSlots();
+
+	stats.numPasses = numPasses;
+	stats.numCulledPasses = numPasses - order.size();
+	stats.numTextures = 0;
+	stats.numAllocated = slots.size();
+	stats.naiveBytes = stats.transientBytes = 0;
+	for (int i = 0; i < numResources; i++) {
+		const Resource &r = resources[i];
+		if (!r.imported && r.first != -1) {
+			stats.numTextures++;
+			stats.naiveBytes += textureBytes(r.desc);
+		}
+	}
+	for (int i = 0, n = slots.size(); i < n; i++)
+		stats.transientBytes += textureBytes(slots[i].desc);
+
+	compiled = true;
+	return true;
+}
+
+bool FrameGraph::sortPasses()
+{
+	int numPasses = passes.size();
+	vector<vector<int> > edges(numPasses);
+	vector<int> inDegree(numPasses, 0);
+
+	for (int r = 0, numResources = resources.size(); r < numResources; r++)
+	{
+		vector<int> w, rd;
+		for (int i = 0; i < numPasses; i++) {
+			const Pass &p = passes[i];
+			if (!p.live) continue;
+			if (find(p.writes.begin(), p.writes.end(), r) != p.writes.end()) w.push_back(i);
+			else if (find(p.reads.begin(), p.reads.end(), r) != p.reads.end()) rd.push_back(i);
+		}
+
+		// writers keep the order they were added in, readers wait for all of
+		// them; a pass that also reads what it writes sees the earlier writes
+		for (int i = 1, n = w.size(); i < n; i++) {
+			edges[w[i - 1]].push_back(w[i]);
+			inDegree[w[i]]++;
+		}
+		for (int i = 0, n = rd.size(); i < n; i++) {
+			for (int j = 0, m = w.size(); j < m; j++) {
+				edges[w[j]].push_back(rd[i]);
+				inDegree[rd[i]]++;
+			}
+		}
+	}
+
+	// of the passes that are ready the one added first goes next, so the
+	// order only changes where dependencies demand it
+	order.clear();
+	vector<bool> done(numPasses, false);
+	int numLive = 0;
+	for (int i = 0; i < numPasses; i++)
+		if (passes[i].live) numLive++;
+
+	while ((int)order.size() < numLive)
+	{
+		int next = -1;
+		for (int i = 0; i < numPasses; i++) {
+			if (passes[i].live && !done[i] && inDegree[i] == 0) {
+				next = i;
+				break;
+			}
+		}
+		if (next == -1) return false;
+
+		done[next] = true;
+		order.push_back(next);
+		for (int j = 0, n = edges[next].size(); j < n; j++)
+			inDegree[edges[next][j]]--;
+	}
+	return true;
+}
+
+void FrameGraph::assignSlots()
+{
+	slots.clear();
+
+	// first come first served: a resource takes the first slot of its
+	// description whose last user ran before its first one
+	for (int pos = 0, n = order.size(); pos < n; pos++)
+	{
+		const Pass &p = passes[order[pos]];
+		for (int k = 0; k < 2; k++) {
+			const vector<int> &used = k == 0 ? p.reads : p.writes;
+			for (int j = 0, m = used.size(); j < m; j++)
+			{
+				Resource &r = resources[used[j]];
+				if (r.imported || r.first != pos || r.slot != -1) continue;
+
+				for (int s = 0, numSlots = slots.size(); s < numSlots; s++) {
+					if (slots[s].last < r.first && slots[s].desc == r.desc) {
+						r.slot = s;
+						break;
+					}
+				}
+				if (r.slot == -1) {
+					Slot s = { r.desc, -1, 0 };
+					slots.push_back(s);
+					r.slot = slots.size() - 1;
+				}
+				slots[r.slot].last = r.last;
+			}
+		}
+	}
+}
+
+bool FrameGraph::isDepthFormat(GLint internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_DEPTH_COMPONENT: case GL_DEPTH_COMPONENT16: case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32: case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH_STENCIL: case GL_DEPTH24_STENCIL8: case GL_DEPTH32F_STENCIL8:
+		return true;
+	}
+	return false;
+}
+
+void FrameGraph::allocate()
+{
+	for (int i = 0, n = pool.size(); i < n; i++)
+		pool[i].used = false;
+
+	for (int s = 0, numSlots = slots.size(); s < numSlots; s++)
+	{
+		Slot &slot = slots[s];
+		slot.texture = 0;
+		for (int i = 0, n = pool.size(); i < n; i++) {
+			if (!pool[i].used && pool[i].desc == slot.desc) {
+				pool[i].used = true;
+				slot.texture = pool[i].texture;
+				break;
+			}
+		}
+		if (slot.texture) continue;
+
+		PooledTexture t = { slot.desc, gl.createTexture(slot.desc), true };
+		pool.push_back(t);
+		slot.texture = t.texture;
+	}
+}
+
+void FrameGraph::releaseUnused()
+{
+	bool released = false;
+	for (int i = 0; i < (int)pool.size(); ) {
+		if (pool[i].used) { i++; continue; }
+		gl.deleteTexture(pool[i].texture);
+		pool.erase(pool.begin() + i);
+		released = true;
+	}
+	// names of deleted textures may come back, so framebuffers go with them
+	if (released) clearFramebuffers();
+}
+
+void FrameGraph::ReleaseTextures()
+{
+	for (int i = 0, n = pool.size(); i < n; i++)
+		gl.deleteTexture(pool[i].texture);
+	pool.clear();
+	for (int s = 0, n = slots.size(); s < n; s++)
+		slots[s].texture = 0;
+	clearFramebuffers();
+}
+
+void FrameGraph::clearFramebuffers()
+{
+	map<vector<GLuint>, GLuint>::iterator it;
+	for (it = framebuffers.begin(); it != framebuffers.end(); ++it)
+		gl.deleteFramebuffer(it->second);
+	framebuffers.clear();
+}
+
+GLuint FrameGraph::GetTextureId(int resource) const
+{
+	const Resource &r = resources[resource];
+	return r.imported ? r.imported : slots[r.slot].texture;
+}
+
+GLuint FrameGraph::getFramebuffer(const Pass &p)
+{
+	vector<GLuint> key;
+	for (int j = 0, n = p.writes.size(); j < n; j++)
+		key.push_back(GetTextureId(p.writes[j]));
+
+	map<vector<GLuint>, GLuint>::iterator it = framebuffers.find(key);
+	if (it != framebuffers.end()) return it->second;
+
+	vector<GLenum> attachments;
+	int numColors = 0;
+	for (int j = 0, n = p.writes.size(); j < n; j++)
+	{
+		GLint format = resources[p.writes[j]].desc.internalFormat;
+		if (format == GL_DEPTH_STENCIL || format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8)
+			attachments.push_back(GL_DEPTH_STENCIL_ATTACHMENT);
+		else if (isDepthFormat(format))
+			attachments.push_back(GL_DEPTH_ATTACHMENT);
+		else
+			attachments.push_back(GL_COLOR_ATTACHMENT0 + numColors++);
+	}
+
+	GLuint fb = gl.createFramebuffer(&key[0], &attachments[0], key.size());
+	framebuffers[key] = fb;
+	return fb;
+}
+
+void FrameGraph::Execute()
+{
+	if (!compiled && !Compile()) return;
+
+	allocate();
+
+	GLint bound = 0, viewport[4];
+	gl.getIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+	gl.getIntegerv(GL_VIEWPORT, viewport);
+
+	for (int pos = 0, n = order.size(); pos < n; pos++)
+	{
+		Pass &p = passes[order[pos]];
+		if (p.writes.empty()) {
+			gl.bindFramebuffer(bound);
+			gl.viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		}
+		else {
+			gl.bindFramebuffer(getFramebuffer(p));
+			const FrameGraphTextureDesc &d = resources[p.writes[0]].desc;
+			gl.viewport(0, 0, d.width, d.height);
+		}
+		if (p.execute) p.execute(p.context, *this, order[pos]);
+	}
+
+	gl.bindFramebuffer(bound);
+	gl.viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	releaseUnused();
+}
\ No newline at end of file
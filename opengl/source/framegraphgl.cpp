@@ -0,0 +1,74 @@
+#include "framegraph.h"
+#include "texture.h"
+
+// the parts of the graph that call GL or know Texture2D
+
+static GLuint createTexture(const FrameGraphTextureDesc &d)
+{
+	GLuint id = 0;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, d.internalFormat, d.width, d.height, 0, d.format, d.type, NULL);
+	return id;
+}
+
+static void deleteTexture(GLuint texture) {
+	glDeleteTextures(1, &texture);
+}
+
+static GLuint createFramebuffer(const GLuint *textures, const GLenum *attachments, int count)
+{
+	GLint bound = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+
+	GLuint fb = 0;
+	glGenFramebuffers(1, &fb);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fb);
+	vector<GLenum> buffers;
+	for (int i = 0; i < count; i++) {
+		glFramebufferTexture(GL_DRAW_FRAMEBUFFER, attachments[i], textures[i], 0);
+		if (attachments[i] >= GL_COLOR_ATTACHMENT0 && attachments[i] <= GL_COLOR_ATTACHMENT15)
+			buffers.push_back(attachments[i]);
+	}
+	if (buffers.empty()) glDrawBuffer(GL_NONE);
+	else glDrawBuffers(buffers.size(), &buffers[0]);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bound);
+	return fb;
+}
+
+static void deleteFramebuffer(GLuint framebuffer) {
+	glDeleteFramebuffers(1, &framebuffer);
+}
+
+static void bindFramebuffer(GLuint framebuffer) {
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+FrameGraphGL FrameGraphGL::Defaults()
+{
+	FrameGraphGL gl;
+	gl.createTexture = ::createTexture;
+	gl.deleteTexture = ::deleteTexture;
+	gl.createFramebuffer = ::createFramebuffer;
+	gl.deleteFramebuffer = ::deleteFramebuffer;
+	gl.bindFramebuffer = ::bindFramebuffer;
+	gl.viewport = glViewport;
+	gl.getIntegerv = glGetIntegerv;
+	return gl;
+}
+
+int FrameGraph::ImportTexture(const char *name, const Texture2D &texture, const FrameGraphTextureDesc &desc)
+{
+	int i = CreateTexture(name, desc);
+	resources[i].imported = texture.GetId();
+	return i;
+}
+
+Texture2D FrameGraph::GetTexture(int resource) const {
+	return Texture2D(GL_TEXTURE0, GetTextureId(resource));
+}
\ No newline at end of file
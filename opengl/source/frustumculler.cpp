@@ -1,10 +1,49 @@
 #include "frustumculler.h"
 #include "glcontext.h"
 
+void FrustumCuller::SetViewMatrix(const Matrix44f &view)
+{
+	this->view = view;
+	model = Matrix44f::Identity();
+	fWorldSpace = true;
+	fModelKnown = true;
+	fLightFrustum = false;
+	fComputePlanes = fComputeProjPlanes = true;
+}
+
+void FrustumCuller::SetLightView(const Matrix44f &view)
+{
+	SetViewMatrix(view);
+	fLightFrustum = true;
+}
+
+void FrustumCuller::ResetViewMatrix()
+{
+	fWorldSpace = false;
+	fLightFrustum = false;
+	fComputePlanes = true;
+}
+
 void FrustumCuller::ComputePlanes()
 {
-	Matrix44f mvp = rc->GetProjection() * rc->GetModelViewRef();
-	float(&m)[4][4] = mvp.m;
+	if (fWorldSpace)
+		extractPlanes(rc->GetProjectionRef() * view, planes);
+	else extractPlanes(rc->GetModelViewProjection(), planes);
+	fComputePlanes = false;
+}
+
+bool FrustumCuller::cullEyeSpace(const AABox &boundingBox)
+{
+	if (fComputeProjPlanes) {
+		extractPlanes(rc->GetProjectionRef(), projPlanes);
+		fComputeProjPlanes = false;
+	}
+	return cullBox(projPlanes, boundingBox.Transform(rc->GetModelViewRef()));
+}
+
+void FrustumCuller::extractPlanes(const Matrix44f &mvp, Plane *planes)
+{
+	const float(&m)[4][4] = mvp.m;
 
 	planes[0] = Plane(
 		m[0][0] + m[0][3],
@@ -47,6 +86,4 @@ void FrustumCuller::ComputePlanes()
 		m[2][3] - m[2][2],
 		m[3][3] - m[3][2]);
 	planes[5].Normalize();
-
-	fComputePlanes = false;
 }
\ No newline at end of file
@@ -1,12 +1,24 @@
+#include <assert.h>
 #include "glcontext.h"
 #include "glwindow.h"
 
 GLRenderingContext::GLRenderingContext(HDC hdc,
-	const GLRenderingContextParams *params) : hrc(NULL), _hdc(hdc), frustumCuller(this)
+	const GLRenderingContextParams *params) : hrc(NULL), _hdc(hdc), frustumCuller(this), occlusionCuller(this), lightCuller(this), assetCache(this), shaderCache(this)
 {
 	curProgram = NULL;
 	mvpComputed = normComputed = false;
+	mvVersion = projVersion = lastVersion = 1;
+	mvOverflow = projOverflow = 0;
+	frameNumber = 0;
 	fFrustumCulling = true;
+	fOcclusionCulling = false;
+	fDepthOnly = false;
+	fLodSelection = true;
+	fTextureStreaming = false;
+	fMeshCache = false;
+	fProgramBinaryCache = false;
+	lodThreshold = 0.25f;
+	threadPool = NULL;
 
 	PIXELFORMATDESCRIPTOR pfd = { };
 	if (!params->pixelFormat)
@@ -90,6 +102,8 @@ GLRenderingContext::GLRenderingContext(HDC hdc,
 
 GLRenderingContext::~GLRenderingContext()
 {
+	shaderCache.Clear();
+	lightCuller.Release();
 	if (hrc) {
 		wglMakeCurrent(_hdc, NULL);
 		wglDeleteContext(hrc);
@@ -99,6 +113,13 @@ GLRenderingContext::~GLRenderingContext()
 		i->second->Destroy();
 		delete i->second;
 	}
+	delete threadPool;
+}
+
+ThreadPool *GLRenderingContext::GetThreadPool()
+{
+	if (!threadPool) threadPool = new ThreadPool();
+	return threadPool;
 }
 
 HGLRC GLRenderingContext::createContextAttrib(HDC hdc, const GLRenderingContextParams *params)
@@ -153,31 +174,175 @@ HGLRC GLRenderingContext::createContextAttrib(HDC hdc, const GLRenderingContextP
 }
 
 
-void GLRenderingContext::set_mv(const Matrix44f &mat)
+static Matrix44f normalMatrixOf(const Matrix44f &mv)
+{
+	// modelview matrices are affine almost always: only the upper 3x3
+	// has to be inverted, and the translation does not affect normals
+	if (mv.wx == 0.0f && mv.wy == 0.0f && mv.wz == 0.0f && mv.wt == 1.0f)
+		return Matrix44f(Matrix33f(mv).GetInverse().GetTranspose());
+	return mv.GetInverse().GetTranspose();
+}
+
+const Matrix44f &GLRenderingContext::GetModelViewProjection()
+{
+	if (!mvpComputed) {
+		mvpMatrix = projection * modelview;
+		mvpComputed = true;
+	}
+	return mvpMatrix;
+}
+
+const Matrix44f &GLRenderingContext::GetNormalMatrix()
+{
+	if (!normComputed) {
+		normalMatrix = normalMatrixOf(modelview);
+		normComputed = true;
+	}
+	return normalMatrix;
+}
+
+void GLRenderingContext::set_mv()
 {
 	frustumCuller.UpdateMVP();
-	list<shared_traits<ProgramObject> *>::iterator pi;
-	for (pi = shaders.begin(); pi != shaders.end(); pi++)
-		(*pi)->fUpdateMV = true;
+	mvVersion = ++lastVersion;
 	mvpComputed = normComputed = false;
 }
 
-void GLRenderingContext::set_proj(const Matrix44f &mat)
+void GLRenderingContext::set_proj()
 {
-	frustumCuller.UpdateMVP();
-	list<shared_traits<ProgramObject> *>::iterator pi;
-	for (pi = shaders.begin(); pi != shaders.end(); pi++)
-		(*pi)->fUpdateProj = true;
+	frustumCuller.UpdateProjection();
+	projVersion = ++lastVersion;
 	mvpComputed = false;
 }
 
+void GLRenderingContext::saveState(MatrixState &s, const Matrix44f &matrix)
+{
+	s.matrix = matrix;
+	s.mvVersion = mvVersion;
+	s.projVersion = projVersion;
+	s.mvpComputed = mvpComputed;
+	s.normComputed = normComputed;
+	if (mvpComputed) s.mvpMatrix = mvpMatrix;
+	if (normComputed) s.normalMatrix = normalMatrix;
+
+	s.planesComputed = !frustumCuller.fWorldSpace && !frustumCuller.fComputePlanes;
+	if (s.planesComputed)
+		memcpy(s.planes, frustumCuller.planes, sizeof(s.planes));
+}
+
+void GLRenderingContext::restoreDerived(const MatrixState &s)
+{
+	mvpComputed = s.mvpComputed;
+	if (mvpComputed) mvpMatrix = s.mvpMatrix;
+
+	// world-space planes do not depend on the modelview
+	if (frustumCuller.fWorldSpace) return;
+	frustumCuller.fComputePlanes = !s.planesComputed;
+	if (s.planesComputed)
+		memcpy(frustumCuller.planes, s.planes, sizeof(s.planes));
+}
+
+void GLRenderingContext::PushModelView()
+{
+	assert(!mvStack.IsFull());
+	if (mvStack.IsFull()) {
+		// refused; the matching pop is refused too, so the levels below stay paired
+		OutputDebugStringA("ERROR: modelview stack overflow\n");
+		mvOverflow++;
+		return;
+	}
+	MatrixState &s = mvStack.Push();
+	saveState(s, modelview);
+	s.cullModel = frustumCuller.model;
+	s.cullModelKnown = frustumCuller.fModelKnown;
+}
+
+void GLRenderingContext::PopModelView()
+{
+	if (mvOverflow != 0) {
+		mvOverflow--;
+		return;
+	}
+	if (mvStack.IsEmpty()) {
+		OutputDebugStringA("ERROR: modelview stack underflow\n");
+		return;
+	}
+
+	const MatrixState &s = mvStack.Top();
+	if (s.mvVersion != mvVersion)
+	{
+		modelview = s.matrix;
+		mvVersion = s.mvVersion;
+		normComputed = s.normComputed;
+		if (normComputed) normalMatrix = s.normalMatrix;
+
+		if (s.projVersion == projVersion)
+			restoreDerived(s);
+		else {
+			mvpComputed = false;
+			frustumCuller.UpdateMVP();
+		}
+
+		if (!curProgram) {
+			glMatrixMode(GL_MODELVIEW);
+			glLoadMatrixf(modelview.data);
+		}
+	}
+	frustumCuller.model = s.cullModel;
+	frustumCuller.fModelKnown = s.cullModelKnown;
+	mvStack.Pop();
+}
+
+void GLRenderingContext::PushProjection()
+{
+	assert(!projStack.IsFull());
+	if (projStack.IsFull()) {
+		OutputDebugStringA("ERROR: projection stack overflow\n");
+		projOverflow++;
+		return;
+	}
+	saveState(projStack.Push(), projection);
+}
+
+void GLRenderingContext::PopProjection()
+{
+	if (projOverflow != 0) {
+		projOverflow--;
+		return;
+	}
+	if (projStack.IsEmpty()) {
+		OutputDebugStringA("ERROR: projection stack underflow\n");
+		return;
+	}
+
+	const MatrixState &s = projStack.Top();
+	if (s.projVersion != projVersion)
+	{
+		projection = s.matrix;
+		projVersion = s.projVersion;
+
+		if (s.mvVersion == mvVersion && !frustumCuller.fWorldSpace)
+			restoreDerived(s);
+		else {
+			mvpComputed = s.mvVersion == mvVersion && s.mvpComputed;
+			if (mvpComputed) mvpMatrix = s.mvpMatrix;
+			frustumCuller.UpdateProjection();
+		}
+
+		if (!curProgram) {
+			glMatrixMode(GL_PROJECTION);
+			glLoadMatrixf(projection.data);
+		}
+	}
+	projStack.Pop();
+}
+
 void GLRenderingContext::SetModelView(const Matrix44f &mat)
 {
 	modelview = mat;
-	if (curProgram) {
-		set_mv(modelview);
-	}
-	else {
+	frustumCuller.replaceModel();
+	set_mv();
+	if (!curProgram) {
 		glMatrixMode(GL_MODELVIEW);
 		glLoadMatrixf(mat.data);
 	}
@@ -186,10 +351,8 @@ void GLRenderingContext::SetModelView(const Matrix44f &mat)
 void GLRenderingContext::SetProjection(const Matrix44f &mat)
 {
 	projection = mat;
-	if (curProgram) {
-		set_proj(projection);
-	}
-	else {
+	set_proj();
+	if (!curProgram) {
 		glMatrixMode(GL_PROJECTION);
 		glLoadMatrixf(mat.data);
 	}
@@ -198,10 +361,9 @@ void GLRenderingContext::SetProjection(const Matrix44f &mat)
 void GLRenderingContext::MultModelView(const Matrix44f &mat)
 {
 	modelview *= mat;
-	if (curProgram) {
-		set_mv(modelview);
-	}
-	else {
+	frustumCuller.multModel(mat);
+	set_mv();
+	if (!curProgram) {
 		glMatrixMode(GL_MODELVIEW);
 		glMultMatrixf(mat.data);
 	}
@@ -210,15 +372,19 @@ void GLRenderingContext::MultModelView(const Matrix44f &mat)
 void GLRenderingContext::MultProjection(const Matrix44f &mat)
 {
 	projection *= mat;
-	if (curProgram) {
-		set_proj(projection);
-	}
-	else {
+	set_proj();
+	if (!curProgram) {
 		glMatrixMode(GL_PROJECTION);
 		glMultMatrixf(mat.data);
 	}
 }
 
+void GLRenderingContext::EndFrame() {
+	frameNumber++;
+	frameArena.Reset();
+	if (fTextureStreaming) textureStreamer.Update();
+}
+
 void GLRenderingContext::AddModule(const char *name, GLRC_Module *module)
 {
 	map<string, GLRC_Module *>::iterator i = modules.find(name);
@@ -0,0 +1,178 @@
+#include "glyphtable.h"
+#include <algorithm>
+
+static unsigned int hashCode(unsigned int code)
+{
+	unsigned int h = code * 2654435761u;
+	return h ^ h >> 16;
+}
+
+static unsigned long long kerningPair(unsigned int first, unsigned int second) {
+	return (unsigned long long)first << 32 | second;
+}
+
+GlyphTable::GlyphTable() {
+	Clear();
+}
+
+void GlyphTable::Clear()
+{
+	glyphs.clear();
+	for (int i = 0; i < GT_LATIN_SIZE; i++)
+		latin[i] = -1;
+	codes.clear();
+	kernings.clear();
+	numCodes = numKernings = 0;
+}
+
+const Glyph *GlyphTable::findOther(unsigned int code) const
+{
+	if (codes.empty()) return NULL;
+	int mask = codes.size() - 1;
+	for (int i = hashCode(code) & mask; codes[i].glyph >= 0; i = (i + 1) & mask)
+		if (codes[i].code == code) return &glyphs[codes[i].glyph];
+	return NULL;
+}
+
+void GlyphTable::Add(unsigned int code, const Glyph &glyph)
+{
+	if (code < GT_LATIN_SIZE) {
+		if (latin[code] >= 0) glyphs[latin[code]] = glyph;
+		else {
+			latin[code] = glyphs.size();
+			glyphs.push_back(glyph);
+		}
+		return;
+	}
+
+	const Glyph *g = findOther(code);
+	if (g) {
+		glyphs[g - &glyphs[0]] = glyph;
+		return;
+	}
+
+	// half full at most
+	if ((numCodes + 1) * 2 > (int)codes.size()) growCodes();
+	int mask = codes.size() - 1;
+	int i = hashCode(code) & mask;
+	while (codes[i].glyph >= 0) i = (i + 1) & mask;
+	codes[i].code = code;
+	codes[i].glyph = glyphs.size();
+	glyphs.push_back(glyph);
+	numCodes++;
+}
+
+void GlyphTable::growCodes()
+{
+	vector<CodeSlot> old;
+	old.swap(codes);
+	CodeSlot empty = { 0, -1 };
+	codes.assign(old.empty() ? 64 : old.size() * 2, empty);
+
+	int mask = codes.size() - 1;
+	for (int j = 0, n = old.size(); j < n; j++) {
+		if (old[j].glyph < 0) continue;
+		int i = hashCode(old[j].code) & mask;
+		while (codes[i].glyph >= 0) i = (i + 1) & mask;
+		codes[i] = old[j];
+	}
+}
+
+float GlyphTable::findKerning(unsigned int first, unsigned int second) const
+{
+	unsigned long long pair = kerningPair(first, second);
+	int mask = kernings.size() - 1;
+	for (int i = hashCode(first ^ hashCode(second)) & mask; kernings[i].pair; i = (i + 1) & mask)
+		if (kernings[i].pair == pair) return kernings[i].amount;
+	return 0.0f;
+}
+
+void GlyphTable::AddKerning(unsigned int first, unsigned int second, float amount)
+{
+	unsigned long long pair = kerningPair(first, second);
+	if (!pair) return;
+
+	if ((numKernings + 1) * 2 > (int)kernings.size()) growKernings();
+	int mask = kernings.size() - 1;
+	int i = hashCode(first ^ hashCode(second)) & mask;
+	for (; kernings[i].pair; i = (i + 1) & mask) {
+		if (kernings[i].pair == pair) {
+			kernings[i].amount = amount;
+			return;
+		}
+	}
+	kernings[i].pair = pair;
+	kernings[i].amount = amount;
+	numKernings++;
+}
+
+void GlyphTable::growKernings()
+{
+	vector<KerningSlot> old;
+	old.swap(kernings);
+	KerningSlot empty = { 0, 0.0f };
+	kernings.assign(old.empty() ? 256 : old.size() * 2, empty);
+
+	int mask = kernings.size() - 1;
+	for (int j = 0, n = old.size(); j < n; j++) {
+		if (!old[j].pair) continue;
+		unsigned int first = (unsigned int)(old[j].pair >> 32);
+		unsigned int second = (unsigned int)old[j].pair;
+		int i = hashCode(first ^ hashCode(second)) & mask;
+		while (kernings[i].pair) i = (i + 1) & mask;
+		kernings[i] = old[j];
+	}
+}
+
+static bool tallerThan(const GlyphRect *a, const GlyphRect *b) {
+	return a->height > b->height || (a->height == b->height && a->width > b->width);
+}
+
+static bool packShelves(vector<GlyphRect *> &sorted, int padding, int width, int height)
+{
+	int x = padding, y = padding, shelfHeight = 0;
+	for (int i = 0, n = sorted.size(); i < n; i++)
+	{
+		GlyphRect &r = *sorted[i];
+		if (x + r.width + padding > width) {
+			x = padding;
+			y += shelfHeight + padding;
+			shelfHeight = 0;
+		}
+		if (x + r.width + padding > width || y + r.height + padding > height)
+			return false;
+
+		r.x = x;
+		r.y = y;
+		x += r.width + padding;
+		if (r.height > shelfHeight) shelfHeight = r.height;
+	}
+	return true;
+}
+
+bool PackGlyphs(vector<GlyphRect> &rects, int padding, int maxSize, int &width, int &height)
+{
+	vector<GlyphRect *> sorted(rects.size());
+	int area = 0;
+	for (int i = 0, n = rects.size(); i < n; i++) {
+		sorted[i] = &rects[i];
+		area += (rects[i].width + padding) * (rects[i].height + padding);
+	}
+	sort(sorted.begin(), sorted.end(), tallerThan);
+
+	// start from the smallest size that could hold the area, wider than tall
+	width = height = 16;
+	while (width * height < area) {
+		if (width == height) width *= 2;
+		else height *= 2;
+	}
+
+	while (width <= maxSize && height <= maxSize)
+	{
+		if (packShelves(sorted, padding, width, height))
+			return true;
+		if (width == height) width *= 2;
+		else height *= 2;
+	}
+	return false;
+}
\ No newline at end of file
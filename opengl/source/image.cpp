@@ -1,4 +1,10 @@
 #include "image.h"
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+#include <fstream>
+
+using namespace std;
 
 #pragma pack(push, 1)
 struct TGAHEADER
@@ -18,85 +24,688 @@ struct TGAHEADER
 };
 #pragma pack(pop)
 
-Image Image::Clone() const
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDPF_FOURCC 0x4
+#define DDPF_RGB 0x40
+#define DDPF_LUMINANCE 0x20000
+#define DDPF_ALPHAPIXELS 0x1
+#define DDSD_REQUIRED 0x1007 // caps, height, width, pixel format
+#define DDSD_PITCH 0x8
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+#define FOURCC(a, b, c, d) ((UINT)(a) | (UINT)(b) << 8 | (UINT)(c) << 16 | (UINT)(d) << 24)
+
+#pragma pack(push, 1)
+struct DDSPIXELFORMAT
 {
-	Image img;
-	img.isGood = isGood;
-	img.width = width;
-	img.height = height;
-	img.dataSize = dataSize;
+	UINT size;
+	UINT flags;
+	UINT fourCC;
+	UINT rgbBitCount;
+	UINT rMask, gMask, bMask, aMask;
+};
 
-	if (dataSize != 0) {
-		img.ptr->data = new BYTE[dataSize];
-		memcpy(img.ptr->data, ptr->data, dataSize);
-	}
-	return img;
-}
+struct DDSHEADER
+{
+	UINT magic;
+	UINT size;
+	UINT flags;
+	UINT height;
+	UINT width;
+	UINT pitchOrLinearSize;
+	UINT depth;
+	UINT mipMapCount;
+	UINT reserved1[11];
+	DDSPIXELFORMAT ddspf;
+	UINT caps, caps2, caps3, caps4;
+	UINT reserved2;
+};
+
+struct DDSHEADER_DX10
+{
+	UINT dxgiFormat;
+	UINT resourceDimension;
+	UINT miscFlag;
+	UINT arraySize;
+	UINT miscFlags2;
+};
+
+struct KTXHEADER
+{
+	BYTE identifier[12];
+	UINT endianness;
+	UINT glType;
+	UINT glTypeSize;
+	UINT glFormat;
+	UINT glInternalFormat;
+	UINT glBaseInternalFormat;
+	UINT pixelWidth;
+	UINT pixelHeight;
+	UINT pixelDepth;
+	UINT numberOfArrayElements;
+	UINT numberOfFaces;
+	UINT numberOfMipmapLevels;
+	UINT bytesOfKeyValueData;
+};
+#pragma pack(pop)
 
-void Image::read(HANDLE hFile, LPVOID lpBuffer, DWORD nNumBytes)
+static const BYTE ktxIdentifier[12] = {
+	0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+static bool hasExtension(const char *filename, const char *ext)
 {
-	DWORD bytesRead;
-	BOOL success = ReadFile(hFile, lpBuffer, nNumBytes, &bytesRead, NULL);
-	if (!success || bytesRead != nNumBytes)
-		throw false;
+	const char *dot = strrchr(filename, '.');
+	if (!dot) return false;
+	for (; *dot && *ext; dot++, ext++)
+		if (tolower((unsigned char)*dot) != *ext) return false;
+	return *dot == *ext;
 }
 
-bool Image::LoadTga(const char *filename)
+void Image::reset()
 {
 	ptr = my_shared_ptr<SharedTraits>::MakeNew();
 	width = height = depth = 0;
 	dataSize = 0;
+	compression = IC_NONE;
+	numMips = 0;
+}
+
+int Image::levelSize(int level) const
+{
+	int w = GetMipWidth(level), h = GetMipHeight(level);
+	if (compression == IC_NONE)
+		return w * h * (depth / 8);
+
+	int blockSize = compression == IC_BC1 || compression == IC_BC4 ? 8 : 16;
+	return ((w + 3) / 4) * ((h + 3) / 4) * blockSize;
+}
+
+// points the image at count tightly packed levels inside a mapped file
+bool Image::wrapLevels(const MappedFile &file, const BYTE *data, const BYTE *end, int count)
+{
+	numMips = count < IMAGE_MAX_MIPS ? count : IMAGE_MAX_MIPS;
+	int offset = 0;
+	for (int i = 0; i < numMips; i++) {
+		mipOffset[i] = offset;
+		mipSize[i] = levelSize(i);
+		offset += mipSize[i];
+	}
+	if (data + offset > end) return false;
+
+	ptr->data = (BYTE *)data;
+	ptr->file = file;
+	dataSize = offset;
+	return true;
+}
+
+bool Image::Load(const char *filename)
+{
+	if (hasExtension(filename, ".dds")) return LoadDds(filename);
+	if (hasExtension(filename, ".ktx")) return LoadKtx(filename);
+	return LoadTga(filename);
+}
+
+void Image::Create(int width, int height, int depth, ImageCompression compression, int numMips)
+{
+	reset();
+	this->width = width;
+	this->height = height;
+	this->depth = compression == IC_NONE ? depth : 0;
+	this->compression = compression;
+	this->numMips = numMips < IMAGE_MAX_MIPS ? numMips : IMAGE_MAX_MIPS;
+
+	int offset = 0;
+	for (int i = 0; i < this->numMips; i++) {
+		mipOffset[i] = offset;
+		mipSize[i] = levelSize(i);
+		offset += mipSize[i];
+	}
+	ptr->data = new BYTE[offset];
+	dataSize = offset;
+	isGood = true;
+}
+
+bool Image::SaveDds(const char *filename) const
+{
+	if (!isGood) return false;
+
+	DDSHEADER header;
+	memset(&header, 0, sizeof(DDSHEADER));
+	header.magic = DDS_MAGIC;
+	header.size = 124;
+	header.flags = DDSD_REQUIRED;
+	header.width = width;
+	header.height = height;
+	header.caps = DDSCAPS_TEXTURE;
+	if (numMips > 1) {
+		header.flags |= DDSD_MIPMAPCOUNT;
+		header.mipMapCount = numMips;
+		header.caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	}
+
+	DDSPIXELFORMAT &pf = header.ddspf;
+	pf.size = sizeof(DDSPIXELFORMAT);
+	if (compression != IC_NONE)
+	{
+		header.flags |= DDSD_LINEARSIZE;
+		header.pitchOrLinearSize = mipSize[0];
+		pf.flags = DDPF_FOURCC;
+		switch (compression)
+		{
+		case IC_BC1: pf.fourCC = FOURCC('D', 'X', 'T', '1'); break;
+		case IC_BC2: pf.fourCC = FOURCC('D', 'X', 'T', '3'); break;
+		case IC_BC3: pf.fourCC = FOURCC('D', 'X', 'T', '5'); break;
+		case IC_BC4: pf.fourCC = FOURCC('A', 'T', 'I', '1'); break;
+		case IC_BC5: pf.fourCC = FOURCC('A', 'T', 'I', '2'); break;
+		default: return false; // BC6H and BC7 would need a DX10 header
+		}
+	}
+	else
+	{
+		header.flags |= DDSD_PITCH;
+		header.pitchOrLinearSize = width * (depth / 8);
+		pf.rgbBitCount = depth;
+		if (depth == 8) {
+			pf.flags = DDPF_LUMINANCE;
+			pf.rMask = 0xFF;
+		}
+		else {
+			pf.flags = DDPF_RGB;
+			pf.rMask = 0xFF0000; pf.gMask = 0xFF00; pf.bMask = 0xFF;
+			if (depth == 32) {
+				pf.flags |= DDPF_ALPHAPIXELS;
+				pf.aMask = 0xFF000000;
+			}
+		}
+	}
+
+	ofstream file(filename, ios::binary);
+	if (!file) return false;
+
+	file.write((const char *)&header, sizeof(DDSHEADER));
+	for (int i = 0; i < numMips; i++)
+		file.write((const char *)ptr->data + mipOffset[i], mipSize[i]);
+	return !file.fail();
+}
+
+Image Image::Clone() const {
+	return *this;
+}
+
+static inline int clampIndex(int i, int size) {
+	return i < size ? i : size - 1;
+}
+
+bool Image::GenerateMips()
+{
+	if (!isGood || numMips > 1) return isGood;
+	if (compression != IC_NONE) return false;
+
+	int count = 1;
+	while ((width >> count) || (height >> count)) count++;
+
+	Image mips;
+	mips.Create(width, height, depth, IC_NONE, count);
+	memcpy(mips.ptr->data, ptr->data, mipSize[0]);
+
+	int bpp = depth / 8;
+	for (int level = 1; level < mips.numMips; level++)
+	{
+		const BYTE *src = mips.ptr->data + mips.mipOffset[level - 1];
+		BYTE *dst = mips.ptr->data + mips.mipOffset[level];
+		int srcWidth = mips.GetMipWidth(level - 1), srcHeight = mips.GetMipHeight(level - 1);
+		int w = mips.GetMipWidth(level), h = mips.GetMipHeight(level);
 
-	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, 0);
-	if (file == INVALID_HANDLE_VALUE)
+		for (int y = 0; y < h; y++)
+		{
+			// odd sizes repeat the last row or column
+			const BYTE *row0 = src + clampIndex(y*2, srcHeight) * srcWidth * bpp;
+			const BYTE *row1 = src + clampIndex(y*2 + 1, srcHeight) * srcWidth * bpp;
+			for (int x = 0; x < w; x++)
+			{
+				int x0 = clampIndex(x*2, srcWidth) * bpp;
+				int x1 = clampIndex(x*2 + 1, srcWidth) * bpp;
+				for (int c = 0; c < bpp; c++)
+					*dst++ = (BYTE)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+			}
+		}
+	}
+
+	*this = mips;
+	return true;
+}
+
+BYTE *Image::GetWritableData()
+{
+	if (!ptr->data) return NULL;
+	if (ptr.GetRefCount() == 1 && !ptr->file)
+		return ptr->data;
+
+	BYTE *data = new BYTE[dataSize];
+	memcpy(data, ptr->data, dataSize);
+	ptr = my_shared_ptr<SharedTraits>::MakeNew();
+	ptr->data = data;
+	return data;
+}
+
+// Converts file pixels into output pixels: a straight copy for 8/24/32
+// bit images, BGR(A) expansion of 15/16 bit pixels and palette lookups
+// for color-mapped images (with the palette already in output format).
+struct TgaPixelReader
+{
+	enum Kind { COPY, RGB16, MAPPED };
+
+	Kind kind;
+	int inBpp, outBpp;
+	const BYTE *palette;
+	int paletteSize;
+
+	void Read(const BYTE *src, BYTE *dst, int count) const
+	{
+		switch (kind)
+		{
+		case COPY:
+			memcpy(dst, src, count*outBpp);
+			break;
+		case RGB16:
+			for (int i = 0; i < count; i++, src += 2, dst += outBpp)
+				expand16(src, dst, outBpp);
+			break;
+		case MAPPED:
+			for (int i = 0; i < count; i++, src += inBpp, dst += outBpp) {
+				int index = inBpp == 1 ? src[0] : src[0] | src[1] << 8;
+				if (index >= paletteSize) index = 0;
+				memcpy(dst, palette + index*outBpp, outBpp);
+			}
+			break;
+		}
+	}
+
+	static void expand16(const BYTE *src, BYTE *dst, int outBpp)
+	{
+		int p = src[0] | src[1] << 8;
+		int b = p & 0x1F, g = (p >> 5) & 0x1F, r = (p >> 10) & 0x1F;
+		dst[0] = BYTE(b << 3 | b >> 2);
+		dst[1] = BYTE(g << 3 | g >> 2);
+		dst[2] = BYTE(r << 3 | r >> 2);
+		if (outBpp == 4) dst[3] = (p & 0x8000) ? 255 : 0;
+	}
+};
+
+// fills count pixels with one value; whole pixels are stored at once
+static void fillRun(BYTE *dst, const BYTE *pixel, int count, int bpp)
+{
+	switch (bpp)
+	{
+	case 1:
+		memset(dst, pixel[0], count);
+		break;
+	case 4: {
+		unsigned int v;
+		memcpy(&v, pixel, 4);
+		unsigned int *d = (unsigned int *)dst;
+		for (int i = 0; i < count; i++) d[i] = v;
+		break;
+	}
+	default:
+		for (int i = 0; i < count; i++, dst += bpp)
+			memcpy(dst, pixel, 3);
+		break;
+	}
+}
+
+bool Image::LoadTga(const char *filename)
+{
+	reset();
+
+	MappedFile file(filename);
+	if (!file)
 		return isGood = false;
 
 	BYTE *data = 0;
 	isGood = true;
 	try {
-		TGAHEADER tgaHeader = { };
-		read(file, &tgaHeader, sizeof(TGAHEADER));
+		// the whole file is decoded from memory
+		if (file.GetSize() < sizeof(TGAHEADER)) throw false;
+		const BYTE *src = file.GetData();
+		const BYTE *end = src + file.GetSize();
 
-		if (tgaHeader.colorMapType != 0 ||
-			tgaHeader.imageType != 2 && tgaHeader.imageType != 3) {
+		TGAHEADER tgaHeader;
+		memcpy(&tgaHeader, src, sizeof(TGAHEADER));
+		src += sizeof(TGAHEADER) + tgaHeader.idLength;
+
+		int type = tgaHeader.imageType & ~8;
+		bool rle = (tgaHeader.imageType & 8) != 0;
+		bool mapped = type == 1;
+		int alphaBits = tgaHeader.descriptor & 0x0F;
+
+		if ((type != 1 && type != 2 && type != 3) || tgaHeader.imageType > 11)
+			throw false;
+		if (mapped && tgaHeader.colorMapType != 1)
 			throw false;
+
+		TgaPixelReader reader = { TgaPixelReader::COPY, 0, 0, NULL, 0 };
+		vector<BYTE> palette;
+
+		if (mapped)
+		{
+			int entrySize = tgaHeader.colorMapEntrySize;
+			int entryBpp = (entrySize + 7) / 8;
+			int first = tgaHeader.colorMapOffset;
+			int count = tgaHeader.colorMapLength;
+			if (tgaHeader.depth != 8 && tgaHeader.depth != 16) throw false;
+			if (entrySize != 15 && entrySize != 16 && entrySize != 24 && entrySize != 32)
+				throw false;
+			if (src + count*entryBpp > end) throw false;
+
+			reader.kind = TgaPixelReader::MAPPED;
+			reader.inBpp = tgaHeader.depth / 8;
+			reader.outBpp = entryBpp == 2 ? (entrySize == 16 && alphaBits ? 4 : 3) : entryBpp;
+
+			// indices refer to entries starting at colorMapOffset
+			reader.paletteSize = first + count;
+			palette.assign(reader.paletteSize * reader.outBpp, 0);
+			for (int i = 0; i < count; i++, src += entryBpp) {
+				BYTE *entry = &palette[(first + i) * reader.outBpp];
+				if (entryBpp == 2) TgaPixelReader::expand16(src, entry, reader.outBpp);
+				else memcpy(entry, src, entryBpp);
+			}
+			reader.palette = palette.data();
+		}
+		else
+		{
+			// a color map may be present in true-color images as well
+			src += tgaHeader.colorMapLength * ((tgaHeader.colorMapEntrySize + 7) / 8);
+
+			int d = tgaHeader.depth;
+			if (type == 3 ? d != 8 : d != 15 && d != 16 && d != 24 && d != 32)
+				throw false;
+
+			reader.inBpp = (d + 7) / 8;
+			if (reader.inBpp == 2) {
+				reader.kind = TgaPixelReader::RGB16;
+				reader.outBpp = d == 16 && alphaBits ? 4 : 3;
+			}
+			else reader.outBpp = reader.inBpp;
 		}
 
-		if (tgaHeader.idLength != 0) {
-			SetFilePointer(file, tgaHeader.idLength, NULL, FILE_CURRENT);
+		width = tgaHeader.width;
+		height = tgaHeader.height;
+		int outBpp = reader.outBpp;
+		int inBpp = reader.inBpp;
+		int rowSize = width * outBpp;
+		int imageSize = rowSize * height;
+
+		// rows are stored bottom-up unless bit 5 of the descriptor is set;
+		// they are written straight to their final place
+		bool flip = (~tgaHeader.descriptor & 0x20) != 0;
+
+		// top-down uncompressed pixels are used right where they are mapped
+		if (!rle && !flip && reader.kind == TgaPixelReader::COPY)
+		{
+			if (src + imageSize > end) throw false;
+			depth = outBpp * 8;
+			wrapLevels(file, src, end, 1);
+			return isGood;
 		}
 
-		DWORD imageSize = tgaHeader.width * tgaHeader.height * tgaHeader.depth / 8;
 		data = new(std::nothrow) BYTE[imageSize];
 		if (!data) throw false;
 
-		read(file, data, imageSize);
-		width = tgaHeader.width;
-		height = tgaHeader.height;
+		BYTE *row = flip ? data + rowSize*(height - 1) : data;
+		int rowStep = flip ? -rowSize : rowSize;
+
+		if (!rle)
+		{
+			int srcRowSize = width * inBpp;
+			if (src + srcRowSize*height > end) throw false;
+			for (int y = 0; y < height; y++, row += rowStep, src += srcRowSize)
+				reader.Read(src, row, width);
+		}
+		else
+		{
+			// packets may cross row boundaries
+			BYTE pixel[4];
+			int remaining = 0;
+			bool run = false;
 
-		int rowSize = imageSize / height;
-		if ((~tgaHeader.descriptor & 0x20)) {
-			BYTE *tmp = new BYTE[rowSize];
-			for (int i = 0; i < height / 2; i++)
+			for (int y = 0; y < height; y++, row += rowStep)
 			{
-				BYTE *r1 = &data[rowSize*i];
-				BYTE *r2 = &data[rowSize*(height - i - 1)];
-				memcpy(tmp, r1, rowSize);
-				memcpy(r1, r2, rowSize);
-				memcpy(r2, tmp, rowSize);
+				BYTE *dst = row;
+				int x = 0;
+				while (x < width)
+				{
+					if (remaining == 0) {
+						if (src >= end) throw false;
+						BYTE h = *src++;
+						remaining = (h & 0x7F) + 1;
+						run = (h & 0x80) != 0;
+						if (run) {
+							if (src + inBpp > end) throw false;
+							reader.Read(src, pixel, 1);
+							src += inBpp;
+						}
+					}
+
+					int n = remaining < width - x ? remaining : width - x;
+					if (run) fillRun(dst, pixel, n, outBpp);
+					else {
+						if (src + n*inBpp > end) throw false;
+						reader.Read(src, dst, n);
+						src += n*inBpp;
+					}
+
+					dst += n*outBpp;
+					x += n;
+					remaining -= n;
+				}
 			}
-			delete [] tmp;
 		}
-		
+
 		ptr->data = data;
 		dataSize = imageSize;
-		depth = tgaHeader.depth;
+		depth = outBpp * 8;
+		numMips = 1;
+		mipOffset[0] = 0;
+		mipSize[0] = imageSize;
 	}
 	catch(bool) {
 		delete [] data;
 		isGood = false;
 	}
 
-	CloseHandle(file);
 	return isGood;
+}
+
+bool Image::LoadDds(const char *filename)
+{
+	reset();
+
+	MappedFile file(filename);
+	if (!file || file.GetSize() < sizeof(DDSHEADER))
+		return isGood = false;
+
+	const BYTE *src = file.GetData();
+	const BYTE *end = src + file.GetSize();
+
+	DDSHEADER header;
+	memcpy(&header, src, sizeof(DDSHEADER));
+	src += sizeof(DDSHEADER);
+
+	if (header.magic != DDS_MAGIC || header.size != 124)
+		return isGood = false;
+
+	// volume textures, cube maps and arrays are not supported
+	const DDSPIXELFORMAT &pf = header.ddspf;
+	if (header.caps2 != 0)
+		return isGood = false;
+
+	if (pf.flags & DDPF_FOURCC)
+	{
+		switch (pf.fourCC)
+		{
+		case FOURCC('D', 'X', 'T', '1'): compression = IC_BC1; break;
+		case FOURCC('D', 'X', 'T', '2'):
+		case FOURCC('D', 'X', 'T', '3'): compression = IC_BC2; break;
+		case FOURCC('D', 'X', 'T', '4'):
+		case FOURCC('D', 'X', 'T', '5'): compression = IC_BC3; break;
+		case FOURCC('A', 'T', 'I', '1'):
+		case FOURCC('B', 'C', '4', 'U'): compression = IC_BC4; break;
+		case FOURCC('A', 'T', 'I', '2'):
+		case FOURCC('B', 'C', '5', 'U'): compression = IC_BC5; break;
+		case FOURCC('D', 'X', '1', '0'):
+		{
+			if (src + sizeof(DDSHEADER_DX10) > end) return isGood = false;
+			DDSHEADER_DX10 dx10;
+			memcpy(&dx10, src, sizeof(DDSHEADER_DX10));
+			src += sizeof(DDSHEADER_DX10);
+			if (dx10.arraySize > 1) return isGood = false;
+
+			// DXGI_FORMAT values
+			switch (dx10.dxgiFormat)
+			{
+			case 71: case 72: compression = IC_BC1; break;
+			case 74: case 75: compression = IC_BC2; break;
+			case 77: case 78: compression = IC_BC3; break;
+			case 80: compression = IC_BC4; break;
+			case 83: compression = IC_BC5; break;
+			case 95: case 96: compression = IC_BC6H; break;
+			case 98: case 99: compression = IC_BC7; break;
+			case 87: case 91: depth = 32; break; // B8G8R8A8
+			default: return isGood = false;
+			}
+			break;
+		}
+		default:
+			return isGood = false;
+		}
+	}
+	else if (pf.flags & DDPF_RGB)
+	{
+		// only the BGR(A) byte order the TGA path produces
+		if (pf.rMask != 0xFF0000 || pf.gMask != 0xFF00 || pf.bMask != 0xFF)
+			return isGood = false;
+		if (pf.rgbBitCount != 24 && pf.rgbBitCount != 32)
+			return isGood = false;
+		depth = pf.rgbBitCount;
+	}
+	else if (pf.flags & DDPF_LUMINANCE && pf.rgbBitCount == 8)
+		depth = 8;
+	else return isGood = false;
+
+	width = header.width;
+	height = header.height;
+	int count = header.mipMapCount ? header.mipMapCount : 1;
+	return isGood = wrapLevels(file, src, end, count);
+}
+
+bool Image::LoadKtx(const char *filename)
+{
+	reset();
+
+	MappedFile file(filename);
+	if (!file || file.GetSize() < sizeof(KTXHEADER))
+		return isGood = false;
+
+	const BYTE *src = file.GetData();
+	const BYTE *end = src + file.GetSize();
+
+	KTXHEADER header;
+	memcpy(&header, src, sizeof(KTXHEADER));
+	if (header.bytesOfKeyValueData > (size_t)(end - src - sizeof(KTXHEADER)))
+		return isGood = false;
+	src += sizeof(KTXHEADER) + header.bytesOfKeyValueData;
+
+	if (memcmp(header.identifier, ktxIdentifier, 12) != 0 || header.endianness != 0x04030201)
+		return isGood = false;
+	if (header.pixelDepth > 1 || header.numberOfArrayElements > 1 || header.numberOfFaces != 1)
+		return isGood = false;
+
+	if (header.glType == 0)
+	{
+		// GL internal formats
+		switch (header.glInternalFormat)
+		{
+		case 0x83F0: case 0x83F1: case 0x8C4C: case 0x8C4D: compression = IC_BC1; break;
+		case 0x83F2: case 0x8C4E: compression = IC_BC2; break;
+		case 0x83F3: case 0x8C4F: compression = IC_BC3; break;
+		case 0x8DBB: compression = IC_BC4; break;
+		case 0x8DBD: compression = IC_BC5; break;
+		case 0x8E8E: case 0x8E8F: compression = IC_BC6H; break;
+		case 0x8E8C: case 0x8E8D: compression = IC_BC7; break;
+		default: return isGood = false;
+		}
+	}
+	else
+	{
+		// GL_UNSIGNED_BYTE with GL_BGR, GL_BGRA, GL_LUMINANCE or GL_RED
+		if (header.glType != 0x1401) return isGood = false;
+		switch (header.glFormat)
+		{
+		case 0x80E0: depth = 24; break;
+		case 0x80E1: depth = 32; break;
+		case 0x1909: case 0x1903: depth = 8; break;
+		default: return isGood = false;
+		}
+	}
+
+	width = header.pixelWidth;
+	height = header.pixelHeight > 0 ? header.pixelHeight : 1;
+
+	// every level is preceded by its size and padded to four bytes; rows
+	// of uncompressed levels are padded to four bytes as well
+	int count = header.numberOfMipmapLevels ? header.numberOfMipmapLevels : 1;
+	numMips = count < IMAGE_MAX_MIPS ? count : IMAGE_MAX_MIPS;
+	const BYTE *base = src;
+	const BYTE *levels[IMAGE_MAX_MIPS];
+	bool rowsPadded = false;
+	for (int i = 0; i < numMips; i++)
+	{
+		UINT stored = levelSize(i);
+		if (compression == IC_NONE) {
+			UINT row = GetMipWidth(i) * (depth / 8);
+			stored = ((row + 3) & ~3) * GetMipHeight(i);
+			if (row % 4 != 0) rowsPadded = true;
+		}
+
+		// sizes come from the file, so they are compared with what is left
+		// rather than added to src
+		if (end - src < 4) return isGood = false;
+		UINT size;
+		memcpy(&size, src, 4);
+		src += 4;
+		if (size < stored || size > (UINT)(end - src))
+			return isGood = false;
+
+		levels[i] = src;
+		mipOffset[i] = src - base;
+		mipSize[i] = levelSize(i);
+		UINT padded = (size + 3) & ~3;
+		src += padded < (UINT)(end - src) ? padded : (UINT)(end - src);
+	}
+
+	if (rowsPadded)
+	{
+		// the rest of the code expects tightly packed rows, so the levels
+		// are copied out of the mapping without the padding
+		int bytesPerPixel = depth / 8;
+		Create(width, height, depth, IC_NONE, numMips);
+		for (int i = 0; i < numMips; i++)
+		{
+			int row = GetMipWidth(i) * bytesPerPixel;
+			int stride = (row + 3) & ~3;
+			for (int y = 0, h = GetMipHeight(i); y < h; y++)
+				memcpy(ptr->data + mipOffset[i] + y * row, levels[i] + y * stride, row);
+		}
+		return isGood = true;
+	}
+
+	ptr->data = (BYTE *)base;
+	ptr->file = file;
+	dataSize = src - base;
+	return isGood = true;
 }
\ No newline at end of file
@@ -0,0 +1,296 @@
+#include "lightculler.h"
+#include "glcontext.h"
+#include "threadpool.h"
+#include <xmmintrin.h>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#define LC_INDEX_TEX_WIDTH 1024 // matches the index lookup in lights.glsl
+#define LC_LIGHT_TEXELS 5
+
+static long long getTicks()
+{
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+static float ticksToMs(long long ticks)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (float)(ticks * 1000.0 / freq.QuadPart);
+}
+
+LightCuller::LightCuller(GLRenderingContext *rc)
+	: rc(rc), viewportWidth(0), viewportHeight(0), zNear(0.0f), zFar(0.0f)
+{
+	boundsValid = false;
+	numGlobalLights = 0;
+	lightTex = gridTex = indexTex = NULL;
+	lightTexHeight = gridTexWidth = gridTexHeight = indexTexHeight = 0;
+	ZeroMemory(&stats, sizeof(stats));
+	SetGrid(16, 9, 24);
+}
+
+LightCuller::~LightCuller() {
+	Release();
+}
+
+void LightCuller::Release()
+{
+	delete lightTex;
+	delete gridTex;
+	delete indexTex;
+	lightTex = gridTex = indexTex = NULL;
+	lightTexHeight = gridTexWidth = gridTexHeight = indexTexHeight = 0;
+}
+
+void LightCuller::SetGrid(int tilesX, int tilesY, int numSlices)
+{
+	this->tilesX = tilesX;
+	this->tilesY = tilesY;
+	this->numSlices = numSlices;
+	boundsValid = false;
+}
+
+void LightCuller::computeBounds()
+{
+	// near and far planes of a perspective projection
+	const float *p = projection.data;
+	zNear = p[14] / (p[10] - 1.0f);
+	zFar = p[14] / (p[10] + 1.0f);
+
+	bounds.resize(tilesX * tilesY * numSlices);
+	slices.resize(numSlices);
+
+	AABox *b = bounds.data();
+	for (int z = 0; z < numSlices; z++)
+	{
+		float d0 = zNear * pow(zFar / zNear, (float)z / numSlices);
+		float d1 = zNear * pow(zFar / zNear, (float)(z + 1) / numSlices);
+		for (int j = 0; j < tilesY; j++)
+		{
+			// at distance d a point with normalized y of ny is at d*(ny + p9)/p5
+			float y0 = -1.0f + 2.0f * j / tilesY + p[9];
+			float y1 = -1.0f + 2.0f * (j + 1) / tilesY + p[9];
+			for (int i = 0; i < tilesX; i++, b++)
+			{
+				float x0 = -1.0f + 2.0f * i / tilesX + p[8];
+				float x1 = -1.0f + 2.0f * (i + 1) / tilesX + p[8];
+				b->vmin.x = min(d0 * x0, d1 * x0) / p[0];
+				b->vmax.x = max(d0 * x1, d1 * x1) / p[0];
+				b->vmin.y = min(d0 * y0, d1 * y0) / p[5];
+				b->vmax.y = max(d0 * y1, d1 * y1) / p[5];
+				b->vmin.z = -d1;
+				b->vmax.z = -d0;
+			}
+		}
+	}
+	boundsValid = true;
+}
+
+void LightCuller::Update(const Matrix44f &view, int viewportWidth, int viewportHeight)
+{
+	long long start = getTicks();
+
+	this->viewportWidth = viewportWidth;
+	this->viewportHeight = viewportHeight;
+	const Matrix44f &proj = rc->GetProjectionRef();
+	if (!boundsValid || memcmp(proj.data, projection.data, sizeof(projection.data)) != 0) {
+		projection = proj;
+		computeBounds();
+	}
+
+	// global lights come first, so the shader finds them at 0..numGlobalLights-1
+	const vector<Light> &lights = rc->lights;
+	int numLights = lights.size();
+	lightData.resize(max(numLights, 1) * LC_LIGHT_TEXELS);
+	pointLights.clear();
+	pointIds.clear();
+	numGlobalLights = 0;
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int i = 0; i < numLights; i++)
+		{
+			const Light &l = lights[i];
+			bool global = l.position.w == 0.0f || l.radius <= 0.0f;
+			if (global != (pass == 0)) continue;
+
+			unsigned int id = numGlobalLights + pointLights.size();
+			Vector4f pos = l.position * view;
+			Vector4f *texels = &lightData[id * LC_LIGHT_TEXELS];
+			texels[0] = pos;
+			texels[1] = Vector4f(l.diffuse.r, l.diffuse.g, l.diffuse.b, l.diffuse.a);
+			texels[2] = Vector4f(l.ambient.r, l.ambient.g, l.ambient.b, l.ambient.a);
+			texels[3] = Vector4f(l.specular.r, l.specular.g, l.specular.b, l.specular.a);
+			texels[4] = Vector4f(global ? 0.0f : l.radius, 0.0f, 0.0f, 0.0f);
+
+			if (global) numGlobalLights++;
+			else {
+				pointLights.push_back(Vector4f(pos.x, pos.y, pos.z, l.radius));
+				pointIds.push_back(id);
+			}
+		}
+	}
+
+	grid.resize(tilesX * tilesY * numSlices * 2);
+	if (!pointLights.empty())
+		rc->GetThreadPool()->ParallelFor(numSlices, cullTask, this);
+	else {
+		for (int z = 0; z < numSlices; z++) {
+			slices[z].indices.clear();
+			slices[z].maxLights = 0;
+		}
+		fill(grid.begin(), grid.end(), 0);
+	}
+
+	// slices filled in their offsets from 0; now they are put one after another
+	indices.clear();
+	stats.maxClusterLights = 0;
+	int clustersPerSlice = tilesX * tilesY;
+	for (int z = 0; z < numSlices; z++)
+	{
+		unsigned int base = indices.size();
+		unsigned int *g = &grid[z * clustersPerSlice * 2];
+		for (int c = 0; c < clustersPerSlice; c++)
+			g[2*c] += base;
+		indices.insert(indices.end(), slices[z].indices.begin(), slices[z].indices.end());
+		stats.maxClusterLights = max(stats.maxClusterLights, slices[z].maxLights);
+	}
+
+	stats.numLights = numLights;
+	stats.numGlobalLights = numGlobalLights;
+	stats.numIndices = indices.size();
+	upload();
+	stats.cullTime = ticksToMs(getTicks() - start);
+}
+
+void LightCuller::cullTask(void *context, int index) {
+	((LightCuller *)context)->cullSlice(index);
+}
+
+void LightCuller::cullSlice(int slice)
+{
+	Slice &s = slices[slice];
+	int clustersPerSlice = tilesX * tilesY;
+	const AABox *b = &bounds[slice * clustersPerSlice];
+	unsigned int *g = &grid[slice * clustersPerSlice * 2];
+
+	// lights reaching the depth range of the slice, packed for SSE;
+	// the padding has a negative squared radius and never passes
+	float zmin = b->vmin.z, zmax = b->vmax.z;
+	s.x.clear(); s.y.clear(); s.z.clear(); s.r2.clear(); s.ids.clear();
+	for (int i = 0, n = pointLights.size(); i < n; i++)
+	{
+		const Vector4f &l = pointLights[i];
+		if (l.z - l.w > zmax || l.z + l.w < zmin) continue;
+		s.x.push_back(l.x);
+		s.y.push_back(l.y);
+		s.z.push_back(l.z);
+		s.r2.push_back(l.w * l.w);
+		s.ids.push_back(pointIds[i]);
+	}
+	int numCandidates = s.ids.size();
+	while (s.ids.size() & 3) {
+		s.x.push_back(0.0f);
+		s.y.push_back(0.0f);
+		s.z.push_back(0.0f);
+		s.r2.push_back(-1.0f);
+		s.ids.push_back(0);
+	}
+
+	s.indices.clear();
+	s.maxLights = 0;
+	for (int c = 0; c < clustersPerSlice; c++)
+	{
+		unsigned int offset = s.indices.size();
+		if (numCandidates != 0)
+		{
+			__m128 minX = _mm_set1_ps(b[c].vmin.x), maxX = _mm_set1_ps(b[c].vmax.x);
+			__m128 minY = _mm_set1_ps(b[c].vmin.y), maxY = _mm_set1_ps(b[c].vmax.y);
+			__m128 minZ = _mm_set1_ps(b[c].vmin.z), maxZ = _mm_set1_ps(b[c].vmax.z);
+
+			for (int i = 0, n = s.ids.size(); i < n; i += 4)
+			{
+				// distance from the center of the sphere to the closest point of the box
+				__m128 x = _mm_loadu_ps(&s.x[i]);
+				__m128 y = _mm_loadu_ps(&s.y[i]);
+				__m128 z = _mm_loadu_ps(&s.z[i]);
+				__m128 dx = _mm_sub_ps(_mm_max_ps(minX, _mm_min_ps(x, maxX)), x);
+				__m128 dy = _mm_sub_ps(_mm_max_ps(minY, _mm_min_ps(y, maxY)), y);
+				__m128 dz = _mm_sub_ps(_mm_max_ps(minZ, _mm_min_ps(z, maxZ)), z);
+				__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+				int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(&s.r2[i])));
+				for (int k = 0; mask != 0; k++, mask >>= 1)
+					if (mask & 1) s.indices.push_back(s.ids[i + k]);
+			}
+		}
+		int count = s.indices.size() - offset;
+		g[2*c] = offset;
+		g[2*c + 1] = count;
+		s.maxLights = max(s.maxLights, count);
+	}
+}
+
+void LightCuller::upload()
+{
+	if (!lightTex)
+	{
+		lightTex = new Texture2D(GL_TEXTURE5);
+		gridTex = new Texture2D(GL_TEXTURE6);
+		indexTex = new Texture2D(GL_TEXTURE7);
+		lightTex->SetFilters(GL_NEAREST, GL_NEAREST);
+		gridTex->SetFilters(GL_NEAREST, GL_NEAREST);
+		indexTex->SetFilters(GL_NEAREST, GL_NEAREST);
+	}
+
+	// textures are reallocated only when they have to grow or the grid changes
+	int lightRows = lightData.size() / LC_LIGHT_TEXELS;
+	if (lightRows > lightTexHeight) {
+		lightTexHeight = lightRows;
+		lightTex->SetTexImage(0, GL_RGBA32F, LC_LIGHT_TEXELS, lightTexHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+	}
+	lightTex->Bind();
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, LC_LIGHT_TEXELS, lightRows, GL_RGBA, GL_FLOAT, lightData.data());
+
+	int gridWidth = tilesX * tilesY;
+	if (gridWidth != gridTexWidth || numSlices != gridTexHeight) {
+		gridTexWidth = gridWidth;
+		gridTexHeight = numSlices;
+		gridTex->SetTexImage(0, GL_RG32UI, gridTexWidth, gridTexHeight, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, NULL);
+	}
+	gridTex->Bind();
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, gridTexWidth, gridTexHeight, GL_RG_INTEGER, GL_UNSIGNED_INT, grid.data());
+
+	// the last row is padded to a full one
+	int indexRows = max(((int)indices.size() + LC_INDEX_TEX_WIDTH - 1) / LC_INDEX_TEX_WIDTH, 1);
+	indices.resize(indexRows * LC_INDEX_TEX_WIDTH);
+	if (indexRows > indexTexHeight) {
+		indexTexHeight = indexRows;
+		indexTex->SetTexImage(0, GL_R32UI, LC_INDEX_TEX_WIDTH, indexTexHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+	}
+	indexTex->Bind();
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, LC_INDEX_TEX_WIDTH, indexRows, GL_RED_INTEGER, GL_UNSIGNED_INT, indices.data());
+}
+
+void LightCuller::Bind(ProgramObject &prog)
+{
+	if (!lightTex) return;
+	lightTex->Bind();
+	gridTex->Bind();
+	indexTex->Bind();
+
+	// slice = log(depth) * scale + bias
+	float scale = numSlices / log(zFar / zNear);
+	prog.Uniform("LightData", 5);
+	prog.Uniform("LightGrid", 6);
+	prog.Uniform("LightIndices", 7);
+	prog.Uniform("NumGlobalLights", numGlobalLights);
+	prog.Uniform("ClusterCount", tilesX, tilesY, numSlices);
+	prog.Uniform("ClusterTileSize", (float)viewportWidth / tilesX, (float)viewportHeight / tilesY);
+	prog.Uniform("ClusterDepth", scale, -log(zNear) * scale);
+}
\ No newline at end of file
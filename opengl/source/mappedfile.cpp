@@ -0,0 +1,122 @@
+#include "mappedfile.h"
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+shared_traits<MappedFile>::~shared_traits()
+{
+	if (!data) return;
+	if (mapped) {
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap((void *)data, size);
+#endif
+	}
+	else delete [] data;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const char *filename)
+{
+	Close();
+
+	HANDLE hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize)) {
+		CloseHandle(hFile);
+		return false;
+	}
+	size_t size = (size_t)fileSize.QuadPart;
+
+	// empty files cannot be mapped
+	if (size != 0)
+	{
+		HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (hMapping) {
+			ptr->data = (const BYTE *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+			ptr->mapped = ptr->data != NULL;
+			// the view keeps the mapping alive
+			CloseHandle(hMapping);
+		}
+
+		if (!ptr->mapped)
+		{
+			BYTE *buffer = new(std::nothrow) BYTE[size];
+			DWORD bytesRead = 0;
+			if (!buffer || !ReadFile(hFile, buffer, (DWORD)size, &bytesRead, NULL) || bytesRead != size) {
+				delete [] buffer;
+				CloseHandle(hFile);
+				return false;
+			}
+			ptr->data = buffer;
+		}
+	}
+
+	CloseHandle(hFile);
+	ptr->size = size;
+	return isOpen = true;
+}
+
+#else
+
+bool MappedFile::Open(const char *filename)
+{
+	Close();
+
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	size_t size = (size_t)st.st_size;
+
+	if (size != 0)
+	{
+		void *view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED) {
+			ptr->data = (const BYTE *)view;
+			ptr->mapped = true;
+		}
+		else
+		{
+			BYTE *buffer = new(std::nothrow) BYTE[size];
+			size_t total = 0;
+			while (buffer && total < size) {
+				ssize_t n = read(fd, buffer + total, size - total);
+				if (n <= 0) break;
+				total += n;
+			}
+			if (!buffer || total != size) {
+				delete [] buffer;
+				close(fd);
+				return false;
+			}
+			ptr->data = buffer;
+		}
+	}
+
+	close(fd);
+	ptr->size = size;
+	return isOpen = true;
+}
+
+#endif
+
+void MappedFile::Close()
+{
+	ptr = my_shared_ptr<SharedTraits>::MakeNew();
+	isOpen = false;
+}
\ No newline at end of file
@@ -2,15 +2,54 @@
 #include "stringhelp.h"
 #include "glcontext.h"
 
+bool MaterialLoader::ReadTextureImage(const string &name, Image &img)
+{
+	// a dot in a directory name is not an extension
+	int dot = name.rfind('.');
+	int slash = name.find_last_of("/\\");
+	if (dot < slash) dot = -1;
+	string dds = (dot != -1 ? name.substr(0, dot) : name) + ".dds";
+	return img.LoadDds(dds.c_str()) || img.Load(name.c_str());
+}
+
+Texture2D MaterialLoader::MakeTexture(const Image &img, TextureStreamer *streamer)
+{
+	Texture2D t;
+	if (streamer && streamer->AddTexture(t, img)) {
+		t.SetFilters(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+		return t;
+	}
+
+	t.LoadFromImage(img);
+	if (t.GetLevelCount() > 1)
+		t.SetFilters(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+	else if (!t.IsCompressed()) {
+		t.SetFilters(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+		t.BuildMipmaps();
+	}
+	else t.SetFilters(GL_LINEAR, GL_LINEAR);
+	return t;
+}
+
+Texture2D MaterialLoader::CreateTexture(const string &name, const Image &img, Dictionary<Texture2D> &textures,
+	TextureStreamer *streamer)
+{
+	Texture2D *tex = textures.GetItem(name.c_str());
+	if (tex) return *tex;
+	return textures.AddItem(name.c_str(), MakeTexture(img, streamer));
+}
+
 Texture2D MaterialLoader::getTexture(const string &name, Dictionary<Texture2D> &textures)
 {
+	if (cache)
+		return cache->LoadTexture(strhlp::joinPath(basePath, name));
+
 	Texture2D *tex = textures.GetItem(name.c_str());
 	if (tex) return *tex;
 
-	Texture2D t(name.c_str());
-	t.SetFilters(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
-	t.BuildMipmaps();
-	return textures.AddItem(name.c_str(), t);
+	Image img;
+	ReadTextureImage(name, img);
+	return CreateTexture(name, img, textures, streamer);
 }
 
 bool MaterialLoader::LoadMtl(const char *filename, Dictionary<Material> &materials)
@@ -20,11 +59,19 @@ bool MaterialLoader::LoadMtl(const char *filename, Dictionary<Material> &materia
 }
 
 bool MaterialLoader::LoadMtl(const char *filename, Dictionary<Material> &materials, Dictionary<Texture2D> &textures)
+{
+	vector<MaterialDesc> descs;
+	if (!ReadMtl(filename, descs)) return false;
+	CreateMaterials(descs, materials, textures);
+	return true;
+}
+
+bool MaterialLoader::ReadMtl(const char *filename, vector<MaterialDesc> &descs)
 {
 	ifstream file(filename);
 	if (!file) return false;
 
-	Material *current = NULL;
+	MaterialDesc *current = NULL;
 
 	string line;
 	while (getline(file, line))
@@ -37,48 +84,76 @@ bool MaterialLoader::LoadMtl(const char *filename, Dictionary<Material> &materia
 		line = line.substr(i + 1);
 
 		if (prefix == "newmtl") {
-			current = &materials.AddItem(line.c_str(), Material());
+			descs.push_back(MaterialDesc());
+			current = &descs.back();
+			current->name = line;
 		}
 		else if (prefix == "Ns") {
-			sscanf_s(line.c_str(), "%f", &current->specularIntensity);
+			sscanf_s(line.c_str(), "%f", &current->material.specularIntensity);
 		}
 		else if (prefix == "Ka") {
-			Color4f &c = current->ambient;
+			Color4f &c = current->material.ambient;
 			sscanf_s(line.c_str(), "%f %f %f", &c.r, &c.g, &c.b);
 		}
 		else if (prefix == "Kd") {
-			Color4f &c = current->diffuse;
+			Color4f &c = current->material.diffuse;
 			sscanf_s(line.c_str(), "%f %f %f", &c.r, &c.g, &c.b);
 		}
 		else if (prefix == "Ks") {
-			Color4f &c = current->specular;
+			Color4f &c = current->material.specular;
 			sscanf_s(line.c_str(), "%f %f %f", &c.r, &c.g, &c.b);
 		}
 		else if (prefix == "map_Kd") {
-			current->diffuseMap = getTexture(line, textures);
+			current->diffuseMap = line;
 		}
 		else if (prefix == "map_Ks") {
-			current->specularMap = getTexture(line, textures);
-			current->specularMap->SetTextureUnit(GL_TEXTURE2);
+			current->specularMap = line;
 		}
 		else if (prefix == "map_Ns") {
-			current->specularIntensityMap = getTexture(line, textures);
-			current->specularIntensityMap->SetTextureUnit(GL_TEXTURE3);
+			current->specularIntensityMap = line;
 		}
 		else if (prefix == "map_d") {
-			current->opacityMask = getTexture(line, textures);
-			current->opacityMask->SetTextureUnit(GL_TEXTURE4);
+			current->opacityMask = line;
 		}
 		else if (prefix == "map_bump" || prefix == "bump") {
-			if (!current->normalMap) {
-				current->normalMap = getTexture(line, textures);
-				current->normalMap->SetTextureUnit(GL_TEXTURE1);
-			}
+			if (current->normalMap.empty())
+				current->normalMap = line;
 		}
 		else if (prefix == "illum") {
-			sscanf_s(line.c_str(), "%d", &current->mode);
+			sscanf_s(line.c_str(), "%d", &current->material.mode);
 		}
 	}
 
 	return true;
+}
+
+void MaterialLoader::CreateMaterials(const vector<MaterialDesc> &descs, Dictionary<Material> &materials,
+	Dictionary<Texture2D> &textures)
+{
+	for (int i = 0, n = descs.size(); i < n; i++)
+	{
+		const MaterialDesc &d = descs[i];
+		Material m = d.material;
+
+		if (!d.diffuseMap.empty()) {
+			m.diffuseMap = getTexture(d.diffuseMap, textures);
+		}
+		if (!d.specularMap.empty()) {
+			m.specularMap = getTexture(d.specularMap, textures);
+			m.specularMap->SetTextureUnit(GL_TEXTURE2);
+		}
+		if (!d.specularIntensityMap.empty()) {
+			m.specularIntensityMap = getTexture(d.specularIntensityMap, textures);
+			m.specularIntensityMap->SetTextureUnit(GL_TEXTURE3);
+		}
+		if (!d.opacityMask.empty()) {
+			m.opacityMask = getTexture(d.opacityMask, textures);
+			m.opacityMask->SetTextureUnit(GL_TEXTURE4);
+		}
+		if (!d.normalMap.empty()) {
+			m.normalMap = getTexture(d.normalMap, textures);
+			m.normalMap->SetTextureUnit(GL_TEXTURE1);
+		}
+		materials.AddItem(d.name.c_str(), m);
+	}
 }
\ No newline at end of file
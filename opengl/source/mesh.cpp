@@ -3,11 +3,85 @@
 #include "modelloader.h"
 
 #define TEX_ID_NONE GLuint(-2)
+#define LOD_HYSTERESIS 0.1f
 
 Mesh::Mesh(GLRenderingContext *rc) : rc(rc)
 {
 	firstIndex = 0;
 	numIndices = -1;
+	curLod = 0;
+	lodFrame = (unsigned int)-2;
+	uvDensity = 0.0f;
+}
+
+void Mesh::AddLod(int firstIndex, int numIndices)
+{
+	MeshLod lod = { firstIndex, numIndices };
+	lods.push_back(lod);
+}
+
+int Mesh::selectLod()
+{
+	int numLods = lods.size() + 1;
+	if (numLods == 1 || !rc->IsLodSelectionEnabled())
+		return curLod = 0;
+
+	const Matrix44f &mv = rc->GetModelViewRef();
+	const Matrix44f &proj = rc->GetProjectionRef();
+	const Point3f &c = boundingSphere.center;
+	Vector4f center = Vector4f(c.x, c.y, c.z) * mv;
+
+	float scale = max(mv.xAxis.LengthSquared(), max(mv.yAxis.LengthSquared(), mv.zAxis.LengthSquared()));
+	float radius = boundingSphere.radius * sqrt(scale);
+
+	// size of the sphere as a fraction of the viewport height
+	float size = radius * proj.data[5];
+	if (proj.data[15] == 0.0f) {
+		float dist = -center.z;
+		if (dist <= radius) return curLod = 0;
+		size /= dist;
+	}
+
+	// lod k is used below threshold / 2^(k-1); the band around each
+	// boundary keeps meshes from flickering between two levels
+	float threshold = rc->GetLodThreshold();
+	int lod = min(curLod, numLods - 1);
+	while (lod + 1 < numLods && size < threshold / (1 << lod) * (1.0f - LOD_HYSTERESIS))
+		lod++;
+	while (lod > 0 && size > threshold / (1 << (lod - 1)) * (1.0f + LOD_HYSTERESIS))
+		lod--;
+	return curLod = lod;
+}
+
+// tells the texture streamer how finely the maps of the mesh are sampled
+// at its nearest point; meshes without a known UV density want level 0
+void Mesh::requestTextures()
+{
+	float uvPerPixel = 0.0f;
+	if (uvDensity > 0.0f)
+	{
+		const Matrix44f &mv = rc->GetModelViewRef();
+		const Matrix44f &proj = rc->GetProjectionRef();
+		const Point3f &c = boundingSphere.center;
+		Vector4f center = Vector4f(c.x, c.y, c.z) * mv;
+		float scale = sqrt(max(mv.xAxis.LengthSquared(), max(mv.yAxis.LengthSquared(), mv.zAxis.LengthSquared())));
+
+		// pixels covered by one unit of the mesh
+		float pixelsPerUnit = proj.data[5] * 0.5f * rc->textureStreamer.GetViewportHeight() * scale;
+		if (proj.data[15] == 0.0f) {
+			float dist = -center.z - boundingSphere.radius * scale;
+			pixelsPerUnit = dist > 0.0f ? pixelsPerUnit / dist : 0.0f;
+		}
+		if (pixelsPerUnit > 0.0f)
+			uvPerPixel = uvDensity / pixelsPerUnit;
+	}
+
+	TextureStreamer &streamer = rc->textureStreamer;
+	if (material.diffuseMap) streamer.Request(*material.diffuseMap, uvPerPixel);
+	if (material.normalMap) streamer.Request(*material.normalMap, uvPerPixel);
+	if (material.specularMap) streamer.Request(*material.specularMap, uvPerPixel);
+	if (material.specularIntensityMap) streamer.Request(*material.specularIntensityMap, uvPerPixel);
+	if (material.opacityMask) streamer.Request(*material.opacityMask, uvPerPixel);
 }
 
 void Mesh::ComputeTangents()
@@ -105,11 +179,31 @@ bool Mesh::Draw()
 {
 	if (rc->IsFrustumCullingEnabled() && !rc->frustumCuller.Cull(boundingBox))
 		return false;
+	if (rc->IsOcclusionCullingEnabled() && !rc->occlusionCuller.Cull(boundingBox))
+		return false;
 	if (!indices) return false;
 
 	vao.Bind();
 	const KnownUniforms &u = rc->GetCurProgram()->GetKnownUniforms();
 
+	if (rc->IsDepthOnlyEnabled())
+	{
+		// only what decides coverage; the LOD is the one the camera chose,
+		// which is a frame old for passes drawn before the camera's. A mesh
+		// the camera did not draw picks its own from the current matrices.
+		if (material.opacityMask) {
+			glUniform1i(u.mtl_useOpacityMask, 1);
+			material.opacityMask->Bind();
+		}
+		int lod = rc->GetFrameNumber() - lodFrame <= 1 ? curLod : selectLod();
+		int first = lod ? lods[lod - 1].firstIndex : firstIndex;
+		int count = lod ? lods[lod - 1].numIndices : GetIndexCount();
+		indices->DrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, first * sizeof(int));
+		if (material.opacityMask) glUniform1i(u.mtl_useOpacityMask, 0);
+		return true;
+	}
+
+	if (rc->IsTextureStreamingEnabled()) requestTextures();
 	glUniform1i(u.mtl_mode, (int)material.mode);
 
 	if (material.diffuseMap) {
@@ -138,7 +232,11 @@ bool Mesh::Draw()
 		}
 	}
 
-	indices->DrawElements(GL_TRIANGLES, GetIndexCount(), GL_UNSIGNED_INT, firstIndex * sizeof(int));
+	int lod = selectLod();
+	lodFrame = rc->GetFrameNumber();
+	int first = lod ? lods[lod - 1].firstIndex : firstIndex;
+	int count = lod ? lods[lod - 1].numIndices : GetIndexCount();
+	indices->DrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, first * sizeof(int));
 
 	if (material.diffuseMap) glUniform1i(u.mtl_useDiffuseMap, 0);
 	if (material.specularMap) glUniform1i(u.mtl_useSpecularMap, 0);
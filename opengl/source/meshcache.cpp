@@ -0,0 +1,378 @@
+#include "meshcache.h"
+#include "modelloader.h"
+#include "mappedfile.h"
+#include "assetcache.h"
+#include "stringhelp.h"
+#include <fstream>
+#include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#define MESH_CACHE_SIGNATURE 0x3148534D // MSH1
+#define MESH_CACHE_VERSION 1
+#define MESH_CACHE_ALIGN 16
+
+#define MC_HAS_NORMALS 1
+#define MC_HAS_TEXCOORDS 2
+#define MC_HAS_TANGENTS 4
+
+enum MeshCacheSection
+{
+	MC_VERTICES,
+	MC_NORMALS,
+	MC_TEXCOORDS,
+	MC_TANGENTS,
+	MC_BINORMALS,
+	MC_INDICES,
+	MC_MESHES,
+	MC_LODS,
+	MC_STRINGS,
+	MC_NUM_SECTIONS
+};
+
+#pragma pack(push, 1)
+struct MESHCACHEHEADER
+{
+	DWORD signature;
+	DWORD version;
+	DWORD separateMeshes;
+	DWORD numLods;
+	float lodReduction;
+	unsigned long long sourceSize;
+	unsigned long long sourceTime;
+	unsigned long long sourceHash;
+	unsigned long long mtlSize; // both 0 without a material library
+	unsigned long long mtlTime;
+	DWORD numVertices;
+	DWORD numIndices;
+	DWORD numMeshes;
+	DWORD numLodRanges;
+	DWORD flags;
+	DWORD materialLib; // offset in the string table
+	DWORD sections[MC_NUM_SECTIONS]; // file offsets
+	DWORD sizes[MC_NUM_SECTIONS];
+};
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+struct MESHCACHEMESH
+{
+	DWORD material; // offset in the string table
+	int firstIndex;
+	int numIndices;
+	Vector3f vmin;
+	Vector3f vmax;
+	float uvDensity;
+};
+#pragma pack(pop)
+
+static long long getTicks()
+{
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+static float ticksToMs(long long ticks)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (float)(ticks * 1000.0 / freq.QuadPart);
+}
+
+static unsigned long long hashBytes(const BYTE *data, size_t size, unsigned long long h = 0xCBF29CE484222325ULL)
+{
+	const unsigned long long k = 0x9E3779B97F4A7C15ULL;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		unsigned long long w;
+		memcpy(&w, data + i, 8);
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+	if (i < size) {
+		unsigned long long w = 0;
+		memcpy(&w, data + i, size - i);
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+static bool getFileStamp(const string &filename, unsigned long long &size, unsigned long long &time)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attr))
+		return false;
+	size = (unsigned long long)attr.nFileSizeHigh << 32 | attr.nFileSizeLow;
+	time = (unsigned long long)attr.ftLastWriteTime.dwHighDateTime << 32 | attr.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+static DWORD addString(vector<char> &table, const string &s)
+{
+	DWORD offset = table.size();
+	table.insert(table.end(), s.begin(), s.end());
+	table.push_back(0);
+	return offset;
+}
+
+// firstIndex and numIndices (-1 - up to the end) within numIndices
+static bool validRange(int first, int count, DWORD numIndices)
+{
+	if (first < 0 || (DWORD)first > numIndices) return false;
+	return count == -1 || (count >= 0 && (DWORD)count <= numIndices - first);
+}
+
+MeshCache::MeshCache(const char *dir)
+{
+	SetDirectory(dir);
+	ResetStats();
+}
+
+void MeshCache::SetDirectory(const string &dir) {
+	this->dir = AssetCache::CanonicalPath(dir);
+}
+
+string MeshCache::entryPath(const char *filename, const MeshCacheKey &key) const
+{
+	string source = AssetCache::CanonicalPath(filename);
+	unsigned long long h = hashBytes((const BYTE *)source.data(), source.size());
+	DWORD options[3] = { (DWORD)key.separateMeshes, (DWORD)key.numLods, 0 };
+	memcpy(&options[2], &key.lodReduction, 4);
+	h = hashBytes((const BYTE *)options, sizeof(options), h);
+
+	char name[32] = "";
+	sprintf_s(name, "%016llx.mcache", h);
+	return strhlp::joinPath(dir, name);
+}
+
+bool MeshCache::Read(const char *filename, const MeshCacheKey &key, ModelData &data)
+{
+	long long start = getTicks();
+	MappedFile file(entryPath(filename, key).c_str());
+	if (!file || file.GetSize() < sizeof(MESHCACHEHEADER)) {
+		unique_lock<mutex> l(lock);
+		stats.numMisses++;
+		return false;
+	}
+
+	const BYTE *base = file.GetData();
+	const MESHCACHEHEADER &h = *(const MESHCACHEHEADER *)base;
+	bool valid = h.signature == MESH_CACHE_SIGNATURE && h.version == MESH_CACHE_VERSION &&
+		h.separateMeshes == (DWORD)key.separateMeshes && h.numLods == (DWORD)key.numLods &&
+		h.lodReduction == key.lodReduction;
+
+	for (int i = 0; i < MC_NUM_SECTIONS && valid; i++)
+		valid = (size_t)h.sections[i] + h.sizes[i] <= file.GetSize();
+	// every array that is copied out below has to be as long as the copy
+	size_t vec3Size = h.numVertices*sizeof(Vector3f);
+	valid = valid && h.sizes[MC_VERTICES] == vec3Size &&
+		(!(h.flags & MC_HAS_NORMALS) || h.sizes[MC_NORMALS] == vec3Size) &&
+		(!(h.flags & MC_HAS_TEXCOORDS) || h.sizes[MC_TEXCOORDS] == h.numVertices*sizeof(Vector2f)) &&
+		(!(h.flags & MC_HAS_TANGENTS) || (h.sizes[MC_TANGENTS] == vec3Size && h.sizes[MC_BINORMALS] == vec3Size)) &&
+		h.sizes[MC_INDICES] == h.numIndices*sizeof(int) &&
+		h.sizes[MC_MESHES] == h.numMeshes*sizeof(MESHCACHEMESH) &&
+		h.sizes[MC_LODS] == h.numLodRanges*sizeof(MeshLodDesc) &&
+		(h.sizes[MC_STRINGS] == 0 || base[h.sections[MC_STRINGS] + h.sizes[MC_STRINGS] - 1] == 0);
+
+	const char *strings = (const char *)base + h.sections[MC_STRINGS];
+	string materialLib = valid && h.materialLib < h.sizes[MC_STRINGS] ? strings + h.materialLib : "";
+
+	// a touched file with the same contents is still good; its new time
+	// is stored once the entry is read, so it is not hashed every time
+	unsigned long long size = 0, time = 0, sourceTime = 0;
+	bool touched = false;
+	if (valid)
+		valid = getFileStamp(filename, size, time) && size == h.sourceSize;
+	if (valid && time != h.sourceTime) {
+		MappedFile source(filename);
+		valid = source && hashBytes(source.GetData(), source.GetSize()) == h.sourceHash;
+		touched = true;
+		sourceTime = time;
+	}
+	if (valid && !materialLib.empty()) {
+		string mtl = strhlp::joinPath(key.basePath, materialLib);
+		valid = getFileStamp(mtl, size, time) && size == h.mtlSize && time == h.mtlTime;
+	}
+
+	if (!valid) {
+		unique_lock<mutex> l(lock);
+		stats.numMisses++;
+		stats.numStale++;
+		return false;
+	}
+
+	const Vector3f *verts = (const Vector3f *)(base + h.sections[MC_VERTICES]);
+	data.vertices.assign(verts, verts + h.numVertices);
+	if (h.flags & MC_HAS_NORMALS) {
+		const Vector3f *norms = (const Vector3f *)(base + h.sections[MC_NORMALS]);
+		data.normals.assign(norms, norms + h.numVertices);
+	}
+	if (h.flags & MC_HAS_TEXCOORDS) {
+		const Vector2f *texs = (const Vector2f *)(base + h.sections[MC_TEXCOORDS]);
+		data.texCoords.assign(texs, texs + h.numVertices);
+	}
+	if (h.flags & MC_HAS_TANGENTS) {
+		const Vector3f *ts = (const Vector3f *)(base + h.sections[MC_TANGENTS]);
+		const Vector3f *bs = (const Vector3f *)(base + h.sections[MC_BINORMALS]);
+		data.tangents.assign(ts, ts + h.numVertices);
+		data.binormals.assign(bs, bs + h.numVertices);
+	}
+	const int *inds = (const int *)(base + h.sections[MC_INDICES]);
+	data.indices.assign(inds, inds + h.numIndices);
+	const MeshLodDesc *lods = (const MeshLodDesc *)(base + h.sections[MC_LODS]);
+	data.lods.assign(lods, lods + h.numLodRanges);
+
+	// ranges and indices are used to read the arrays above, so a damaged
+	// entry is dropped here rather than read past their ends
+	const MESHCACHEMESH *meshes = (const MESHCACHEMESH *)(base + h.sections[MC_MESHES]);
+	for (DWORD i = 0; i < h.numIndices && valid; i++)
+		valid = (DWORD)inds[i] < h.numVertices;
+	for (DWORD i = 0; i < h.numMeshes && valid; i++)
+		valid = validRange(meshes[i].firstIndex, meshes[i].numIndices, h.numIndices);
+	for (DWORD i = 0; i < h.numLodRanges && valid; i++)
+		valid = lods[i].numIndices >= 0 && validRange(lods[i].firstIndex, lods[i].numIndices, h.numIndices);
+	if (!valid) {
+		data = ModelData();
+		unique_lock<mutex> l(lock);
+		stats.numMisses++;
+		stats.numStale++;
+		return false;
+	}
+
+	data.meshes.resize(h.numMeshes);
+	for (DWORD i = 0; i < h.numMeshes; i++) {
+		ModelMeshDesc &m = data.meshes[i];
+		m.material = meshes[i].material < h.sizes[MC_STRINGS] ? strings + meshes[i].material : "";
+		m.firstIndex = meshes[i].firstIndex;
+		m.numIndices = meshes[i].numIndices;
+		m.boundingBox.vmin = meshes[i].vmin;
+		m.boundingBox.vmax = meshes[i].vmax;
+		m.uvDensity = meshes[i].uvDensity;
+	}
+	data.materialLib = materialLib;
+
+	size_t fileSize = file.GetSize();
+	if (touched) {
+		// the mapping has to be gone before the file is written
+		file.Close();
+		fstream entry(entryPath(filename, key).c_str(), ios::in | ios::out | ios::binary);
+		entry.seekp(offsetof(MESHCACHEHEADER, sourceTime));
+		entry.write((const char *)&sourceTime, sizeof(sourceTime));
+	}
+
+	unique_lock<mutex> l(lock);
+	stats.numHits++;
+	stats.bytesRead += (double)fileSize;
+	stats.readTime += ticksToMs(getTicks() - start);
+	return true;
+}
+
+bool MeshCache::Write(const char *filename, const MeshCacheKey &key, const ModelData &data)
+{
+	long long start = getTicks();
+
+	MESHCACHEHEADER h;
+	memset(&h, 0, sizeof(h));
+	h.signature = MESH_CACHE_SIGNATURE;
+	h.version = MESH_CACHE_VERSION;
+	h.separateMeshes = key.separateMeshes;
+	h.numLods = key.numLods;
+	h.lodReduction = key.lodReduction;
+
+	MappedFile source(filename);
+	if (!source || !getFileStamp(filename, h.sourceSize, h.sourceTime))
+		return false;
+	h.sourceHash = hashBytes(source.GetData(), source.GetSize());
+	if (!data.materialLib.empty())
+		getFileStamp(strhlp::joinPath(key.basePath, data.materialLib), h.mtlSize, h.mtlTime);
+
+	int numVertices = data.vertices.size();
+	h.numVertices = numVertices;
+	h.numIndices = data.indices.size();
+	h.numMeshes = data.meshes.size();
+	h.numLodRanges = data.lods.size();
+	if (!data.normals.empty()) h.flags |= MC_HAS_NORMALS;
+	if (!data.texCoords.empty()) h.flags |= MC_HAS_TEXCOORDS;
+	if (!data.tangents.empty()) h.flags |= MC_HAS_TANGENTS;
+
+	vector<char> strings;
+	h.materialLib = addString(strings, data.materialLib);
+	vector<MESHCACHEMESH> meshes(h.numMeshes);
+	for (DWORD i = 0; i < h.numMeshes; i++) {
+		const ModelMeshDesc &m = data.meshes[i];
+		MESHCACHEMESH &dst = meshes[i];
+		dst.material = addString(strings, m.material);
+		dst.firstIndex = m.firstIndex;
+		dst.numIndices = m.numIndices;
+		dst.vmin = m.boundingBox.vmin;
+		dst.vmax = m.boundingBox.vmax;
+		dst.uvDensity = m.uvDensity;
+	}
+
+	const void *src[MC_NUM_SECTIONS] = {
+		data.vertices.data(), data.normals.data(), data.texCoords.data(),
+		data.tangents.data(), data.binormals.data(), data.indices.data(),
+		meshes.data(), data.lods.data(), strings.data()
+	};
+	h.sizes[MC_VERTICES] = numVertices*sizeof(Vector3f);
+	h.sizes[MC_NORMALS] = data.normals.size()*sizeof(Vector3f);
+	h.sizes[MC_TEXCOORDS] = data.texCoords.size()*sizeof(Vector2f);
+	h.sizes[MC_TANGENTS] = data.tangents.size()*sizeof(Vector3f);
+	h.sizes[MC_BINORMALS] = data.binormals.size()*sizeof(Vector3f);
+	h.sizes[MC_INDICES] = h.numIndices*sizeof(int);
+	h.sizes[MC_MESHES] = h.numMeshes*sizeof(MESHCACHEMESH);
+	h.sizes[MC_LODS] = h.numLodRanges*sizeof(MeshLodDesc);
+	h.sizes[MC_STRINGS] = strings.size();
+
+	// every array starts on an aligned offset
+	size_t offset = sizeof(h);
+	for (int i = 0; i < MC_NUM_SECTIONS; i++) {
+		offset = (offset + MESH_CACHE_ALIGN - 1) & ~(size_t)(MESH_CACHE_ALIGN - 1);
+		h.sections[i] = offset;
+		offset += h.sizes[i];
+	}
+
+	vector<BYTE> buffer(offset, 0);
+	memcpy(buffer.data(), &h, sizeof(h));
+	for (int i = 0; i < MC_NUM_SECTIONS; i++)
+		if (h.sizes[i]) memcpy(&buffer[h.sections[i]], src[i], h.sizes[i]);
+
+	// written under a temporary name, so readers never see half a file
+	CreateDirectoryA(dir.c_str(), NULL);
+	string path = entryPath(filename, key);
+	char suffix[32] = "";
+	sprintf_s(suffix, ".%lu.tmp", GetCurrentThreadId());
+	string tmp = path + suffix;
+
+	ofstream file(tmp.c_str(), ios::binary);
+	file.write((const char *)buffer.data(), buffer.size());
+	file.close();
+	if (!file || !MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFileA(tmp.c_str());
+		return false;
+	}
+
+	unique_lock<mutex> l(lock);
+	stats.numWrites++;
+	stats.bytesWritten += (double)buffer.size();
+	stats.writeTime += ticksToMs(getTicks() - start);
+	return true;
+}
+
+void MeshCache::Remove(const char *filename, const MeshCacheKey &key) {
+	DeleteFileA(entryPath(filename, key).c_str());
+}
+
+MeshCacheStats MeshCache::GetStats()
+{
+	unique_lock<mutex> l(lock);
+	return stats;
+}
+
+void MeshCache::ResetStats()
+{
+	unique_lock<mutex> l(lock);
+	memset(&stats, 0, sizeof(stats));
+}
\ No newline at end of file
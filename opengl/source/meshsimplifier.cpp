@@ -0,0 +1,275 @@
+#include "meshsimplifier.h"
+#include <algorithm>
+
+#define SIMPLIFY_MAX_PASSES 64
+
+void MeshSimplifier::Quadric::Add(const Quadric &q)
+{
+	a00 += q.a00; a01 += q.a01; a02 += q.a02;
+	a11 += q.a11; a12 += q.a12; a22 += q.a22;
+	b0 += q.b0; b1 += q.b1; b2 += q.b2;
+	c += q.c;
+}
+
+double MeshSimplifier::Quadric::Error(const Vector3f &p) const
+{
+	double x = p.x, y = p.y, z = p.z;
+	double e = a00*x*x + a11*y*y + a22*z*z
+		+ 2.0*(a01*x*y + a02*x*z + a12*y*z)
+		+ 2.0*(b0*x + b1*y + b2*z) + c;
+	return e > 0.0 ? e : 0.0;
+}
+
+struct PositionLess
+{
+	const Vector3f *v;
+	PositionLess(const Vector3f *v) : v(v) { }
+	bool operator()(int i, int j) const {
+		if (v[i].x != v[j].x) return v[i].x < v[j].x;
+		if (v[i].y != v[j].y) return v[i].y < v[j].y;
+		return v[i].z < v[j].z;
+	}
+};
+
+MeshSimplifier::MeshSimplifier(const Vector3f *vertices, int numVertices)
+	: srcVertices(vertices), srcNumVertices(numVertices), vertices(NULL), numVertices(0)
+{
+	vector<int> order(numVertices);
+	for (int i = 0; i < numVertices; i++) order[i] = i;
+	sort(order.begin(), order.end(), PositionLess(vertices));
+
+	srcPosRemap.resize(numVertices);
+	srcSeam.assign(numVertices, 0);
+
+	for (int i = 0; i < numVertices; )
+	{
+		int j = i + 1;
+		while (j < numVertices && vertices[order[j]] == vertices[order[i]]) j++;
+
+		int first = order[i];
+		for (int k = i; k < j; k++) {
+			first = min(first, order[k]);
+			if (j - i > 1) srcSeam[order[k]] = 1;
+		}
+		for (int k = i; k < j; k++)
+			srcPosRemap[order[k]] = first;
+		i = j;
+	}
+
+	localIndex.assign(numVertices, -1);
+	localGroup.assign(numVertices, -1);
+}
+
+// Renumbers the vertices referenced by inds from 0, so that the passes
+// over a mesh cost its own vertex count rather than the whole model's.
+// Seams are still those found over all of the model's vertices.
+void MeshSimplifier::compact(vector<int> &inds)
+{
+	localVertices.clear();
+	globalIndex.clear();
+	posRemap.clear();
+	seam.clear();
+
+	for (int i = 0, n = inds.size(); i < n; i++)
+	{
+		int g = inds[i];
+		if (localIndex[g] == -1)
+		{
+			int l = globalIndex.size();
+			localIndex[g] = l;
+			globalIndex.push_back(g);
+			localVertices.push_back(srcVertices[g]);
+			seam.push_back(srcSeam[g]);
+
+			int group = srcPosRemap[g];
+			if (localGroup[group] == -1) localGroup[group] = l;
+			posRemap.push_back(localGroup[group]);
+		}
+		inds[i] = localIndex[g];
+	}
+
+	for (int i = 0, n = globalIndex.size(); i < n; i++) {
+		localIndex[globalIndex[i]] = -1;
+		localGroup[srcPosRemap[globalIndex[i]]] = -1;
+	}
+
+	vertices = localVertices.data();
+	numVertices = localVertices.size();
+}
+
+void MeshSimplifier::computeQuadrics(const vector<int> &inds)
+{
+	Quadric zero = { };
+	quadrics.assign(numVertices, zero);
+
+	for (int i = 0, n = inds.size(); i < n; i += 3)
+	{
+		const Vector3f &p0 = vertices[inds[i]];
+		const Vector3f &p1 = vertices[inds[i+1]];
+		const Vector3f &p2 = vertices[inds[i+2]];
+
+		Vector3f normal = Cross(p1 - p0, p2 - p0);
+		float len = normal.Length();
+		if (len == 0.0f) continue;
+
+		// area-weighted plane quadric
+		double w = len * 0.5;
+		double nx = normal.x / len, ny = normal.y / len, nz = normal.z / len;
+		double d = -(nx*p0.x + ny*p0.y + nz*p0.z);
+
+		Quadric q;
+		q.a00 = w*nx*nx; q.a01 = w*nx*ny; q.a02 = w*nx*nz;
+		q.a11 = w*ny*ny; q.a12 = w*ny*nz; q.a22 = w*nz*nz;
+		q.b0 = w*nx*d; q.b1 = w*ny*d; q.b2 = w*nz*d;
+		q.c = w*d*d;
+
+		for (int k = 0; k < 3; k++)
+			quadrics[posRemap[inds[i+k]]].Add(q);
+	}
+}
+
+void MeshSimplifier::lockBorders(const vector<int> &inds)
+{
+	locked.assign(numVertices, 0);
+
+	// an edge is on the border if no triangle walks it in the other direction
+	vector<pair<int, int> > edges;
+	edges.reserve(inds.size());
+	for (int i = 0, n = inds.size(); i < n; i += 3)
+		for (int k = 0; k < 3; k++) {
+			int a = posRemap[inds[i + k]];
+			int b = posRemap[inds[i + (k + 1) % 3]];
+			edges.push_back(make_pair(a, b));
+		}
+	sort(edges.begin(), edges.end());
+
+	for (int i = 0, n = edges.size(); i < n; i++)
+	{
+		pair<int, int> rev(edges[i].second, edges[i].first);
+		if (!binary_search(edges.begin(), edges.end(), rev))
+			locked[edges[i].first] = locked[edges[i].second] = 1;
+	}
+}
+
+void MeshSimplifier::buildAdjacency(const vector<int> &inds)
+{
+	adjOffset.assign(numVertices + 1, 0);
+	for (int i = 0, n = inds.size(); i < n; i++)
+		adjOffset[inds[i] + 1]++;
+	for (int i = 0; i < numVertices; i++)
+		adjOffset[i + 1] += adjOffset[i];
+
+	vector<int> fill(adjOffset.begin(), adjOffset.end() - 1);
+	adjTris.resize(inds.size());
+	for (int i = 0, n = inds.size(); i < n; i++)
+		adjTris[fill[inds[i]]++] = i / 3;
+}
+
+bool MeshSimplifier::flips(const vector<int> &inds, int from, int to) const
+{
+	const Vector3f &target = vertices[to];
+
+	for (int i = adjOffset[from]; i < adjOffset[from + 1]; i++)
+	{
+		const int *tri = &inds[adjTris[i] * 3];
+		if (tri[0] == to || tri[1] == to || tri[2] == to)
+			continue; // this triangle collapses
+
+		Vector3f p[3], q[3];
+		for (int k = 0; k < 3; k++) {
+			p[k] = vertices[tri[k]];
+			q[k] = tri[k] == from ? target : p[k];
+		}
+
+		Vector3f n0 = Cross(p[1] - p[0], p[2] - p[0]);
+		Vector3f n1 = Cross(q[1] - q[0], q[2] - q[0]);
+		if (Dot(n0, n1) <= 0.0f) return true;
+	}
+	return false;
+}
+
+float MeshSimplifier::Simplify(const int *indices, int numIndices, int targetCount, vector<int> &result)
+{
+	result.assign(indices, indices + numIndices);
+	if (numIndices <= targetCount) return 0.0f;
+
+	compact(result);
+	computeQuadrics(result);
+	lockBorders(result);
+
+	collapseTo.resize(numVertices);
+	touched.resize(numVertices);
+	float maxError = 0.0f;
+
+	vector<Collapse> collapses;
+	for (int pass = 0; pass < SIMPLIFY_MAX_PASSES && (int)result.size() > targetCount; pass++)
+	{
+		buildAdjacency(result);
+
+		collapses.clear();
+		for (int i = 0, n = result.size(); i < n; i += 3)
+			for (int k = 0; k < 3; k++)
+			{
+				int a = result[i + k];
+				int b = result[i + (k + 1) % 3];
+
+				for (int dir = 0; dir < 2; dir++, swap(a, b))
+				{
+					if (seam[a] || locked[posRemap[a]]) continue;
+
+					Quadric q = quadrics[a];
+					q.Add(quadrics[posRemap[b]]);
+					Collapse c = { a, b, (float)q.Error(vertices[b]) };
+					collapses.push_back(c);
+				}
+			}
+		if (collapses.empty()) break;
+		sort(collapses.begin(), collapses.end());
+
+		for (int i = 0; i < numVertices; i++) collapseTo[i] = i;
+		touched.assign(numVertices, 0);
+
+		// an interior collapse removes two triangles
+		int removeTris = ((int)result.size() - targetCount) / 3;
+		int removed = 0, numCollapsed = 0;
+
+		for (int i = 0, n = collapses.size(); i < n && removed < removeTris; i++)
+		{
+			const Collapse &c = collapses[i];
+			if (touched[c.from] || touched[c.to]) continue;
+			if (flips(result, c.from, c.to)) continue;
+
+			collapseTo[c.from] = c.to;
+			quadrics[posRemap[c.to]].Add(quadrics[c.from]);
+			maxError = max(maxError, c.error);
+			numCollapsed++;
+
+			// the neighbourhood of a collapsed vertex is stale until the next pass
+			for (int j = adjOffset[c.from]; j < adjOffset[c.from + 1]; j++)
+			{
+				const int *tri = &result[adjTris[j] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+				if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+					removed++;
+			}
+		}
+		if (numCollapsed == 0) break;
+
+		int write = 0;
+		for (int i = 0, n = result.size(); i < n; i += 3)
+		{
+			int a = collapseTo[result[i]];
+			int b = collapseTo[result[i+1]];
+			int c = collapseTo[result[i+2]];
+			if (a == b || b == c || a == c) continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	for (int i = 0, n = result.size(); i < n; i++)
+		result[i] = globalIndex[result[i]];
+	return maxError;
+}
\ No newline at end of file
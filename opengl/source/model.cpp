@@ -4,17 +4,19 @@
 Model::Model(GLRenderingContext *rc)
 	: rc(rc), scale(Vector3f(1.0f)) { }
 
-bool Model::LoadObj(const char *filename)
+bool Model::LoadObj(const char *filename, int numLods)
 {
 	meshes.clear();
 	ModelLoader loader(rc);
+	loader.SetLodCount(numLods);
 	return loader.LoadObj(filename, meshes);
 }
 
-bool Model::LoadRaw(const char *filename)
+bool Model::LoadRaw(const char *filename, int numLods)
 {
 	meshes.clear();
 	ModelLoader loader(rc);
+	loader.SetLodCount(numLods);
 	return loader.LoadRaw(filename, meshes);
 }
 
@@ -36,9 +38,11 @@ int Model::Draw()
 	if (shader) shader->Use();
 	rc->PushModelView();
 	ApplyTransform();
+
 	for (int i = 0, s = meshes.size(); i < s; i++) {
 		if (meshes[i].Draw()) drawCalls++;
 	}
+
 	rc->PopModelView();
 	return drawCalls;
 }
\ No newline at end of file
@@ -1,11 +1,13 @@
 #include "modelloader.h"
 #include "stringhelp.h"
 #include "material.h"
+#include "meshsimplifier.h"
 #include <fstream>
 
 #define RAW_FILE_SIGNATURE 0x00574152
 #define RAW_HAS_NORMALS 1
 #define RAW_HAS_TEXCOORDS 2
+#define RAW_HAS_LODS 4
 
 #pragma pack(push, 1)
 struct RAWSTRING
@@ -37,6 +39,16 @@ struct RAWMESHDESC
 };
 #pragma pack(pop)
 
+// optional section at the end of the file: numRanges MeshLodDesc
+// entries followed by numIndices indices that continue the index array
+#pragma pack(push, 1)
+struct RAWLODHEADER
+{
+	DWORD numRanges;
+	DWORD numIndices;
+};
+#pragma pack(pop)
+
 void ModelLoader::read_num(const string &line, char &c, int &i, int &n)
 {
 	n = 0;
@@ -50,9 +62,16 @@ void ModelLoader::read_num(const string &line, char &c, int &i, int &n)
 	if (neg) n = -n;
 }
 
-void ModelLoader::setupVao(vector<Mesh> &meshes, bool computeTangents)
+const MaterialDesc *ModelData::FindMaterial(const string &name) const
+{
+	for (int i = 0, n = materials.size(); i < n; i++)
+		if (materials[i].name == name) return &materials[i];
+	return NULL;
+}
+
+void ModelLoader::setupVao(vector<Mesh> &meshes, int firstMesh, const ModelData &data)
 {
-	Mesh &m0 = meshes[0];
+	Mesh &m0 = meshes[firstMesh];
 
 	int attribs = VA_XYZ;
 	m0.vao.Bind();
@@ -67,11 +86,18 @@ void ModelLoader::setupVao(vector<Mesh> &meshes, bool computeTangents)
 	}
 	m0.vao.EnableAttribs(attribs);
 
-	if (!computeTangents) return;
+	if (data.tangents.empty()) return;
 
-	if (meshes.size() == 1)
+	int dataSize = data.tangents.size()*sizeof(Vector3f);
+	VertexBuffer tangents(rc, GL_ARRAY_BUFFER);
+	VertexBuffer binormals(rc, GL_ARRAY_BUFFER);
+	tangents.SetData(dataSize, data.tangents.data(), GL_STATIC_DRAW);
+	binormals.SetData(dataSize, data.binormals.data(), GL_STATIC_DRAW);
+
+	if (meshes.size() - firstMesh == 1)
 	{
-		m0.ComputeTangents();
+		m0.tangents = tangents;
+		m0.binormals = binormals;
 		m0.vao.Bind();
 		m0.vao.EnableVertexAttrib(AttribLocation::Tangent);
 		m0.vao.EnableVertexAttrib(AttribLocation::Binormal);
@@ -80,8 +106,6 @@ void ModelLoader::setupVao(vector<Mesh> &meshes, bool computeTangents)
 	}
 	else
 	{
-		VertexBuffer tangents(rc, GL_ARRAY_BUFFER);
-		VertexBuffer binormals(rc, GL_ARRAY_BUFFER);
 		VertexArrayObject vao_normalMap;
 
 		vao_normalMap.Bind();
@@ -94,44 +118,163 @@ void ModelLoader::setupVao(vector<Mesh> &meshes, bool computeTangents)
 		if (texCoords)
 			texCoords->AttribPointer(AttribLocation::TexCoord, 2, GL_FLOAT);
 
-		int numVertices = vertices->GetSize() / sizeof(Vector3f);
-		Vector3f *data = new Vector3f[numVertices];
-		int dataSize = numVertices*sizeof(Vector3f);
-		ZeroMemory(data, dataSize);
-		tangents.SetData(dataSize, data, GL_STATIC_DRAW);
-		binormals.SetData(dataSize, data, GL_STATIC_DRAW);
-		delete[] data;
-
-		for (int i = 0, s = meshes.size(); i < s; i++)
+		for (int i = firstMesh, s = meshes.size(); i < s; i++)
 		{
 			Mesh &m = meshes[i];
 			m.tangents = tangents;
 			m.binormals = binormals;
-			if (m.material.normalMap) {
+			if (m.material.normalMap)
 				m.vao = vao_normalMap;
-				m.ComputeTangents();
-			}
 		}
 	}
 }
 
-bool ModelLoader::loadObj(const char *filename, vector<Mesh> &meshes, bool separateMeshes)
+// same as Mesh::ComputeTangents() but on the CPU copy of the model; a
+// single mesh always gets tangents, otherwise only normal-mapped ones do
+void ModelLoader::computeTangents(ModelData &data)
+{
+	int numVertices = data.vertices.size();
+	if (data.normals.empty() || data.texCoords.empty()) return;
+
+	data.tangents.assign(numVertices, Vector3f());
+	data.binormals.assign(numVertices, Vector3f());
+
+	const Vector3f *verts = data.vertices.data();
+	const Vector2f *texs = data.texCoords.data();
+	const int *inds = data.indices.data();
+	Vector3f *ts = data.tangents.data();
+	Vector3f *bs = data.binormals.data();
+
+	for (int k = 0, numMeshes = data.meshes.size(); k < numMeshes; k++)
+	{
+		const ModelMeshDesc &m = data.meshes[k];
+		const MaterialDesc *material = data.FindMaterial(m.material);
+		if (numMeshes != 1 && (!material || material->normalMap.empty()))
+			continue;
+
+		int count = m.numIndices >= 0 ? m.numIndices : (int)data.indices.size() - m.firstIndex;
+		for (int i = m.firstIndex, n = m.firstIndex + count; i < n; i += 3)
+		{
+			int i1 = inds[i], i2 = inds[i+1], i3 = inds[i+2];
+
+			const Vector3f &v1 = verts[i1];
+			const Vector3f &v2 = verts[i2];
+			const Vector3f &v3 = verts[i3];
+
+			const Vector2f &t1 = texs[i1];
+			const Vector2f &t2 = texs[i2];
+			const Vector2f &t3 = texs[i3];
+
+			Vector3f edge1 = v2 - v1;
+			Vector3f edge2 = v3 - v1;
+			Vector2f uv1 = t2 - t1;
+			Vector2f uv2 = t3 - t1;
+
+			float f = 1.0f / (uv1.x * uv2.y - uv2.x * uv1.y);
+			Vector3f tangent = (uv2.y * edge1 - uv1.y * edge2) * f;
+			Vector3f binormal = (uv1.x * edge2 - uv2.x * edge1) * f;
+			tangent.Normalize();
+			binormal.Normalize();
+
+			ts[i1] = ts[i2] = ts[i3] = tangent;
+			bs[i1] = bs[i2] = bs[i3] = binormal;
+		}
+	}
+}
+
+// the texture streamer picks mip levels from this: the square root of
+// the UV area of a mesh over its surface area
+void ModelLoader::computeUVDensity(ModelData &data)
+{
+	if (data.texCoords.empty()) return;
+
+	const Vector3f *verts = data.vertices.data();
+	const Vector2f *texs = data.texCoords.data();
+	const int *inds = data.indices.data();
+
+	for (int k = 0, numMeshes = data.meshes.size(); k < numMeshes; k++)
+	{
+		ModelMeshDesc &m = data.meshes[k];
+		int count = m.numIndices >= 0 ? m.numIndices : (int)data.indices.size() - m.firstIndex;
+		double area = 0.0, uvArea = 0.0;
+
+		for (int i = m.firstIndex, n = m.firstIndex + count; i < n; i += 3)
+		{
+			int i1 = inds[i], i2 = inds[i+1], i3 = inds[i+2];
+			area += Cross(verts[i2] - verts[i1], verts[i3] - verts[i1]).Length();
+
+			Vector2f uv1 = texs[i2] - texs[i1];
+			Vector2f uv2 = texs[i3] - texs[i1];
+			uvArea += fabs(uv1.x * uv2.y - uv2.x * uv1.y);
+		}
+		m.uvDensity = area > 0.0 ? (float)sqrt(uvArea / area) : 0.0f;
+	}
+}
+
+void ModelLoader::generateLods(const Vector3f *verts, int numVertices, vector<int> &inds,
+	const vector<int> &meshFirst, vector<MeshLodDesc> &lods)
+{
+	MeshSimplifier simplifier(verts, numVertices);
+	int numBaseIndices = inds.size();
+	vector<int> src, lod;
+
+	for (int i = 0, n = meshFirst.size(); i < n; i++)
+	{
+		int first = meshFirst[i];
+		int count = (i == n - 1 ? numBaseIndices : meshFirst[i + 1]) - first;
+		src.assign(inds.begin() + first, inds.begin() + first + count);
+
+		// each level is simplified from the previous one
+		float target = (float)count;
+		for (int k = 0; k < numLods && src.size() >= 3; k++)
+		{
+			target *= lodReduction;
+			simplifier.Simplify(src.data(), src.size(), (int)target, lod);
+
+			// stop when locked borders and seams leave little to collapse
+			if (lod.empty() || lod.size() > src.size() * 0.9f) break;
+
+			MeshLodDesc desc = { i, (int)inds.size(), (int)lod.size() };
+			lods.push_back(desc);
+			inds.insert(inds.end(), lod.begin(), lod.end());
+			src.swap(lod);
+		}
+	}
+}
+
+bool ModelLoader::ReadObj(const char *filename, ModelData &data, bool separateMeshes)
+{
+	MeshCacheKey key = { separateMeshes, numLods, lodReduction, basePath };
+	if (meshCache && meshCache->Read(filename, key, data)) {
+		if (!data.materialLib.empty())
+			MaterialLoader().ReadMtl(strhlp::joinPath(basePath, data.materialLib).c_str(), data.materials);
+		return true;
+	}
+
+	if (!parseObj(filename, data, separateMeshes)) return false;
+	if (meshCache) meshCache->Write(filename, key, data);
+	return true;
+}
+
+bool ModelLoader::parseObj(const char *filename, ModelData &data, bool separateMeshes)
 {
 	ifstream file(filename);
 	if (!file) return false;
 
-	Mesh mesh(rc);
-	Dictionary<Material> *mtlLib = NULL;
-	Material *curMaterial = NULL;
+	ModelMeshDesc mesh = { "", 0, -1 };
+	const MaterialDesc *curMaterial = NULL;
+	StringMap<int> materialIds; // usemtl names - indices in data.materials
 	string curMaterialName = "", lastMaterialName = "";
-	bool computeTangents = false;
+	bool needTangents = false;
 
 	Vector3f v;
 	Vector2f tc;
 
-	vector<Vector3f> verts, norms;
+	vector<Vector3f> &verts = data.vertices;
+	vector<Vector3f> norms;
 	vector<Vector2f> texs;
-	vector<int> iverts, inorms, itexs;
+	vector<int> &iverts = data.indices;
+	vector<int> inorms, itexs;
 
 	Vector3f vmax, vmin;
 	bool first_vert = true;
@@ -149,38 +292,36 @@ bool ModelLoader::loadObj(const char *filename, vector<Mesh> &meshes, bool separ
 		line = line.substr(i + 1);
 
 		if (prefix == "mtllib") {
-			mtlLib = rc->materials.GetLib(line.c_str());
-			if (!mtlLib) {
-				Dictionary<Material> materialLib;
-				Dictionary<Texture2D> &textureLib = rc->textures.GetDefaultLib();
-				MaterialLoader().LoadMtl(line.c_str(), materialLib, textureLib);
-				mtlLib = &rc->materials.AddLib(line.c_str(), materialLib);
-			}
+			data.materialLib = line;
+			data.materials.clear();
+			MaterialLoader().ReadMtl(strhlp::joinPath(basePath, line).c_str(), data.materials);
+			materialIds.Clear();
+			for (int i = 0, n = data.materials.size(); i < n; i++)
+				materialIds.Insert(data.materials[i].name, i);
 		}
 		else if (prefix == "usemtl")
 		{
 			if (curMaterialName != lastMaterialName)
 			{
 				if (curMaterial) {
-					mesh.material = *curMaterial;
+					mesh.material = curMaterialName;
 					lastMaterialName = curMaterialName;
 				}
-				mesh.SetFirstIndex(lastIndex);
-				mesh.SetIndexCount(iverts.size() - lastIndex);
+				mesh.firstIndex = lastIndex;
+				mesh.numIndices = iverts.size() - lastIndex;
 				mesh.boundingBox.vmin = vmin;
 				mesh.boundingBox.vmax = vmax;
-				mesh.boundingSphere.center = (vmax + vmin) / 2;
-				mesh.boundingSphere.radius = max(max(vmax.x - vmin.x, vmax.y - vmin.y), vmax.z - vmin.z);
-				meshes.push_back(mesh);
+				data.meshes.push_back(mesh);
 
 				lastIndex = iverts.size();
 				first_vert = true;
 			}
 
-			curMaterial = mtlLib->GetItem(line.c_str());
+			const int *id = materialIds.Find(line);
+			curMaterial = id ? &data.materials[*id] : NULL;
 			if (curMaterial) {
 				curMaterialName = line;
-				if (curMaterial->normalMap) computeTangents = true;
+				if (!curMaterial->normalMap.empty()) needTangents = true;
 			}
 		}
 		else if (prefix == "o" || prefix == "g")
@@ -191,16 +332,14 @@ bool ModelLoader::loadObj(const char *filename, vector<Mesh> &meshes, bool separ
 				first_mesh = false;
 			else {
 				if (curMaterial) {
-					mesh.material = *curMaterial;
+					mesh.material = curMaterialName;
 					lastMaterialName = curMaterialName;
 				}
-				mesh.SetFirstIndex(lastIndex);
-				mesh.SetIndexCount(iverts.size() - lastIndex);
+				mesh.firstIndex = lastIndex;
+				mesh.numIndices = iverts.size() - lastIndex;
 				mesh.boundingBox.vmin = vmin;
 				mesh.boundingBox.vmax = vmax;
-				mesh.boundingSphere.center = (vmax + vmin) / 2;
-				mesh.boundingSphere.radius = max(max(vmax.x - vmin.x, vmax.y - vmin.y), vmax.z - vmin.z);
-				meshes.push_back(mesh);
+				data.meshes.push_back(mesh);
 
 				lastIndex = iverts.size();
 				first_vert = true;
@@ -263,18 +402,16 @@ bool ModelLoader::loadObj(const char *filename, vector<Mesh> &meshes, bool separ
 		}
 	}
 
-	if (curMaterial) mesh.material = *curMaterial;
-	mesh.SetFirstIndex(lastIndex);
-	mesh.SetIndexCount(iverts.size() - lastIndex);
+	if (curMaterial) mesh.material = curMaterialName;
+	mesh.firstIndex = lastIndex;
+	mesh.numIndices = iverts.size() - lastIndex;
 	mesh.boundingBox.vmin = vmin;
 	mesh.boundingBox.vmax = vmax;
-	mesh.boundingSphere.center = (vmax + vmin) / 2;
-	mesh.boundingSphere.radius = max(max(vmax.x - vmin.x, vmax.y - vmin.y), vmax.z - vmin.z);
-	meshes.push_back(mesh);
+	data.meshes.push_back(mesh);
 
 	file.close();
 
-	if (meshes.size() == 1) meshes[0].SetIndexCount(-1);
+	if (data.meshes.size() == 1) data.meshes[0].numIndices = -1;
 
 	int numVertices = verts.size();
 	if (numVertices == 0) return false;
@@ -284,8 +421,8 @@ bool ModelLoader::loadObj(const char *filename, vector<Mesh> &meshes, bool separ
 
 	if (hasNormals || hasTexCoords)
 	{
-		vector<Vector3f> norms_new;
-		vector<Vector2f> texs_new;
+		vector<Vector3f> &norms_new = data.normals;
+		vector<Vector2f> &texs_new = data.texCoords;
 
 		if (hasNormals) {
 			norms_new.resize(numVertices);
@@ -332,38 +469,25 @@ bool ModelLoader::loadObj(const char *filename, vector<Mesh> &meshes, bool separ
 			}
 		}
 		numVertices = verts.size();
-
-		if (hasNormals) {
-			normals = VertexBuffer(rc, GL_ARRAY_BUFFER);
-			normals->SetData(norms_new.size()*sizeof(Vector3f), norms_new.data(), GL_STATIC_DRAW);
-		}
-		if (hasTexCoords) {
-			texCoords = VertexBuffer(rc, GL_ARRAY_BUFFER);
-			texCoords->SetData(texs_new.size()*sizeof(Vector2f), texs_new.data(), GL_STATIC_DRAW);
-		}
 	}
 
-	vertices = VertexBuffer(rc, GL_ARRAY_BUFFER);
-	indices = VertexBuffer(rc, GL_ELEMENT_ARRAY_BUFFER);
-	vertices->SetData(numVertices*sizeof(Vector3f), verts.data(), GL_STATIC_DRAW);
-	indices->SetData(numIndices*sizeof(int), iverts.data(), GL_STATIC_DRAW);
+	if (needTangents) computeTangents(data);
+	computeUVDensity(data);
 
-	for (int i = 0, s = meshes.size(); i < s; i++)
+	if (numLods > 0)
 	{
-		Mesh &m = meshes[i];
-		m.vertices = vertices;
-		m.indices = indices;
-		m.normals = normals;
-		m.texCoords = texCoords;
-	}
-
-	setupVao(meshes, computeTangents);
+		vector<int> meshFirst;
+		for (int i = 0, s = data.meshes.size(); i < s; i++)
+			meshFirst.push_back(data.meshes[i].firstIndex);
+		generateLods(verts.data(), numVertices, iverts, meshFirst, data.lods);
 
-	vertices = indices = texCoords = normals = NULL;
+		// the index buffer no longer ends with the mesh
+		if (data.meshes.size() == 1) data.meshes[0].numIndices = numIndices;
+	}
 	return true;
 }
 
-bool ModelLoader::loadRaw(const char *filename, vector<Mesh> &meshes, bool separateMeshes)
+bool ModelLoader::ReadRaw(const char *filename, ModelData &data, bool separateMeshes)
 {
 	HANDLE hFile = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
 	if (hFile == INVALID_HANDLE_VALUE) return false;
@@ -384,126 +508,243 @@ bool ModelLoader::loadRaw(const char *filename, vector<Mesh> &meshes, bool separ
 	bool hasNormals = (rawHeader.flags & RAW_HAS_NORMALS) != 0;
 	bool hasTexCoords = (rawHeader.flags & RAW_HAS_TEXCOORDS) != 0;
 
-	Dictionary<Material> *mtlLib = NULL;
-	char *stringTable = NULL;
-	RAWMESHDESC *meshDesc = new RAWMESHDESC[numMeshes];
-	Vector3f *vertexData = new Vector3f[numVertices];
-	UINT *indexData = new UINT[numIndices];
+	vector<char> stringTable(rawHeader.stringTableSize + 1);
+	vector<RAWMESHDESC> meshDesc(numMeshes);
+	data.vertices.resize(numVertices);
+	data.indices.resize(numIndices);
 
 	if (rawHeader.stringTableSize != 0) {
-		stringTable = new char[rawHeader.stringTableSize];
-		ReadFile(hFile, stringTable, rawHeader.stringTableSize, &bytesRead, NULL);
+		ReadFile(hFile, stringTable.data(), rawHeader.stringTableSize, &bytesRead, NULL);
 
 		if (rawHeader.materialLib.offset != (DWORD)-1)
 		{
-			char *libName = stringTable + rawHeader.materialLib.offset;
-			mtlLib = rc->materials.GetLib(libName);
-			if (!mtlLib) {
-				Dictionary<Material> materialLib;
-				Dictionary<Texture2D> &textureLib = rc->textures.GetDefaultLib();
-				MaterialLoader().LoadMtl(libName, materialLib, textureLib);
-				mtlLib = &rc->materials.AddLib(libName, materialLib);
-			}
+			data.materialLib = &stringTable[rawHeader.materialLib.offset];
+			string path = strhlp::joinPath(basePath, data.materialLib);
+			MaterialLoader().ReadMtl(path.c_str(), data.materials);
 		}
 	}
 	
-	ReadFile(hFile, meshDesc, numMeshes*sizeof(RAWMESHDESC), &bytesRead, NULL);
-	ReadFile(hFile, vertexData, numVertices*sizeof(Vector3f), &bytesRead, NULL);
-	ReadFile(hFile, indexData, numIndices*sizeof(UINT), &bytesRead, NULL);
+	ReadFile(hFile, meshDesc.data(), numMeshes*sizeof(RAWMESHDESC), &bytesRead, NULL);
+	ReadFile(hFile, data.vertices.data(), numVertices*sizeof(Vector3f), &bytesRead, NULL);
+	ReadFile(hFile, data.indices.data(), numIndices*sizeof(UINT), &bytesRead, NULL);
 
-	vertices = VertexBuffer(rc, GL_ARRAY_BUFFER);
-	indices = VertexBuffer(rc, GL_ELEMENT_ARRAY_BUFFER);
-	vertices->SetData(numVertices*sizeof(Vector3f), vertexData, GL_STATIC_DRAW);
-	indices->SetData(numIndices*sizeof(UINT), indexData, GL_STATIC_DRAW);
+	if (hasNormals) {
+		data.normals.resize(numVertices);
+		ReadFile(hFile, data.normals.data(), numVertices*sizeof(Vector3f), &bytesRead, NULL);
+	}
+	if (hasTexCoords) {
+		data.texCoords.resize(numVertices);
+		ReadFile(hFile, data.texCoords.data(), numVertices*sizeof(Vector2f), &bytesRead, NULL);
+	}
 
-	if (hasNormals)
+	if (rawHeader.flags & RAW_HAS_LODS)
 	{
-		normals = VertexBuffer(rc, GL_ARRAY_BUFFER);
-		Vector3f *norms = new Vector3f[numVertices];
-		ReadFile(hFile, norms, numVertices*sizeof(Vector3f), &bytesRead, NULL);
-		normals->SetData(numVertices*sizeof(Vector3f), norms, GL_STATIC_DRAW);
-		delete[] norms;
+		RAWLODHEADER lodHeader = { };
+		ReadFile(hFile, &lodHeader, sizeof(RAWLODHEADER), &bytesRead, NULL);
+		data.lods.resize(lodHeader.numRanges);
+		data.indices.resize(numIndices + lodHeader.numIndices);
+		if (!data.lods.empty())
+			ReadFile(hFile, data.lods.data(), data.lods.size()*sizeof(MeshLodDesc), &bytesRead, NULL);
+		if (lodHeader.numIndices != 0)
+			ReadFile(hFile, &data.indices[numIndices], lodHeader.numIndices*sizeof(int), &bytesRead, NULL);
 	}
-
-	if (hasTexCoords)
+	else if (numLods > 0)
 	{
-		texCoords = VertexBuffer(rc, GL_ARRAY_BUFFER);
-		Vector2f *texs = new Vector2f[numVertices];
-		ReadFile(hFile, texs, numVertices*sizeof(Vector2f), &bytesRead, NULL);
-		texCoords->SetData(numVertices*sizeof(Vector2f), texs, GL_STATIC_DRAW);
-		delete[] texs;
+		vector<int> meshFirst;
+		for (int i = 0; i < numMeshes; i++)
+			meshFirst.push_back(meshDesc[i].firstIndex);
+		generateLods(data.vertices.data(), numVertices, data.indices, meshFirst, data.lods);
 	}
 
 	CloseHandle(hFile);
 
+	bool needTangents = false;
+	for (int i = 0; i < numMeshes; i++)
+	{
+		ModelMeshDesc mesh = { "", meshDesc[i].firstIndex, -1 };
+		if (!data.materialLib.empty()) {
+			mesh.material = &stringTable[meshDesc[i].materialName.offset];
+			const MaterialDesc *material = data.FindMaterial(mesh.material);
+			if (material && !material->normalMap.empty()) needTangents = true;
+		}
+
+		if (numMeshes != 1 || !data.lods.empty()) {
+			int next = i == numMeshes - 1 ? numIndices : meshDesc[i + 1].firstIndex;
+			mesh.numIndices = next - meshDesc[i].firstIndex;
+		}
+
+		mesh.boundingBox.vmin = meshDesc[i].vmin;
+		mesh.boundingBox.vmax = meshDesc[i].vmax;
+		data.meshes.push_back(mesh);
+	}
+
+	if (needTangents) computeTangents(data);
+	computeUVDensity(data);
+	return true;
+}
+
+void ModelLoader::CreateMeshes(const ModelData &data, vector<Mesh> &meshes)
+{
+	Dictionary<Material> *mtlLib = NULL;
+	if (!data.materialLib.empty())
+	{
+		string path = strhlp::joinPath(basePath, data.materialLib);
+		mtlLib = rc->assetCache.FindMaterialLib(path);
+		if (!mtlLib) {
+			Dictionary<Material> materialLib;
+			MaterialLoader loader;
+			loader.SetAssetCache(&rc->assetCache);
+			loader.SetBasePath(basePath);
+			loader.CreateMaterials(data.materials, materialLib, rc->textures.GetDefaultLib());
+			mtlLib = &rc->assetCache.AddMaterialLib(path, data.materialLib, materialLib);
+		}
+	}
+
+	int numVertices = data.vertices.size();
+	vertices = VertexBuffer(rc, GL_ARRAY_BUFFER);
+	vertices->SetData(numVertices*sizeof(Vector3f), data.vertices.data(), GL_STATIC_DRAW);
+	if (!data.normals.empty()) {
+		normals = VertexBuffer(rc, GL_ARRAY_BUFFER);
+		normals->SetData(numVertices*sizeof(Vector3f), data.normals.data(), GL_STATIC_DRAW);
+	}
+	if (!data.texCoords.empty()) {
+		texCoords = VertexBuffer(rc, GL_ARRAY_BUFFER);
+		texCoords->SetData(numVertices*sizeof(Vector2f), data.texCoords.data(), GL_STATIC_DRAW);
+	}
+	indices = VertexBuffer(rc, GL_ELEMENT_ARRAY_BUFFER);
+	indices->SetData(data.indices.size()*sizeof(int), data.indices.data(), GL_STATIC_DRAW);
+
 	Mesh mesh(rc);
 	mesh.vertices = vertices;
 	mesh.indices = indices;
 	mesh.normals = normals;
 	mesh.texCoords = texCoords;
 
-	bool computeTangents = false;
+	int firstMesh = meshes.size();
+	int numMeshes = data.meshes.size();
 	for (int i = 0; i < numMeshes; i++)
 	{
-		if (mtlLib) {
-			char *materialName = stringTable + meshDesc[i].materialName.offset;
-			Material *material = mtlLib->GetItem(materialName);
-			if (material) {
-				mesh.material = *material;
-				if (material->normalMap) computeTangents = true;
-			}
-			else mesh.material = Material();
-		}
-
-		mesh.SetFirstIndex(meshDesc[i].firstIndex);
-		if (numMeshes != 1) {
-			int next = i == numMeshes - 1 ? numIndices : meshDesc[i + 1].firstIndex;
-			mesh.SetIndexCount(next - meshDesc[i].firstIndex);
-		}
+		const ModelMeshDesc &desc = data.meshes[i];
+		Material *material = mtlLib ? mtlLib->GetItem(desc.material.c_str()) : NULL;
+		mesh.material = material ? *material : Material();
 
-		Vector3f &vmin = meshDesc[i].vmin;
-		Vector3f &vmax = meshDesc[i].vmax;
+		mesh.SetFirstIndex(desc.firstIndex);
+		mesh.SetIndexCount(desc.numIndices);
+		mesh.uvDensity = desc.uvDensity;
 
-		mesh.boundingBox.vmin = vmin;
-		mesh.boundingBox.vmax = vmax;
+		const Vector3f &vmin = desc.boundingBox.vmin;
+		const Vector3f &vmax = desc.boundingBox.vmax;
+		mesh.boundingBox = desc.boundingBox;
 		mesh.boundingSphere.center = (vmax + vmin) / 2;
 		mesh.boundingSphere.radius = max(max(vmax.x - vmin.x, vmax.y - vmin.y), vmax.z - vmin.z);
 
 		meshes.push_back(mesh);
 	}
 
-	setupVao(meshes, computeTangents);
+	for (int i = 0, n = data.lods.size(); i < n; i++) {
+		const MeshLodDesc &lod = data.lods[i];
+		if (lod.mesh < numMeshes)
+			meshes[firstMesh + lod.mesh].AddLod(lod.firstIndex, lod.numIndices);
+	}
+
+	setupVao(meshes, firstMesh, data);
 
 	vertices = indices = normals = texCoords = NULL;
-	delete [] stringTable;
-	delete [] meshDesc;
-	delete [] vertexData;
-	delete [] indexData;
+}
+
+bool ModelLoader::BakeRawLods(const char *filename)
+{
+	if (numLods <= 0) return false;
+
+	HANDLE hFile = CreateFile(filename, GENERIC_READ|GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) return false;
+
+	DWORD bytesRead = 0;
+	RAWHEADER rawHeader = { };
+	ReadFile(hFile, &rawHeader, sizeof(RAWHEADER), &bytesRead, NULL);
+
+	if (rawHeader.signature != RAW_FILE_SIGNATURE) {
+		CloseHandle(hFile);
+		return false;
+	}
+
+	int numVertices = rawHeader.numVertices;
+	int numIndices = rawHeader.numIndices;
+	int numMeshes = rawHeader.numMeshes;
+
+	vector<RAWMESHDESC> meshDesc(numMeshes);
+	vector<Vector3f> verts(numVertices);
+	vector<int> inds(numIndices);
+
+	SetFilePointer(hFile, rawHeader.stringTableSize, NULL, FILE_CURRENT);
+	ReadFile(hFile, meshDesc.data(), numMeshes*sizeof(RAWMESHDESC), &bytesRead, NULL);
+	ReadFile(hFile, verts.data(), numVertices*sizeof(Vector3f), &bytesRead, NULL);
+	ReadFile(hFile, inds.data(), numIndices*sizeof(int), &bytesRead, NULL);
+
+	// existing LODs are replaced
+	DWORD end = SetFilePointer(hFile, 0, NULL, FILE_CURRENT);
+	if (rawHeader.flags & RAW_HAS_NORMALS) end += numVertices*sizeof(Vector3f);
+	if (rawHeader.flags & RAW_HAS_TEXCOORDS) end += numVertices*sizeof(Vector2f);
+
+	vector<int> meshFirst;
+	for (int i = 0; i < numMeshes; i++)
+		meshFirst.push_back(meshDesc[i].firstIndex);
+
+	vector<MeshLodDesc> lods;
+	generateLods(verts.data(), numVertices, inds, meshFirst, lods);
+
+	RAWLODHEADER lodHeader = { (DWORD)lods.size(), (DWORD)(inds.size() - numIndices) };
+	DWORD bytesWritten = 0;
+	SetFilePointer(hFile, end, NULL, FILE_BEGIN);
+	WriteFile(hFile, &lodHeader, sizeof(RAWLODHEADER), &bytesWritten, NULL);
+	if (!lods.empty()) {
+		WriteFile(hFile, lods.data(), lods.size()*sizeof(MeshLodDesc), &bytesWritten, NULL);
+		WriteFile(hFile, &inds[numIndices], lodHeader.numIndices*sizeof(int), &bytesWritten, NULL);
+	}
+	SetEndOfFile(hFile);
+
+	rawHeader.flags |= RAW_HAS_LODS;
+	SetFilePointer(hFile, 0, NULL, FILE_BEGIN);
+	WriteFile(hFile, &rawHeader, sizeof(RAWHEADER), &bytesWritten, NULL);
+
+	CloseHandle(hFile);
 	return true;
 }
 
 bool ModelLoader::LoadObj(const char *filename, Mesh &mesh)
 {
+	ModelData data;
+	if (!ReadObj(filename, data, false)) return false;
+
 	vector<Mesh> tmp;
-	bool result = loadObj(filename, tmp, false);
-	if (result) mesh = tmp[0];
-	return result;
+	CreateMeshes(data, tmp);
+	mesh = tmp[0];
+	return true;
 }
 
 bool ModelLoader::LoadObj(const char *filename, vector<Mesh> &meshes)
 {
-	return loadObj(filename, meshes, true);
+	ModelData data;
+	if (!ReadObj(filename, data)) return false;
+	CreateMeshes(data, meshes);
+	return true;
 }
 
 bool ModelLoader::LoadRaw(const char *filename, Mesh &mesh)
 {
+	ModelData data;
+	if (!ReadRaw(filename, data, false)) return false;
+
 	vector<Mesh> tmp;
-	bool result = loadRaw(filename, tmp, false);
-	if (result) mesh = tmp[0];
-	return result;
+	CreateMeshes(data, tmp);
+	mesh = tmp[0];
+	return true;
 }
 
 bool ModelLoader::LoadRaw(const char *filename, vector<Mesh> &meshes)
 {
-	return loadRaw(filename, meshes, true);
+	ModelData data;
+	if (!ReadRaw(filename, data)) return false;
+	CreateMeshes(data, meshes);
+	return true;
 }
\ No newline at end of file
@@ -0,0 +1,397 @@
+#include "occlusionculler.h"
+#include "glcontext.h"
+#include "threadpool.h"
+#include "modelloader.h"
+#include <xmmintrin.h>
+#include <float.h>
+
+#define OC_VERTS_PER_TASK 4096
+#define OC_MIN_W 0.0001f
+
+static long long getTicks()
+{
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+static float ticksToMs(long long ticks)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (float)(ticks * 1000.0 / freq.QuadPart);
+}
+
+OcclusionCuller::OcclusionCuller(GLRenderingContext *rc)
+	: rc(rc), width(0), height(0), numTiles(0), tileHeight(0), depth(NULL)
+{
+	rendered = false;
+	testTicks = 0;
+	ZeroMemory(&stats, sizeof(stats));
+	ZeroMemory(&frameStats, sizeof(frameStats));
+	SetResolution(256, 128);
+}
+
+OcclusionCuller::~OcclusionCuller() {
+	release();
+}
+
+void OcclusionCuller::release()
+{
+	_mm_free(depth);
+	depth = NULL;
+	for (int i = 1, n = levels.size(); i < n; i++) {
+		delete [] levels[i].minDepth;
+		delete [] levels[i].maxDepth;
+	}
+	levels.clear();
+}
+
+void OcclusionCuller::SetResolution(int width, int height)
+{
+	// rows are processed four pixels at a time
+	width = (width + 3) & ~3;
+	if (width == this->width && height == this->height) return;
+
+	release();
+	this->width = width;
+	this->height = height;
+	rendered = false;
+	allocate();
+}
+
+void OcclusionCuller::allocate()
+{
+	depth = (float *)_mm_malloc(width*height*sizeof(float), 16);
+
+	Level l0 = { width, height, depth, depth };
+	levels.push_back(l0);
+
+	int w = width, h = height;
+	while (w > 1 || h > 1)
+	{
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+		Level l = { w, h, new float[w*h], new float[w*h] };
+		levels.push_back(l);
+	}
+
+	tileHeight = 16;
+	numTiles = (height + tileHeight - 1) / tileHeight;
+	tileTris.resize(numTiles);
+}
+
+void OcclusionCuller::AddOccluder(const ModelData &data, int mesh, const Matrix44f &model)
+{
+	const ModelMeshDesc &desc = data.meshes[mesh];
+	int first = desc.firstIndex;
+	int numIndices = desc.numIndices != -1 ? desc.numIndices : data.indices.size() - first;
+	const Vector3f *verts = data.vertices.data();
+	const int *inds = data.indices.data();
+
+	// copy only the vertices referenced by the mesh's index range
+	vector<int> remap(data.vertices.size(), -1);
+	for (int i = first, n = first + numIndices; i < n; i++)
+	{
+		int v = inds[i];
+		if (remap[v] == -1) {
+			remap[v] = worldVerts.size();
+			Vector4f p = Vector4f(verts[v].x, verts[v].y, verts[v].z) * model;
+			worldVerts.push_back(Vector3f(p.x, p.y, p.z));
+		}
+		indices.push_back(remap[v]);
+	}
+}
+
+void OcclusionCuller::AddOccluders(const ModelData &data, const Matrix44f &model)
+{
+	for (int i = 0, n = data.meshes.size(); i < n; i++)
+		AddOccluder(data, i, model);
+}
+
+void OcclusionCuller::ClearOccluders()
+{
+	worldVerts.clear();
+	indices.clear();
+	rendered = false;
+}
+
+void OcclusionCuller::transformTask(void *context, int index)
+{
+	OcclusionCuller *oc = (OcclusionCuller *)context;
+	int first = index * OC_VERTS_PER_TASK;
+	int last = min(first + OC_VERTS_PER_TASK, (int)oc->worldVerts.size());
+
+	const float *m = oc->viewProj.data;
+	__m128 c0 = _mm_loadu_ps(m);
+	__m128 c1 = _mm_loadu_ps(m + 4);
+	__m128 c2 = _mm_loadu_ps(m + 8);
+	__m128 c3 = _mm_loadu_ps(m + 12);
+
+	float hw = oc->width * 0.5f;
+	float hh = oc->height * 0.5f;
+
+	for (int i = first; i < last; i++)
+	{
+		const Vector3f &v = oc->worldVerts[i];
+		__m128 p = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v.x)), _mm_mul_ps(c1, _mm_set1_ps(v.y))),
+			_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(v.z)), c3));
+
+		Vector4f &clip = oc->clipVerts[i];
+		_mm_storeu_ps(clip.data, p);
+
+		if (clip.w > OC_MIN_W)
+		{
+			float w_inv = 1.0f / clip.w;
+			oc->screenVerts[i] = Vector3f(
+				(clip.x * w_inv + 1.0f) * hw,
+				(clip.y * w_inv + 1.0f) * hh,
+				clip.z * w_inv * 0.5f + 0.5f);
+			oc->vertVisible[i] = 1;
+		}
+		else oc->vertVisible[i] = 0;
+	}
+}
+
+void OcclusionCuller::rasterizeTask(void *context, int index) {
+	((OcclusionCuller *)context)->rasterizeTile(index);
+}
+
+void OcclusionCuller::RenderOccluders(const Matrix44f &viewProj)
+{
+	long long start = getTicks();
+
+	frameStats = stats;
+	frameStats.testTime = ticksToMs(testTicks);
+	ZeroMemory(&stats, sizeof(stats));
+	testTicks = 0;
+
+	this->viewProj = viewProj;
+	int numVerts = worldVerts.size();
+	clipVerts.resize(numVerts);
+	screenVerts.resize(numVerts);
+	vertVisible.resize(numVerts);
+
+	ThreadPool *pool = rc->GetThreadPool();
+	int numTasks = (numVerts + OC_VERTS_PER_TASK - 1) / OC_VERTS_PER_TASK;
+	pool->ParallelFor(numTasks, transformTask, this);
+
+	// bin triangles into horizontal tiles
+	for (int i = 0; i < numTiles; i++)
+		tileTris[i].clear();
+
+	int numTris = indices.size() / 3;
+	stats.numOccluderTris = numTris;
+	for (int i = 0; i < numTris; i++)
+	{
+		Triangle t = { indices[3*i], indices[3*i+1], indices[3*i+2] };
+
+		// triangles crossing the near plane are dropped: fewer occluders
+		// only make the test more conservative
+		if (!vertVisible[t.i0] || !vertVisible[t.i1] || !vertVisible[t.i2])
+			continue;
+
+		const Vector3f &a = screenVerts[t.i0];
+		const Vector3f &b = screenVerts[t.i1];
+		const Vector3f &c = screenVerts[t.i2];
+
+		float area = (b.x - a.x)*(c.y - a.y) - (c.x - a.x)*(b.y - a.y);
+		if (area <= 0.0f) continue;
+
+		float ymin = min(a.y, min(b.y, c.y));
+		float ymax = max(a.y, max(b.y, c.y));
+		float xmin = min(a.x, min(b.x, c.x));
+		float xmax = max(a.x, max(b.x, c.x));
+		if (ymax < 0.0f || ymin >= height || xmax < 0.0f || xmin >= width)
+			continue;
+
+		int t0 = max((int)ymin, 0) / tileHeight;
+		int t1 = min((int)ymax, height - 1) / tileHeight;
+		for (int k = t0; k <= t1; k++)
+			tileTris[k].push_back(t);
+		stats.numRasterizedTris++;
+	}
+
+	pool->ParallelFor(numTiles, rasterizeTask, this);
+	buildPyramid();
+	rendered = true;
+
+	stats.rasterTime = ticksToMs(getTicks() - start);
+}
+
+void OcclusionCuller::rasterizeTile(int tile)
+{
+	int y0 = tile * tileHeight;
+	int y1 = min(y0 + tileHeight, height);
+
+	__m128 far1 = _mm_set1_ps(1.0f);
+	for (int i = y0*width, n = y1*width; i < n; i += 4)
+		_mm_store_ps(depth + i, far1);
+
+	const vector<Triangle> &tris = tileTris[tile];
+	for (int i = 0, n = tris.size(); i < n; i++)
+		rasterizeTriangle(tris[i], y0, y1);
+}
+
+void OcclusionCuller::rasterizeTriangle(const Triangle &t, int y0, int y1)
+{
+	const Vector3f &v0 = screenVerts[t.i0];
+	const Vector3f &v1 = screenVerts[t.i1];
+	const Vector3f &v2 = screenVerts[t.i2];
+
+	int xmin = max((int)min(v0.x, min(v1.x, v2.x)), 0);
+	int xmax = min((int)max(v0.x, max(v1.x, v2.x)), width - 1);
+	int ymin = max((int)min(v0.y, min(v1.y, v2.y)), y0);
+	int ymax = min((int)max(v0.y, max(v1.y, v2.y)), y1 - 1);
+	if (xmin > xmax || ymin > ymax) return;
+
+	// edge functions E(x, y) = A*x + B*y + C, positive inside
+	float A0 = v1.y - v2.y, B0 = v2.x - v1.x, C0 = v1.x*v2.y - v1.y*v2.x;
+	float A1 = v2.y - v0.y, B1 = v0.x - v2.x, C1 = v2.x*v0.y - v2.y*v0.x;
+	float A2 = v0.y - v1.y, B2 = v1.x - v0.x, C2 = v0.x*v1.y - v0.y*v1.x;
+
+	// depth is linear in screen space
+	float area_inv = 1.0f / (C0 + C1 + C2);
+	float dzdx = (A0*v0.z + A1*v1.z + A2*v2.z) * area_inv;
+	float dzdy = (B0*v0.z + B1*v1.z + B2*v2.z) * area_inv;
+	float z0 = (C0*v0.z + C1*v1.z + C2*v2.z) * area_inv;
+
+	__m128 a0 = _mm_set1_ps(A0), a1 = _mm_set1_ps(A1), a2 = _mm_set1_ps(A2);
+	__m128 dz = _mm_set1_ps(dzdx);
+	__m128 zero = _mm_setzero_ps();
+	__m128 offs = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+	xmin &= ~3;
+	for (int y = ymin; y <= ymax; y++)
+	{
+		float py = y + 0.5f;
+		__m128 r0 = _mm_set1_ps(B0*py + C0);
+		__m128 r1 = _mm_set1_ps(B1*py + C1);
+		__m128 r2 = _mm_set1_ps(B2*py + C2);
+		__m128 rz = _mm_set1_ps(dzdy*py + z0);
+		float *row = depth + y*width;
+
+		for (int x = xmin; x <= xmax; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), offs);
+			__m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+			__m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+			__m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), r2);
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero),
+				_mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+			if (!_mm_movemask_ps(inside)) continue;
+
+			__m128 z = _mm_add_ps(_mm_mul_ps(dz, px), rz);
+			__m128 cur = _mm_load_ps(row + x);
+			__m128 res = _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(cur, z)),
+				_mm_andnot_ps(inside, cur));
+			_mm_store_ps(row + x, res);
+		}
+	}
+}
+
+void OcclusionCuller::buildPyramid()
+{
+	for (int l = 1, n = levels.size(); l < n; l++)
+	{
+		const Level &src = levels[l - 1];
+		Level &dst = levels[l];
+
+		for (int y = 0; y < dst.height; y++)
+		{
+			int sy0 = 2*y, sy1 = min(2*y + 1, src.height - 1);
+			for (int x = 0; x < dst.width; x++)
+			{
+				int sx0 = 2*x, sx1 = min(2*x + 1, src.width - 1);
+				int i00 = sy0*src.width + sx0, i01 = sy0*src.width + sx1;
+				int i10 = sy1*src.width + sx0, i11 = sy1*src.width + sx1;
+
+				dst.minDepth[y*dst.width + x] = min(min(src.minDepth[i00], src.minDepth[i01]),
+					min(src.minDepth[i10], src.minDepth[i11]));
+				dst.maxDepth[y*dst.width + x] = max(max(src.maxDepth[i00], src.maxDepth[i01]),
+					max(src.maxDepth[i10], src.maxDepth[i11]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::Cull(const AABox &box)
+{
+	if (!rendered) return true;
+
+	long long start = getTicks();
+	stats.numTested++;
+
+	const float(&m)[4][4] = rc->GetModelViewProjection().m;
+	float xmin = FLT_MAX, ymin = FLT_MAX, zmin = FLT_MAX;
+	float xmax = -FLT_MAX, ymax = -FLT_MAX;
+	bool visible = false;
+
+	for (int i = 0; i < 8; i++)
+	{
+		float x = (i & 1) ? box.vmax.x : box.vmin.x;
+		float y = (i & 2) ? box.vmax.y : box.vmin.y;
+		float z = (i & 4) ? box.vmax.z : box.vmin.z;
+
+		float cw = m[0][3]*x + m[1][3]*y + m[2][3]*z + m[3][3];
+		if (cw <= OC_MIN_W) {
+			// the box reaches the camera plane
+			visible = true;
+			break;
+		}
+
+		float w_inv = 1.0f / cw;
+		float sx = (m[0][0]*x + m[1][0]*y + m[2][0]*z + m[3][0]) * w_inv;
+		float sy = (m[0][1]*x + m[1][1]*y + m[2][1]*z + m[3][1]) * w_inv;
+		float sz = (m[0][2]*x + m[1][2]*y + m[2][2]*z + m[3][2]) * w_inv;
+
+		xmin = min(xmin, sx); xmax = max(xmax, sx);
+		ymin = min(ymin, sy); ymax = max(ymax, sy);
+		zmin = min(zmin, sz);
+	}
+
+	if (!visible)
+	{
+		int x0 = max((int)((xmin + 1.0f) * 0.5f * width), 0);
+		int x1 = min((int)((xmax + 1.0f) * 0.5f * width), width - 1);
+		int y0 = max((int)((ymin + 1.0f) * 0.5f * height), 0);
+		int y1 = min((int)((ymax + 1.0f) * 0.5f * height), height - 1);
+		zmin = zmin * 0.5f + 0.5f;
+
+		// off-screen boxes are left to the frustum culler
+		if (x0 > x1 || y0 > y1) visible = true;
+		else
+		{
+			// pick the level where the box covers at most 4x4 texels
+			int l = 0, last = levels.size() - 1;
+			while (l < last && ((x1 >> l) - (x0 >> l) > 3 || (y1 >> l) - (y0 >> l) > 3))
+				l++;
+
+			// one level up the box covers at most 2x2 texels: if it is nearer
+			// than every occluder there, it is visible
+			int lc = min(l + 1, last);
+			const Level &coarse = levels[lc];
+			float nearest = 1.0f;
+			for (int y = y0 >> lc; y <= y1 >> lc; y++)
+				for (int x = x0 >> lc; x <= x1 >> lc; x++)
+					nearest = min(nearest, coarse.minDepth[y*coarse.width + x]);
+
+			if (zmin <= nearest) visible = true;
+			else
+			{
+				const Level &fine = levels[l];
+				for (int y = y0 >> l; y <= y1 >> l && !visible; y++)
+					for (int x = x0 >> l; x <= x1 >> l; x++)
+						if (fine.maxDepth[y*fine.width + x] >= zmin) {
+							visible = true;
+							break;
+						}
+			}
+		}
+	}
+
+	if (!visible) stats.numCulled++;
+	testTicks += getTicks() - start;
+	return visible;
+}
\ No newline at end of file
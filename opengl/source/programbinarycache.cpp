@@ -0,0 +1,266 @@
+#include "programbinarycache.h"
+#include "stringhelp.h"
+#include <fstream>
+#include <string.h>
+#include <stdio.h>
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <chrono>
+#endif
+
+#define PROGRAM_BINARY_SIGNATURE 0x31424750 // PGB1
+#define PROGRAM_BINARY_VERSION 1
+
+struct PROGRAMBINARYHEADER
+{
+	unsigned int signature;
+	unsigned int version;
+	unsigned long long sourceHash;
+	unsigned long long driverHash;
+	unsigned int format;
+	unsigned int size;
+	float compileTime;
+	unsigned int reserved;
+};
+
+static unsigned long long hashBytes(const BYTE *data, size_t size, unsigned long long h = 0xCBF29CE484222325ULL)
+{
+	const unsigned long long k = 0x9E3779B97F4A7C15ULL;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		unsigned long long w;
+		memcpy(&w, data + i, 8);
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+	if (i < size) {
+		unsigned long long w = 0;
+		memcpy(&w, data + i, size - i);
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+static unsigned long long hashDriver(const string &driver) {
+	return hashBytes((const BYTE *)driver.data(), driver.size());
+}
+
+// replaces to with from, so readers see the old file or the new one
+static bool replaceFile(const string &from, const string &to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+static void makeDirectory(const string &dir)
+{
+#ifdef _WIN32
+	CreateDirectoryA(dir.c_str(), NULL);
+#else
+	mkdir(dir.c_str(), 0755);
+#endif
+}
+
+static long long getTicks()
+{
+#ifdef _WIN32
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+#else
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static float ticksToMs(long long ticks)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (float)(ticks * 1000.0 / freq.QuadPart);
+#else
+	return (float)(ticks / 1000000.0);
+#endif
+}
+
+ProgramBinaryCache::ProgramBinaryCache(const char *dir) : dir(dir) {
+	memset(&gl, 0, sizeof(gl));
+	ResetStats();
+}
+
+// binaries are only good for the driver that made them
+string ProgramBinaryCache::driverString()
+{
+	const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	string s;
+	for (int i = 0; i < 3; i++) {
+		const char *v = (const char *)gl.getString(names[i]);
+		if (v) s += v;
+		s += '\n';
+	}
+	return s;
+}
+
+bool ProgramBinaryCache::IsSupported()
+{
+	if (!HasGL() || !gl.programBinary || !gl.getProgramBinary) return false;
+	GLint numFormats = 0;
+	gl.getIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	return numFormats > 0;
+}
+
+bool ProgramBinaryCache::isFormatSupported(GLenum format)
+{
+	GLint numFormats = 0;
+	gl.getIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	if (numFormats <= 0) return false;
+
+	vector<GLint> formats(numFormats);
+	gl.getIntegerv(GL_PROGRAM_BINARY_FORMATS, &formats[0]);
+	for (int i = 0; i < numFormats; i++)
+		if ((GLenum)formats[i] == format) return true;
+	return false;
+}
+
+bool ProgramBinaryCache::Load(GLuint program, unsigned long long sourceHash)
+{
+	if (!HasGL()) return false;
+	long long start = getTicks();
+	string driver = driverString();
+	ProgramBinary binary;
+	if (!Read(sourceHash, driver, binary)) return false;
+
+	// a format the driver stopped listing is not worth handing over
+	if (!isFormatSupported(binary.format)) {
+		reject(sourceHash, driver);
+		return false;
+	}
+
+	GLint isLinked = 0;
+	gl.programBinary(program, binary.format, binary.data.data(), binary.data.size());
+	gl.getProgramiv(program, GL_LINK_STATUS, &isLinked);
+	if (isLinked != GL_TRUE) {
+		reject(sourceHash, driver);
+		return false;
+	}
+
+	loaded(binary, ticksToMs(getTicks() - start));
+	return true;
+}
+
+bool ProgramBinaryCache::Save(GLuint program, unsigned long long sourceHash, float compileTime)
+{
+	if (!HasGL()) return false;
+	ProgramBinary binary;
+	binary.compileTime = compileTime;
+	binary.format = 0;
+
+	GLint length = 0;
+	gl.getProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return false;
+	binary.data.resize(length);
+	gl.getProgramBinary(program, length, &length, &binary.format, binary.data.data());
+	binary.data.resize(length);
+	return Write(sourceHash, driverString(), binary);
+}
+
+bool ProgramBinaryCache::Remove(unsigned long long sourceHash)
+{
+	if (!HasGL()) return false;
+	return remove(entryPath(sourceHash, driverString()).c_str()) == 0;
+}
+
+string ProgramBinaryCache::entryPath(unsigned long long sourceHash, const string &driver) const
+{
+	unsigned long long h = hashBytes((const BYTE *)&sourceHash, sizeof(sourceHash), hashDriver(driver));
+	char name[32] = "";
+	sprintf(name, "%016llx.pbin", h);
+	return strhlp::joinPath(dir, name);
+}
+
+bool ProgramBinaryCache::Read(unsigned long long sourceHash, const string &driver, ProgramBinary &binary)
+{
+	MappedFile file(entryPath(sourceHash, driver).c_str());
+	const PROGRAMBINARYHEADER *h = (const PROGRAMBINARYHEADER *)file.GetData();
+	bool valid = file && file.GetSize() >= sizeof(PROGRAMBINARYHEADER) &&
+		h->signature == PROGRAM_BINARY_SIGNATURE && h->version == PROGRAM_BINARY_VERSION &&
+		h->sourceHash == sourceHash && h->driverHash == hashDriver(driver) &&
+		h->size > 0 && sizeof(PROGRAMBINARYHEADER) + h->size <= file.GetSize();
+
+	if (!valid) {
+		lock_guard<mutex> l(lock);
+		stats.numMisses++;
+		return false;
+	}
+
+	const BYTE *data = file.GetData() + sizeof(PROGRAMBINARYHEADER);
+	binary.format = h->format;
+	binary.data.assign(data, data + h->size);
+	binary.compileTime = h->compileTime;
+	return true;
+}
+
+void ProgramBinaryCache::loaded(const ProgramBinary &binary, float loadTime)
+{
+	lock_guard<mutex> l(lock);
+	stats.numHits++;
+	stats.loadTime += loadTime;
+	stats.savedTime += binary.compileTime - loadTime;
+}
+
+void ProgramBinaryCache::reject(unsigned long long sourceHash, const string &driver)
+{
+	remove(entryPath(sourceHash, driver).c_str());
+	lock_guard<mutex> l(lock);
+	stats.numMisses++;
+	stats.numRejected++;
+}
+
+bool ProgramBinaryCache::Write(unsigned long long sourceHash, const string &driver, const ProgramBinary &binary)
+{
+	if (binary.data.empty()) return false;
+
+	PROGRAMBINARYHEADER h;
+	memset(&h, 0, sizeof(h));
+	h.signature = PROGRAM_BINARY_SIGNATURE;
+	h.version = PROGRAM_BINARY_VERSION;
+	h.sourceHash = sourceHash;
+	h.driverHash = hashDriver(driver);
+	h.format = binary.format;
+	h.size = binary.data.size();
+	h.compileTime = binary.compileTime;
+
+	// written under a temporary name, so readers never see half a file
+	makeDirectory(dir);
+	string path = entryPath(sourceHash, driver);
+	string tmp = path + ".tmp";
+
+	ofstream file(tmp.c_str(), ios::binary);
+	file.write((const char *)&h, sizeof(h));
+	file.write((const char *)binary.data.data(), binary.data.size());
+	file.close();
+	if (!file || !replaceFile(tmp, path)) {
+		remove(tmp.c_str());
+		return false;
+	}
+
+	lock_guard<mutex> l(lock);
+	stats.numWrites++;
+	return true;
+}
+
+ProgramBinaryCacheStats ProgramBinaryCache::GetStats()
+{
+	lock_guard<mutex> l(lock);
+	return stats;
+}
+
+void ProgramBinaryCache::ResetStats()
+{
+	lock_guard<mutex> l(lock);
+	memset(&stats, 0, sizeof(stats));
+}
\ No newline at end of file
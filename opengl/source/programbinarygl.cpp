@@ -0,0 +1,13 @@
+#include "programbinarycache.h"
+
+// kept apart from the cache, which only calls through the table
+ProgramBinaryGL ProgramBinaryGL::Defaults()
+{
+	ProgramBinaryGL gl;
+	gl.getIntegerv = glGetIntegerv;
+	gl.getString = glGetString;
+	gl.programBinary = glProgramBinary;
+	gl.getProgramiv = glGetProgramiv;
+	gl.getProgramBinary = glGetProgramBinary;
+	return gl;
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include "rendertargets.h"
+#include "glformat.h"
+#include <algorithm>
+
+RenderTargets::RenderTargets() : width(0), height(0) { }
+
+RenderTargets::~RenderTargets() {
+	Clear();
+}
+
+void RenderTargets::Clear()
+{
+	for (int i = 0, n = targets.size(); i < n; i++)
+		delete targets[i].texture;
+	targets.clear();
+}
+
+void RenderTargets::allocate(Target &t)
+{
+	int w = max((int)(width * t.desc.scale), 1);
+	int h = max((int)(height * t.desc.scale), 1);
+	t.texture->SetTexImage(0, t.desc.internalFormat, w, h, 0, t.desc.format, t.desc.type, NULL);
+}
+
+Texture2D *RenderTargets::Add(const RenderTargetDesc &desc, GLenum textureUnit)
+{
+	Target t = { desc, new Texture2D(textureUnit) };
+	t.texture->SetFilters(GL_NEAREST, GL_NEAREST);
+	t.texture->SetWrapMode(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+	if (width != 0 && height != 0) allocate(t);
+	targets.push_back(t);
+	return t.texture;
+}
+
+bool RenderTargets::Resize(int width, int height)
+{
+	if (width == this->width && height == this->height) return false;
+	this->width = width;
+	this->height = height;
+	if (width != 0 && height != 0) {
+		for (int i = 0, n = targets.size(); i < n; i++)
+			allocate(targets[i]);
+	}
+	return true;
+}
+
+size_t RenderTargets::GetBytes() const
+{
+	size_t bytes = 0;
+	if (width == 0 || height == 0) return 0;
+	for (int i = 0, n = targets.size(); i < n; i++) {
+		const RenderTargetDesc &d = targets[i].desc;
+		int w = max((int)(width * d.scale), 1);
+		int h = max((int)(height * d.scale), 1);
+		bytes += (size_t)w * h * GetPixelSize(d.internalFormat);
+	}
+	return bytes;
+}
\ No newline at end of file
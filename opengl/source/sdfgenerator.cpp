@@ -0,0 +1,189 @@
+#include "sdfgenerator.h"
+#include "threadpool.h"
+#include <math.h>
+
+#define SDF_INF 1e20
+#define SDF_LINES_PER_TASK 16
+
+// buffers for transforming lines of up to n samples
+struct SdfScratch
+{
+	vector<double> f, d, z;
+	vector<int> v;
+	SdfScratch(int n) : f(n), d(n), z(n + 1), v(n) { }
+};
+
+// Squared Euclidean distance transform of one line (Felzenszwalb and
+// Huttenlocher): the lower envelope of parabolas rooted at each sample.
+// data holds 0 at features and SDF_INF elsewhere and gets the result.
+static void transformLine(double *data, int n, int stride, SdfScratch &scratch)
+{
+	double *f = &scratch.f[0], *d = &scratch.d[0], *z = &scratch.z[0];
+	int *v = &scratch.v[0];
+	for (int q = 0; q < n; q++)
+		f[q] = data[q*stride];
+
+	int k = 0;
+	v[0] = 0;
+	z[0] = -SDF_INF;
+	z[1] = SDF_INF;
+	for (int q = 1; q < n; q++)
+	{
+		double s = ((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2*q - 2*v[k]);
+		while (s <= z[k]) {
+			k--;
+			s = ((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2*q - 2*v[k]);
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = SDF_INF;
+	}
+
+	k = 0;
+	for (int q = 0; q < n; q++) {
+		while (z[k + 1] < q) k++;
+		double dq = q - v[k];
+		d[q] = dq*dq + f[v[k]];
+	}
+	for (int q = 0; q < n; q++)
+		data[q*stride] = d[q];
+}
+
+// Signed distance from squared distances to the nearest outside and
+// inside samples; neighbours across the outline are half a sample away
+// from it. scale is in samples per field pixel.
+static BYTE encodeDistance(double toOutside, double toInside, double scale, int spread)
+{
+	double d = toOutside > 0 ? sqrt(toOutside) - 0.5 : 0.5 - sqrt(toInside);
+	double v = 128.0 + d / scale * 127.0 / spread;
+	return v <= 0.0 ? 0 : v >= 255.0 ? 255 : (BYTE)(v + 0.5);
+}
+
+struct SdfGenerator::AtlasJob
+{
+	int width, height;
+	double *toOutside, *toInside;
+};
+
+void SdfGenerator::transformColumns(void *context, int index)
+{
+	AtlasJob &job = *(AtlasJob *)context;
+	SdfScratch scratch(job.height);
+	int last = (index + 1)*SDF_LINES_PER_TASK;
+	if (last > job.width) last = job.width;
+	for (int x = index*SDF_LINES_PER_TASK; x < last; x++) {
+		transformLine(job.toOutside + x, job.height, job.width, scratch);
+		transformLine(job.toInside + x, job.height, job.width, scratch);
+	}
+}
+
+void SdfGenerator::transformRows(void *context, int index)
+{
+	AtlasJob &job = *(AtlasJob *)context;
+	SdfScratch scratch(job.width);
+	int last = (index + 1)*SDF_LINES_PER_TASK;
+	if (last > job.height) last = job.height;
+	for (int y = index*SDF_LINES_PER_TASK; y < last; y++) {
+		transformLine(job.toOutside + y*job.width, job.width, 1, scratch);
+		transformLine(job.toInside + y*job.width, job.width, 1, scratch);
+	}
+}
+
+bool SdfGenerator::Generate(const Image &src, Image &dst) const
+{
+	int depth = src.GetDepth();
+	if (!src || src.IsCompressed() || (depth != 8 && depth != 32))
+		return false;
+
+	int w = src.GetWidth(), h = src.GetHeight();
+	int bpp = depth / 8;
+	const BYTE *coverage = src.GetData() + bpp - 1; // alpha is the last byte
+
+	vector<double> toOutside(w*h), toInside(w*h);
+	for (int i = 0, n = w*h; i < n; i++) {
+		bool inside = coverage[i*bpp] >= 128;
+		toOutside[i] = inside ? SDF_INF : 0.0;
+		toInside[i] = inside ? 0.0 : SDF_INF;
+	}
+
+	AtlasJob job = { w, h, &toOutside[0], &toInside[0] };
+	int numColumnTasks = (w + SDF_LINES_PER_TASK - 1) / SDF_LINES_PER_TASK;
+	int numRowTasks = (h + SDF_LINES_PER_TASK - 1) / SDF_LINES_PER_TASK;
+	if (pool) {
+		pool->ParallelFor(numColumnTasks, transformColumns, &job);
+		pool->ParallelFor(numRowTasks, transformRows, &job);
+	}
+	else {
+		for (int i = 0; i < numColumnTasks; i++) transformColumns(&job, i);
+		for (int i = 0; i < numRowTasks; i++) transformRows(&job, i);
+	}
+
+	dst.Create(w, h, 8);
+	BYTE *field = dst.GetWritableData();
+	for (int i = 0, n = w*h; i < n; i++)
+		field[i] = encodeDistance(toOutside[i], toInside[i], 1.0, spread);
+	return true;
+}
+
+struct SdfGenerator::GlyphJob
+{
+	const SdfGenerator *generator;
+	SdfGlyph *glyphs;
+	int scale;
+};
+
+void SdfGenerator::makeGlyph(void *context, int index)
+{
+	GlyphJob &job = *(GlyphJob *)context;
+	const SdfGlyph &g = job.glyphs[index];
+	int scale = job.scale;
+	int spread = job.generator->spread;
+	int fw = job.generator->GetFieldSize(g.width, scale);
+	int fh = job.generator->GetFieldSize(g.height, scale);
+
+	// the bitmap at spread field pixels from the corner of a grid that
+	// covers the whole field at the resolution of the bitmap
+	int w = fw*scale, h = fh*scale;
+	int offset = spread*scale;
+	vector<double> toOutside(w*h, 0.0), toInside(w*h, SDF_INF);
+	for (int y = 0; y < g.height; y++) {
+		const BYTE *row = g.coverage + y*g.pitch;
+		for (int x = 0; x < g.width; x++) {
+			if (row[x] < 128) continue;
+			int i = (y + offset)*w + x + offset;
+			toOutside[i] = SDF_INF;
+			toInside[i] = 0.0;
+		}
+	}
+
+	SdfScratch scratch(w > h ? w : h);
+	for (int x = 0; x < w; x++) {
+		transformLine(&toOutside[x], h, w, scratch);
+		transformLine(&toInside[x], h, w, scratch);
+	}
+	for (int y = 0; y < h; y++) {
+		transformLine(&toOutside[y*w], w, 1, scratch);
+		transformLine(&toInside[y*w], w, 1, scratch);
+	}
+
+	// each field pixel takes the sample nearest to its center
+	for (int y = 0; y < fh; y++) {
+		BYTE *dst = g.field + y*g.fieldPitch;
+		for (int x = 0; x < fw; x++) {
+			int i = (y*scale + scale/2)*w + x*scale + scale/2;
+			dst[x] = encodeDistance(toOutside[i], toInside[i], scale, spread);
+		}
+	}
+}
+
+void SdfGenerator::Generate(vector<SdfGlyph> &glyphs, int scale) const
+{
+	if (glyphs.empty()) return;
+	GlyphJob job = { this, &glyphs[0], scale };
+	if (pool)
+		pool->ParallelFor(glyphs.size(), makeGlyph, &job);
+	else
+		for (int i = 0, n = glyphs.size(); i < n; i++)
+			makeGlyph(&job, i);
+}
\ No newline at end of file
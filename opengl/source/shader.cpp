@@ -1,91 +1,24 @@
 #include "shader.h"
-#include "stringhelp.h"
+#include "shaderpreprocessor.h"
 #include "glcontext.h"
 #include <vector>
 #include <string>
-#include <stack>
 
 using namespace std;
 
-class ShaderPreprocessor
+static long long getTicks()
 {
-	const vector<string> &definitions;
-	vector<string> lines;
-	stack<bool> st;
-public:
-	ShaderPreprocessor(const vector<string> &definitions)
-		: definitions(definitions)
-	{
-		st.push(true);
-	}
-
-	vector<string> &GetLines() { return lines; }
-	const vector<string> &GetLines() const { return lines; }
-
-	void CheckErrors() {
-		if (st.size() != 1)
-			throw false;
-	}
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
 
-	void ProcessLine(const string &line)
-	{
-		if (line[0] != '#') {
-			if (st.top()) lines.push_back(line + "\n");
-			else lines.push_back("\n");
-		}
-		else
-		{
-			string directive, definition;
-			int i = line.find_first_of(" \t");
-			if (i != -1)
-			{
-				directive = line.substr(1, i - 1);
-				definition = strhlp::trim(line.substr(i + 1));
-			}
-			else directive = strhlp::trimRight(line.substr(1));
-
-			if (directive == "ifdef" || directive == "ifndef")
-			{
-				if (st.top())
-				{
-					if (isdigit(definition[0])) throw false;
-					for (int j = 0, n = definition.size(); j < n; j++) {
-						char c = definition[j];
-						if (!isalnum(c) && c != '_') throw false;
-					}
-
-					int k = -1;
-					for (int i = 0, n = definitions.size(); i < n; i++) {
-						if (definitions[i] == definition) {
-							k = i;
-							break;
-						}
-					}
-					bool value = directive == "ifdef" ? (k != -1) : (k == -1);
-					st.push(value);
-				}
-				lines.push_back("\n");
-			}
-			else if (directive == "else")
-			{
-				if (st.size() < 2) throw false;
-				bool value = st.top();
-				st.pop();
-				st.push(!value);
-				lines.push_back("\n");
-			}
-			else if (directive == "endif")
-			{
-				if (st.size() < 2) throw false;
-				st.pop();
-				lines.push_back("\n");
-			}
-			else {
-				lines.push_back(line + "\n");
-			}
-		}
-	}
-};
+static float ticksToMs(long long ticks)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (float)(ticks * 1000.0 / freq.QuadPart);
+}
 
 Shader::Shader(GLenum type) {
 	ptr->handle = glCreateShader(type);
@@ -96,69 +29,47 @@ Shader::Shader(GLenum type, const char *path, const vector<string> &definitions)
 	ptr->compiled = CompileFile(path, definitions);
 }
 
-void Shader::compileLines(const vector<string> &lines)
+bool Shader::Compile(const ShaderPreprocessor &sp)
 {
-	int numLines = lines.size();
-
-	const char **source = new const char*[numLines];
-	for (int i = 0; i < numLines; i++) {
-		source[i] = lines[i].c_str();
-	}
+	CompileAsync(sp);
+	return CheckCompiled();
+}
 
-	glShaderSource(ptr->handle, numLines, (const GLchar **)source, NULL);
+void Shader::CompileAsync(const ShaderPreprocessor &sp)
+{
+	const string &source = sp.GetSource();
+	const GLchar *text = source.c_str();
+	GLint length = source.size();
+	glShaderSource(ptr->handle, 1, &text, &length);
 	glCompileShader(ptr->handle);
-	delete[] source;
+	ptr->files = sp.GetFiles();
+}
+
+bool Shader::CheckCompiled() {
+	return log(ptr->files);
 }
 
 bool Shader::CompileFile(const char *filename, const vector<string> &definitions)
 {
-	ifstream file(filename);
-	if (!file) return false;
-
-	string line;
 	ShaderPreprocessor sp(definitions);
-
-	try {
-		while (getline(file, line))
-			sp.ProcessLine(line);
-		sp.CheckErrors();
-	}
-	catch (bool)
-	{
-		file.close();
-		OutputDebugStringA("ERROR: #if[n]def parse error\n");
+	if (!sp.ProcessFile(filename)) {
+		OutputDebugStringA(("ERROR: " + sp.GetError() + "\n").c_str());
 		return false;
 	}
-
-	file.close();
-
-	compileLines(sp.GetLines());
-	return log();
+	return Compile(sp);
 }
 
 bool Shader::CompileSource(const char *source, int length, const vector<string> &definitions)
 {
-	string s = length ? string(source, length) : string(source);
-	vector<string> lines = strhlp::split(s, '\n');
-
 	ShaderPreprocessor sp(definitions);
-
-	try {
-		for (int i = 0, n = lines.size(); i < n; i++)
-			sp.ProcessLine(lines[i]);
-		sp.CheckErrors();
-	}
-	catch (bool)
-	{
-		OutputDebugStringA("ERROR: #if[n]def parse error\n");
+	if (!sp.ProcessSource(source, length)) {
+		OutputDebugStringA(("ERROR: " + sp.GetError() + "\n").c_str());
 		return false;
 	}
-
-	compileLines(sp.GetLines());
-	return log();
+	return Compile(sp);
 }
 
-bool Shader::log()
+bool Shader::log(const vector<string> &files)
 {
 	GLint isCompiled = 0;
 	GLint logLen = 0;
@@ -170,21 +81,41 @@ bool Shader::log()
 		glGetShaderInfoLog(ptr->handle, logLen, &logLen, infoLog);
 		OutputDebugString(infoLog);
 		delete [] infoLog;
+
+		// messages name files by their source string number
+		if (files.size() > 1) {
+			for (int i = 0, n = files.size(); i < n; i++) {
+				char buf[16] = "";
+				sprintf_s(buf, "%d: ", i);
+				OutputDebugStringA((buf + files[i] + "\n").c_str());
+			}
+		}
 	}
 	ptr->compiled = isCompiled ? true : false;
 	return isCompiled == TRUE;
 }
 
+struct shared_traits<ProgramObject>::PendingBuild
+{
+	Shader vert, frag;
+	ProgramBinaryCache *cache; // NULL if the binary is not to be kept
+	unsigned long long hash;
+	long long start;
+
+	PendingBuild() : vert(GL_VERTEX_SHADER), frag(GL_FRAGMENT_SHADER) { }
+};
+
 shared_traits<ProgramObject>::shared_traits()
-	: rc(rc), handle(0), linked(false)
+	: rc(rc), handle(0), linked(false), pending(NULL)
 {
 	handle = glCreateProgram();
-	fUpdateMV = fUpdateProj = true;
+	mvVersion = projVersion = (unsigned int)-1;
 }
 
 shared_traits<ProgramObject>::~shared_traits()
 {
 	rc->DetachProgram(this);
+	delete pending;
 	glDeleteProgram(handle);
 }
 
@@ -209,14 +140,13 @@ ProgramObject::ProgramObject(GLRenderingContext *rc, const char *vertPath, const
 	ptr->rc = rc;
 	rc->AttachProgram(ptr.Get());
 
-	Shader vertShader(GL_VERTEX_SHADER, vertPath);
-	Shader fragShader(GL_FRAGMENT_SHADER, fragPath);
-
-	if (vertShader.IsCompiled() && fragShader.IsCompiled()) {
-		AttachShader(vertShader);
-		AttachShader(fragShader);
-		Link();
+	ShaderPreprocessor vert, frag;
+	if (!vert.ProcessFile(vertPath) || !frag.ProcessFile(fragPath)) {
+		const string &error = vert.GetError().empty() ? frag.GetError() : vert.GetError();
+		OutputDebugStringA(("ERROR: " + error + "\n").c_str());
+		return;
 	}
+	Build(vert, frag);
 }
 
 void ProgramObject::AttachShader(const Shader &shader) {
@@ -230,43 +160,41 @@ void ProgramObject::DetachShader(const Shader &shader) {
 void ProgramObject::updateMVP()
 {
 	if (ptr->knownUniforms.mvp_matrix != -1) {
-		if (!rc->mvpComputed) {
-			rc->mvpMatrix = rc->projection * rc->modelview;
-			rc->mvpComputed = true;
-		}
-		glUniformMatrix4fv(ptr->knownUniforms.mvp_matrix, 1, GL_FALSE, rc->mvpMatrix.data);
+		glUniformMatrix4fv(ptr->knownUniforms.mvp_matrix, 1, GL_FALSE,
+			rc->GetModelViewProjection().data);
 	}
 }
 
 void ProgramObject::updateNorm()
 {
 	if (ptr->knownUniforms.normal_matrix != -1) {
-		if (!rc->normComputed) {
-			rc->normalMatrix = rc->modelview.GetInverse().GetTranspose();
-			rc->normComputed = true;
-		}
-		glUniformMatrix4fv(ptr->knownUniforms.normal_matrix, 1, GL_FALSE, rc->normalMatrix.data);
+		glUniformMatrix4fv(ptr->knownUniforms.normal_matrix, 1, GL_FALSE,
+			rc->GetNormalMatrix().data);
 	}
 }
 
 void ProgramObject::updateMatrices()
 {
-	if (ptr->fUpdateMV || ptr->fUpdateProj)
+	bool updateMV = ptr->mvVersion != rc->mvVersion;
+	bool updateProj = ptr->projVersion != rc->projVersion;
+
+	if (updateMV || updateProj)
 		updateMVP();
 
-	if (ptr->fUpdateMV) {
+	if (updateMV) {
 		glUniformMatrix4fv(ptr->knownUniforms.modelView_matrix, 1, GL_FALSE, rc->modelview.data);
 		updateNorm();
-		ptr->fUpdateMV = false;
+		ptr->mvVersion = rc->mvVersion;
 	}
-	if (ptr->fUpdateProj) {
+	if (updateProj) {
 		glUniformMatrix4fv(ptr->knownUniforms.projection_matrix, 1, GL_FALSE, rc->projection.data);
-		ptr->fUpdateProj = false;
+		ptr->projVersion = rc->projVersion;
 	}
 }
 
 void ProgramObject::Use()
 {
+	if (ptr->pending) FinishBuild();
 	if (!rc->curProgram || rc->curProgram->ptr->handle != ptr->handle) {
 		rc->curProgram = this;
 		glUseProgram(ptr->handle);
@@ -275,16 +203,24 @@ void ProgramObject::Use()
 
 bool ProgramObject::Link()
 {
-	GLint isLinked = 0;
-	GLint logLen = 0;
+	submitLink();
+	return checkLinked();
+}
 
+void ProgramObject::submitLink()
+{
 	BindAttribLocation(AttribLocation::Vertex, "Vertex");
 	BindAttribLocation(AttribLocation::Normal, "Normal");
 	BindAttribLocation(AttribLocation::TexCoord, "TexCoord");
 	BindAttribLocation(AttribLocation::Tangent, "Tangent");
 	BindAttribLocation(AttribLocation::Binormal, "Binormal");
-
 	glLinkProgram(ptr->handle);
+}
+
+bool ProgramObject::checkLinked()
+{
+	GLint isLinked = 0;
+	GLint logLen = 0;
 	glGetProgramiv(ptr->handle, GL_LINK_STATUS, &isLinked);
 	glGetProgramiv(ptr->handle, GL_INFO_LOG_LENGTH, &logLen);
 
@@ -297,42 +233,120 @@ bool ProgramObject::Link()
 	}
 
 	ptr->linked = isLinked == TRUE;
-	if (ptr->linked)
+	if (ptr->linked) readUniforms();
+	return ptr->linked;
+}
+
+bool ProgramObject::Build(const ShaderPreprocessor &vert, const ShaderPreprocessor &frag)
+{
+	BuildAsync(vert, frag);
+	return FinishBuild();
+}
+
+void ProgramObject::BuildAsync(const ShaderPreprocessor &vert, const ShaderPreprocessor &frag)
+{
+	delete ptr->pending;
+	ptr->pending = NULL;
+	ptr->linked = false;
+	ptr->mvVersion = ptr->projVersion = (unsigned int)-1;
+
+	ProgramBinaryCache *cache = NULL;
+	unsigned long long hash = 0;
+	ProgramBinaryCache &binaries = rc->programBinaryCache;
+	// the context's functions are there by the time anything is built
+	if (rc->IsProgramBinaryCacheEnabled() && !binaries.HasGL())
+		binaries.SetGL(ProgramBinaryGL::Defaults());
+	if (rc->IsProgramBinaryCacheEnabled() && binaries.IsSupported())
 	{
-		shared_traits<ProgramObject>::Uniforms &uniforms = ptr->uniforms;
-		KnownUniforms &knownUniforms = ptr->knownUniforms;
+		cache = &binaries;
+		hash = ShaderCache::HashSource(frag.GetSource(), ShaderCache::HashSource(vert.GetSource()));
+
+		// loading a binary does not compile anything, so it is not deferred
+		if (cache->Load(ptr->handle, hash)) {
+			ptr->linked = true;
+			readUniforms();
+			return;
+		}
+	}
+
+	shared_traits<ProgramObject>::PendingBuild *p = new shared_traits<ProgramObject>::PendingBuild;
+	p->cache = cache;
+	p->hash = hash;
+	p->start = getTicks();
+	ptr->pending = p;
 
-		uniforms.free();
-		glGetProgramiv(ptr->handle, GL_ACTIVE_UNIFORMS, &uniforms.count);
-		if (uniforms.count != 0) {
-			int maxLen = 0;
-			glGetProgramiv(ptr->handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLen);
+	p->vert.CompileAsync(vert);
+	p->frag.CompileAsync(frag);
+	AttachShader(p->vert);
+	AttachShader(p->frag);
+	if (cache) glProgramParameteri(ptr->handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	// a program with a shader that failed does not link, so this is safe to submit
+	submitLink();
+}
 
-			uniforms.types = new GLenum[uniforms.count];
+bool ProgramObject::IsBuildComplete()
+{
+	if (!ptr->pending || !GLEW_ARB_parallel_shader_compile) return true;
+	GLint done = 0;
+	glGetProgramiv(ptr->handle, GL_COMPLETION_STATUS_ARB, &done);
+	return done == TRUE;
+}
 
-			GLint size = 0;
-			char buf[1];
-			for (int i = 0; i < uniforms.count; i++) {
-				glGetActiveUniform(ptr->handle, i, 1, NULL, &size, &uniforms.types[i], buf);
-			}
+bool ProgramObject::FinishBuild()
+{
+	shared_traits<ProgramObject>::PendingBuild *p = ptr->pending;
+	if (!p) return ptr->linked;
+	ptr->pending = NULL;
+
+	// both are checked to log the errors of both
+	bool vertCompiled = p->vert.CheckCompiled();
+	bool fragCompiled = p->frag.CheckCompiled();
+	if (vertCompiled && fragCompiled && checkLinked() && p->cache)
+		p->cache->Save(ptr->handle, p->hash, ticksToMs(getTicks() - p->start));
+
+	DetachShader(p->vert);
+	DetachShader(p->frag);
+	delete p;
+	return ptr->linked;
+}
+
+void ProgramObject::readUniforms()
+{
+	shared_traits<ProgramObject>::Uniforms &uniforms = ptr->uniforms;
+	KnownUniforms &knownUniforms = ptr->knownUniforms;
+
+	// a program (re)linked into this handle holds none of the matrices,
+	// whatever versions it had before
+	ptr->mvVersion = ptr->projVersion = (unsigned int)-1;
 
-			knownUniforms.modelView_matrix = GetUniformLocation("ModelView");
-			knownUniforms.projection_matrix = GetUniformLocation("Projection");
-			knownUniforms.normal_matrix = GetUniformLocation("NormalMatrix");
-			knownUniforms.mvp_matrix = GetUniformLocation("ModelViewProjection");
-			knownUniforms.mtl_ambient = GetUniformLocation("Material.ambient");
-			knownUniforms.mtl_diffuse = GetUniformLocation("Material.diffuse");
-			knownUniforms.mtl_specular = GetUniformLocation("Material.specular");
-			knownUniforms.mtl_shininess = GetUniformLocation("Material.shininess");
-			knownUniforms.mtl_useDiffuseMap = GetUniformLocation("Material.useDiffuseMap");
-			knownUniforms.mtl_useSpecularMap = GetUniformLocation("Material.useSpecularMap");
-			knownUniforms.mtl_useNormalMap = GetUniformLocation("Material.useNormalMap");
-			knownUniforms.mtl_useOpacityMask = GetUniformLocation("Material.useOpacityMask");
-			knownUniforms.mtl_mode = GetUniformLocation("Material.mode");
+	uniforms.free();
+	glGetProgramiv(ptr->handle, GL_ACTIVE_UNIFORMS, &uniforms.count);
+	if (uniforms.count != 0) {
+		int maxLen = 0;
+		glGetProgramiv(ptr->handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLen);
+
+		uniforms.types = new GLenum[uniforms.count];
+
+		GLint size = 0;
+		char buf[1];
+		for (int i = 0; i < uniforms.count; i++) {
+			glGetActiveUniform(ptr->handle, i, 1, NULL, &size, &uniforms.types[i], buf);
 		}
-	}
 
-	return ptr->linked;
+		knownUniforms.modelView_matrix = GetUniformLocation("ModelView");
+		knownUniforms.projection_matrix = GetUniformLocation("Projection");
+		knownUniforms.normal_matrix = GetUniformLocation("NormalMatrix");
+		knownUniforms.mvp_matrix = GetUniformLocation("ModelViewProjection");
+		knownUniforms.mtl_ambient = GetUniformLocation("Material.ambient");
+		knownUniforms.mtl_diffuse = GetUniformLocation("Material.diffuse");
+		knownUniforms.mtl_specular = GetUniformLocation("Material.specular");
+		knownUniforms.mtl_shininess = GetUniformLocation("Material.shininess");
+		knownUniforms.mtl_useDiffuseMap = GetUniformLocation("Material.useDiffuseMap");
+		knownUniforms.mtl_useSpecularMap = GetUniformLocation("Material.useSpecularMap");
+		knownUniforms.mtl_useNormalMap = GetUniformLocation("Material.useNormalMap");
+		knownUniforms.mtl_useOpacityMask = GetUniformLocation("Material.useOpacityMask");
+		knownUniforms.mtl_mode = GetUniformLocation("Material.mode");
+	}
 }
 
 GLint ProgramObject::GetAttribLocation(const char *name) {
@@ -0,0 +1,267 @@
+#include "shadercache.h"
+#include "assetcache.h"
+#include <algorithm>
+#include <string.h>
+
+static long long getTicks()
+{
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+static float ticksToMs(long long ticks)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (float)(ticks * 1000.0 / freq.QuadPart);
+}
+
+ShaderCache::ShaderCache(GLRenderingContext *rc) :
+	rc(rc),
+	numPending(0),
+	quit(false)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+ShaderCache::~ShaderCache()
+{
+	if (worker.joinable()) {
+		{
+			lock_guard<mutex> l(lock);
+			quit = true;
+		}
+		wake.notify_all();
+		worker.join();
+	}
+	for (int i = 0, n = queued.size(); i < n; i++) delete queued[i];
+	for (int i = 0, n = ready.size(); i < n; i++) delete ready[i];
+}
+
+unsigned long long ShaderCache::HashSource(const string &source, unsigned long long h)
+{
+	const unsigned long long k = 0x9E3779B97F4A7C15ULL;
+	const char *data = source.data();
+	size_t size = source.size();
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		unsigned long long w;
+		memcpy(&w, data + i, 8);
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+	if (i < size) {
+		unsigned long long w = 0;
+		memcpy(&w, data + i, size - i);
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+	// the length keeps sources padded with zeros apart
+	h = (h ^ size) * k;
+	return h ^ h >> 32;
+}
+
+void ShaderCache::describe(Variant &v, const char *vertPath, const char *fragPath, const vector<string> &definitions)
+{
+	// paths are made absolute here, as the worker does not share the current directory
+	v.vertPath = AssetCache::CanonicalPath(vertPath);
+	v.fragPath = AssetCache::CanonicalPath(fragPath);
+	v.definitions = definitions;
+	sort(v.definitions.begin(), v.definitions.end());
+	v.definitions.erase(unique(v.definitions.begin(), v.definitions.end()), v.definitions.end());
+	v.preprocessed = false;
+
+	v.key = v.vertPath + '|' + v.fragPath;
+	for (int i = 0, n = v.definitions.size(); i < n; i++)
+		v.key += '|' + v.definitions[i];
+}
+
+void ShaderCache::preprocess(Variant &v)
+{
+	v.vert = ShaderPreprocessor(v.definitions);
+	v.frag = ShaderPreprocessor(v.definitions);
+	v.preprocessed = v.vert.ProcessFile(v.vertPath.c_str()) && v.frag.ProcessFile(v.fragPath.c_str());
+}
+
+ProgramObject ShaderCache::GetProgram(const char *vertPath, const char *fragPath, const vector<string> &definitions)
+{
+	Variant v;
+	describe(v, vertPath, fragPath, definitions);
+	stats.numRequests++;
+
+	const unsigned long long *hash = requests.Find(v.key);
+	if (hash) {
+		stats.numHits++;
+		return programs.find(*hash)->second;
+	}
+	preprocess(v);
+	return addProgram(v);
+}
+
+ProgramObject ShaderCache::addProgram(Variant &v, bool async)
+{
+	// failures are not kept, so the files can be fixed and asked for again
+	if (!v.preprocessed) {
+		const string &error = v.vert.GetError().empty() ? v.frag.GetError() : v.vert.GetError();
+		OutputDebugStringA(("ERROR: " + error + "\n").c_str());
+		return ProgramObject(rc);
+	}
+
+	unsigned long long hash = HashSource(v.frag.GetSource(), HashSource(v.vert.GetSource()));
+	map<unsigned long long, ProgramObject>::iterator i = programs.find(hash);
+	if (i != programs.end()) {
+		requests.Insert(v.key, hash);
+		stats.numSourceHits++;
+		return i->second;
+	}
+
+	long long start = getTicks();
+	ProgramObject prog(rc);
+	if (async) prog.BuildAsync(v.vert, v.frag);
+	else prog.Build(v.vert, v.frag);
+	stats.compileMs += ticksToMs(getTicks() - start);
+
+	// programs built in steps are kept until they turn out not to link
+	if (async || prog.IsLinked()) {
+		requests.Insert(v.key, hash);
+		programs.insert(make_pair(hash, prog));
+		stats.numPrograms++;
+	}
+	return prog;
+}
+
+struct RequestsOf
+{
+	unsigned long long hash;
+	vector<string> *keys;
+	void operator()(const char *key, unsigned long long h) {
+		if (h == hash) keys->push_back(key);
+	}
+};
+
+void ShaderCache::forget(unsigned long long hash)
+{
+	vector<string> keys;
+	RequestsOf f = { hash, &keys };
+	requests.ForEach(f);
+	for (int i = 0, n = keys.size(); i < n; i++)
+		requests.Remove(keys[i]);
+	if (programs.erase(hash)) stats.numPrograms--;
+}
+
+void ShaderCache::AddVariant(const char *vertPath, const char *fragPath, const vector<string> &definitions)
+{
+	Variant *v = new Variant;
+	describe(*v, vertPath, fragPath, definitions);
+	if (requests.Find(v->key)) {
+		delete v;
+		return;
+	}
+
+	{
+		lock_guard<mutex> l(lock);
+		queued.push_back(v);
+		numPending++;
+	}
+	if (!worker.joinable())
+		worker = thread(&ShaderCache::workerMain, this);
+	wake.notify_one();
+}
+
+void ShaderCache::workerMain()
+{
+	unique_lock<mutex> l(lock);
+	for (;;)
+	{
+		while (!quit && queued.empty())
+			wake.wait(l);
+		if (quit) return;
+
+		Variant *v = queued.front();
+		queued.pop_front();
+		l.unlock();
+		preprocess(*v);
+		l.lock();
+		ready.push_back(v);
+	}
+}
+
+int ShaderCache::Prewarm(float budgetMs)
+{
+	long long start = getTicks();
+	int count = 0;
+
+	// finishes what the driver is done with, without waiting for the rest
+	for (list<pair<unsigned long long, ProgramObject> >::iterator i = building.begin(); i != building.end(); )
+	{
+		if (!i->second.IsBuildComplete()) { ++i; continue; }
+		long long t = getTicks();
+		if (!i->second.FinishBuild()) forget(i->first);
+		stats.compileMs += ticksToMs(getTicks() - t);
+		i = building.erase(i);
+		count++;
+
+		lock_guard<mutex> l(lock);
+		numPending--;
+	}
+
+	// With parallel compilation everything ready is submitted at once and
+	// finished by later calls; otherwise programs are built one by one.
+	bool parallel = GLEW_ARB_parallel_shader_compile != 0;
+	for (;;)
+	{
+		if (!parallel && count != 0 && ticksToMs(getTicks() - start) >= budgetMs) break;
+
+		Variant *v;
+		{
+			lock_guard<mutex> l(lock);
+			if (ready.empty()) break;
+			v = ready.front();
+			ready.pop_front();
+		}
+
+		// it may have been asked for since it was declared
+		bool submitted = false;
+		if (!requests.Find(v->key)) {
+			ProgramObject prog = addProgram(*v, parallel);
+			const unsigned long long *hash = requests.Find(v->key);
+			stats.numPrewarmed++;
+			if (parallel && hash) {
+				building.push_back(make_pair(*hash, prog));
+				submitted = true;
+			}
+			else count++;
+		}
+		delete v;
+
+		if (!submitted) {
+			lock_guard<mutex> l(lock);
+			numPending--;
+		}
+	}
+	return count;
+}
+
+int ShaderCache::GetPendingCount()
+{
+	lock_guard<mutex> l(lock);
+	return numPending;
+}
+
+void ShaderCache::Clear()
+{
+	requests.Clear();
+	programs.clear();
+	stats.numPrograms = 0;
+
+	// declared variants go as well; the one the worker is preprocessing
+	// still arrives in ready and is counted until Prewarm() takes it
+	lock_guard<mutex> l(lock);
+	numPending -= building.size() + queued.size() + ready.size();
+	building.clear();
+	for (int i = 0, n = queued.size(); i < n; i++) delete queued[i];
+	for (int i = 0, n = ready.size(); i < n; i++) delete ready[i];
+	queued.clear();
+	ready.clear();
+}
\ No newline at end of file
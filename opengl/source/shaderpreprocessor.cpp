@@ -0,0 +1,601 @@
+#include "shaderpreprocessor.h"
+#include "mappedfile.h"
+#include "stringhelp.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <mutex>
+
+#define SP_MAX_INCLUDE_DEPTH 32
+#define SP_MAX_MACRO_NESTING 16
+
+namespace
+{
+	struct SourceFile
+	{
+		string text;
+		string guard; // macro of the include guard around all of it
+	};
+
+	// constructed on first use, like the string pool
+	struct FileCache
+	{
+		mutex lock;
+		StringMap<SourceFile> files;
+	};
+
+	FileCache &fileCache()
+	{
+		static FileCache cache;
+		return cache;
+	}
+}
+
+static bool isIdentStart(char c) {
+	return isalpha((unsigned char)c) || c == '_';
+}
+
+static bool isIdentChar(char c) {
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+static const char *skipSpace(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+	return p;
+}
+
+static const char *skipIdent(const char *p, const char *end)
+{
+	if (p < end && isIdentStart(*p))
+		while (p < end && isIdentChar(*p)) p++;
+	return p;
+}
+
+static const char *findLineEnd(const char *p, const char *end, const char *&next)
+{
+	const char *eol = (const char *)memchr(p, '\n', end - p);
+	next = eol ? eol + 1 : end;
+	if (!eol) eol = end;
+	if (eol > p && eol[-1] == '\r') eol--;
+	return eol;
+}
+
+// blank lines and // comments are not significant to the preprocessor
+static bool isBlank(const char *p, const char *end) {
+	return p == end || (end - p >= 2 && p[0] == '/' && p[1] == '/');
+}
+
+// Splits a directive line (from after the #) into its name and its
+// argument, the argument without a trailing // comment and spaces.
+static void splitDirective(const char *p, const char *end, string &name, string &arg)
+{
+	p = skipSpace(p, end);
+	const char *nameEnd = skipIdent(p, end);
+	name.assign(p, nameEnd);
+
+	p = skipSpace(nameEnd, end);
+	const char *argEnd = p;
+	for (const char *q = p; q < end; q++) {
+		if (q + 1 < end && q[0] == '/' && q[1] == '/') break;
+		if (*q != ' ' && *q != '\t') argEnd = q + 1;
+	}
+	arg.assign(p, argEnd);
+}
+
+static string leadingIdent(const string &s)
+{
+	const char *p = s.c_str();
+	return string(p, skipIdent(p, p + s.size()));
+}
+
+// Name of the include guard around all of text: the first two significant
+// lines are #ifndef X and #define X, and the #endif of the first is last.
+static string findGuard(const string &text)
+{
+	const char *p = text.c_str(), *end = p + text.size(), *next;
+	string guard, name, arg;
+	int numLines = 0, depth = 0;
+	bool closed = false;
+	for (; p < end; p = next)
+	{
+		const char *eol = findLineEnd(p, end, next);
+		const char *s = skipSpace(p, eol);
+		if (isBlank(s, eol)) continue;
+		if (closed || (*s != '#' && numLines < 2)) return "";
+		if (*s != '#') continue;
+
+		splitDirective(s + 1, eol, name, arg);
+		if (numLines == 0) {
+			if (name != "ifndef") return "";
+			guard = leadingIdent(arg);
+			depth = 1;
+		}
+		else if (numLines == 1) {
+			if (name != "define" || leadingIdent(arg) != guard) return "";
+		}
+		else if (name == "if" || name == "ifdef" || name == "ifndef")
+			depth++;
+		else if (name == "endif" && --depth == 0)
+			closed = true;
+		numLines++;
+	}
+	return closed ? guard : "";
+}
+
+// Replaces every /* */ comment with a space, keeping the line breaks in
+// it so line numbers do not move; a commented-out directive is then not
+// a directive. // comments are kept, as the rest of the code skips them.
+static string stripBlockComments(const char *text, int length)
+{
+	string out;
+	out.reserve(length);
+	const char *p = text, *end = text + length;
+	while (p < end)
+	{
+		const char *slash = (const char *)memchr(p, '/', end - p);
+		if (!slash || slash + 1 == end) {
+			out.append(p, end);
+			break;
+		}
+		out.append(p, slash);
+		p = slash;
+
+		if (p[1] == '/') {
+			// a /* after // on the same line does not start a comment
+			const char *eol = (const char *)memchr(p, '\n', end - p);
+			if (!eol) eol = end;
+			out.append(p, eol);
+			p = eol;
+		}
+		else if (p[1] == '*') {
+			out += ' ';
+			for (p += 2; p < end && !(p[0] == '*' && p + 1 < end && p[1] == '/'); p++)
+				if (*p == '\n') out += '\n';
+			p = p < end ? p + 2 : end;
+		}
+		else out += *p++;
+	}
+	return out;
+}
+
+static bool loadFile(const string &path, SourceFile &file)
+{
+	FileCache &cache = fileCache();
+	lock_guard<mutex> lock(cache.lock);
+	const SourceFile *cached = cache.files.Find(path);
+	if (!cached)
+	{
+		MappedFile f(path.c_str());
+		if (!f) return false;
+		SourceFile s;
+		s.text = stripBlockComments((const char *)f.GetData(), f.GetSize());
+		s.guard = findGuard(s.text);
+		cached = &cache.files.Insert(path, s);
+	}
+	file = *cached;
+	return true;
+}
+
+void ShaderPreprocessor::ClearFileCache()
+{
+	FileCache &cache = fileCache();
+	lock_guard<mutex> lock(cache.lock);
+	cache.files.Clear();
+}
+
+// Integer expressions of #if and #elif with the operators of C but ?:
+// and the comma. Names that are not defined are 0, defined ones are
+// replaced with their value. The first error stops the parse; what is
+// returned after it is meaningless.
+class ExpressionParser
+{
+public:
+	ExpressionParser(ShaderPreprocessor &sp, const string &expr, int nesting)
+		: sp(sp), p(expr.c_str()), nesting(nesting), failed(false) { }
+
+	// false with message set if the expression is not valid
+	bool Parse(long long &value, string &message)
+	{
+		value = binary(1);
+		skip();
+		if (*p) error(string("unexpected '") + p + "' in #if");
+		message = this->message;
+		return !failed;
+	}
+private:
+	ShaderPreprocessor &sp;
+	const char *p;
+	int nesting;
+	bool failed;
+	string message;
+
+	long long error(const string &message)
+	{
+		if (!failed) {
+			failed = true;
+			this->message = message;
+		}
+		return 0;
+	}
+
+	void skip() {
+		while (*p == ' ' || *p == '\t') p++;
+	}
+
+	// operator at p and its precedence, 0 if there is none
+	int peekOperator(int &len)
+	{
+		static const struct { const char *op; int precedence; } ops[] = {
+			{ "||", 1 }, { "&&", 2 }, { "==", 6 }, { "!=", 6 }, { "<=", 7 }, { ">=", 7 },
+			{ "<<", 8 }, { ">>", 8 }, { "|", 3 }, { "^", 4 }, { "&", 5 }, { "<", 7 },
+			{ ">", 7 }, { "+", 9 }, { "-", 9 }, { "*", 10 }, { "/", 10 }, { "%", 10 }
+		};
+		skip();
+		for (int i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++) {
+			len = strlen(ops[i].op);
+			if (!strncmp(p, ops[i].op, len)) return ops[i].precedence;
+		}
+		return 0;
+	}
+
+	long long binary(int minPrecedence)
+	{
+		long long lhs = unary();
+		for (;;)
+		{
+			if (failed) return 0;
+			int len = 0;
+			int precedence = peekOperator(len);
+			if (precedence < minPrecedence) return lhs;
+			string op(p, len);
+			p += len;
+			long long rhs = binary(precedence + 1);
+			if (failed) return 0;
+
+			if (op == "||") lhs = lhs || rhs;
+			else if (op == "&&") lhs = lhs && rhs;
+			else if (op == "==") lhs = lhs == rhs;
+			else if (op == "!=") lhs = lhs != rhs;
+			else if (op == "<=") lhs = lhs <= rhs;
+			else if (op == ">=") lhs = lhs >= rhs;
+			else if (op == "<<") lhs = lhs << rhs;
+			else if (op == ">>") lhs = lhs >> rhs;
+			else if (op == "|") lhs = lhs | rhs;
+			else if (op == "^") lhs = lhs ^ rhs;
+			else if (op == "&") lhs = lhs & rhs;
+			else if (op == "<") lhs = lhs < rhs;
+			else if (op == ">") lhs = lhs > rhs;
+			else if (op == "+") lhs = lhs + rhs;
+			else if (op == "-") lhs = lhs - rhs;
+			else if (op == "*") lhs = lhs * rhs;
+			else {
+				if (!rhs) return error("division by zero in #if");
+				lhs = op == "/" ? lhs / rhs : lhs % rhs;
+			}
+		}
+	}
+
+	long long unary()
+	{
+		skip();
+		char c = *p;
+		if (c == '!') { p++; return !unary(); }
+		if (c == '~') { p++; return ~unary(); }
+		if (c == '-') { p++; return -unary(); }
+		if (c == '+') { p++; return unary(); }
+		if (c == '(')
+		{
+			p++;
+			long long value = binary(1);
+			if (failed) return 0;
+			skip();
+			if (*p != ')') return error("missing ')' in #if");
+			p++;
+			return value;
+		}
+		if (isdigit((unsigned char)c))
+		{
+			char *end;
+			long long value = strtoll(p, &end, 0);
+			p = end;
+			while (*p == 'u' || *p == 'U' || *p == 'l' || *p == 'L') p++;
+			return value;
+		}
+		if (isIdentStart(c))
+		{
+			const char *begin = p;
+			p = skipIdent(p, p + strlen(p));
+			string name(begin, p);
+			if (name == "defined") return defined();
+
+			const string *value = sp.macros.Find(name);
+			if (!value) return 0;
+			if (nesting >= SP_MAX_MACRO_NESTING)
+				return error("macro " + name + " nests too deeply");
+			long long result = 0;
+			string message;
+			if (!ExpressionParser(sp, *value, nesting + 1).Parse(result, message))
+				return error(message);
+			return result;
+		}
+		return error(c ? "unexpected '" + string(1, c) + "' in #if" : "expected a value in #if");
+	}
+
+	// defined NAME or defined(NAME)
+	long long defined()
+	{
+		skip();
+		bool paren = *p == '(';
+		if (paren) { p++; skip(); }
+		const char *begin = p;
+		p = skipIdent(p, p + strlen(p));
+		if (p == begin) return error("expected a name after defined");
+		string name(begin, p);
+		if (paren) {
+			skip();
+			if (*p != ')') return error("missing ')' after defined");
+			p++;
+		}
+		return sp.macros.Find(name) ? 1 : 0;
+	}
+};
+
+ShaderPreprocessor::ShaderPreprocessor(const vector<string> &definitions) :
+	injected(false),
+	exactLines(false),
+	depth(0),
+	conditionBase(0)
+{
+	for (int i = 0, n = definitions.size(); i < n; i++)
+	{
+		const string &d = definitions[i];
+		size_t eq = d.find('=');
+		string name = strhlp::trim(d.substr(0, eq));
+		string value = eq != string::npos ? strhlp::trim(d.substr(eq + 1)) : "1";
+		if (name.empty()) continue;
+		macros.Insert(name, value) = value;
+		this->definitions.push_back(name + " " + value);
+	}
+}
+
+bool ShaderPreprocessor::ProcessFile(const char *filename)
+{
+	string path = strhlp::normalizePath(filename);
+	SourceFile file;
+	if (!loadFile(path, file)) {
+		error = string("cannot open ") + filename;
+		return false;
+	}
+
+	output.reserve(output.size() + file.text.size() + 256);
+	if (!process(file.text.data(), file.text.size(), fileIndex(path)))
+		return false;
+	if (!injected) inject(NULL, 0, 1);
+	return true;
+}
+
+bool ShaderPreprocessor::ProcessSource(const char *source, int length)
+{
+	if (!length) length = strlen(source);
+	string text = stripBlockComments(source, length);
+	output.reserve(output.size() + text.size() + 256);
+	if (!process(text.data(), text.size(), fileIndex("<source>")))
+		return false;
+	if (!injected) inject(NULL, 0, 1);
+	return true;
+}
+
+int ShaderPreprocessor::fileIndex(const string &path)
+{
+	for (int i = 0, n = files.size(); i < n; i++)
+		if (files[i] == path) return i;
+	files.push_back(path);
+	return files.size() - 1;
+}
+
+// sets the error and returns false, so callers can return it
+bool ShaderPreprocessor::fail(int file, int line, const string &message)
+{
+	char buf[32] = "";
+	sprintf(buf, "(%d): ", line);
+	error = files[file] + buf + message;
+	return false;
+}
+
+bool ShaderPreprocessor::process(const char *text, int length, int file)
+{
+	int base = conditionBase;
+	conditionBase = conditions.size();
+
+	const char *p = text, *end = text + length, *next;
+	int line = 1;
+	bool ok = true;
+	for (; ok && p < end; p = next, line++)
+	{
+		const char *eol = findLineEnd(p, end, next);
+		const char *s = skipSpace(p, eol);
+
+		// definitions go right after #version, which has to come first
+		if (!injected && !isBlank(s, eol))
+		{
+			string name, arg;
+			if (*s == '#') splitDirective(s + 1, eol, name, arg);
+			if (name == "version") {
+				output.append(p, eol - p);
+				output += '\n';
+				inject(arg.c_str(), file, line + 1);
+				continue;
+			}
+			inject(NULL, file, line);
+		}
+
+		if (s < eol && *s == '#')
+			ok = directive(p, eol, file, line);
+		else if (isActive()) {
+			output.append(p, eol - p);
+			output += '\n';
+		}
+		else output += '\n';
+	}
+
+	if (ok && (int)conditions.size() != conditionBase)
+		ok = fail(file, conditions.back().line, "unterminated #if");
+	conditionBase = base;
+	return ok;
+}
+
+void ShaderPreprocessor::inject(const char *version, int file, int nextLine)
+{
+	// before 3.00 #line N numbers the line after it N + 1
+	exactLines = version && atoi(version) >= 300;
+	injected = true;
+	for (int i = 0, n = definitions.size(); i < n; i++) {
+		output += "#define ";
+		output += definitions[i];
+		output += '\n';
+	}
+	if (!definitions.empty())
+		lineDirective(nextLine, file);
+}
+
+void ShaderPreprocessor::lineDirective(int line, int file)
+{
+	char buf[32] = "";
+	sprintf(buf, "#line %d %d\n", exactLines ? line : line - 1, file);
+	output += buf;
+}
+
+bool ShaderPreprocessor::test(const string &expr, int file, int line, bool &result)
+{
+	long long value = 0;
+	string message;
+	if (!ExpressionParser(*this, expr, 0).Parse(value, message))
+		return fail(file, line, message);
+	result = value != 0;
+	return true;
+}
+
+bool ShaderPreprocessor::directive(const char *begin, const char *end, int file, int line)
+{
+	string name, arg;
+	splitDirective(skipSpace(begin, end) + 1, end, name, arg);
+	bool active = isActive();
+
+	if (name == "ifdef" || name == "ifndef" || name == "if")
+	{
+		Condition c = { false, false, active, false, line };
+		if (active) {
+			if (name == "if") {
+				if (!test(arg, file, line, c.active)) return false;
+			}
+			else {
+				string macro = leadingIdent(arg);
+				if (macro.empty()) return fail(file, line, "expected a name after #" + name);
+				c.active = (macros.Find(macro) != NULL) == (name == "ifdef");
+			}
+		}
+		c.taken = c.active;
+		conditions.push_back(c);
+	}
+	else if (name == "elif" || name == "else" || name == "endif")
+	{
+		if ((int)conditions.size() <= conditionBase)
+			return fail(file, line, "#" + name + " without #if");
+		Condition &c = conditions.back();
+		if (name == "endif")
+			conditions.pop_back();
+		else if (c.sawElse)
+			return fail(file, line, "#" + name + " after #else");
+		else {
+			// #elif is only evaluated when its branch can be taken
+			c.sawElse = name == "else";
+			bool value = c.sawElse;
+			if (!value && c.parentActive && !c.taken && !test(arg, file, line, value))
+				return false;
+			c.active = c.parentActive && !c.taken && value;
+			c.taken = c.taken || c.active;
+		}
+	}
+	else if (!active) { }
+	else if (name == "include")
+	{
+		char close = arg.empty() ? 0 : arg[0] == '"' ? '"' : arg[0] == '<' ? '>' : 0;
+		size_t last = arg.find(close, 1);
+		if (!close || last == string::npos)
+			return fail(file, line, "expected \"file\" after #include");
+		return include(arg.substr(1, last - 1), file, line);
+	}
+	else if (name == "pragma" && arg == "once") {
+		onceFiles.Insert(onceKey(files[file]), true);
+		output += '\n';
+		return true;
+	}
+	else if (name == "error")
+		return fail(file, line, "#error " + arg);
+	else
+	{
+		// the compiler needs the macros too
+		if (name == "define" || name == "undef")
+		{
+			string macro = leadingIdent(arg);
+			if (macro.empty()) return fail(file, line, "expected a name after #" + name);
+			if (name == "undef")
+				macros.Remove(macro);
+			else {
+				string value = strhlp::trim(arg.substr(macro.size()));
+				macros.Insert(macro, value) = value;
+			}
+		}
+		output.append(begin, end - begin);
+		output += '\n';
+		return true;
+	}
+	output += '\n';
+	return true;
+}
+
+bool ShaderPreprocessor::include(const string &name, int file, int line)
+{
+	if (depth >= SP_MAX_INCLUDE_DEPTH)
+		return fail(file, line, "#include nested too deeply");
+
+	// paths are normalized, so a file reached through different spellings
+	// is one file to #pragma once and to the file cache
+	const string &including = files[file];
+	size_t slash = including.find_last_of("/\\");
+	string path = strhlp::normalizePath(strhlp::joinPath(slash != string::npos ? including.substr(0, slash) : "", name));
+
+	// files included already that say so are left out without reading them
+	SourceFile source;
+	if (onceFiles.Find(onceKey(path))) {
+		output += '\n';
+		return true;
+	}
+	if (!loadFile(path, source))
+		return fail(file, line, "cannot open " + path);
+	if (!source.guard.empty() && macros.Find(source.guard)) {
+		output += '\n';
+		return true;
+	}
+
+	int index = fileIndex(path);
+	lineDirective(1, index);
+	depth++;
+	bool ok = process(source.text.data(), source.text.size(), index);
+	depth--;
+	if (!ok) return false;
+	lineDirective(line + 1, file);
+	return true;
+}
+
+// file names are not case sensitive on Windows
+string ShaderPreprocessor::onceKey(const string &path)
+{
+#ifdef _WIN32
+	return strhlp::toLowerCase(path);
+#else
+	return path;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "stringmap.h"
+#include <mutex>
+
+#define POOL_BLOCK_SIZE (64*1024)
+
+namespace
+{
+	struct PoolSlot
+	{
+		unsigned int hash;
+		int len;
+		const char *str;
+	};
+
+	// constructed on first use, so maps in static objects can intern too
+	struct Pool
+	{
+		mutex lock;
+		vector<PoolSlot> slots;
+		vector<char *> blocks;
+		char *block; // the one strings are being added to
+		int blockOffset;
+		int count;
+		int bytes;
+
+		Pool() : block(NULL), blockOffset(POOL_BLOCK_SIZE), count(0), bytes(0) {
+			PoolSlot empty = { 0, 0, NULL };
+			slots.assign(256, empty);
+		}
+		~Pool() {
+			for (int i = 0, n = blocks.size(); i < n; i++)
+				delete [] blocks[i];
+		}
+
+		const char *copy(const char *s, int len)
+		{
+			char *p;
+			if (len + 1 > POOL_BLOCK_SIZE / 4)
+				blocks.push_back(p = new char[len + 1]); // a block of its own
+			else {
+				if (blockOffset + len + 1 > POOL_BLOCK_SIZE) {
+					blocks.push_back(block = new char[POOL_BLOCK_SIZE]);
+					blockOffset = 0;
+				}
+				p = block + blockOffset;
+				blockOffset += len + 1;
+			}
+			memcpy(p, s, len);
+			p[len] = 0;
+			bytes += len + 1;
+			return p;
+		}
+
+		void grow()
+		{
+			vector<PoolSlot> old;
+			old.swap(slots);
+			PoolSlot empty = { 0, 0, NULL };
+			slots.assign(old.size() * 2, empty);
+
+			int mask = slots.size() - 1;
+			for (int j = 0, n = old.size(); j < n; j++) {
+				if (!old[j].str) continue;
+				int i = old[j].hash & mask;
+				while (slots[i].str) i = (i + 1) & mask;
+				slots[i] = old[j];
+			}
+		}
+	};
+
+	Pool &getPool()
+	{
+		static Pool pool;
+		return pool;
+	}
+}
+
+unsigned int StringPool::Hash(const char *s, int len)
+{
+	// eight bytes at a time, the tail padded with zeros
+	const unsigned long long k = 0x9E3779B97F4A7C15ULL;
+	unsigned long long h = 0xCBF29CE484222325ULL ^ (unsigned long long)len;
+	int i = 0;
+	for (; i + 8 <= len; i += 8) {
+		unsigned long long w;
+		memcpy(&w, s + i, 8);
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+	if (i < len) {
+		unsigned long long w = 0;
+		memcpy(&w, s + i, len - i);
+		h = (h ^ w) * k;
+		h ^= h >> 32;
+	}
+	unsigned int r = (unsigned int)(h ^ h >> 29);
+	return r ? r : 1;
+}
+
+const char *StringPool::Intern(const char *s, int len, unsigned int hash)
+{
+	Pool &pool = getPool();
+	unique_lock<mutex> l(pool.lock);
+
+	int mask = pool.slots.size() - 1;
+	int i = hash & mask;
+	for (; pool.slots[i].str; i = (i + 1) & mask) {
+		const PoolSlot &slot = pool.slots[i];
+		if (slot.hash == hash && slot.len == len && memcmp(slot.str, s, len) == 0)
+			return slot.str;
+	}
+
+	PoolSlot slot = { hash, len, pool.copy(s, len) };
+	pool.slots[i] = slot;
+	if (++pool.count * 2 > (int)pool.slots.size())
+		pool.grow();
+	return slot.str;
+}
+
+int StringPool::GetCount()
+{
+	Pool &pool = getPool();
+	unique_lock<mutex> l(pool.lock);
+	return pool.count;
+}
+
+int StringPool::GetBytes()
+{
+	Pool &pool = getPool();
+	unique_lock<mutex> l(pool.lock);
+	return pool.bytes;
+}
\ No newline at end of file
@@ -1,44 +1,75 @@
 #include "text2d.h"
 #include "datatypes.h"
 #include "transform.h"
+#include "image.h"
+#include "mappedfile.h"
+#include "stringhelp.h"
+#include "shaderpreprocessor.h"
 
-Font2D::Font2D(const char *filename) : lineSpacing(0)
+// TrueType glyphs for distance fields are rasterized this many times larger
+#define SDF_TTF_SCALE 4
+
+Font2D::Font2D(const char *filename) : lineSpacing(0), scale(1.0f)
 {
-	loaded = ptr->load(filename);
+	loaded = ptr->load(filename, NULL);
 }
 
-void Font2D::LoadFnt(const char *filename)
+bool Font2D::LoadFnt(const char *filename, const SdfGenerator *generator)
 {
 	if (ptr.GetRefCount() != 1)
 		ptr = my_shared_ptr<SharedTraits>::MakeNew();
-	loaded = ptr->load(filename);
+	return loaded = ptr->load(filename, generator);
 }
 
-shared_traits<Font2D>::shared_traits()
+bool Font2D::LoadTtf(const char *filename, int pixelHeight, const wchar_t *chars, const SdfGenerator *generator)
 {
-	numChars = numCharsets = 0;
-	charsets = NULL;
-	charWidth = NULL;
-	numCellsX = numCellsY = 0;
-	fontHeight = 0.0f;
-
-	dty = 0.0f;
-	numCellsX_inv = numCellsY_inv = 0.0f;
-	texWidth_inv = 0.0f;
+	if (ptr.GetRefCount() != 1)
+		ptr = my_shared_ptr<SharedTraits>::MakeNew();
+	return loaded = ptr->loadTtf(filename, pixelHeight, chars, generator);
 }
 
-shared_traits<Font2D>::~shared_traits()
+bool shared_traits<Font2D>::load(const char *filename, const SdfGenerator *generator)
 {
-	delete [] charsets;
-	delete [] charWidth;
+	ifstream file(filename);
+	if (!file) return false;
+	glyphs.Clear();
+	sdf = generator != NULL;
+
+	// BMFont text files start with their info or common line
+	string first;
+	file >> first;
+	file.clear();
+	file.seekg(0);
+	if (first == "info" || first == "common")
+		return loadBMFont(file, filename, generator);
+	return loadGrid(file, generator);
 }
 
-bool shared_traits<Font2D>::load(const char *filename)
+bool shared_traits<Font2D>::loadAtlas(const char *filename, const SdfGenerator *generator)
 {
-	ifstream file(filename);
-	if (!file) return false;
+	if (!generator)
+		fontTexture.LoadFromFile(filename);
+	else {
+		// the field of the coverage the atlas has, at the same size
+		Image img, field;
+		if (img.Load(filename) && generator->Generate(img, field))
+			fontTexture.LoadFromImage(field);
+	}
+	fontTexture.SetFilters(GL_LINEAR, GL_LINEAR);
+	return fontTexture.IsLoaded();
+}
 
-	int curCharset = 0;
+bool shared_traits<Font2D>::loadGrid(ifstream &file, const SdfGenerator *generator)
+{
+	struct Charset {
+		int base;
+		int startChar;
+		int endChar;
+	};
+
+	vector<Charset> charsets;
+	vector<int> charWidth;
+	int numChars = 0;
 	int cellWidth = 0, cellHeight = 0;
 
 	while (!file.eof())
@@ -48,17 +79,11 @@ bool shared_traits<Font2D>::load(const char *filename)
 		
 		if (!strcmp(prefix, "nc"))
 			file >> numChars;
-		else if (!strcmp(prefix, "ns")) {
-			file >> numCharsets;
-			charsets = new Charset[numCharsets];
-			memset(charsets, 0, numCharsets*sizeof(Charset));
-		}
 		else if (!strcmp(prefix, "f "))
 		{
 			char path[MAX_PATH] = { };
 			file >> path;
-			fontTexture.LoadFromTGA(path);
-			fontTexture.SetFilters(GL_LINEAR, GL_LINEAR);
+			loadAtlas(path, generator);
 		}
 		else if (!strcmp(prefix, "cw")) {
 			file >> cellWidth;
@@ -71,78 +96,421 @@ bool shared_traits<Font2D>::load(const char *filename)
 		}
 		else if (!strcmp(prefix, "fw"))
 		{
-			charWidth = new int[numChars];
+			charWidth.resize(numChars);
 			for (int i = 0; i < numChars; i++)
 				file >> charWidth[i];
 		}
 		else if (!strcmp(prefix, "cs")) {
-			if (curCharset < numCharsets) {
-				Charset charset = { };
-				file >> charset.base >> charset.startChar >> charset.endChar;
-				charsets[curCharset++] = charset;
-			}
+			Charset charset = { };
+			file >> charset.base >> charset.startChar >> charset.endChar;
+			charsets.push_back(charset);
 		}
 		ws(file);
 	}
 
-	if (!fontTexture.IsLoaded()) return false;
+	if (!fontTexture.IsLoaded() || !cellWidth || !cellHeight) return false;
 
 	int tw = fontTexture.GetWidth();
 	int th = fontTexture.GetHeight();
+	int numCellsX = tw / cellWidth;
+	int numCellsY = th / cellHeight;
+	base = fontHeight;
+
+	for (int i = 0, n = charsets.size(); i < n; i++)
+	{
+		const Charset &c = charsets[i];
+		for (int ch = c.startChar; ch <= c.endChar; ch++)
+		{
+			// the first charset a character is in wins
+			int index = ch - c.startChar + c.base;
+			if (index < 0 || index >= (int)charWidth.size() || glyphs.Find(ch))
+				continue;
+
+			// cells are numbered row by row
+			int x = index % numCellsX;
+			int y = index / numCellsX;
+			float w = (float)charWidth[index];
+
+			Glyph g = { };
+			g.x1 = w;
+			g.y1 = fontHeight;
+			g.u0 = (float)x / numCellsX;
+			g.v0 = (float)y / numCellsY;
+			g.u1 = g.u0 + w / tw;
+			g.v1 = g.v0 + fontHeight / th;
+			g.advance = w;
+			glyphs.Add(ch, g);
+		}
+	}
+	return true;
+}
+
+// value of key=value in a line of a BMFont file, without quotes
+static string bmValue(const string &line, const char *key)
+{
+	string k = string(" ") + key + "=";
+	size_t i = line.find(k);
+	if (i == string::npos) return "";
+	i += k.size();
+
+	if (i < line.size() && line[i] == '"') {
+		size_t end = line.find('"', i + 1);
+		return line.substr(i + 1, end != string::npos ? end - i - 1 : string::npos);
+	}
+	size_t end = line.find_first_of(" \t\r", i);
+	return line.substr(i, end != string::npos ? end - i : string::npos);
+}
+
+static int bmInt(const string &line, const char *key) {
+	return atoi(bmValue(line, key).c_str());
+}
+
+bool shared_traits<Font2D>::loadBMFont(ifstream &file, const char *filename, const SdfGenerator *generator)
+{
+	string dir = filename;
+	size_t slash = dir.find_last_of("/\\");
+	dir = slash != string::npos ? dir.substr(0, slash) : "";
+
+	float scaleW = 0.0f, scaleH = 0.0f;
+	string line;
+	while (getline(file, line))
+	{
+		int i = line.find(' ');
+		if (i == -1) continue;
+		string tag = line.substr(0, i);
+
+		if (tag == "common") {
+			fontHeight = (float)bmInt(line, "lineHeight");
+			base = (float)bmInt(line, "base");
+			scaleW = (float)bmInt(line, "scaleW");
+			scaleH = (float)bmInt(line, "scaleH");
+		}
+		else if (tag == "page" && bmInt(line, "id") == 0) {
+			loadAtlas(strhlp::joinPath(dir, bmValue(line, "file")).c_str(), generator);
+		}
+		else if (tag == "char" && bmInt(line, "page") == 0 && scaleW > 0 && scaleH > 0)
+		{
+			float x = (float)bmInt(line, "x");
+			float y = (float)bmInt(line, "y");
+			float w = (float)bmInt(line, "width");
+			float h = (float)bmInt(line, "height");
+
+			Glyph g;
+			g.x0 = (float)bmInt(line, "xoffset");
+			g.y0 = (float)bmInt(line, "yoffset");
+			g.x1 = g.x0 + w;
+			g.y1 = g.y0 + h;
+			g.u0 = x / scaleW;
+			g.v0 = y / scaleH;
+			g.u1 = (x + w) / scaleW;
+			g.v1 = (y + h) / scaleH;
+			g.advance = (float)bmInt(line, "xadvance");
+			glyphs.Add(bmInt(line, "id"), g);
+		}
+		else if (tag == "kerning")
+			glyphs.AddKerning(bmInt(line, "first"), bmInt(line, "second"), (float)bmInt(line, "amount"));
+	}
+	return fontTexture.IsLoaded() && glyphs.GetCount() > 0;
+}
+
+static USHORT readBE16(const BYTE *p) {
+	return (USHORT)(p[0] << 8 | p[1]);
+}
+
+static UINT readBE32(const BYTE *p) {
+	return (UINT)p[0] << 24 | (UINT)p[1] << 16 | (UINT)p[2] << 8 | p[3];
+}
+
+// family name of the (first) font of a TrueType file, from its name table
+static wstring ttfFamilyName(const BYTE *data, size_t size)
+{
+	const BYTE *end = data + size;
+	size_t font = 0;
+	if (size >= 16 && !memcmp(data, "ttcf", 4))
+		font = readBE32(data + 12);
+	if (font + 12 > size) return L"";
+
+	int numTables = readBE16(data + font + 4);
+	for (int i = 0; i < numTables; i++)
+	{
+		const BYTE *rec = data + font + 12 + i*16;
+		if (rec + 16 > end) break;
+		if (memcmp(rec, "name", 4)) continue;
+
+		size_t offset = readBE32(rec + 8);
+		if (offset + 6 > size) break;
+		const BYTE *table = data + offset;
+		int count = readBE16(table + 2);
+		const BYTE *strings = table + readBE16(table + 4);
+
+		wstring name;
+		for (int j = 0; j < count; j++)
+		{
+			// family names for Windows in UTF-16, US English preferred
+			const BYTE *r = table + 6 + j*12;
+			if (r + 12 > end) break;
+			if (readBE16(r) != 3 || readBE16(r + 2) != 1 || readBE16(r + 6) != 1)
+				continue;
+
+			const BYTE *s = strings + readBE16(r + 10);
+			int len = readBE16(r + 8) / 2;
+			if (s + len*2 > end) continue;
+			name.resize(len);
+			for (int k = 0; k < len; k++)
+				name[k] = readBE16(s + k*2);
+			if (readBE16(r + 4) == 0x409) break;
+		}
+		return name;
+	}
+	return L"";
+}
 
-	dty = fontHeight / th;
-	texWidth_inv = 1.0f / tw;
+bool shared_traits<Font2D>::loadTtf(const char *filename, int pixelHeight, const wchar_t *chars,
+	const SdfGenerator *generator)
+{
+	MappedFile file(filename);
+	if (!file) return false;
+	wstring face = ttfFamilyName(file.GetData(), file.GetSize());
+	if (face.empty()) return false;
+
+	// GDI does the rasterizing; the font is installed for this process
+	// only and just while its glyphs are drawn
+	DWORD numFonts = 0;
+	HANDLE fontRes = AddFontMemResourceEx((void *)file.GetData(), (DWORD)file.GetSize(), NULL, &numFonts);
+	if (!fontRes) return false;
+
+	// fields are made from bigger glyphs and get a border of spread pixels
+	sdf = generator != NULL;
+	int scale = sdf ? SDF_TTF_SCALE : 1;
+	int spread = sdf ? generator->GetSpread() : 0;
+
+	HDC hdc = CreateCompatibleDC(NULL);
+	HFONT font = CreateFontW(-pixelHeight*scale, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+		OUT_TT_ONLY_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH, face.c_str());
+	HGDIOBJ oldFont = SelectObject(hdc, font);
+
+	TEXTMETRICW tm;
+	GetTextMetricsW(hdc, &tm);
+	fontHeight = (float)(tm.tmHeight + tm.tmExternalLeading) / scale;
+	base = (float)tm.tmAscent / scale;
+
+	wstring defaultChars;
+	if (!chars) {
+		for (wchar_t c = 32; c < 127; c++) defaultChars += c;
+		for (wchar_t c = 160; c < 256; c++) defaultChars += c;
+		for (wchar_t c = 0x400; c < 0x460; c++) defaultChars += c;
+		chars = defaultChars.c_str();
+	}
+
+	struct GlyphBitmap {
+		unsigned int code;
+		GLYPHMETRICS gm;
+		vector<BYTE> pixels;
+	};
+
+	const MAT2 identity = { { 0, 1 }, { 0, 0 }, { 0, 0 }, { 0, 1 } };
+	vector<GlyphBitmap> bitmaps;
+	vector<GlyphRect> rects;
+	for (const wchar_t *c = chars; *c; c++)
+	{
+		GlyphBitmap b;
+		b.code = *c;
+		DWORD size = GetGlyphOutlineW(hdc, *c, GGO_GRAY8_BITMAP, &b.gm, 0, NULL, &identity);
+		if (size == GDI_ERROR) continue;
+		if (size) {
+			// 65 levels of coverage, stretched to 0-255
+			b.pixels.resize(size);
+			GetGlyphOutlineW(hdc, *c, GGO_GRAY8_BITMAP, &b.gm, size, b.pixels.data(), &identity);
+			for (DWORD i = 0; i < size; i++)
+				b.pixels[i] = (BYTE)(b.pixels[i] * 255 / 64);
+		}
 
-	if (cellWidth != 0) {
-		numCellsX = tw / cellWidth;
-		numCellsX_inv = 1.0f / numCellsX;
+		// blank glyphs (spaces) only advance the pen
+		GlyphRect r = { 0, 0, 0, 0 };
+		if (size && sdf) {
+			r.width = generator->GetFieldSize(b.gm.gmBlackBoxX, scale);
+			r.height = generator->GetFieldSize(b.gm.gmBlackBoxY, scale);
+		}
+		else if (size) {
+			r.width = b.gm.gmBlackBoxX;
+			r.height = b.gm.gmBlackBoxY;
+		}
+		bitmaps.push_back(b);
+		rects.push_back(r);
 	}
-	if (cellHeight != 0) {
-		numCellsY = th / cellHeight;
-		numCellsY_inv = 1.0f / numCellsY;
+
+	int numPairs = GetKerningPairsW(hdc, 0, NULL);
+	vector<KERNINGPAIR> pairs(numPairs);
+	if (numPairs) GetKerningPairsW(hdc, numPairs, pairs.data());
+
+	SelectObject(hdc, oldFont);
+	DeleteObject(font);
+	DeleteDC(hdc);
+	RemoveFontMemResourceEx(fontRes);
+
+	int tw = 0, th = 0;
+	if (bitmaps.empty() || !PackGlyphs(rects, 1, 4096, tw, th))
+		return false;
+
+	// Distance fields are single channel, 0 being far outside. Otherwise
+	// the atlas is white with the coverage in alpha, which is what the
+	// text shader reads.
+	Image atlas;
+	atlas.Create(tw, th, sdf ? 8 : 32);
+	BYTE *pixels = atlas.GetWritableData();
+	if (sdf) memset(pixels, 0, tw*th);
+	else {
+		for (int i = 0, n = tw*th; i < n; i++) {
+			pixels[4*i] = pixels[4*i + 1] = pixels[4*i + 2] = 255;
+			pixels[4*i + 3] = 0;
+		}
 	}
+
+	glyphs.Clear();
+	vector<SdfGlyph> fields;
+	for (int i = 0, n = bitmaps.size(); i < n; i++)
+	{
+		const GlyphBitmap &b = bitmaps[i];
+		const GlyphRect &r = rects[i];
+		float originX = (float)b.gm.gmptGlyphOrigin.x / scale;
+		float originY = (float)b.gm.gmptGlyphOrigin.y / scale;
+
+		// rows are DWORD aligned
+		int pitch = (b.gm.gmBlackBoxX + 3) & ~3;
+		if (sdf && r.width) {
+			SdfGlyph f = { b.pixels.data(), (int)b.gm.gmBlackBoxX, (int)b.gm.gmBlackBoxY, pitch,
+				pixels + r.y*tw + r.x, tw };
+			fields.push_back(f);
+		}
+		else {
+			for (int y = 0; y < r.height; y++) {
+				BYTE *dst = pixels + ((r.y + y)*tw + r.x)*4 + 3;
+				const BYTE *src = &b.pixels[y*pitch];
+				for (int x = 0; x < r.width; x++)
+					dst[x*4] = src[x];
+			}
+		}
+
+		Glyph g;
+		g.x0 = originX - spread;
+		g.y0 = base - originY - spread;
+		g.x1 = g.x0 + r.width;
+		g.y1 = g.y0 + r.height;
+		g.u0 = (float)r.x / tw;
+		g.v0 = (float)r.y / th;
+		g.u1 = (float)(r.x + r.width) / tw;
+		g.v1 = (float)(r.y + r.height) / th;
+		g.advance = (float)b.gm.gmCellIncX / scale;
+		glyphs.Add(b.code, g);
+	}
+	if (sdf) generator->Generate(fields, scale);
+
+	for (int i = 0; i < numPairs; i++) {
+		const KERNINGPAIR &k = pairs[i];
+		if (glyphs.Find(k.wFirst) && glyphs.Find(k.wSecond))
+			glyphs.AddKerning(k.wFirst, k.wSecond, (float)k.iKernAmount / scale);
+	}
+
+	if (!fontTexture.LoadFromImage(atlas)) return false;
+	fontTexture.SetFilters(GL_LINEAR, GL_LINEAR);
 	return true;
 }
 
+// reads a code point from UTF-16 text (or UTF-32, where wchar_t is 32-bit)
+static unsigned int nextCodePoint(const wchar_t *&text)
+{
+	unsigned int c = *text++;
+	if (c >= 0xD800 && c < 0xDC00 && *text >= 0xDC00 && *text < 0xE000)
+		c = 0x10000 + ((c - 0xD800) << 10) + (*text++ - 0xDC00);
+	return c;
+}
+
 int Font2D::CalcTextWidth(const wchar_t *text)
 {
 	if (!loaded) return 0;
 
-	int w = 0;
-	for (int i = 0; *text; i++, text++)
+	const GlyphTable &glyphs = ptr->glyphs;
+	float w = 0.0f, maxWidth = 0.0f;
+	unsigned int prev = 0;
+	while (*text)
 	{
-		wchar_t ch = *text;
-		int index = 0;
+		unsigned int c = nextCodePoint(text);
+		if (c == '\n') {
+			if (w > maxWidth) maxWidth = w;
+			w = 0.0f;
+			prev = 0;
+			continue;
+		}
 
-		bool found = false;
-		for (int j = 0; j < ptr->numCharsets; j++)
-		{
-			SharedTraits::Charset &c = ptr->charsets[j];
-			if (ch >= c.startChar && ch <= c.endChar)
-			{
-				index = ch - c.startChar + c.base;
-				found = true;
-				break;
-			}
+		const Glyph *g = glyphs.Find(c);
+		if (!g) continue;
+		w += glyphs.GetKerning(prev, c) + g->advance;
+		prev = c;
+	}
+	return (int)((w > maxWidth ? w : maxWidth) * scale);
+}
+
+int Font2D::LayoutText(const wchar_t *text, GlyphQuad *quads) const
+{
+	if (!loaded) return 0;
+
+	// glyphs are scaled about the pen position; spacing is in pixels
+	const GlyphTable &glyphs = ptr->glyphs;
+	float x = 0.0f, y = 0.0f;
+	unsigned int prev = 0;
+	int numQuads = 0;
+	while (*text)
+	{
+		unsigned int c = nextCodePoint(text);
+		if (c == '\n') {
+			x = 0.0f;
+			y += ptr->fontHeight*scale + lineSpacing;
+			prev = 0;
+			continue;
 		}
 
-		if (!found) continue;
-		w += ptr->charWidth[index];
+		const Glyph *g = glyphs.Find(c);
+		if (!g) continue;
+		x += glyphs.GetKerning(prev, c) * scale;
+		prev = c;
+
+		if (g->x1 > g->x0) {
+			GlyphQuad &q = quads[numQuads++];
+			q.x0 = x + g->x0*scale;
+			q.y0 = y + g->y0*scale;
+			q.x1 = x + g->x1*scale;
+			q.y1 = y + g->y1*scale;
+			q.u0 = g->u0;
+			q.v0 = g->v0;
+			q.u1 = g->u1;
+			q.v1 = g->v1;
+		}
+		x += g->advance * scale;
 	}
-	return w;
+	return numQuads;
 }
 
 class GLRC_Text2DModule : public GLRC_Module
 {
 private:
 	friend class Text2D;
+	friend class TextBatch;
 	void Initialize(GLRenderingContext *rc);
 	void Destroy();
 
 	static const char *shaderSource[2];
-	ProgramObject *prog;
+	static const char *batchShaderSource[2];
+	static const char *sdfFragmentSource;
+	static const char *batchSdfFragmentSource;
+	ProgramObject *prog, *sdfProg;
+	ProgramObject *batchProg, *batchSdfProg;
+
+	static ProgramObject *makeProgram(GLRenderingContext *rc, const char *vertexSource,
+		const char *fragmentSource, bool vertexColor);
 };
 
+#define TEXT_COLOR_ATTRIB 5
+
 const char *GLRC_Text2DModule::shaderSource[2] = 
 {
 	"attribute vec3 Vertex;"
@@ -162,25 +530,96 @@ const char *GLRC_Text2DModule::shaderSource[2] =
 	"}"
 };
 
+// positions are in pixels; ScreenTransform maps them to clip space
+const char *GLRC_Text2DModule::batchShaderSource[2] = 
+{
+	"attribute vec2 Vertex;"
+	"attribute vec2 TexCoord;"
+	"attribute vec4 Color;"
+	"varying vec2 fTexCoord;"
+	"varying vec4 fColor;"
+	"uniform vec4 ScreenTransform;"
+	"void main() {"
+		"fTexCoord = TexCoord;"
+		"fColor = Color;"
+		"gl_Position = vec4(Vertex * ScreenTransform.xy + ScreenTransform.zw, 0.0, 1.0);"
+	"}"
+	,
+	"varying vec2 fTexCoord;"
+	"varying vec4 fColor;"
+	"uniform sampler2D ColorMap;"
+	"void main() {"
+		"gl_FragColor = vec4(fColor.rgb, fColor.a * texture2D(ColorMap, fTexCoord).a);"
+	"}"
+};
+
+// The edge is at 0.5 in the field; coverage ramps over about a pixel
+// around it, however much the glyph is scaled.
+const char *GLRC_Text2DModule::sdfFragmentSource =
+	"varying vec2 fTexCoord;"
+	"uniform sampler2D ColorMap;"
+	"uniform vec4 Color;"
+	"void main() {"
+		"float d = texture2D(ColorMap, fTexCoord).r;"
+		"float w = fwidth(d) * 0.7;"
+		"gl_FragColor = vec4(Color.xyz, Color.a * smoothstep(0.5 - w, 0.5 + w, d));"
+	"}";
+
+const char *GLRC_Text2DModule::batchSdfFragmentSource =
+	"varying vec2 fTexCoord;"
+	"varying vec4 fColor;"
+	"uniform sampler2D ColorMap;"
+	"void main() {"
+		"float d = texture2D(ColorMap, fTexCoord).r;"
+		"float w = fwidth(d) * 0.7;"
+		"gl_FragColor = vec4(fColor.rgb, fColor.a * smoothstep(0.5 - w, 0.5 + w, d));"
+	"}";
+
+ProgramObject *GLRC_Text2DModule::makeProgram(GLRenderingContext *rc, const char *vertexSource,
+	const char *fragmentSource, bool vertexColor)
+{
+	ProgramObject *p = new ProgramObject(rc);
+	ShaderPreprocessor vert, frag;
+	vert.ProcessSource(vertexSource);
+	frag.ProcessSource(fragmentSource);
+	if (vertexColor) p->BindAttribLocation(TEXT_COLOR_ATTRIB, "Color");
+	p->BuildAsync(vert, frag);
+	return p;
+}
+
 void GLRC_Text2DModule::Initialize(GLRenderingContext *rc)
 {
 	if (GLEW_ARB_shader_objects) {
-		prog = new ProgramObject(rc);
-
-		Shader vshader(GL_VERTEX_SHADER);
-		Shader fshader(GL_FRAGMENT_SHADER);
-		vshader.CompileSource(shaderSource[0]);
-		fshader.CompileSource(shaderSource[1]);
-		prog->AttachShader(vshader);
-		prog->AttachShader(fshader);
-		prog->Link();
-		prog->Uniform("ColorMap", 0);
+		prog = makeProgram(rc, shaderSource[0], shaderSource[1], false);
+		sdfProg = makeProgram(rc, shaderSource[0], sdfFragmentSource, false);
+		batchProg = makeProgram(rc, batchShaderSource[0], batchShaderSource[1], true);
+		batchSdfProg = makeProgram(rc, batchShaderSource[0], batchSdfFragmentSource, true);
+
+		// all four compile together, and are only waited for here
+		ProgramObject *progs[4] = { prog, sdfProg, batchProg, batchSdfProg };
+		for (int i = 0; i < 4; i++) {
+			progs[i]->FinishBuild();
+			progs[i]->Uniform("ColorMap", 0);
+		}
 	}
-	else prog = NULL;
+	else prog = sdfProg = batchProg = batchSdfProg = NULL;
 }
 
 void GLRC_Text2DModule::Destroy() {
 	delete prog;
+	delete sdfProg;
+	delete batchProg;
+	delete batchSdfProg;
+}
+
+static GLRC_Text2DModule *getText2DModule(GLRenderingContext *rc)
+{
+	GLRC_Text2DModule *module = (GLRC_Text2DModule *)rc->GetModule("Text2D");
+	if (!module) {
+		module = new GLRC_Text2DModule;
+		rc->AddModule("Text2D", module);
+	}
+	return module;
 }
 
 Text2D::Text2D(GLRenderingContext *rc, const Font2D &font) :
@@ -190,12 +629,9 @@ Text2D::Text2D(GLRenderingContext *rc, const Font2D &font) :
 	texCoords(rc, GL_ARRAY_BUFFER),
 	numVerts(0)
 {
-	GLRC_Text2DModule *module = (GLRC_Text2DModule *)rc->GetModule("Text2D");
-	if (!module) {
-		module = new GLRC_Text2DModule;
-		rc->AddModule("Text2D", module);
-	}
+	GLRC_Text2DModule *module = getText2DModule(rc);
 	prog = module->prog;
+	sdfProg = module->sdfProg;
 
 	vao.Bind();
 	vao.EnableVertexAttrib(AttribLocation::Vertex);
@@ -225,6 +661,7 @@ void Text2D::clone(const Text2D &t)
 {
 	rc = t.rc;
 	prog = t.prog;
+	sdfProg = t.sdfProg;
 	numVerts = t.numVerts;
 	if (numVerts != 0) {
 		t.vertices.CloneTo(vertices);
@@ -236,68 +673,34 @@ void Text2D::SetText(const wchar_t *text)
 {
 	if (!font.IsLoaded()) return;
 
-	numVerts = 6*wcslen(text);
-	Vector3f *verts = new Vector3f[numVerts];
-	Vector2f *texs = new Vector2f[numVerts];
+	ScratchScope scratch(rc->frameArena);
+	GlyphQuad *quads = scratch.AllocArray<GlyphQuad>(wcslen(text));
+	int numQuads = font.LayoutText(text, quads);
+	numVerts = 6*numQuads;
+	Vector3f *verts = scratch.AllocArray<Vector3f>(numVerts);
+	Vector2f *texs = scratch.AllocArray<Vector2f>(numVerts);
 
-	float w = 0, h = 0;
-	for (int i = 0; *text; i++, text++)
+	for (int i = 0; i < numQuads; i++)
 	{
-		wchar_t ch = *text;
-		int index = 0;
-		int x = 0, y = 0;
-
-		if (ch == '\n')
-		{
-			h += font->fontHeight + font.lineSpacing;
-			w = 0;
-			continue;
-		}
-
-		bool found = false;
-		for (int j = 0; j < font->numCharsets; j++)
-		{
-			shared_traits<Font2D>::Charset &c = font->charsets[j];
-			if (ch >= c.startChar && ch <= c.endChar)
-			{
-				index = ch - c.startChar + c.base;
-				x = index % font->numCellsX;
-				y = index / font->numCellsY;
-				found = true;
-				break;
-			}
-		}
-
-		if (!found) continue;
-
-		float dw = (float)font->charWidth[index];
+		const GlyphQuad &q = quads[i];
 		int k = 6*i;
-		verts[k]   = Vector3f(w, h, 0);
-		verts[k+1] = Vector3f(w, h + font->fontHeight, 0);
-		verts[k+2] = Vector3f(w + dw, h, 0);
+		verts[k]   = Vector3f(q.x0, q.y0, 0);
+		verts[k+1] = Vector3f(q.x0, q.y1, 0);
+		verts[k+2] = Vector3f(q.x1, q.y0, 0);
 		verts[k+3] = verts[k+2];
 		verts[k+4] = verts[k+1];
-		verts[k+5] = Vector3f(w + dw, h + font->fontHeight, 0);
+		verts[k+5] = Vector3f(q.x1, q.y1, 0);
 
-		float tx = (float)x * font->numCellsX_inv;
-		float ty = (float)y * font->numCellsY_inv;
-		float dtx = dw * font->texWidth_inv;
-		
-		texs[k]   = Vector2f(tx, ty);
-		texs[k+1] = Vector2f(tx, ty + font->dty);
-		texs[k+2] = Vector2f(tx + dtx, ty);
+		texs[k]   = Vector2f(q.u0, q.v0);
+		texs[k+1] = Vector2f(q.u0, q.v1);
+		texs[k+2] = Vector2f(q.u1, q.v0);
 		texs[k+3] = texs[k+2];
 		texs[k+4] = texs[k+1];
-		texs[k+5] = Vector2f(tx + dtx, ty + font->dty);
-
-		w += dw;
+		texs[k+5] = Vector2f(q.u1, q.v1);
 	}
 	
 	vertices.SetData(numVerts*sizeof(Vector3f), verts, GL_STATIC_DRAW);
 	texCoords.SetData(numVerts*sizeof(Vector2f), texs, GL_STATIC_DRAW);
-
-	delete [] verts;
-	delete [] texs;
 }
 
 void Text2D::drawFixed(int x, int y)
@@ -332,12 +735,155 @@ void Text2D::Draw(int x, int y)
 	rc->SetProjection(Ortho2D(0, viewport[2], viewport[3], 0));
 	rc->SetModelView(Translate((float)x, (float)y, 0));
 	
+	ProgramObject *p = font->sdf ? sdfProg : prog;
 	vao.Bind();
-	prog->Use();
-	prog->Uniform("Color", 1, font.color.data);
+	p->Use();
+	p->Uniform("Color", 1, font.color.data);
 	vertices.DrawArrays(GL_TRIANGLES, 0, numVerts);
 	
 	glDisable(GL_BLEND);
 	rc->PopModelView();
 	rc->PopProjection();
+}
+
+TextBatch::TextBatch(GLRenderingContext *rc) :
+	rc(rc),
+	vertices(rc, GL_ARRAY_BUFFER),
+	indices(rc, GL_ELEMENT_ARRAY_BUFFER),
+	numGlyphs(0),
+	indexCapacity(0),
+	lastDrawCount(0)
+{
+	GLRC_Text2DModule *module = getText2DModule(rc);
+	prog = module->batchProg;
+	sdfProg = module->batchSdfProg;
+
+	vao.Bind();
+	vao.EnableVertexAttrib(AttribLocation::Vertex);
+	vao.EnableVertexAttrib(AttribLocation::TexCoord);
+	vao.EnableVertexAttrib(TEXT_COLOR_ATTRIB);
+	vertices.AttribPointer(AttribLocation::Vertex, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), 0);
+	vertices.AttribPointer(AttribLocation::TexCoord, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), 8);
+	vertices.AttribPointer(TEXT_COLOR_ATTRIB, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TextVertex), 16);
+	indices.Bind();
+	vao.Unbind();
+}
+
+static BYTE colorByte(float c) {
+	return c <= 0.0f ? 0 : c >= 1.0f ? 255 : (BYTE)(c * 255.0f + 0.5f);
+}
+
+void TextBatch::Add(const Font2D &font, const wchar_t *text, int x, int y)
+{
+	if (!font.IsLoaded()) return;
+
+	// strings of fonts that share an atlas go into the same draw
+	const Texture2D &texture = font->fontTexture;
+	Atlas *atlas = NULL;
+	for (int i = 0, n = atlases.size(); i < n && !atlas; i++)
+		if (atlases[i].texture.GetId() == texture.GetId()) atlas = &atlases[i];
+	if (!atlas) {
+		atlases.push_back(Atlas(texture, font->sdf));
+		atlas = &atlases.back();
+	}
+
+	ScratchScope scratch(rc->frameArena);
+	GlyphQuad *quads = scratch.AllocArray<GlyphQuad>(wcslen(text));
+	int numQuads = font.LayoutText(text, quads);
+
+	Color4f c = font.GetColor();
+	Color4b color(colorByte(c.r), colorByte(c.g), colorByte(c.b), colorByte(c.a));
+	float fx = (float)x, fy = (float)y;
+
+	vector<TextVertex> &verts = atlas->verts;
+	int first = verts.size();
+	verts.resize(first + 4*numQuads);
+	for (int i = 0; i < numQuads; i++)
+	{
+		const GlyphQuad &q = quads[i];
+		TextVertex *v = &verts[first + 4*i];
+		v[0].pos = Vector2f(fx + q.x0, fy + q.y0);
+		v[1].pos = Vector2f(fx + q.x0, fy + q.y1);
+		v[2].pos = Vector2f(fx + q.x1, fy + q.y0);
+		v[3].pos = Vector2f(fx + q.x1, fy + q.y1);
+		v[0].texCoord = Vector2f(q.u0, q.v0);
+		v[1].texCoord = Vector2f(q.u0, q.v1);
+		v[2].texCoord = Vector2f(q.u1, q.v0);
+		v[3].texCoord = Vector2f(q.u1, q.v1);
+		v[0].color = v[1].color = v[2].color = v[3].color = color;
+	}
+	numGlyphs += numQuads;
+}
+
+void TextBatch::Draw()
+{
+	lastDrawCount = 0;
+	if (!numGlyphs || !prog) {
+		Clear();
+		return;
+	}
+
+	// the index buffer only changes when it has to grow; quad i refers
+	// to vertices 4i..4i+3, so each atlas starts at its first quad
+	vao.Bind();
+	if (numGlyphs > indexCapacity)
+	{
+		indexCapacity = max(numGlyphs, 2*indexCapacity);
+		vector<int> quadIndices(6*indexCapacity);
+		for (int i = 0; i < indexCapacity; i++) {
+			int *k = &quadIndices[6*i];
+			k[0] = 4*i;     k[1] = 4*i + 1; k[2] = 4*i + 2;
+			k[3] = 4*i + 2; k[4] = 4*i + 1; k[5] = 4*i + 3;
+		}
+		indices.SetData(quadIndices.size()*sizeof(int), quadIndices.data(), GL_STATIC_DRAW);
+	}
+
+	// the whole buffer is replaced, so the driver does not wait for the last frame's draws
+	vertices.SetData(4*numGlyphs*sizeof(TextVertex), NULL, GL_STREAM_DRAW);
+	int offset = 0;
+	for (int i = 0, n = atlases.size(); i < n; i++) {
+		const vector<TextVertex> &verts = atlases[i].verts;
+		if (verts.empty()) continue;
+		vertices.SetSubData(offset, verts.size()*sizeof(TextVertex), verts.data());
+		offset += verts.size()*sizeof(TextVertex);
+	}
+
+	float viewport[4] = { };
+	glGetFloatv(GL_VIEWPORT, viewport);
+	float sx = 2.0f / viewport[2], sy = -2.0f / viewport[3];
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	ProgramObject *current = NULL;
+	int firstQuad = 0;
+	for (int i = 0, n = atlases.size(); i < n; i++)
+	{
+		Atlas &atlas = atlases[i];
+		int numQuads = atlas.verts.size() / 4;
+		if (!numQuads) continue;
+
+		// distance field atlases have a program of their own
+		ProgramObject *p = atlas.sdf ? sdfProg : prog;
+		if (p != current) {
+			p->Use();
+			p->Uniform("ScreenTransform", sx, sy, -1.0f, 1.0f);
+			current = p;
+		}
+		atlas.texture.Bind();
+		indices.DrawElements(GL_TRIANGLES, 6*numQuads, GL_UNSIGNED_INT, 6*firstQuad*sizeof(int));
+		firstQuad += numQuads;
+		lastDrawCount++;
+	}
+	glDisable(GL_BLEND);
+	vao.Unbind();
+
+	Clear();
+}
+
+void TextBatch::Clear()
+{
+	// atlases are kept with their storage, as the same fonts are used every frame
+	for (int i = 0, n = atlases.size(); i < n; i++)
+		atlases[i].verts.clear();
+	numGlyphs = 0;
 }
\ No newline at end of file
@@ -47,17 +47,20 @@ void BaseTexture::BuildMipmaps() {
 	}
 }
 
-void BaseTexture::read(HANDLE hFile, LPVOID lpBuffer, DWORD nNumBytes)
+bool BaseTexture::loadFromTGA(const char *filename, Image &img)
 {
-	DWORD bytesRead;
-	BOOL success = ReadFile(hFile, lpBuffer, nNumBytes, &bytesRead, NULL);
-	if (!success || bytesRead != nNumBytes)
-		throw false;
+	img.LoadTga(filename);
+	if (!img) return false;
+
+	ptr->width = img.GetWidth();
+	ptr->height = img.GetHeight();
+
+	return true;
 }
 
-bool BaseTexture::loadFromTGA(const char *filename, Image &img)
+bool BaseTexture::loadImage(const char *filename, Image &img)
 {
-	img.LoadTga(filename);
+	img.Load(filename);
 	if (!img) return false;
 
 	ptr->width = img.GetWidth();
@@ -66,9 +69,46 @@ bool BaseTexture::loadFromTGA(const char *filename, Image &img)
 	return true;
 }
 
-void BaseTexture::texImage2D(GLenum target, const Image &img)
+static GLenum compressedFormat(ImageCompression compression)
+{
+	switch (compression)
+	{
+	case IC_BC1: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+	case IC_BC2: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+	case IC_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case IC_BC4: return GL_COMPRESSED_RED_RGTC1;
+	case IC_BC5: return GL_COMPRESSED_RG_RGTC2;
+	case IC_BC6H: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+	case IC_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default: return 0;
+	}
+}
+
+void BaseTexture::texImage2D(GLenum target, const Image &img, int firstLevel)
 {
 	Bind();
+	int numMips = img.GetMipCount();
+	ptr->numLevels = numMips;
+	ptr->baseLevel = firstLevel;
+	ptr->compressed = img.IsCompressed();
+
+	if (img.IsCompressed())
+	{
+		GLenum internalFormat = compressedFormat(img.GetCompression());
+		for (int i = firstLevel; i < numMips; i++) {
+			glCompressedTexImage2D(target, i - firstLevel, internalFormat, img.GetMipWidth(i),
+				img.GetMipHeight(i), 0, img.GetMipSize(i), img.GetMipData(i));
+		}
+	}
+	else texLevels(target, img, firstLevel);
+
+	// a partial chain is complete up to the last stored level
+	if (numMips > 1)
+		glTexParameteri(this->target, GL_TEXTURE_MAX_LEVEL, numMips - firstLevel - 1);
+}
+
+void BaseTexture::texLevels(GLenum target, const Image &img, int firstLevel)
+{
 	int format = 0, internalFormat = 0;
 
 	switch (img.GetDepth())
@@ -87,8 +127,13 @@ void BaseTexture::texImage2D(GLenum target, const Image &img)
 		break;
 	}
 
-	glTexImage2D(target, 0, internalFormat, img.GetWidth(),
-		img.GetHeight(), 0, format, GL_UNSIGNED_BYTE, img.GetData());
+	// image rows are tightly packed, which small RGB levels are not by default
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = firstLevel, n = img.GetMipCount(); i < n; i++) {
+		glTexImage2D(target, i - firstLevel, internalFormat, img.GetMipWidth(i),
+			img.GetMipHeight(i), 0, format, GL_UNSIGNED_BYTE, img.GetMipData(i));
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
 Texture2D::Texture2D(GLenum textureUnit, GLuint id)
@@ -98,7 +143,7 @@ Texture2D::Texture2D(GLenum textureUnit, GLuint id)
 Texture2D::Texture2D(const char *filename, GLenum textureUnit, GLuint id)
 	: BaseTexture(GL_TEXTURE_2D, textureUnit, id)
 {
-	LoadFromTGA(filename);
+	LoadFromFile(filename);
 }
 
 bool Texture2D::LoadFromTGA(const char *filename)
@@ -112,6 +157,29 @@ bool Texture2D::LoadFromTGA(const char *filename)
 	return false;
 }
 
+bool Texture2D::LoadFromFile(const char *filename)
+{
+	Image img;
+	ptr->loaded = loadImage(filename, img);
+	if (ptr->loaded) {
+		texImage2D(target, img);
+		return true;
+	}
+	return false;
+}
+
+bool Texture2D::LoadFromImage(const Image &img)
+{
+	ptr->loaded = img.IsGood();
+	if (ptr->loaded) {
+		ptr->width = img.GetWidth();
+		ptr->height = img.GetHeight();
+		texImage2D(target, img);
+		return true;
+	}
+	return false;
+}
+
 void Texture2D::SetTexImage(GLenum level, GLint internalFormat, GLsizei width, GLsizei height,
 	GLint border, GLenum format, GLenum type, const GLvoid *data)
 {
@@ -0,0 +1,700 @@
+#include "texturecompressor.h"
+#include "threadpool.h"
+#include <math.h>
+#include <string.h>
+#include <xmmintrin.h>
+
+#define KAISER_WIDTH 2.0f // filter radius in destination pixels
+#define KAISER_ALPHA 4.0f
+#define REFINE_ITERATIONS 2
+
+// sRGB transfer function tables, filled once at startup
+struct GammaTables
+{
+	float toLinear[256];
+	BYTE toSrgb[4096];
+
+	GammaTables()
+	{
+		for (int i = 0; i < 256; i++) {
+			float c = i / 255.0f;
+			toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 4096; i++) {
+			float c = i / 4095.0f;
+			c = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+			toSrgb[i] = BYTE(c * 255.0f + 0.5f);
+		}
+	}
+};
+static const GammaTables gammaTables;
+
+static inline float clamp01(float v) {
+	return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+static inline int roundToInt(float v, int maxValue) {
+	int i = (int)(v + 0.5f);
+	return i < 0 ? 0 : (i > maxValue ? maxValue : i);
+}
+
+// 4x4 pixels split into r, g, b, a planes (values 0..255)
+struct PixelBlock
+{
+	float c[4][16];
+};
+
+static void fetchBlock(const BYTE *pixels, int width, int height, int bpp, int bx, int by, PixelBlock &block)
+{
+	for (int y = 0; y < 4; y++)
+	{
+		// blocks over the edge repeat the last row and column
+		int sy = by*4 + y < height ? by*4 + y : height - 1;
+		const BYTE *row = pixels + sy * width * bpp;
+
+		for (int x = 0; x < 4; x++)
+		{
+			int sx = bx*4 + x < width ? bx*4 + x : width - 1;
+			const BYTE *p = row + sx * bpp;
+			int i = y*4 + x;
+			if (bpp == 1) {
+				block.c[0][i] = block.c[1][i] = block.c[2][i] = p[0];
+				block.c[3][i] = 255.0f;
+			}
+			else {
+				block.c[0][i] = p[2];
+				block.c[1][i] = p[1];
+				block.c[2][i] = p[0];
+				block.c[3][i] = bpp == 4 ? p[3] : 255.0f;
+			}
+		}
+	}
+}
+
+/*
+	BC1 color block
+*/
+
+static int pack565(const float *c) {
+	return roundToInt(c[0] * (31.0f / 255.0f), 31) << 11 |
+		roundToInt(c[1] * (63.0f / 255.0f), 63) << 5 |
+		roundToInt(c[2] * (31.0f / 255.0f), 31);
+}
+
+static void unpack565(int c, int *rgb)
+{
+	int r = c >> 11, g = (c >> 5) & 0x3F, b = c & 0x1F;
+	rgb[0] = r << 3 | r >> 2;
+	rgb[1] = g << 2 | g >> 4;
+	rgb[2] = b << 3 | b >> 2;
+}
+
+static void boundingBoxEndpoints(const PixelBlock &block, float *lo, float *hi)
+{
+	for (int k = 0; k < 3; k++)
+	{
+		float mn = block.c[k][0], mx = block.c[k][0];
+		for (int i = 1; i < 16; i++) {
+			mn = block.c[k][i] < mn ? block.c[k][i] : mn;
+			mx = block.c[k][i] > mx ? block.c[k][i] : mx;
+		}
+		// pulling the corners in a bit lowers the average error
+		float inset = (mx - mn) / 16.0f;
+		lo[k] = mn + inset;
+		hi[k] = mx - inset;
+	}
+}
+
+static void principalAxisEndpoints(const PixelBlock &block, float *lo, float *hi)
+{
+	float mean[3] = { };
+	for (int k = 0; k < 3; k++) {
+		for (int i = 0; i < 16; i++) mean[k] += block.c[k][i];
+		mean[k] /= 16.0f;
+	}
+
+	float cov[6] = { }; // rr, rg, rb, gg, gb, bb
+	for (int i = 0; i < 16; i++)
+	{
+		float r = block.c[0][i] - mean[0];
+		float g = block.c[1][i] - mean[1];
+		float b = block.c[2][i] - mean[2];
+		cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+		cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+	}
+
+	// power iteration for the dominant eigenvector
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iter = 0; iter < 8; iter++)
+	{
+		float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+		float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+		float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+		float len = sqrtf(x*x + y*y + z*z);
+		if (len < 1e-6f) {
+			// flat block
+			for (int k = 0; k < 3; k++) lo[k] = hi[k] = mean[k];
+			return;
+		}
+		axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+	}
+
+	float tmin = 0.0f, tmax = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = (block.c[0][i] - mean[0])*axis[0] +
+			(block.c[1][i] - mean[1])*axis[1] +
+			(block.c[2][i] - mean[2])*axis[2];
+		tmin = t < tmin ? t : tmin;
+		tmax = t > tmax ? t : tmax;
+	}
+	float inset = (tmax - tmin) / 16.0f;
+	tmin += inset;
+	tmax -= inset;
+	for (int k = 0; k < 3; k++) {
+		lo[k] = mean[k] + axis[k]*tmin;
+		hi[k] = mean[k] + axis[k]*tmax;
+	}
+}
+
+// picks the nearest of four palette colors for every pixel (four pixels
+// per SSE step) and returns the total squared error
+static float selectIndices(const float *const planes[], int numPlanes,
+	const float (*palette)[3], int paletteSize, int *indices)
+{
+	float error = 0.0f;
+	for (int i = 0; i < 16; i += 4)
+	{
+		__m128 v[3];
+		for (int k = 0; k < numPlanes; k++)
+			v[k] = _mm_loadu_ps(planes[k] + i);
+
+		__m128 best = _mm_set1_ps(1e30f);
+		__m128 bestIndex = _mm_setzero_ps();
+		for (int p = 0; p < paletteSize; p++)
+		{
+			__m128 d = _mm_setzero_ps();
+			for (int k = 0; k < numPlanes; k++) {
+				__m128 diff = _mm_sub_ps(v[k], _mm_set1_ps(palette[p][k]));
+				d = _mm_add_ps(d, _mm_mul_ps(diff, diff));
+			}
+			__m128 closer = _mm_cmplt_ps(d, best);
+			best = _mm_min_ps(d, best);
+			bestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float)p)),
+				_mm_andnot_ps(closer, bestIndex));
+		}
+
+		float idx[4], err[4];
+		_mm_storeu_ps(idx, bestIndex);
+		_mm_storeu_ps(err, best);
+		for (int j = 0; j < 4; j++) {
+			indices[i + j] = (int)idx[j];
+			error += err[j];
+		}
+	}
+	return error;
+}
+
+static float fitColorIndices(const PixelBlock &block, int c0, int c1, int *indices)
+{
+	int e0[3], e1[3];
+	unpack565(c0, e0);
+	unpack565(c1, e1);
+
+	float palette[4][3];
+	for (int k = 0; k < 3; k++) {
+		palette[0][k] = (float)e0[k];
+		palette[1][k] = (float)e1[k];
+		palette[2][k] = (2.0f*e0[k] + e1[k]) / 3.0f;
+		palette[3][k] = (e0[k] + 2.0f*e1[k]) / 3.0f;
+	}
+	const float *planes[3] = { block.c[0], block.c[1], block.c[2] };
+	return selectIndices(planes, 3, palette, 4, indices);
+}
+
+// least squares endpoints for fixed indices
+static bool refineColorEndpoints(const PixelBlock &block, const int *indices, float *a, float *b)
+{
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[3] = { }, bx[3] = { };
+	for (int i = 0; i < 16; i++)
+	{
+		float alpha = weights[indices[i]], beta = 1.0f - alpha;
+		aa += alpha*alpha; bb += beta*beta; ab += alpha*beta;
+		for (int k = 0; k < 3; k++) {
+			ax[k] += alpha*block.c[k][i];
+			bx[k] += beta*block.c[k][i];
+		}
+	}
+
+	float det = aa*bb - ab*ab;
+	if (fabsf(det) < 1e-6f) return false;
+	for (int k = 0; k < 3; k++) {
+		a[k] = (ax[k]*bb - bx[k]*ab) / det;
+		b[k] = (bx[k]*aa - ax[k]*ab) / det;
+	}
+	return true;
+}
+
+static void writeColorBlock(int c0, int c1, int *indices, BYTE *out)
+{
+	// c0 > c1 selects the four color mode
+	if (c0 < c1) {
+		int t = c0; c0 = c1; c1 = t;
+		for (int i = 0; i < 16; i++) indices[i] ^= 1;
+	}
+	else if (c0 == c1)
+		memset(indices, 0, 16 * sizeof(int));
+
+	unsigned int bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= indices[i] << (i * 2);
+
+	out[0] = BYTE(c0); out[1] = BYTE(c0 >> 8);
+	out[2] = BYTE(c1); out[3] = BYTE(c1 >> 8);
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = BYTE(bits >> (i * 8));
+}
+
+static void encodeColorBlock(const PixelBlock &block, CompressionQuality quality, BYTE *out)
+{
+	float lo[3], hi[3];
+	if (quality == CQ_FAST)
+		boundingBoxEndpoints(block, lo, hi);
+	else principalAxisEndpoints(block, lo, hi);
+
+	int c0 = pack565(hi), c1 = pack565(lo);
+	int indices[16];
+	float error = fitColorIndices(block, c0, c1, indices);
+
+	if (quality == CQ_HIGH)
+	{
+		for (int iter = 0; iter < REFINE_ITERATIONS; iter++)
+		{
+			float a[3], b[3];
+			if (!refineColorEndpoints(block, indices, a, b)) break;
+
+			int n0 = pack565(a), n1 = pack565(b);
+			int trial[16];
+			float e = fitColorIndices(block, n0, n1, trial);
+			if (e >= error) break;
+
+			error = e;
+			c0 = n0; c1 = n1;
+			memcpy(indices, trial, sizeof(trial));
+		}
+	}
+	writeColorBlock(c0, c1, indices, out);
+}
+
+/*
+	BC4 single channel block (also the alpha half of BC3 and both halves of BC5)
+*/
+
+static void channelPalette(int a0, int a1, float *palette)
+{
+	palette[0] = (float)a0;
+	palette[1] = (float)a1;
+	for (int i = 2; i < 8; i++)
+		palette[i] = ((8 - i)*a0 + (i - 1)*a1) / 7.0f;
+}
+
+static float fitChannelIndices(const float *values, int a0, int a1, int *indices)
+{
+	float palette[8][3];
+	float p[8];
+	channelPalette(a0, a1, p);
+	for (int i = 0; i < 8; i++) palette[i][0] = p[i];
+	return selectIndices(&values, 1, palette, 8, indices);
+}
+
+static void encodeChannelBlock(const float *values, CompressionQuality quality, BYTE *out)
+{
+	float mn = values[0], mx = values[0];
+	for (int i = 1; i < 16; i++) {
+		mn = values[i] < mn ? values[i] : mn;
+		mx = values[i] > mx ? values[i] : mx;
+	}
+
+	int a0 = roundToInt(mx, 255), a1 = roundToInt(mn, 255);
+	int indices[16] = { };
+	if (a0 != a1)
+	{
+		float error = fitChannelIndices(values, a0, a1, indices);
+
+		for (int iter = 0; quality == CQ_HIGH && iter < REFINE_ITERATIONS; iter++)
+		{
+			float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax = 0.0f, bx = 0.0f;
+			for (int i = 0; i < 16; i++)
+			{
+				float alpha = indices[i] == 0 ? 1.0f : (indices[i] == 1 ? 0.0f : (8 - indices[i]) / 7.0f);
+				float beta = 1.0f - alpha;
+				aa += alpha*alpha; bb += beta*beta; ab += alpha*beta;
+				ax += alpha*values[i]; bx += beta*values[i];
+			}
+			float det = aa*bb - ab*ab;
+			if (fabsf(det) < 1e-6f) break;
+
+			int n0 = roundToInt((ax*bb - bx*ab) / det, 255);
+			int n1 = roundToInt((bx*aa - ax*ab) / det, 255);
+			if (n0 <= n1) break; // would switch to the six value mode
+
+			int trial[16];
+			float e = fitChannelIndices(values, n0, n1, trial);
+			if (e >= error) break;
+
+			error = e;
+			a0 = n0; a1 = n1;
+			memcpy(indices, trial, sizeof(trial));
+		}
+	}
+
+	out[0] = BYTE(a0);
+	out[1] = BYTE(a1);
+	unsigned long long bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (unsigned long long)indices[i] << (i * 3);
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = BYTE(bits >> (i * 8));
+}
+
+/*
+	Decoding (for error measurement)
+*/
+
+static void decodeColorBlock(const BYTE *in, BYTE (*rgb)[3])
+{
+	int c0 = in[0] | in[1] << 8, c1 = in[2] | in[3] << 8;
+	unsigned int bits = in[4] | in[5] << 8 | in[6] << 16 | (unsigned int)in[7] << 24;
+
+	int palette[4][3];
+	unpack565(c0, palette[0]);
+	unpack565(c1, palette[1]);
+	for (int k = 0; k < 3; k++)
+	{
+		if (c0 > c1) {
+			palette[2][k] = (2*palette[0][k] + palette[1][k]) / 3;
+			palette[3][k] = (palette[0][k] + 2*palette[1][k]) / 3;
+		}
+		else {
+			palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+			palette[3][k] = 0;
+		}
+	}
+	for (int i = 0; i < 16; i++) {
+		int *p = palette[(bits >> (i * 2)) & 3];
+		rgb[i][0] = BYTE(p[0]); rgb[i][1] = BYTE(p[1]); rgb[i][2] = BYTE(p[2]);
+	}
+}
+
+static void decodeChannelBlock(const BYTE *in, BYTE *values)
+{
+	int a0 = in[0], a1 = in[1];
+	int palette[8] = { a0, a1 };
+	for (int i = 2; i < 8; i++)
+	{
+		if (a0 > a1)
+			palette[i] = ((8 - i)*a0 + (i - 1)*a1 + 3) / 7;
+		else if (i < 6)
+			palette[i] = ((6 - i)*a0 + (i - 1)*a1 + 2) / 5;
+		else palette[i] = i == 6 ? 0 : 255;
+	}
+
+	unsigned long long bits = 0;
+	for (int i = 0; i < 6; i++)
+		bits |= (unsigned long long)in[2 + i] << (i * 8);
+	for (int i = 0; i < 16; i++)
+		values[i] = BYTE(palette[(bits >> (i * 3)) & 7]);
+}
+
+/*
+	TextureCompressor
+*/
+
+int TextureCompressor::GetCompressedSize(int width, int height, ImageCompression format)
+{
+	int blockSize = format == IC_BC1 || format == IC_BC4 ? 8 : 16;
+	return ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+void TextureCompressor::compressRow(void *context, int row)
+{
+	const Job &job = *(const Job *)context;
+	CompressionQuality quality = job.compressor->quality;
+	int blockSize = job.format == IC_BC1 || job.format == IC_BC4 ? 8 : 16;
+	BYTE *out = job.blocks + row * job.blocksX * blockSize;
+
+	PixelBlock block;
+	for (int bx = 0; bx < job.blocksX; bx++, out += blockSize)
+	{
+		fetchBlock(job.pixels, job.width, job.height, job.bpp, bx, row, block);
+		switch (job.format)
+		{
+		case IC_BC1:
+			encodeColorBlock(block, quality, out);
+			break;
+		case IC_BC3:
+			encodeChannelBlock(block.c[3], quality, out);
+			encodeColorBlock(block, quality, out + 8);
+			break;
+		case IC_BC4:
+			encodeChannelBlock(block.c[0], quality, out);
+			break;
+		case IC_BC5:
+			encodeChannelBlock(block.c[0], quality, out);
+			encodeChannelBlock(block.c[1], quality, out + 8);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void TextureCompressor::CompressLevel(const BYTE *pixels, int width, int height, int bpp,
+	ImageCompression format, BYTE *blocks)
+{
+	Job job = { this, pixels, width, height, bpp, (width + 3) / 4, format, blocks };
+	int blocksY = (height + 3) / 4;
+
+	if (pool)
+		pool->ParallelFor(blocksY, compressRow, &job);
+	else
+		for (int i = 0; i < blocksY; i++)
+			compressRow(&job, i);
+}
+
+// weights of the source samples that make up one destination sample
+struct FilterTaps
+{
+	int first, count;
+	float weights[8];
+};
+
+static float besselI0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+	for (int k = 1; k < 16; k++) {
+		term *= (x * 0.5f / k) * (x * 0.5f / k);
+		sum += term;
+	}
+	return sum;
+}
+
+static void axisTaps(int srcLen, int dstLen, MipFilter filter, vector<FilterTaps> &taps)
+{
+	taps.resize(dstLen);
+	for (int x = 0; x < dstLen; x++)
+	{
+		FilterTaps &t = taps[x];
+		if (srcLen == 1) {
+			t.first = 0; t.count = 1; t.weights[0] = 1.0f;
+			continue;
+		}
+		if (filter == MF_BOX) {
+			t.first = 2*x; t.count = 2;
+			t.weights[0] = t.weights[1] = 0.5f;
+			continue;
+		}
+
+		// windowed sinc centered between source pixels 2x and 2x+1
+		const float pi = 3.14159265f;
+		float sum = 0.0f;
+		t.first = 2*x - 3; t.count = 8;
+		for (int i = 0; i < 8; i++)
+		{
+			float d = (t.first + i + 0.5f - (2*x + 1)) * 0.5f;
+			float sinc = d == 0.0f ? 1.0f : sinf(pi*d) / (pi*d);
+			float r = d / KAISER_WIDTH;
+			float window = besselI0(KAISER_ALPHA * sqrtf(1.0f - r*r)) / besselI0(KAISER_ALPHA);
+			t.weights[i] = sinc * window;
+			sum += t.weights[i];
+		}
+		for (int i = 0; i < 8; i++) t.weights[i] /= sum;
+	}
+}
+
+// halves a four channel float image using separable filtering
+void TextureCompressor::downsample(const vector<float> &src, int width, int height,
+	vector<float> &dst, int dstWidth, int dstHeight) const
+{
+	vector<FilterTaps> tapsX, tapsY;
+	axisTaps(width, dstWidth, filter, tapsX);
+	axisTaps(height, dstHeight, filter, tapsY);
+
+	vector<float> tmp(dstWidth * height * 4);
+	for (int y = 0; y < height; y++)
+	{
+		const float *row = &src[y * width * 4];
+		for (int x = 0; x < dstWidth; x++)
+		{
+			const FilterTaps &t = tapsX[x];
+			float sum[4] = { };
+			for (int i = 0; i < t.count; i++)
+			{
+				int sx = t.first + i;
+				sx = sx < 0 ? 0 : (sx >= width ? width - 1 : sx);
+				for (int k = 0; k < 4; k++)
+					sum[k] += row[sx*4 + k] * t.weights[i];
+			}
+			memcpy(&tmp[(y * dstWidth + x) * 4], sum, sizeof(sum));
+		}
+	}
+
+	dst.assign(dstWidth * dstHeight * 4, 0.0f);
+	for (int y = 0; y < dstHeight; y++)
+	{
+		const FilterTaps &t = tapsY[y];
+		float *out = &dst[y * dstWidth * 4];
+		for (int i = 0; i < t.count; i++)
+		{
+			int sy = t.first + i;
+			sy = sy < 0 ? 0 : (sy >= height ? height - 1 : sy);
+			const float *row = &tmp[sy * dstWidth * 4];
+			for (int x = 0; x < dstWidth * 4; x++)
+				out[x] += row[x] * t.weights[i];
+		}
+	}
+}
+
+// Builds levels 1..n of the chain. Filtering is done in floating point
+// from the previous float level, so rounding does not accumulate.
+void TextureCompressor::buildMips(const Image &src, TextureContent content, vector<vector<BYTE> > &levels)
+{
+	int width = src.GetWidth(), height = src.GetHeight();
+	int bpp = src.GetDepth() / 8;
+	const BYTE *pixels = src.GetData();
+
+	vector<float> cur(width * height * 4), next;
+	for (int i = 0; i < width * height; i++)
+	{
+		const BYTE *p = pixels + i * bpp;
+		float *c = &cur[i * 4];
+		for (int k = 0; k < 4; k++)
+			c[k] = k < bpp ? p[k] / 255.0f : 1.0f;
+		if (bpp == 1) c[1] = c[2] = c[0];
+		if (content == TC_COLOR)
+			for (int k = 0; k < 3; k++) c[k] = gammaTables.toLinear[k < bpp ? p[k] : p[0]];
+	}
+
+	for (int level = 1; level < (int)levels.size() + 1; level++)
+	{
+		int w = width >> level ? width >> level : 1;
+		int h = height >> level ? height >> level : 1;
+		downsample(cur, width >> (level - 1) ? width >> (level - 1) : 1,
+			height >> (level - 1) ? height >> (level - 1) : 1, next, w, h);
+		cur.swap(next);
+
+		vector<BYTE> &out = levels[level - 1];
+		out.resize(w * h * bpp);
+		for (int i = 0; i < w * h; i++)
+		{
+			float *c = &cur[i * 4];
+			if (content == TC_NORMAL)
+			{
+				float x = c[2]*2.0f - 1.0f, y = c[1]*2.0f - 1.0f, z = c[0]*2.0f - 1.0f;
+				float len = sqrtf(x*x + y*y + z*z);
+				if (len > 1e-6f) {
+					c[2] = x / len * 0.5f + 0.5f;
+					c[1] = y / len * 0.5f + 0.5f;
+					c[0] = z / len * 0.5f + 0.5f;
+				}
+			}
+
+			BYTE *p = &out[i * bpp];
+			for (int k = 0; k < bpp; k++)
+			{
+				if (content == TC_COLOR && k < 3)
+					p[k] = gammaTables.toSrgb[roundToInt(clamp01(c[k]) * 4095.0f, 4095)];
+				else p[k] = BYTE(roundToInt(c[k] * 255.0f, 255));
+			}
+		}
+	}
+}
+
+bool TextureCompressor::Compress(const Image &src, ImageCompression format, TextureContent content, Image &dst)
+{
+	if (!src || src.IsCompressed()) return false;
+	if (format != IC_BC1 && format != IC_BC3 && format != IC_BC4 && format != IC_BC5)
+		return false;
+
+	int width = src.GetWidth(), height = src.GetHeight();
+	int numLevels = 1;
+	while ((width >> numLevels || height >> numLevels) && numLevels < IMAGE_MAX_MIPS)
+		numLevels++;
+
+	vector<vector<BYTE> > levels(numLevels - 1);
+	buildMips(src, content, levels);
+
+	int bpp = src.GetDepth() / 8;
+	dst.Create(width, height, 0, format, numLevels);
+	CompressLevel(src.GetData(), width, height, bpp, format, dst.GetWritableMipData(0));
+	for (int i = 1; i < numLevels; i++)
+		CompressLevel(&levels[i - 1][0], dst.GetMipWidth(i), dst.GetMipHeight(i), bpp,
+			format, dst.GetWritableMipData(i));
+	return true;
+}
+
+double TextureCompressor::ComputePSNR(const Image &original, const Image &compressed)
+{
+	if (!original || original.IsCompressed() || !compressed.IsCompressed())
+		return 0.0;
+
+	int width = original.GetWidth(), height = original.GetHeight();
+	int bpp = original.GetDepth() / 8;
+	ImageCompression format = compressed.GetCompression();
+	int blockSize = format == IC_BC1 || format == IC_BC4 ? 8 : 16;
+	int blocksX = (width + 3) / 4;
+	const BYTE *blocks = compressed.GetMipData(0);
+
+	// channels of the decoded block compared with r, g, b, a of the source
+	int numChannels = format == IC_BC4 ? 1 : (format == IC_BC5 ? 2 : (format == IC_BC3 ? 4 : 3));
+
+	double sum = 0.0;
+	long long count = 0;
+	for (int by = 0; by < (height + 3) / 4; by++)
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			const BYTE *in = blocks + (by * blocksX + bx) * blockSize;
+			BYTE decoded[16][4];
+			BYTE rgb[16][3], channel[16];
+
+			switch (format)
+			{
+			case IC_BC1:
+			case IC_BC3:
+				decodeColorBlock(format == IC_BC3 ? in + 8 : in, rgb);
+				for (int i = 0; i < 16; i++) memcpy(decoded[i], rgb[i], 3);
+				if (format == IC_BC3) {
+					decodeChannelBlock(in, channel);
+					for (int i = 0; i < 16; i++) decoded[i][3] = channel[i];
+				}
+				break;
+			case IC_BC5:
+				decodeChannelBlock(in + 8, channel);
+				for (int i = 0; i < 16; i++) decoded[i][1] = channel[i];
+				// falls through
+			case IC_BC4:
+				decodeChannelBlock(in, channel);
+				for (int i = 0; i < 16; i++) decoded[i][0] = channel[i];
+				break;
+			default:
+				return 0.0;
+			}
+
+			PixelBlock source;
+			fetchBlock(original.GetData(), width, height, bpp, bx, by, source);
+			for (int y = 0; y < 4 && by*4 + y < height; y++)
+				for (int x = 0; x < 4 && bx*4 + x < width; x++)
+					for (int k = 0; k < numChannels; k++) {
+						double d = decoded[y*4 + x][k] - source.c[k][y*4 + x];
+						sum += d*d;
+						count++;
+					}
+		}
+
+	if (count == 0) return 0.0;
+	double mse = sum / count;
+	return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "texturestreamer.h"
+#include <algorithm>
+#include <math.h>
+
+static long long getTicks()
+{
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+static float ticksToMs(long long ticks)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (float)(ticks * 1000.0 / freq.QuadPart);
+}
+
+struct TextureStreamer::LessRecent
+{
+	const vector<Entry> &entries;
+	LessRecent(const vector<Entry> &entries) : entries(entries) { }
+	bool operator()(int a, int b) const {
+		return entries[a].lastUsed < entries[b].lastUsed;
+	}
+};
+
+struct TextureStreamer::LargerGap
+{
+	const vector<Entry> &entries;
+	LargerGap(const vector<Entry> &entries) : entries(entries) { }
+	bool operator()(int a, int b) const {
+		const Entry &ea = entries[a], &eb = entries[b];
+		return ea.residentLevel - ea.wantedLevel > eb.residentLevel - eb.wantedLevel;
+	}
+};
+
+TextureStreamer::TextureStreamer()
+	: budget(256 << 20), uploadLimit(8 << 20), residentBytes(0), frame(1), viewportHeight(1080)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+bool TextureStreamer::AddTexture(Texture2D &tex, const Image &img)
+{
+	if (!img) return false;
+	if (tex.ptr->streamIndex >= 0) return true;
+
+	Entry e;
+	e.texture = tex;
+	e.image = img;
+	if (!e.image.GenerateMips()) return false;
+
+	int numMips = e.image.GetMipCount();
+	e.levelBytes[numMips] = 0;
+	for (int i = numMips - 1; i >= 0; i--)
+		e.levelBytes[i] = e.levelBytes[i + 1] + e.image.GetMipSize(i);
+
+	e.tailLevel = 0;
+	while (e.tailLevel < numMips - 1 &&
+		max(e.image.GetMipWidth(e.tailLevel), e.image.GetMipHeight(e.tailLevel)) > TS_TAIL_SIZE)
+		e.tailLevel++;
+	e.residentLevel = numMips;
+	e.wantedLevel = e.tailLevel;
+	e.lastUsed = 0;
+
+	tex.ptr->width = img.GetWidth();
+	tex.ptr->height = img.GetHeight();
+	tex.ptr->loaded = true;
+	tex.ptr->streamIndex = entries.size();
+	entries.push_back(e);
+	setResident(entries.back(), e.tailLevel);
+	return true;
+}
+
+void TextureStreamer::RemoveTexture(Texture2D &tex)
+{
+	int index = tex.ptr->streamIndex;
+	if (index < 0) return;
+	setResident(entries[index], 0);
+	removeEntry(index);
+}
+
+void TextureStreamer::removeEntry(int index)
+{
+	Entry &e = entries[index];
+	residentBytes -= e.levelBytes[e.residentLevel];
+	e.texture.ptr->streamIndex = -1;
+
+	if (index != (int)entries.size() - 1) {
+		e = entries.back();
+		e.texture.ptr->streamIndex = index;
+	}
+	entries.pop_back();
+}
+
+void TextureStreamer::setResident(Entry &e, int level)
+{
+	int numMips = e.image.GetMipCount();
+	int oldCount = numMips - e.residentLevel;
+	e.texture.texImage2D(GL_TEXTURE_2D, e.image, level);
+
+	// levels past the new chain would keep their memory otherwise
+	for (int i = numMips - level; i < oldCount; i++)
+		glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	residentBytes += e.levelBytes[level] - e.levelBytes[e.residentLevel];
+	e.residentLevel = level;
+}
+
+void TextureStreamer::Request(const BaseTexture &tex, float uvPerPixel)
+{
+	int index = tex.ptr->streamIndex;
+	if (index < 0) return;
+	Entry &e = entries[index];
+
+	// one level per halving of the texels that fall on a pixel
+	float texelsPerPixel = uvPerPixel * max(tex.ptr->width, tex.ptr->height);
+	int level = texelsPerPixel > 1.0f ? (int)(logf(texelsPerPixel) * 1.442695f) : 0;
+	if (level < e.wantedLevel) e.wantedLevel = level;
+	e.lastUsed = frame;
+}
+
+// Drops levels finer than wanted, least recently drawn textures first,
+// until bytes are freed or nothing is left to take. Textures that were
+// not requested this frame want only their tail.
+int TextureStreamer::evict(int bytes)
+{
+	vector<int> order;
+	for (int i = 0, n = entries.size(); i < n; i++)
+		if (entries[i].residentLevel < entries[i].wantedLevel)
+			order.push_back(i);
+	sort(order.begin(), order.end(), LessRecent(entries));
+
+	int freed = 0;
+	for (int i = 0, n = order.size(); i < n && freed < bytes; i++) {
+		Entry &e = entries[order[i]];
+		freed += e.levelBytes[e.residentLevel] - e.levelBytes[e.wantedLevel];
+		setResident(e, e.wantedLevel);
+		stats.numEvictions++;
+	}
+	return freed;
+}
+
+void TextureStreamer::Update()
+{
+	long long start = getTicks();
+	stats.numUploads = stats.numEvictions = 0;
+
+	GLint viewport[4] = { };
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (viewport[3] > 0) viewportHeight = viewport[3];
+
+	// textures nobody else holds are gone
+	for (int i = entries.size() - 1; i >= 0; i--)
+		if (entries[i].texture.GetRefCount() == 1)
+			removeEntry(i);
+
+	if (residentBytes > budget)
+		evict(residentBytes - budget);
+
+	vector<int> order;
+	for (int i = 0, n = entries.size(); i < n; i++) {
+		const Entry &e = entries[i];
+		if (e.lastUsed == frame && e.wantedLevel < e.residentLevel)
+			order.push_back(i);
+	}
+	sort(order.begin(), order.end(), LargerGap(entries));
+
+	int uploaded = 0;
+	for (int i = 0, n = order.size(); i < n; i++)
+	{
+		Entry &e = entries[order[i]];
+		int level = e.wantedLevel;
+		if (uploaded > 0 && uploaded + e.levelBytes[level] > uploadLimit)
+			break;
+
+		int grow = e.levelBytes[level] - e.levelBytes[e.residentLevel];
+		if (residentBytes + grow > budget)
+			evict(residentBytes + grow - budget);
+
+		// settle for coarser levels if the budget is still short
+		while (level < e.residentLevel &&
+			residentBytes + e.levelBytes[level] - e.levelBytes[e.residentLevel] > budget)
+			level++;
+		if (level == e.residentLevel) continue;
+
+		setResident(e, level);
+		uploaded += e.levelBytes[level];
+		stats.numUploads++;
+	}
+
+	stats.numTextures = entries.size();
+	stats.numRequested = stats.numWaiting = 0;
+	stats.requestedBytes = stats.fullBytes = 0;
+	for (int i = 0, n = entries.size(); i < n; i++)
+	{
+		Entry &e = entries[i];
+		if (e.lastUsed == frame) {
+			stats.numRequested++;
+			if (e.residentLevel > e.wantedLevel) stats.numWaiting++;
+		}
+		stats.requestedBytes += e.levelBytes[e.wantedLevel];
+		stats.fullBytes += e.levelBytes[0];
+		e.wantedLevel = e.tailLevel;
+	}
+	stats.residentBytes = residentBytes;
+	stats.budget = budget;
+
+	frame++;
+	stats.updateTime = ticksToMs(getTicks() - start);
+}
\ No newline at end of file
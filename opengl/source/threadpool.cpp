@@ -0,0 +1,87 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int numThreads)
+	: quit(false), func(NULL), context(NULL), count(0), pending(0), busy(0), generation(0)
+{
+	next = 0;
+	if (numThreads <= 0)
+		numThreads = (int)thread::hardware_concurrency() - 1;
+	for (int i = 0; i < numThreads; i++)
+		workers.push_back(thread(&ThreadPool::workerMain, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		unique_lock<mutex> l(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (int i = 0, n = workers.size(); i < n; i++)
+		workers[i].join();
+}
+
+int ThreadPool::runTasks()
+{
+	int numDone = 0;
+	for (;;) {
+		int i = next++;
+		if (i >= count) break;
+		func(context, i);
+		numDone++;
+	}
+	return numDone;
+}
+
+void ThreadPool::workerMain()
+{
+	unsigned int seen = 0;
+	for (;;)
+	{
+		{
+			unique_lock<mutex> l(lock);
+			while (!quit && seen == generation)
+				wake.wait(l);
+			if (quit) return;
+			seen = generation;
+			busy++;
+		}
+
+		int numDone = runTasks();
+
+		unique_lock<mutex> l(lock);
+		pending -= numDone;
+		busy--;
+		if (busy == 0) done.notify_all();
+	}
+}
+
+void ThreadPool::ParallelFor(int count, ParallelTask func, void *context)
+{
+	if (count <= 0) return;
+	if (workers.empty() || count == 1) {
+		for (int i = 0; i < count; i++) func(context, i);
+		return;
+	}
+
+	{
+		unique_lock<mutex> l(lock);
+		// a late worker may still be looking at the previous batch
+		while (busy != 0)
+			done.wait(l);
+		this->func = func;
+		this->context = context;
+		this->count = count;
+		this->pending = count;
+		next = 0;
+		generation++;
+	}
+	wake.notify_all();
+
+	int numDone = runTasks();
+
+	unique_lock<mutex> l(lock);
+	pending -= numDone;
+	while (pending != 0)
+		done.wait(l);
+}
\ No newline at end of file
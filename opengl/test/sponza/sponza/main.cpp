@@ -1,12 +1,147 @@
 #include "mainwindow.h"
 #include "gameloop.h"
 #include "stringhelp.h"
+#include "image.h"
+#include "modelloader.h"
 using namespace strhlp;
 
+// sponza.exe -benchtga: decodes the Sponza texture set several times and
+// reports throughput in file bytes and decoded bytes per second
+static void BenchmarkTga()
+{
+	const int numPasses = 5;
+	LARGE_INTEGER freq, start, stop;
+	QueryPerformanceFrequency(&freq);
+
+	double fileBytes = 0, imageBytes = 0;
+	int numFiles = 0;
+	LONGLONG ticks = 0;
+
+	WIN32_FIND_DATAA fd;
+	HANDLE hFind = FindFirstFileA("sponza_obj/textures/*.tga", &fd);
+	if (hFind == INVALID_HANDLE_VALUE) return;
+	do {
+		char path[MAX_PATH] = "sponza_obj/textures/";
+		strcat_s(path, fd.cFileName);
+
+		for (int i = 0; i < numPasses; i++)
+		{
+			Image img;
+			QueryPerformanceCounter(&start);
+			img.LoadTga(path);
+			QueryPerformanceCounter(&stop);
+			if (!img) break;
+
+			ticks += stop.QuadPart - start.QuadPart;
+			fileBytes += fd.nFileSizeLow;
+			imageBytes += img.GetDataSize();
+		}
+		numFiles++;
+	} while (FindNextFileA(hFind, &fd));
+	FindClose(hFind);
+
+	double seconds = (double)ticks / freq.QuadPart;
+	char buf[256] = "";
+	sprintf_s(buf, "%d files x %d passes in %.2f s\nFile: %.1f MB/s\nDecoded: %.1f MB/s",
+		numFiles, numPasses, seconds, fileBytes / seconds / 1048576.0, imageBytes / seconds / 1048576.0);
+	MessageBoxA(NULL, buf, "TGA decode", MB_OK);
+}
+
+// sponza.exe -benchobj [file.obj]: reads an OBJ file cold (parsing it and
+// writing the mesh cache entry) and then warm (from the cache); without a
+// file name sponza_obj/sponza.obj is used
+static void BenchmarkMeshCache(const char *filename)
+{
+	char dir[MAX_PATH] = "";
+	GetCurrentDirectory(MAX_PATH, dir);
+	if (!*filename) {
+		SetCurrentDirectory("sponza_obj");
+		filename = "sponza.obj";
+	}
+
+	MeshCache cache;
+	ModelLoader loader(NULL);
+	loader.SetLodCount(3);
+	loader.SetMeshCache(&cache);
+	MeshCacheKey key = { true, 3, 0.5f, "" };
+	cache.Remove(filename, key);
+
+	LARGE_INTEGER freq, t0, t1, t2;
+	QueryPerformanceFrequency(&freq);
+	ModelData cold, warm;
+	QueryPerformanceCounter(&t0);
+	bool ok = loader.ReadObj(filename, cold);
+	QueryPerformanceCounter(&t1);
+	ok = ok && loader.ReadObj(filename, warm);
+	QueryPerformanceCounter(&t2);
+	SetCurrentDirectory(dir);
+
+	char buf[256] = "";
+	if (ok) {
+		MeshCacheStats stats = cache.GetStats();
+		sprintf_s(buf, "%d vertices, %d triangles, %d meshes\n"
+			"Cold: %.0f ms (cache write %.0f ms, %.1f MB)\nWarm: %.0f ms (%d hit)",
+			(int)warm.vertices.size(), (int)warm.indices.size() / 3, (int)warm.meshes.size(),
+			(t1.QuadPart - t0.QuadPart) * 1000.0 / freq.QuadPart, stats.writeTime, stats.bytesWritten / 1048576.0,
+			(t2.QuadPart - t1.QuadPart) * 1000.0 / freq.QuadPart, stats.numHits);
+	}
+	else sprintf_s(buf, "cannot read %s", filename);
+	MessageBoxA(NULL, buf, "Mesh cache", MB_OK);
+}
+
+// sponza.exe -benchdict: 1M material lookups by name through LibCollection
+// (library, then item) against the same lookups in a std::map
+static void BenchmarkDictionary()
+{
+	const int numItems = 64, numLookups = 1000000;
+	char names[numItems][32];
+	LibCollection<Material> materials;
+	Dictionary<Material> lib;
+	map<string, Material> ref;
+	for (int i = 0; i < numItems; i++) {
+		sprintf_s(names[i], "sponza_material_%d", i);
+		lib.AddItem(names[i], Material());
+		ref[names[i]] = Material();
+	}
+	materials.AddLib("sponza.mtl", lib);
+
+	LARGE_INTEGER freq, t0, t1, t2;
+	QueryPerformanceFrequency(&freq);
+	int found = 0, foundRef = 0;
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; i < numLookups; i++)
+		if (materials.GetItem("sponza.mtl", names[i % numItems])) found++;
+	QueryPerformanceCounter(&t1);
+	for (int i = 0; i < numLookups; i++)
+		if (ref.find(names[i % numItems]) != ref.end()) foundRef++;
+	QueryPerformanceCounter(&t2);
+
+	double ms = (t1.QuadPart - t0.QuadPart) * 1000.0 / freq.QuadPart;
+	double msRef = (t2.QuadPart - t1.QuadPart) * 1000.0 / freq.QuadPart;
+	char buf[256] = "";
+	sprintf_s(buf, "%d lookups of %d names\nLibCollection: %.1f ms (%d found)\nstd::map: %.1f ms (%d found)",
+		numLookups, numItems, ms, found, msRef, foundRef);
+	MessageBoxA(NULL, buf, "Dictionary", MB_OK);
+}
+
 int WINAPI WinMain(HINSTANCE hInst, HINSTANCE, LPSTR lpCmdLine, int nCmdShow)
 {
 	SetCurrentDirectory("../sponza");
-	MainWindow wnd;
+	if (strstr(lpCmdLine, "-benchtga")) {
+		BenchmarkTga();
+		return 0;
+	}
+	if (strstr(lpCmdLine, "-benchdict")) {
+		BenchmarkDictionary();
+		return 0;
+	}
+	const char *benchObj = strstr(lpCmdLine, "-benchobj");
+	if (benchObj) {
+		BenchmarkMeshCache(trim(string(benchObj + 9)).c_str());
+		return 0;
+	}
+
+	MainWindow wnd(strstr(lpCmdLine, "-benchload") != NULL, strstr(lpCmdLine, "-benchtext") != NULL);
 	wnd.Show(SW_SHOW);
 
 	GameLoop loop(wnd);
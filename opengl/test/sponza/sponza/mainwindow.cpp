@@ -1,9 +1,10 @@
 #include "mainwindow.h"
+#include "modelloader.h"
 #include "transform.h"
 #include <strsafe.h>
 #include <time.h>
 
-MainWindow::MainWindow()
+MainWindow::MainWindow(bool benchLoad, bool benchText) : fBenchLoad(benchLoad), fBenchText(benchText)
 {
 	this->Create("Sponza", CW_USEDEFAULT, CW_USEDEFAULT, 1000, 700);
 	//this->CreateFullScreen("Sponza");
@@ -22,9 +23,191 @@ void MainWindow::Shot()
 	fShowMuzzleFlash = true;
 }
 
+void MainWindow::AddOccluders(const ModelData &data)
+{
+	sponza->UpdateTransform();
+	for (int i = 0, n = data.meshes.size(); i < n; i++) {
+		// alpha-tested geometry (foliage, chains) does not hide anything
+		const MaterialDesc *material = data.FindMaterial(data.meshes[i].material);
+		if (!material || material->opacityMask.empty())
+			m_rc->occlusionCuller.AddOccluder(data, i, sponza->GetTransformRef());
+	}
+}
+
+void MainWindow::AddLights()
+{
+	// the sun, and lamps along the walls
+	Light sun = { Vector4f(1.0f, 1.0f, -1.0f, 0.0f), Color4f(0.5f, 0.5f, 0.5f), Color4f(0.05f), Color4f(0.2f), 0.0f };
+	m_rc->lights.push_back(sun);
+
+	const Vector3f lampPos[8] = {
+		Vector3f(-9.0f, 66.0f, 107.0f), Vector3f(-13.0f, 62.0f, -126.0f),
+		Vector3f(-282.0f, 68.0f, -7.0f), Vector3f(-240.0f, 24.0f, 80.0f), Vector3f(-241.0f, 21.0f, -91.0f),
+		Vector3f(243.0f, 68.0f, -7.0f), Vector3f(240.0f, 24.0f, 80.0f), Vector3f(241.0f, 21.0f, -91.0f)
+	};
+	const Color4f lampColor[8] = {
+		Color4f(1.0f, 0.0f, 0.0f), Color4f(1.0f, 0.0f, 0.0f),
+		Color4f(0.0f, 0.0f, 1.0f), Color4f(1.0f, 0.65f, 0.0f), Color4f(1.0f, 0.65f, 0.0f),
+		Color4f(0.0f, 0.0f, 1.0f), Color4f(1.0f, 0.65f, 0.0f), Color4f(1.0f, 0.65f, 0.0f)
+	};
+	for (int i = 0; i < 8; i++) {
+		const Vector3f &p = lampPos[i];
+		Light lamp = { Vector4f(p.x, p.y, p.z, 1.0f), lampColor[i], lampColor[i], Color4f(1.0f), 150.0f };
+		m_rc->lights.push_back(lamp);
+	}
+}
+
+void MainWindow::OnAssetProgress(void *context, const AssetHandle &asset)
+{
+	MainWindow *wnd = (MainWindow *)context;
+	if (asset.IsReady() && asset.GetName() == "sponza.raw")
+		wnd->AddOccluders(*asset.GetData());
+}
+
+// sponza.exe -benchload: loads Sponza with LoadRaw() and then through the
+// asset loader at 4 ms of uploads per frame, and reports the total time
+// and how long the main thread was blocked in each case
+void MainWindow::BenchmarkLoading()
+{
+	LARGE_INTEGER freq, start, stop;
+	QueryPerformanceFrequency(&freq);
+
+	char dir[MAX_PATH] = "";
+	GetCurrentDirectory(MAX_PATH, dir);
+	SetCurrentDirectory("sponza_obj");
+
+	double times[2] = { };
+	double blocked = 0.0, maxFrame = 0.0;
+	int numFrames = 0;
+
+	// the first pass only warms up the file cache
+	for (int pass = 0; pass < 3; pass++)
+	{
+		m_rc->materials.RemoveLib("sponza.mtl");
+		m_rc->assetCache.Clear();
+
+		Model model(m_rc);
+		QueryPerformanceCounter(&start);
+		if (pass < 2)
+			model.LoadRaw("sponza.raw", 3);
+		else
+		{
+			AssetHandle asset = loader->LoadModel("sponza.raw", &model, 3);
+			while (!asset.IsDone()) {
+				loader->ProcessUploads(4.0f);
+				double t = loader->GetLastUploadTime();
+				blocked += t;
+				maxFrame = max(maxFrame, t);
+				numFrames++;
+				Sleep(1);
+			}
+		}
+		QueryPerformanceCounter(&stop);
+		if (pass > 0)
+			times[pass - 1] = (double)(stop.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart;
+	}
+	SetCurrentDirectory(dir);
+
+	char buf[256] = "";
+	sprintf_s(buf, "LoadRaw: %.0f ms, all on the main thread\n"
+		"AssetLoader: %.0f ms, main thread blocked %.0f ms over %d frames (max %.1f ms)",
+		times[0], times[1], blocked, numFrames, maxFrame);
+	MessageBoxA(NULL, buf, "Sponza load", MB_OK);
+}
+
+// sponza.exe -benchtext: lays out a screen of text many times, alone and
+// together with the upload Text2D::SetText() does, in glyphs per second;
+// then draws a HUD of short labels with a Text2D per label and with a
+// TextBatch, and reports the CPU time of a frame of each
+void MainWindow::BenchmarkText()
+{
+	const int numPasses = 2000, numLabels = 300, numFrames = 50;
+	const wchar_t *sample =
+		L"Meshes: 381\nFrame arena: 12 / 64 KB (peak 40 KB)\n"
+		L"Occluded: 120 / 381 (raster 0.42 ms, test 0.05 ms)\n"
+		L"The quick brown fox jumps over the lazy dog. 0123456789\n"
+		L"\u0421\u044a\u0435\u0448\u044c \u0436\u0435 \u0435\u0449\u0451 "
+		L"\u044d\u0442\u0438\u0445 \u043c\u044f\u0433\u043a\u0438\u0445 "
+		L"\u0444\u0440\u0430\u043d\u0446\u0443\u0437\u0441\u043a\u0438\u0445 "
+		L"\u0431\u0443\u043b\u043e\u043a";
+
+	LARGE_INTEGER freq, t0, t1, t2, t3;
+	QueryPerformanceFrequency(&freq);
+	vector<GlyphQuad> quads(wcslen(sample));
+	Text2D t(m_rc, *font);
+
+	double numGlyphs = 0;
+	QueryPerformanceCounter(&t0);
+	for (int i = 0; i < numPasses; i++)
+		numGlyphs += font->LayoutText(sample, quads.data());
+	QueryPerformanceCounter(&t1);
+	for (int i = 0; i < numPasses; i++)
+		t.SetText(sample);
+	glFinish();
+	QueryPerformanceCounter(&t2);
+
+	double layout = (double)(t1.QuadPart - t0.QuadPart) / freq.QuadPart;
+	double setText = (double)(t2.QuadPart - t1.QuadPart) / freq.QuadPart;
+
+	// copies of a Text2D share its vertex array, so each label is made anew
+	vector<Text2D *> labels(numLabels);
+	for (int i = 0; i < numLabels; i++)
+		labels[i] = new Text2D(m_rc, *font);
+	wchar_t label[32] = L"";
+	glFinish();
+	QueryPerformanceCounter(&t0);
+	for (int f = 0; f < numFrames; f++) {
+		for (int i = 0; i < numLabels; i++) {
+			StringCchPrintfW(label, 32, L"Label %d: %d", i, f);
+			labels[i]->SetText(label);
+			labels[i]->Draw(10 + i % 10 * 90, 10 + i / 10 * 20);
+		}
+		glFinish();
+	}
+	QueryPerformanceCounter(&t1);
+	for (int i = 0; i < numLabels; i++)
+		delete labels[i];
+
+	QueryPerformanceCounter(&t2);
+	for (int f = 0; f < numFrames; f++) {
+		for (int i = 0; i < numLabels; i++) {
+			StringCchPrintfW(label, 32, L"Label %d: %d", i, f);
+			text->Add(*font, label, 10 + i % 10 * 90, 10 + i / 10 * 20);
+		}
+		text->Draw();
+		glFinish();
+	}
+	QueryPerformanceCounter(&t3);
+
+	double perText2D = (double)(t1.QuadPart - t0.QuadPart) * 1000.0 / freq.QuadPart / numFrames;
+	double perBatch = (double)(t3.QuadPart - t2.QuadPart) * 1000.0 / freq.QuadPart / numFrames;
+
+	// a distance field of the same atlas, on one thread and on the pool
+	Font2D sdfFont;
+	SdfGenerator serial, pooled(m_rc->GetThreadPool());
+	QueryPerformanceCounter(&t0);
+	sdfFont.LoadFnt("fonts/font.fnt", &serial);
+	QueryPerformanceCounter(&t1);
+	sdfFont.LoadFnt("fonts/font.fnt", &pooled);
+	QueryPerformanceCounter(&t2);
+	double sdfSerial = (double)(t1.QuadPart - t0.QuadPart) * 1000.0 / freq.QuadPart;
+	double sdfPooled = (double)(t2.QuadPart - t1.QuadPart) * 1000.0 / freq.QuadPart;
+
+	char buf[512] = "";
+	sprintf_s(buf, "%d glyphs x %d passes\nLayoutText: %.1f M glyphs/s\nSetText: %.1f M glyphs/s\n"
+		"%d labels: Text2D %.2f ms/frame (%d draws), TextBatch %.2f ms/frame (%d draws)\n"
+		"SDF atlas: %.1f ms, %.1f ms on the pool",
+		(int)(numGlyphs / numPasses), numPasses, numGlyphs / layout / 1e6, numGlyphs / setText / 1e6,
+		numLabels, perText2D, numLabels, perBatch, text->GetLastDrawCount(), sdfSerial, sdfPooled);
+	MessageBoxA(NULL, buf, "Text", MB_OK);
+}
+
 void MainWindow::OnCreate()
 {
 	glewInit();
+	// lets the driver compile programs started with BuildAsync() on as many threads as it likes
+	if (GLEW_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
 
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
@@ -42,21 +225,43 @@ void MainWindow::OnCreate()
 		"textures/skybox/rt.tga",
 	};
 
+	m_rc->EnableProgramBinaryCache(true);
 	skybox = new Skybox(m_rc, sides);
-	mainShader = new ProgramObject(m_rc, "shaders/main.vert.glsl", "shaders/main.frag.glsl");
+	mainShader = new ProgramObject(m_rc->shaderCache.GetProgram("shaders/main.vert.glsl", "shaders/main.frag.glsl"));
+	gbufferShader = new ProgramObject(m_rc->shaderCache.GetProgram("shaders/main.vert.glsl", "shaders/gbuffer.frag.glsl"));
+	lightingShader = new ProgramObject(m_rc->shaderCache.GetProgram("shaders/fullscreen.vert.glsl", "shaders/deferred.frag.glsl"));
+	shadowShader = new ProgramObject(m_rc->shaderCache.GetProgram("shaders/shadow.vert.glsl", "shaders/shadow.frag.glsl"));
+	bloomShader = new ProgramObject(m_rc->shaderCache.GetProgram("shaders/fullscreen.vert.glsl", "shaders/bloom.frag.glsl"));
+	compositeShader = new ProgramObject(m_rc->shaderCache.GetProgram("shaders/fullscreen.vert.glsl", "shaders/composite.frag.glsl"));
+	screenVao = new VertexArrayObject();
+	shadows = new CascadedShadowMap(m_rc);
+	deferred = new DeferredRenderer(m_rc);
+	frameGraph = new FrameGraph();
+	fDeferred = true;
+	drawCalls = 0;
 	gun = new Model(m_rc);
 	muzzle_flash = new Model(m_rc);
 	crosshair = new Model(m_rc);
 	sponza = new Model(m_rc);
 
-	Font2D font("fonts/font.fnt");
-	font.SetColor(Color4f(1));
-	text = new Text2D(m_rc, font);
-	
+	font = new Font2D("fonts/font.fnt");
+	font->SetColor(Color4f(1));
+	text = new TextBatch(m_rc);
+	if (fBenchText) BenchmarkText();
+
+	// sponza's textures take over 160 MB with all their levels
+	m_rc->EnableTextureStreaming(true);
+	m_rc->textureStreamer.SetBudget(96 << 20);
+
+	loader = new AssetLoader(m_rc);
+	loader->SetProgressCallback(OnAssetProgress, this);
+	if (fBenchLoad) BenchmarkLoading();
+
+	// the scene is drawn while sponza streams in; see OnAssetProgress()
 	char dir[MAX_PATH] = "";
 	GetCurrentDirectory(MAX_PATH, dir);
 	SetCurrentDirectory("sponza_obj");
-	sponza->LoadRaw("sponza.raw");
+	sponzaAsset = loader->LoadModel("sponza.raw", sponza, 3);
 	sponza->shader = *mainShader;
 	sponza->scale = Vector3f(0.2f);
 	SetCurrentDirectory(dir);
@@ -76,14 +281,20 @@ void MainWindow::OnCreate()
 	crosshair->shader = *mainShader;
 	crosshair->scale = Vector3f(4.0f);
 
-	for (int i = 0, n = sponza->meshes.size(); i < n; i++) {
-		sponza->meshes[i].ComputeBoundingBox();
-	}
-
 	mainShader->Uniform("ColorMap", 0);
 	mainShader->Uniform("NormalMap", 1);
 	mainShader->Uniform("SpecularMap", 2);
 	mainShader->Uniform("OpacityMask", 4);
+	gbufferShader->Uniform("ColorMap", 0);
+	gbufferShader->Uniform("NormalMap", 1);
+	gbufferShader->Uniform("SpecularMap", 2);
+	gbufferShader->Uniform("OpacityMask", 4);
+	shadowShader->Uniform("OpacityMask", 4);
+	bloomShader->Uniform("Source", 8);
+	compositeShader->Uniform("Scene", 8);
+	compositeShader->Uniform("Bloom", 9);
+	compositeShader->Uniform("BloomStrength", 0.6f);
+	AddLights();
 
 	camera.SetPosition(0, 20, 0);
 	camera.RotateY(90);
@@ -93,23 +304,101 @@ void MainWindow::OnCreate()
 
 void MainWindow::OnDisplay()
 {
+	if (!loader->IsIdle())
+		loader->ProcessUploads(4.0f);
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// with deferred shading the scene goes to the G-buffer and is lit once per pixel below
+	ProgramObject *sceneShader = fDeferred ? gbufferShader : mainShader;
+	sponza->shader = *sceneShader;
+	gun->shader = *sceneShader;
+
 	m_rc->PushModelView();
-		gun->Draw();
+		if (!fDeferred) gun->Draw();
 
 		camera.ApplyTransform(m_rc);
-		skybox->Draw();
+		if (!fDeferred) skybox->Draw();
 
-		static int viewLoc = mainShader->GetUniformLocation("View");
 		Matrix44f view = m_rc->GetModelView();
-		mainShader->Use();
-		glUniformMatrix4fv(viewLoc, 1, FALSE, view.data);
-
-		int drawCalls = sponza->Draw();
-		WCHAR buf[20] = L"";
-		StringCchPrintfW(buf, 20, L"Meshes: %d", drawCalls);
-		text->SetText(buf);
+		float viewport[4] = { };
+		glGetFloatv(GL_VIEWPORT, viewport);
+		m_rc->lightCuller.Update(view, (int)viewport[2], (int)viewport[3]);
+		m_rc->lightCuller.Bind(*mainShader);
+
+		// the sun's shadows, each cascade drawing only the casters it sees
+		Model *casters[1] = { sponza };
+		shadows->Update(view);
+		shadows->Render(*shadowShader, casters, 1);
+		shadows->Bind(*mainShader);
+
+		m_rc->occlusionCuller.RenderOccluders(m_rc->GetProjectionRef() * view);
+		m_rc->frustumCuller.SetViewMatrix(view);
+
+		if (fDeferred) {
+			// the sky goes to the scene color first, then the G-buffer is filled
+			// in transient textures and lit over it where there is geometry
+			const FrameGraphTextureDesc colorDesc = { (int)viewport[2], (int)viewport[3],
+				GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE };
+			frameGraph->Reset();
+			sceneColor = frameGraph->CreateTexture("SceneColor", colorDesc);
+			int sky = frameGraph->AddPass("sky", DrawSky, this);
+			frameGraph->Write(sky, sceneColor);
+			deferred->AddPasses(*frameGraph, (int)viewport[2], (int)viewport[3],
+				*lightingShader, DrawScene, this, sceneColor);
+
+			// bloom is blurred at full size, so its targets take the textures
+			// of the G-buffer once lighting is done with them
+			const char *names[2] = { "BloomH", "BloomV" };
+			for (int i = 0; i < 2; i++) {
+				bloom[i] = frameGraph->CreateTexture(names[i], colorDesc);
+				bloomPasses[i] = frameGraph->AddPass(names[i], DrawBloom, this);
+				frameGraph->Read(bloomPasses[i], i == 0 ? sceneColor : bloom[0]);
+				frameGraph->Write(bloomPasses[i], bloom[i]);
+			}
+			int composite = frameGraph->AddPass("composite", DrawComposite, this);
+			frameGraph->Read(composite, sceneColor);
+			frameGraph->Read(composite, bloom[1]);
+			frameGraph->SetSideEffect(composite);
+
+			m_rc->lightCuller.Bind(*lightingShader);
+			shadows->Bind(*lightingShader);
+			frameGraph->Execute();
+		}
+		else {
+			m_rc->EnableOcclusionCulling(true);
+			drawCalls = sponza->Draw();
+			m_rc->EnableOcclusionCulling(false);
+		}
+		m_rc->frustumCuller.ResetViewMatrix();
+
+		const FrameArenaStats &arena = m_rc->frameArena.GetLastFrameStats();
+		const OcclusionCullerStats &occl = m_rc->occlusionCuller.GetStats();
+		const TextureStreamerStats &tex = m_rc->textureStreamer.GetStats();
+		const AssetCacheStats &cache = m_rc->assetCache.GetStats();
+		const FrameGraphStats &graph = frameGraph->GetStats();
+		const ShadowStats &shadow = shadows->GetStats();
+		WCHAR buf[640] = L"";
+		if (!sponzaAsset.IsDone())
+			StringCchPrintfW(buf, 640, L"Loading: %d%%\n", (int)(sponzaAsset.GetProgress() * 100));
+		int len = lstrlenW(buf);
+		StringCchPrintfW(buf + len, 640 - len, L"Meshes: %d\nFrame arena: %d / %d KB (peak %d KB)\n"
+			L"Occluded: %d / %d (raster %.2f ms, test %.2f ms)\n"
+			L"Textures: %d / %d MB resident, %d MB needed, %d MB full (%d of %d waiting)\n"
+			L"Cache: %d textures, %d MB, %d MB saved (%d path hits, %d content hits)\n"
+			L"Frame graph: %d passes (%d culled), %d targets in %d, %d / %d KB transient\n"
+			L"Shadow casters: %d / %d / %d / %d (fit %.2f ms, render %.2f ms)",
+			drawCalls, arena.bytesUsed / 1024, arena.capacity / 1024, arena.peakBytes / 1024,
+			occl.numCulled, occl.numTested, occl.rasterTime, occl.testTime,
+			tex.residentBytes >> 20, tex.budget >> 20, tex.requestedBytes >> 20, tex.fullBytes >> 20,
+			tex.numWaiting, tex.numRequested,
+			cache.numTextures, cache.cachedBytes >> 20, cache.savedBytes >> 20,
+			cache.numPathHits, cache.numContentHits,
+			graph.numPasses, graph.numCulledPasses, graph.numTextures, graph.numAllocated,
+			graph.transientBytes >> 10, graph.naiveBytes >> 10,
+			shadow.numCasters[0], shadow.numCasters[1], shadow.numCasters[2], shadow.numCasters[3],
+			shadow.fitTime, shadow.renderTime);
+		text->Add(*font, buf, 10, 10);
 		
 		glEnable(GL_BLEND);
 		glDisable(GL_CULL_FACE);
@@ -123,8 +412,6 @@ void MainWindow::OnDisplay()
 
 		m_rc->PushModelView();
 		m_rc->PushProjection();
-			float viewport[4] = { };
-			glGetFloatv(GL_VIEWPORT, viewport);
 			m_rc->SetProjection(Ortho2D(0, viewport[2], viewport[3], 0));
 			m_rc->SetModelView(Matrix44f::Identity());
 
@@ -136,10 +423,68 @@ void MainWindow::OnDisplay()
 		glEnable(GL_CULL_FACE);
 		glDisable(GL_BLEND);
 
-		text->Draw(10, 10);
+		text->Draw();
 	m_rc->PopModelView();
 }
 
+void MainWindow::DrawSky(void *context, FrameGraph &graph, int pass) {
+	((MainWindow *)context)->skybox->Draw();
+}
+
+void MainWindow::DrawScene(void *context, FrameGraph &graph, int pass)
+{
+	MainWindow *self = (MainWindow *)context;
+	GLRenderingContext *rc = self->m_rc;
+
+	// the gun is drawn without the camera, as it is in forward shading
+	rc->PushModelView();
+		rc->SetModelView(Matrix44f::Identity());
+		self->gun->Draw();
+	rc->PopModelView();
+
+	rc->EnableOcclusionCulling(true);
+	self->drawCalls = self->sponza->Draw();
+	rc->EnableOcclusionCulling(false);
+}
+
+void MainWindow::DrawBloom(void *context, FrameGraph &graph, int pass)
+{
+	MainWindow *self = (MainWindow *)context;
+	bool across = pass == self->bloomPasses[0];
+	int source = across ? self->sceneColor : self->bloom[0];
+	const FrameGraphTextureDesc &d = graph.GetDesc(source);
+
+	// the first pass keeps only what is bright enough to bloom
+	Texture2D texture = graph.GetTexture(source);
+	texture.SetTextureUnit(GL_TEXTURE8);
+	texture.Bind();
+	self->bloomShader->Uniform("Direction", across ? 1.0f / d.width : 0.0f, across ? 0.0f : 1.0f / d.height);
+	self->bloomShader->Uniform("Threshold", across ? 0.8f : 0.0f);
+
+	self->screenVao->Bind();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	self->screenVao->Unbind();
+}
+
+void MainWindow::DrawComposite(void *context, FrameGraph &graph, int pass)
+{
+	MainWindow *self = (MainWindow *)context;
+	Texture2D scene = graph.GetTexture(self->sceneColor);
+	Texture2D bloom = graph.GetTexture(self->bloom[1]);
+	scene.SetTextureUnit(GL_TEXTURE8);
+	bloom.SetTextureUnit(GL_TEXTURE9);
+	scene.Bind();
+	bloom.Bind();
+	self->compositeShader->Use();
+
+	// the screen keeps the depth it was cleared to, for what is drawn after
+	glDepthMask(GL_FALSE);
+	self->screenVao->Bind();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	self->screenVao->Unbind();
+	glDepthMask(GL_TRUE);
+}
+
 void MainWindow::OnSize(int w, int h)
 {
 	glViewport(0, 0, w, h);
@@ -240,10 +585,21 @@ void MainWindow::OnDestroy()
 {
 	delete skybox;
 	delete mainShader;
+	delete gbufferShader;
+	delete lightingShader;
+	delete shadowShader;
+	delete bloomShader;
+	delete compositeShader;
+	delete screenVao;
+	delete shadows;
+	delete deferred;
+	delete frameGraph;
 	delete sponza;
 	delete gun;
 	delete muzzle_flash;
 	delete crosshair;
 	delete text;
+	delete font;
+	delete loader;
 	PostQuitMessage(0);
 }
\ No newline at end of file
@@ -6,20 +6,39 @@
 #include "skybox.h"
 #include "model.h"
 #include "text2d.h"
+#include "assetloader.h"
+#include "deferredrenderer.h"
+#include "framegraph.h"
+#include "cascadedshadowmap.h"
 
 class MainWindow : public GLWindow
 {
 public:
-	MainWindow();
+	MainWindow(bool benchLoad = false, bool benchText = false);
 	void Update(int timeDelta);
 private:
 	Camera camera;
 	Skybox *skybox;
 	ProgramObject *mainShader;
+	ProgramObject *gbufferShader, *lightingShader;
+	ProgramObject *shadowShader;
+	ProgramObject *bloomShader, *compositeShader;
+	VertexArrayObject *screenVao; // for full-screen triangles
+	CascadedShadowMap *shadows;
+	DeferredRenderer *deferred;
+	FrameGraph *frameGraph;
+	int sceneColor, bloom[2], bloomPasses[2]; // of the graph of this frame
 	Model *sponza, *gun, *muzzle_flash, *crosshair;
-	Text2D *text;
+	Font2D *font;
+	TextBatch *text;
+	AssetLoader *loader;
+	AssetHandle sponzaAsset;
 
+	bool fBenchLoad;
+	bool fBenchText;
+	bool fDeferred;
 	bool fShowMuzzleFlash;
+	int drawCalls;
 	bool fGunAnim;
 	float gunAnim;
 
@@ -33,12 +52,29 @@ private:
 	}
 
 	void Shot();
+	void AddOccluders(const ModelData &data);
+	void AddLights();
+	void BenchmarkLoading();
+	void BenchmarkText();
+	static void OnAssetProgress(void *context, const AssetHandle &asset);
+	static void DrawSky(void *context, FrameGraph &graph, int pass);
+	static void DrawScene(void *context, FrameGraph &graph, int pass);
+	static void DrawBloom(void *context, FrameGraph &graph, int pass);
+	static void DrawComposite(void *context, FrameGraph &graph, int pass);
 
 	void OnCreate();
 	void OnDisplay();
 	void OnSize(int w, int h);
 	void OnKeyDown(UINT keyCode) {
 		if (keyCode == 27) DestroyWindow(m_hwnd);
+		// F2 switches between deferred and forward shading
+		if (keyCode == VK_F2) {
+			fDeferred = !fDeferred;
+			if (!fDeferred) {
+				frameGraph->Reset();
+				frameGraph->ReleaseTextures();
+			}
+		}
 	}
 	void OnMouseDown(MouseButton btn, int x, int y);
 	void OnMouseMove(UINT keyPressed, int x, int y);
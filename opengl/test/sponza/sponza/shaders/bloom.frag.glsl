@@ -0,0 +1,24 @@
+#version 130
+
+in vec2 fTexCoord;
+
+uniform sampler2D Source;
+uniform vec2 Direction;  // one texel along the blur
+uniform float Threshold; // what is darker does not bloom
+
+const float weights[5] = float[5](0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
+
+vec3 bright(in vec2 uv) {
+	return max(texture(Source, uv).rgb - vec3(Threshold), vec3(0.0));
+}
+
+// half of a separable 9-tap gaussian, once across and once down
+void main()
+{
+	vec3 color = bright(fTexCoord) * weights[0];
+	for (int i = 1; i < 5; i++) {
+		color += bright(fTexCoord + Direction * float(i)) * weights[i];
+		color += bright(fTexCoord - Direction * float(i)) * weights[i];
+	}
+	gl_FragColor = vec4(color, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+// Light sources binned into clusters on the CPU (see LightCuller): a grid
+// of screen tiles by depth slices, each with an offset and count into a
+// list of light indices. Global lights come first and reach every pixel.
+#ifndef CLUSTERS_GLSL
+#define CLUSTERS_GLSL
+
+struct Light
+{
+	vec4 position; // view space
+	vec4 diffuse;
+	vec4 ambient;
+	vec4 specular;
+	float radius;
+};
+
+uniform sampler2D LightData;     // five texels per light
+uniform usampler2D LightGrid;    // offset and count; a row per slice
+uniform usampler2D LightIndices; // 1024 per row
+uniform int NumGlobalLights;
+uniform ivec3 ClusterCount;      // tiles across and down, slices
+uniform vec2 ClusterTileSize;    // in pixels
+uniform vec2 ClusterDepth;       // slice = log(depth) * x + y
+
+Light GetLight(int i)
+{
+	Light l;
+	l.position = texelFetch(LightData, ivec2(0, i), 0);
+	l.diffuse = texelFetch(LightData, ivec2(1, i), 0);
+	l.ambient = texelFetch(LightData, ivec2(2, i), 0);
+	l.specular = texelFetch(LightData, ivec2(3, i), 0);
+	l.radius = texelFetch(LightData, ivec2(4, i), 0).x;
+	return l;
+}
+
+// offset and count of the lights of the cluster at the fragment, which is
+// at viewZ in view space
+uvec2 GetCluster(float viewZ)
+{
+	ivec2 tile = clamp(ivec2(gl_FragCoord.xy / ClusterTileSize), ivec2(0), ClusterCount.xy - 1);
+	int slice = clamp(int(log(-viewZ) * ClusterDepth.x + ClusterDepth.y), 0, ClusterCount.z - 1);
+	return texelFetch(LightGrid, ivec2(tile.y * ClusterCount.x + tile.x, slice), 0).xy;
+}
+
+int GetClusterLight(int k) {
+	return int(texelFetch(LightIndices, ivec2(k & 1023, k >> 10), 0).r);
+}
+
+#endif // CLUSTERS_GLSL
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 130
+
+in vec2 fTexCoord;
+
+uniform sampler2D Scene;
+uniform sampler2D Bloom;
+uniform float BloomStrength;
+
+void main() {
+	gl_FragColor = texture(Scene, fTexCoord) + texture(Bloom, fTexCoord) * BloomStrength;
+}
\ No newline at end of file
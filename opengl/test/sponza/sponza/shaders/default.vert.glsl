@@ -20,17 +20,7 @@ uniform mat4 ModelView;
 uniform mat4 NormalMatrix;
 uniform mat4 ModelViewProjection;
 
-uniform struct
-{
-	vec4 diffuse;
-	vec4 specular;
-	float shininess;
-	int useDiffuseMap;
-	int useSpecularMap;
-	int useNormalMap;
-	int useOpacityMask;
-	int mode;
-} Material;
+#include "material.glsl"
 
 void main()
 {
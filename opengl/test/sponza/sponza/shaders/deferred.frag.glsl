@@ -0,0 +1,76 @@
+#version 130
+
+in vec2 fTexCoord;
+
+uniform sampler2D GAlbedo;
+uniform sampler2D GNormal;
+uniform sampler2D GSpecular;
+uniform sampler2D GDepth;
+uniform vec4 ProjectionParams; // x and y scale, x and y offset
+uniform vec2 DepthParams;
+
+#include "clusters.glsl"
+#include "shadows.glsl"
+
+vec3 position;
+vec3 normal;
+vec4 albedo;
+vec4 specular;
+
+// the Blinn-Phong of lights.glsl, with the surface from the G-buffer
+vec4 PhongLight(in Light l, in float shadow)
+{
+	vec3 lightDir;
+	if (l.position.w == 0.0)
+		lightDir = l.position.xyz;
+	else lightDir = l.position.xyz - position;
+
+	float att;
+	if (l.radius != 0) {
+		float dist = length(lightDir);
+		att = clamp(1.0 - dist / l.radius, 0.0, 1.0);
+		att *= att;
+	}
+	else att = 1;
+
+	lightDir = normalize(lightDir);
+	vec4 color = (l.ambient + l.diffuse * max(0.0, dot(normal, lightDir)) * shadow) * albedo * att;
+
+	if (specular.a != 0.0)
+	{
+		vec3 halfDir = normalize(lightDir + normalize(-position));
+		float specAngle = max(0.0, dot(normal, halfDir));
+		color += l.specular * att * shadow * vec4(specular.rgb, 1.0) * pow(specAngle, specular.a * 255.0);
+	}
+	return color;
+}
+
+void main()
+{
+	float depth = texture(GDepth, fTexCoord).r;
+	if (depth == 1.0) discard;
+	gl_FragDepth = depth;
+
+	albedo = texture(GAlbedo, fTexCoord);
+	vec4 encoded = texture(GNormal, fTexCoord);
+	if (encoded.w == 0.0) {
+		gl_FragColor = albedo;
+		return;
+	}
+	normal = normalize(encoded.xyz);
+	specular = texture(GSpecular, fTexCoord);
+
+	// back to view space through the projection
+	float z = -DepthParams.y / (depth * 2.0 - 1.0 + DepthParams.x);
+	vec2 ndc = fTexCoord * 2.0 - vec2(1.0);
+	position = vec3(-z * (ndc + ProjectionParams.zw) / ProjectionParams.xy, z);
+
+	vec4 color = vec4(0.0);
+	for (int i = 0; i < NumGlobalLights; i++)
+		color += PhongLight(GetLight(i), i == ShadowLight ? GetShadow(position) : 1.0);
+
+	uvec2 cluster = GetCluster(position.z);
+	for (int k = int(cluster.x), n = int(cluster.x + cluster.y); k < n; k++)
+		color += PhongLight(GetLight(GetClusterLight(k)), 1.0);
+	gl_FragColor = color;
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 130
+
+out vec2 fTexCoord;
+
+// one triangle covering the screen, drawn without attributes
+void main()
+{
+	vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	fTexCoord = p;
+	gl_Position = vec4(p * 2.0 - vec2(1.0), 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#version 130
+
+in vec3 fPosition;
+in vec3 fNormal;
+in vec2 fTexCoord;
+in vec3 fTangent;
+in vec3 fBinormal;
+
+uniform sampler2D ColorMap;
+uniform sampler2D NormalMap;
+uniform sampler2D SpecularMap;
+uniform sampler2D OpacityMask;
+
+#include "material.glsl"
+
+// Writes what deferred.frag.glsl lights the pixel with: the albedo, the
+// view-space normal (w is 0 for materials without lighting) and the
+// specular color with the shininess / 255 in alpha.
+void main()
+{
+	if (Material.useOpacityMask)
+	{
+		vec4 c = texture(OpacityMask, fTexCoord);
+		if (c.r < 0.5) discard;
+	}
+
+	vec3 normal;
+	if (Material.useNormalMap)
+	{
+		vec2 t = texture(NormalMap, fTexCoord).xy;
+		mat3 tbn = mat3(normalize(fTangent), normalize(fBinormal), normalize(fNormal));
+		t.y = 1.0 - t.y;
+		vec3 n = vec3(t * 2.0 - vec2(1.0), 0.0);
+		n.z = sqrt(max(0.0, 1.0 - dot(n.xy, n.xy)));
+		normal = normalize(tbn * n);
+	}
+	else {
+		normal = normalize(fNormal);
+	}
+
+	vec4 specular = vec4(0.0);
+	if (Material.mode == MM_BLINN_PHONG) {
+		specular = mix(Material.specular, texture(SpecularMap, fTexCoord), Material.useSpecularMap);
+		specular.a = min(Material.shininess, 255.0) / 255.0;
+	}
+
+	gl_FragData[0] = mix(Material.diffuse, texture(ColorMap, fTexCoord), Material.useDiffuseMap);
+	gl_FragData[1] = vec4(normal, Material.mode == MM_NO_LIGHTING ? 0.0 : 1.0);
+	gl_FragData[2] = specular;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+// Blinn-Phong lighting from the scene's light sources. The shader including
+// this declares fPosition, fTexCoord and SpecularMap.
+#ifndef LIGHTS_GLSL
+#define LIGHTS_GLSL
+
+#include "material.glsl"
+#include "clusters.glsl"
+#include "shadows.glsl"
+
+// SPECULAR set to 0 or 1 fixes the specular term, otherwise it follows Material.mode
+#ifdef SPECULAR
+#define USE_SPECULAR bool(SPECULAR)
+#else
+#define USE_SPECULAR (Material.mode == MM_BLINN_PHONG)
+#endif
+
+vec3 fragNormal;
+vec4 mtl_diffuse;
+
+float GetDiffuse(in vec3 lightDir)
+{
+	return max(0.0, dot(fragNormal, lightDir));
+}
+
+float GetSpecular(in vec3 lightDir)
+{
+	vec3 viewDir = normalize(-fPosition);
+	vec3 halfDir = normalize(lightDir + viewDir);
+	float specAngle = max(0.0, dot(fragNormal, halfDir));
+	return pow(specAngle, Material.shininess);
+}
+
+// shadow scales what the light adds beyond its ambient term
+vec4 PhongLight(in Light l, in float shadow)
+{
+	vec3 lightDir;
+	if (l.position.w == 0.0)
+		lightDir = l.position.xyz;
+	else lightDir = l.position.xyz - fPosition;
+
+	float att;
+	if (l.radius != 0) {
+		float dist = length(lightDir);
+		att = clamp(1.0 - dist / l.radius, 0.0, 1.0);
+		att *= att;
+	}
+	else att = 1;
+
+	lightDir = normalize(lightDir);
+	
+	vec4 color = (l.ambient + l.diffuse * GetDiffuse(lightDir) * shadow) * mtl_diffuse * att;
+
+	if (USE_SPECULAR)
+	{
+		vec4 mtl_specular = mix(Material.specular, texture(SpecularMap, fTexCoord), Material.useSpecularMap);
+		color += l.specular * att * shadow * mtl_specular * GetSpecular(lightDir);
+	}
+	return color;
+}
+
+// all lights reaching the cluster of the fragment
+vec4 ClusteredLight()
+{
+	vec4 color = vec4(0.0);
+	for (int i = 0; i < NumGlobalLights; i++)
+		color += PhongLight(GetLight(i), i == ShadowLight ? GetShadow(fPosition) : 1.0);
+
+	uvec2 cluster = GetCluster(fPosition.z);
+	for (int k = int(cluster.x), n = int(cluster.x + cluster.y); k < n; k++)
+		color += PhongLight(GetLight(GetClusterLight(k)), 1.0);
+	return color;
+}
+
+#endif // LIGHTS_GLSL
\ No newline at end of file
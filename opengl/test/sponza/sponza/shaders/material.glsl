@@ -0,0 +1,20 @@
+#ifndef MATERIAL_GLSL
+#define MATERIAL_GLSL
+
+const int MM_NO_LIGHTING = 0;
+const int MM_LAMBERT = 1;
+const int MM_BLINN_PHONG = 2;
+
+uniform struct
+{
+	vec4 diffuse;
+	vec4 specular;
+	float shininess;
+	int useDiffuseMap;
+	int useSpecularMap;
+	int useNormalMap;
+	int useOpacityMask;
+	int mode;
+} Material;
+
+#endif // MATERIAL_GLSL
\ No newline at end of file
@@ -0,0 +1,17 @@
+#version 130
+
+in vec2 fTexCoord;
+
+uniform sampler2D OpacityMask;
+
+#include "material.glsl"
+
+// depth only; cut-out surfaces cast the shadow of what is left of them
+void main()
+{
+	if (Material.useOpacityMask != 0)
+	{
+		vec4 c = texture(OpacityMask, fTexCoord);
+		if (c.r < 0.5) discard;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 130
+
+in vec3 Vertex;
+in vec2 TexCoord;
+
+out vec2 fTexCoord;
+
+uniform mat4 ModelViewProjection;
+
+void main()
+{
+	fTexCoord = TexCoord;
+	fTexCoord.y = 1.0 - fTexCoord.y;
+	gl_Position = ModelViewProjection * vec4(Vertex, 1.0);
+}
\ No newline at end of file
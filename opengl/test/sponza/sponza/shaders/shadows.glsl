@@ -0,0 +1,32 @@
+// Cascaded shadow maps of one directional light (see CascadedShadowMap):
+// a depth array texture with a layer per cascade and a matrix taking
+// view-space positions into each.
+#ifndef SHADOWS_GLSL
+#define SHADOWS_GLSL
+
+uniform sampler2DArrayShadow ShadowMap;
+uniform mat4 ShadowMatrix[4];
+uniform vec4 ShadowSplits;     // view-space distance each cascade ends at
+uniform float ShadowTexelSize;
+uniform int NumCascades;       // 0 without shadows
+uniform int ShadowLight;       // the light casting them, -1 for none
+
+// how much of the shadow light reaches viewPos, from 0 to 1
+float GetShadow(in vec3 viewPos)
+{
+	float dist = -viewPos.z;
+	int c = 0;
+	while (c < NumCascades && dist > ShadowSplits[c]) c++;
+	if (c >= NumCascades) return 1.0;
+
+	// four filtered comparisons around the point cover 4x4 texels
+	vec4 p = ShadowMatrix[c] * vec4(viewPos, 1.0);
+	float lit = 0.0;
+	for (int i = 0; i < 4; i++) {
+		vec2 offset = vec2(float(i & 1), float(i >> 1)) * 2.0 - vec2(1.0);
+		lit += texture(ShadowMap, vec4(p.xy + offset * ShadowTexelSize, float(c), p.z));
+	}
+	return lit * 0.25;
+}
+
+#endif // SHADOWS_GLSL
\ No newline at end of file
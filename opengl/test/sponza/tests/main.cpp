@@ -0,0 +1,435 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+#include "programbinarycache.h"
+#include "framegraph.h"
+
+using namespace std;
+
+// tests [name]
+// Checks the parts of the library that decide things on the CPU, with
+// the GL calls they make going to stubs instead of a driver, so no
+// window or GPU is needed. Runs every test, or those whose names start
+// with the argument, and returns the number that failed.
+
+static int numChecks, numFailed;
+static bool failed;
+
+#define CHECK(x) do { \
+	numChecks++; \
+	if (!(x)) { printf("  %s:%d: %s\n", __FILE__, __LINE__, #x); failed = true; } \
+} while (0)
+
+// A driver with a single binary format. It hands out the bytes it was
+// given last and links a program from a binary only if it is those bytes
+// in its format and it still takes binaries.
+static struct StubDriver
+{
+	GLint format;
+	const char *version;
+	bool takesBinaries;
+	vector<BYTE> binary; // of the linked program
+	bool linked;
+	int numBinaries;     // glProgramBinary calls
+} stub;
+
+static void resetStub()
+{
+	static const BYTE program[] = { 'p', 'r', 'o', 'g', 'r', 'a', 'm', 0, 1, 2, 3 };
+	stub.format = 0x1234;
+	stub.version = "4.5 stub";
+	stub.takesBinaries = true;
+	stub.binary.assign(program, program + sizeof(program));
+	stub.linked = true;
+	stub.numBinaries = 0;
+}
+
+static void GLAPIENTRY stubGetIntegerv(GLenum pname, GLint *params)
+{
+	if (pname == GL_NUM_PROGRAM_BINARY_FORMATS) *params = 1;
+	else if (pname == GL_PROGRAM_BINARY_FORMATS) params[0] = stub.format;
+}
+
+static const GLubyte *GLAPIENTRY stubGetString(GLenum name)
+{
+	const char *s = name == GL_VENDOR ? "vendor" : name == GL_RENDERER ? "renderer" : stub.version;
+	return (const GLubyte *)s;
+}
+
+static void GLAPIENTRY stubProgramBinary(GLuint program, GLenum format, const void *binary, GLsizei length)
+{
+	stub.numBinaries++;
+	stub.linked = stub.takesBinaries && format == (GLenum)stub.format &&
+		length == (GLsizei)stub.binary.size() && memcmp(binary, stub.binary.data(), length) == 0;
+}
+
+static void GLAPIENTRY stubGetProgramiv(GLuint program, GLenum pname, GLint *param)
+{
+	if (pname == GL_LINK_STATUS) *param = stub.linked ? GL_TRUE : GL_FALSE;
+	else if (pname == GL_PROGRAM_BINARY_LENGTH) *param = stub.binary.size();
+}
+
+static void GLAPIENTRY stubGetProgramBinary(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *format, void *binary)
+{
+	*length = min((GLsizei)stub.binary.size(), bufSize);
+	*format = stub.format;
+	memcpy(binary, stub.binary.data(), *length);
+}
+
+static void initCache(ProgramBinaryCache &cache)
+{
+	ProgramBinaryGL gl = { stubGetIntegerv, stubGetString, stubProgramBinary, stubGetProgramiv, stubGetProgramBinary };
+	resetStub();
+	cache.SetGL(gl);
+}
+
+static void testBinaryCacheMiss()
+{
+	ProgramBinaryCache cache("testcache");
+	initCache(cache);
+	CHECK(cache.IsSupported());
+
+	// nothing is ever saved under that hash
+	CHECK(!cache.Load(1, 0xDEADBEEFULL));
+	CHECK(stub.numBinaries == 0);
+
+	// a driver update misses as well
+	CHECK(cache.Save(1, 1ULL, 10.0f));
+	stub.version = "4.6 stub";
+	CHECK(!cache.Load(1, 1ULL));
+
+	ProgramBinaryCacheStats stats = cache.GetStats();
+	CHECK(stats.numMisses == 2);
+	CHECK(stats.numHits == 0);
+	CHECK(stats.numRejected == 0);
+
+	stub.version = "4.5 stub";
+	CHECK(cache.Remove(1ULL));
+}
+
+static void testBinaryCacheHit()
+{
+	ProgramBinaryCache cache("testcache");
+	initCache(cache);
+
+	CHECK(cache.Save(1, 2ULL, 10.0f));
+	stub.linked = false;
+	CHECK(cache.Load(2, 2ULL));
+	CHECK(stub.numBinaries == 1);
+	CHECK(stub.linked);
+
+	// the entry stays for the next run
+	CHECK(cache.Load(3, 2ULL));
+
+	ProgramBinaryCacheStats stats = cache.GetStats();
+	CHECK(stats.numWrites == 1);
+	CHECK(stats.numHits == 2);
+	CHECK(stats.numMisses == 0);
+
+	CHECK(cache.Remove(2ULL));
+	CHECK(!cache.Load(3, 2ULL));
+}
+
+static void testBinaryCacheRejected()
+{
+	ProgramBinaryCache cache("testcache");
+	initCache(cache);
+
+	// the driver no longer takes the binary; the entry goes and the next
+	// build compiles from source
+	CHECK(cache.Save(1, 3ULL, 10.0f));
+	stub.takesBinaries = false;
+	CHECK(!cache.Load(2, 3ULL));
+	CHECK(stub.numBinaries == 1);
+	stub.takesBinaries = true;
+	CHECK(!cache.Load(2, 3ULL));
+	CHECK(stub.numBinaries == 1);
+
+	// a format the driver stopped listing is not handed over at all
+	CHECK(cache.Save(1, 3ULL, 10.0f));
+	stub.format = 0x5678;
+	CHECK(!cache.Load(2, 3ULL));
+	CHECK(stub.numBinaries == 1);
+	stub.format = 0x1234;
+	CHECK(!cache.Load(2, 3ULL));
+
+	ProgramBinaryCacheStats stats = cache.GetStats();
+	CHECK(stats.numHits == 0);
+	CHECK(stats.numRejected == 2);
+	CHECK(stats.numMisses == 4);
+}
+
+static void testBinaryCacheSavedTime()
+{
+	ProgramBinaryCache cache("testcache");
+	initCache(cache);
+
+	CHECK(cache.Save(1, 4ULL, 50.0f));
+	CHECK(cache.Load(2, 4ULL));
+	CHECK(cache.Load(3, 4ULL));
+
+	// each hit saves the build time it recorded, less what loading took
+	ProgramBinaryCacheStats stats = cache.GetStats();
+	CHECK(stats.loadTime >= 0.0f && stats.loadTime < 50.0f);
+	CHECK(fabs(stats.savedTime - (100.0f - stats.loadTime)) < 0.01f);
+
+	// misses save nothing
+	CHECK(!cache.Load(4, 5ULL));
+	CHECK(fabs(cache.GetStats().savedTime - stats.savedTime) < 0.01f);
+
+	cache.ResetStats();
+	CHECK(cache.GetStats().savedTime == 0.0f);
+
+	CHECK(cache.Remove(4ULL));
+}
+
+// Names handed out by the stub frame graph functions, and what the passes
+// saw while the graph executed.
+static struct StubGraph
+{
+	int numTextures, numFramebuffers; // alive
+	int numCreated;                   // textures ever made
+	GLuint nextName;
+	GLuint bound;
+	GLint viewport[4];
+	vector<int> executed;
+	vector<GLuint> framebuffers; // bound for each pass executed
+	GLuint seen[2];              // textures of the resources of seenIds
+	int seenIds[2];
+} graphStub;
+
+static GLuint stubCreateTexture(const FrameGraphTextureDesc &desc) {
+	graphStub.numTextures++;
+	graphStub.numCreated++;
+	return graphStub.nextName++;
+}
+
+static void stubDeleteTexture(GLuint texture) {
+	graphStub.numTextures--;
+}
+
+static GLuint stubCreateFramebuffer(const GLuint *textures, const GLenum *attachments, int count) {
+	graphStub.numFramebuffers++;
+	return graphStub.nextName++;
+}
+
+static void stubDeleteFramebuffer(GLuint framebuffer) {
+	graphStub.numFramebuffers--;
+}
+
+static void stubBindFramebuffer(GLuint framebuffer) {
+	graphStub.bound = framebuffer;
+}
+
+static void GLAPIENTRY stubViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	GLint v[4] = { x, y, width, height };
+	memcpy(graphStub.viewport, v, sizeof(v));
+}
+
+static void GLAPIENTRY stubGraphGetIntegerv(GLenum pname, GLint *params)
+{
+	if (pname == GL_DRAW_FRAMEBUFFER_BINDING) *params = graphStub.bound;
+	else if (pname == GL_VIEWPORT) memcpy(params, graphStub.viewport, sizeof(graphStub.viewport));
+}
+
+static FrameGraphGL stubGraphGL()
+{
+	FrameGraphGL gl = { stubCreateTexture, stubDeleteTexture, stubCreateFramebuffer,
+		stubDeleteFramebuffer, stubBindFramebuffer, stubViewport, stubGraphGetIntegerv };
+	GLint viewport[4] = { 0, 0, 640, 480 };
+	graphStub.numTextures = graphStub.numFramebuffers = 0;
+	graphStub.numCreated = 0;
+	graphStub.nextName = 100;
+	graphStub.bound = 7; // the screen, as far as the graph knows
+	memcpy(graphStub.viewport, viewport, sizeof(viewport));
+	graphStub.executed.clear();
+	graphStub.framebuffers.clear();
+	graphStub.seen[0] = graphStub.seen[1] = 0;
+	graphStub.seenIds[0] = graphStub.seenIds[1] = -1;
+	return gl;
+}
+
+static void recordPass(void *context, FrameGraph &graph, int pass)
+{
+	graphStub.executed.push_back(pass);
+	graphStub.framebuffers.push_back(graphStub.bound);
+	for (int i = 0; i < 2; i++)
+		if (graphStub.seenIds[i] != -1 && !graph.IsCulled(pass))
+			graphStub.seen[i] = graph.GetTextureId(graphStub.seenIds[i]);
+}
+
+static const FrameGraphTextureDesc colorDesc = { 320, 240, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE };
+static const FrameGraphTextureDesc hdrDesc = { 320, 240, GL_RGBA16F, GL_RGBA, GL_FLOAT };
+
+static void testFrameGraphCulling()
+{
+	FrameGraph graph(stubGraphGL());
+
+	// nothing reads what unused writes
+	int unused = graph.AddPass("unused", recordPass, NULL);
+	int draw = graph.AddPass("draw", recordPass, NULL);
+	int present = graph.AddPass("present", recordPass, NULL);
+	int a = graph.CreateTexture("a", colorDesc);
+	int b = graph.CreateTexture("b", colorDesc);
+	graph.Write(unused, a);
+	graph.Write(draw, b);
+	graph.Read(present, b);
+	graph.SetSideEffect(present);
+
+	CHECK(graph.Compile());
+	CHECK(graph.IsCulled(unused));
+	CHECK(!graph.IsCulled(draw));
+	CHECK(!graph.IsCulled(present));
+	CHECK(graph.GetStats().numCulledPasses == 1);
+	CHECK(graph.GetStats().numTextures == 1);
+
+	graph.Execute();
+	CHECK(graphStub.executed.size() == 2);
+	CHECK(find(graphStub.executed.begin(), graphStub.executed.end(), unused) == graphStub.executed.end());
+	CHECK(graphStub.numTextures == 1);
+}
+
+static void testFrameGraphOrdering()
+{
+	FrameGraph graph(stubGraphGL());
+
+	// declared the other way round
+	int lighting = graph.AddPass("lighting", recordPass, NULL);
+	int geometry = graph.AddPass("geometry", recordPass, NULL);
+	int gbuffer = graph.CreateTexture("gbuffer", colorDesc);
+	graph.Read(lighting, gbuffer);
+	graph.Write(geometry, gbuffer);
+	graph.SetSideEffect(lighting);
+
+	CHECK(graph.Compile());
+	CHECK(graph.GetOrder().size() == 2);
+	CHECK(graph.GetOrder()[0] == geometry && graph.GetOrder()[1] == lighting);
+
+	// the writer draws to a framebuffer of its own at the texture's size,
+	// the reader to what was bound before
+	graph.Execute();
+	CHECK(graphStub.executed.size() == 2);
+	CHECK(graphStub.executed[0] == geometry && graphStub.executed[1] == lighting);
+	CHECK(graphStub.framebuffers[0] != 7 && graphStub.framebuffers[1] == 7);
+	CHECK(graphStub.numFramebuffers == 1);
+	CHECK(graphStub.bound == 7);
+	CHECK(graphStub.viewport[2] == 640 && graphStub.viewport[3] == 480);
+
+	graph.ReleaseTextures();
+	CHECK(graphStub.numTextures == 0 && graphStub.numFramebuffers == 0);
+}
+
+static void testFrameGraphCycle()
+{
+	FrameGraph graph(stubGraphGL());
+
+	int first = graph.AddPass("first", recordPass, NULL);
+	int second = graph.AddPass("second", recordPass, NULL);
+	int a = graph.CreateTexture("a", colorDesc);
+	int b = graph.CreateTexture("b", colorDesc);
+	graph.Read(first, a);
+	graph.Write(first, b);
+	graph.Read(second, b);
+	graph.Write(second, a);
+	graph.SetSideEffect(second);
+
+	CHECK(!graph.Compile());
+	CHECK(graph.GetOrder().empty());
+
+	// nothing runs and nothing is allocated
+	graph.Execute();
+	CHECK(graphStub.executed.empty());
+	CHECK(graphStub.numTextures == 0);
+}
+
+static void testFrameGraphAliasing()
+{
+	FrameGraph graph(stubGraphGL());
+
+	// scene is dead once blur has read it, so bloom can take its texture;
+	// blurred has another format and needs its own
+	int draw = graph.AddPass("draw", recordPass, NULL);
+	int blur = graph.AddPass("blur", recordPass, NULL);
+	int bloom = graph.AddPass("bloom", recordPass, NULL);
+	int present = graph.AddPass("present", recordPass, NULL);
+	int scene = graph.CreateTexture("scene", colorDesc);
+	int blurred = graph.CreateTexture("blurred", hdrDesc);
+	int bloomed = graph.CreateTexture("bloomed", colorDesc);
+	graph.Write(draw, scene);
+	graph.Read(blur, scene);
+	graph.Write(blur, blurred);
+	graph.Read(bloom, blurred);
+	graph.Write(bloom, bloomed);
+	graph.Read(present, bloomed);
+	graph.SetSideEffect(present);
+
+	CHECK(graph.Compile());
+	const FrameGraphStats &stats = graph.GetStats();
+	CHECK(stats.numTextures == 3);
+	CHECK(stats.numAllocated == 2);
+	CHECK(stats.transientBytes < stats.naiveBytes);
+	CHECK(stats.naiveBytes - stats.transientBytes == 320 * 240 * 4);
+
+	graphStub.seenIds[0] = scene;
+	graphStub.seenIds[1] = bloomed;
+	graph.Execute();
+	CHECK(graphStub.executed.size() == 4);
+	CHECK(graphStub.numCreated == 2);
+	CHECK(graphStub.seen[0] != 0 && graphStub.seen[0] == graphStub.seen[1]);
+
+	// the same plan next frame takes the textures kept from this one
+	graph.Reset();
+	draw = graph.AddPass("draw", recordPass, NULL);
+	present = graph.AddPass("present", recordPass, NULL);
+	scene = graph.CreateTexture("scene", colorDesc);
+	graph.Write(draw, scene);
+	graph.Read(present, scene);
+	graph.SetSideEffect(present);
+	graph.Execute();
+	CHECK(graphStub.numCreated == 2);
+	CHECK(graphStub.numTextures == 1);
+}
+
+struct Test
+{
+	const char *name;
+	void (*run)();
+};
+
+static const Test tests[] = {
+	{ "BinaryCacheMiss", testBinaryCacheMiss },
+	{ "BinaryCacheHit", testBinaryCacheHit },
+	{ "BinaryCacheRejected", testBinaryCacheRejected },
+	{ "BinaryCacheSavedTime", testBinaryCacheSavedTime },
+	{ "FrameGraphCulling", testFrameGraphCulling },
+	{ "FrameGraphOrdering", testFrameGraphOrdering },
+	{ "FrameGraphCycle", testFrameGraphCycle },
+	{ "FrameGraphAliasing", testFrameGraphAliasing },
+};
+
+int main(int argc, char **argv)
+{
+	const char *filter = argc > 1 ? argv[1] : "";
+	int numTests = 0;
+	for (int i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++)
+	{
+		if (strncmp(tests[i].name, filter, strlen(filter)) != 0) continue;
+		failed = false;
+		tests[i].run();
+		printf("%s %s\n", failed ? "FAIL" : "ok  ", tests[i].name);
+		if (failed) numFailed++;
+		numTests++;
+	}
+	// the binary cache tests remove their entries, which empties it
+	rmdir("testcache");
+	printf("%d tests, %d checks, %d failed\n", numTests, numChecks, numFailed);
+	return numFailed;
+}
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include "stringhelp.h"
+#include "image.h"
+#include "threadpool.h"
+#include "texturecompressor.h"
+using namespace strhlp;
+
+// texbake [-fast|-high] [-kaiser] [-threads n] file.mtl
+// Compresses every texture referenced by a material library into a .dds
+// next to it (MaterialLoader picks those up instead of the .tga) and
+// reports quality and throughput per texture. Only needs the portable
+// image and compressor code, so it also builds on Linux machines.
+
+struct BakeItem
+{
+	string path;
+	ImageCompression format;
+	TextureContent content;
+};
+
+static bool listTextures(const char *mtlFile, vector<BakeItem> &items)
+{
+	ifstream file(mtlFile);
+	if (!file) return false;
+
+	// map names are relative to the library
+	string dir = mtlFile;
+	int slash = dir.find_last_of("/\\");
+	dir = slash != -1 ? dir.substr(0, slash + 1) : "";
+
+	string line;
+	while (getline(file, line))
+	{
+		line = trimLeft(line);
+		int i = line.find(' ');
+		if (i == -1) continue;
+		string prefix = line.substr(0, i);
+		string name = dir + line.substr(i + 1);
+		replace(name.begin(), name.end(), '\\', '/'); // also fine for Windows
+
+		BakeItem item = { name, IC_BC1, TC_COLOR };
+		if (prefix == "map_bump" || prefix == "bump") {
+			item.format = IC_BC5;
+			item.content = TC_NORMAL;
+		}
+		else if (prefix == "map_d") {
+			item.format = IC_BC4;
+			item.content = TC_LINEAR;
+		}
+		else if (prefix != "map_Kd" && prefix != "map_Ks" && prefix != "map_Ns")
+			continue;
+
+		bool listed = false;
+		for (int k = 0; k < (int)items.size(); k++)
+			if (items[k].path == name) listed = true;
+		if (!listed) items.push_back(item);
+	}
+	return true;
+}
+
+static const char *formatName(ImageCompression format)
+{
+	switch (format) {
+	case IC_BC1: return "BC1";
+	case IC_BC3: return "BC3";
+	case IC_BC4: return "BC4";
+	case IC_BC5: return "BC5";
+	default: return "?";
+	}
+}
+
+int main(int argc, char **argv)
+{
+	CompressionQuality quality = CQ_NORMAL;
+	MipFilter filter = MF_BOX;
+	int numThreads = 0;
+	const char *mtlFile = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-fast")) quality = CQ_FAST;
+		else if (!strcmp(argv[i], "-high")) quality = CQ_HIGH;
+		else if (!strcmp(argv[i], "-kaiser")) filter = MF_KAISER;
+		else if (!strcmp(argv[i], "-threads") && i + 1 < argc) numThreads = atoi(argv[++i]);
+		else mtlFile = argv[i];
+	}
+	if (!mtlFile) {
+		printf("usage: texbake [-fast|-high] [-kaiser] [-threads n] file.mtl\n");
+		return 1;
+	}
+
+	vector<BakeItem> items;
+	if (!listTextures(mtlFile, items)) {
+		printf("cannot read %s\n", mtlFile);
+		return 1;
+	}
+
+	ThreadPool pool(numThreads);
+	TextureCompressor compressor(&pool);
+	compressor.SetQuality(quality);
+	compressor.SetMipFilter(filter);
+
+	double totalSeconds = 0.0, totalBytes = 0.0, totalOut = 0.0;
+	int numBaked = 0;
+
+	printf("%d threads\n", pool.GetThreadCount());
+	for (int i = 0; i < (int)items.size(); i++)
+	{
+		BakeItem &item = items[i];
+		Image src;
+		if (!src.LoadTga(item.path.c_str())) {
+			printf("%-48s cannot load\n", item.path.c_str());
+			continue;
+		}
+		// diffuse maps with alpha keep it
+		if (item.format == IC_BC1 && src.GetDepth() == 32)
+			item.format = IC_BC3;
+
+		Image dst;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		bool ok = compressor.Compress(src, item.format, item.content, dst);
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+		int dot = item.path.rfind('.');
+		string ddsPath = item.path.substr(0, dot) + ".dds";
+		if (!ok || !dst.SaveDds(ddsPath.c_str())) {
+			printf("%-48s failed\n", item.path.c_str());
+			continue;
+		}
+
+		double seconds = elapsed.count();
+		double psnr = TextureCompressor::ComputePSNR(src, dst);
+		printf("%-48s %4dx%-4d %s %2d mips  %5.2f dB  %6.1f MB/s\n", item.path.c_str(),
+			src.GetWidth(), src.GetHeight(), formatName(item.format), dst.GetMipCount(),
+			psnr, src.GetDataSize() / seconds / 1048576.0);
+
+		totalSeconds += seconds;
+		totalBytes += src.GetDataSize();
+		totalOut += dst.GetDataSize();
+		numBaked++;
+	}
+
+	if (numBaked > 0) {
+		printf("%d textures in %.2f s, %.1f MB/s, %.1f MB -> %.1f MB\n", numBaked, totalSeconds,
+			totalBytes / totalSeconds / 1048576.0, totalBytes / 1048576.0, totalOut / 1048576.0);
+	}
+	return 0;
+}
\ No newline at end of file